@@ -47,9 +47,15 @@ std::unique_ptr<GpuMapping> AddressSpace::MapBufferGpu(std::shared_ptr<AddressSp
          "0x%lx",
          offset, length, alignment, static_cast<uint32_t>(align_pow2), gpu_addr);
 
-    if (!address_space->Insert(gpu_addr, buffer->platform_buffer(), offset, length,
-                               buffer->caching_type()))
-        return DRETP(nullptr, "failed to insert into address_space");
+    {
+        auto lock = buffer->LockCachingType();
+
+        if (!address_space->Insert(gpu_addr, buffer->platform_buffer(), offset, length,
+                                   buffer->caching_type(), buffer->lru_age()))
+            return DRETP(nullptr, "failed to insert into address_space");
+
+        buffer->set_gpu_mapped();
+    }
 
     return std::unique_ptr<GpuMapping>(
         new GpuMapping(address_space, buffer, offset, length, gpu_addr));
@@ -34,9 +34,9 @@ public:
     virtual bool Clear(uint64_t addr) = 0;
 
     // Inserts the pages for the given buffer into page table entries for the allocation at the
-    // given address.
+    // given address. |lru_age| applies to CACHING_LLC only.
     virtual bool Insert(uint64_t addr, magma::PlatformBuffer* buffer, uint64_t offset,
-                        uint64_t length, CachingType caching_type) = 0;
+                        uint64_t length, CachingType caching_type, LruAge lru_age) = 0;
 
     static std::unique_ptr<GpuMapping> MapBufferGpu(std::shared_ptr<AddressSpace> address_space,
                                                     std::shared_ptr<MsdIntelBuffer> buffer,
@@ -0,0 +1,55 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "batch_latency.h"
+
+constexpr uint32_t LatencyHistogram::kBucketCount;
+
+uint32_t LatencyHistogram::bucket(uint64_t latency_ns)
+{
+    uint64_t latency_us = latency_ns / 1000;
+    uint32_t bucket = 0;
+    while (latency_us && bucket < kBucketCount - 1) {
+        latency_us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+void BatchLatencyStats::Record(const BatchTimes& times, uint64_t timestamp_period_ps)
+{
+    auto record = [this](MsdIntelGenBatchLatencyStage stage, uint64_t start, uint64_t end) {
+        if (start && end >= start)
+            histograms_[stage].Record(end - start);
+    };
+
+    record(kMsdIntelGenBatchLatencyQueue, times.enqueue_ns, times.pickup_ns);
+    record(kMsdIntelGenBatchLatencySchedule, times.pickup_ns, times.submit_ns);
+    record(kMsdIntelGenBatchLatencyTotal, times.enqueue_ns, times.complete_ns);
+
+    batch_count_.fetch_add(1, std::memory_order_relaxed);
+    if (!times.gpu_timed()) {
+        untimed_batch_count_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    auto ticks_to_ns = [timestamp_period_ps](uint64_t ticks) {
+        return BatchTimes::ticks_to_ns(ticks, timestamp_period_ps);
+    };
+
+    uint64_t runtime_ns = times.gpu_runtime_ns(timestamp_period_ps);
+    gpu_runtime_ns_.fetch_add(runtime_ns, std::memory_order_relaxed);
+
+    histograms_[kMsdIntelGenBatchLatencyGpuWait].Record(
+        ticks_to_ns(times.gpu_start_ticks - times.submit_ticks));
+    histograms_[kMsdIntelGenBatchLatencyGpuExecution].Record(runtime_ns);
+
+    // The gpu end on the cpu clock, taking the submission as the point where both clocks meet.
+    if (times.submit_ns && times.complete_ns) {
+        uint64_t gpu_end_ns =
+            times.submit_ns + ticks_to_ns(times.gpu_end_ticks - times.submit_ticks);
+        histograms_[kMsdIntelGenBatchLatencyRetire].Record(
+            times.complete_ns > gpu_end_ns ? times.complete_ns - gpu_end_ns : 0);
+    }
+}
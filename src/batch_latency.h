@@ -0,0 +1,113 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BATCH_LATENCY_H
+#define BATCH_LATENCY_H
+
+#include "magma_util/macros.h"
+#include "msd_defs.h"
+#include "msd_intel_gen_query.h"
+#include <atomic>
+#include <chrono>
+
+// When a batch passed each point on its way through the driver, in steady clock nanoseconds,
+// and when the gpu ran it, in gpu timestamp ticks. Times not taken are 0.
+struct BatchTimes {
+    uint64_t enqueue_ns = 0;
+    uint64_t pickup_ns = 0;
+    uint64_t submit_ns = 0;
+    uint64_t complete_ns = 0;
+    // The engine's timestamp register, read at submission.
+    uint64_t submit_ticks = 0;
+    uint64_t gpu_start_ticks = 0;
+    uint64_t gpu_end_ticks = 0;
+
+    // False if the batch wasn't timed by the gpu, or its timestamps didn't land.
+    bool gpu_timed() const
+    {
+        return submit_ticks && gpu_start_ticks >= submit_ticks && gpu_end_ticks >= gpu_start_ticks;
+    }
+
+    // The time the gpu spent executing the batch, or 0 if it wasn't timed.
+    uint64_t gpu_runtime_ns(uint64_t timestamp_period_ps) const
+    {
+        return gpu_timed() ? ticks_to_ns(gpu_end_ticks - gpu_start_ticks, timestamp_period_ps) : 0;
+    }
+
+    static uint64_t ticks_to_ns(uint64_t ticks, uint64_t timestamp_period_ps)
+    {
+        return ticks * timestamp_period_ps / 1000;
+    }
+
+    static uint64_t now_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+};
+
+// A histogram of latencies in log2 buckets of microseconds; see
+// kMsdIntelGenBatchLatencyBucketCount.
+// Thread safe.
+class LatencyHistogram {
+public:
+    static constexpr uint32_t kBucketCount = kMsdIntelGenBatchLatencyBucketCount;
+
+    static uint32_t bucket(uint64_t latency_ns);
+
+    void Record(uint64_t latency_ns)
+    {
+        counts_[bucket(latency_ns)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t count(uint32_t bucket) const
+    {
+        DASSERT(bucket < kBucketCount);
+        return counts_[bucket].load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic_uint64_t counts_[kBucketCount] = {};
+};
+
+// Latency histograms, one per MsdIntelGenBatchLatencyStage, and gpu runtime for the batches of
+// one connection.
+// Thread safe.
+class BatchLatencyStats {
+public:
+    BatchLatencyStats(msd_client_id_t client_id) : client_id_(client_id) {}
+
+    msd_client_id_t client_id() { return client_id_; }
+
+    // Records the latencies of a completed batch. Stages missing either of their times are
+    // skipped; gpu ticks are converted with |timestamp_period_ps|.
+    void Record(const BatchTimes& times, uint64_t timestamp_period_ps);
+
+    uint64_t count(MsdIntelGenBatchLatencyStage stage, uint32_t bucket) const
+    {
+        DASSERT(stage < kMsdIntelGenBatchLatencyStageCount);
+        return histograms_[stage].count(bucket);
+    }
+
+    // Summed over the batches timed by the gpu.
+    uint64_t gpu_runtime_ns() const { return gpu_runtime_ns_.load(std::memory_order_relaxed); }
+
+    uint64_t batch_count() const { return batch_count_.load(std::memory_order_relaxed); }
+
+    // Batches missing from the gpu runtime.
+    uint64_t untimed_batch_count() const
+    {
+        return untimed_batch_count_.load(std::memory_order_relaxed);
+    }
+
+private:
+    msd_client_id_t client_id_;
+    std::atomic_uint64_t gpu_runtime_ns_{};
+    std::atomic_uint64_t batch_count_{};
+    std::atomic_uint64_t untimed_batch_count_{};
+    LatencyHistogram histograms_[kMsdIntelGenBatchLatencyStageCount];
+};
+
+#endif // BATCH_LATENCY_H
@@ -0,0 +1,27 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "bus_mapping.h"
+#include "magma_util/macros.h"
+
+class PlatformBusMapper : public BusMapper {
+public:
+    std::unique_ptr<BusMapping> MapPageRange(magma::PlatformBuffer* buffer,
+                                             uint32_t start_page_index,
+                                             uint32_t page_count) override
+    {
+        std::vector<uint64_t> bus_addr(page_count);
+        if (!buffer->MapPageRangeBus(start_page_index, page_count, bus_addr.data()))
+            return DRETP(nullptr, "MapPageRangeBus failed");
+
+        // The bus addresses of pinned pages don't change, so there's nothing to release.
+        return std::make_unique<BusMapping>(start_page_index, std::move(bus_addr));
+    }
+};
+
+BusMapper* BusMapper::Platform()
+{
+    static PlatformBusMapper bus_mapper;
+    return &bus_mapper;
+}
@@ -0,0 +1,46 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BUS_MAPPING_H
+#define BUS_MAPPING_H
+
+#include "platform_buffer.h"
+#include <memory>
+#include <vector>
+
+// The bus addresses of a range of buffer pages, as held in the gpu's page tables. They remain
+// valid until the mapping is destroyed.
+class BusMapping {
+public:
+    BusMapping(uint32_t start_page_index, std::vector<uint64_t> bus_addr)
+        : start_page_index_(start_page_index), bus_addr_(std::move(bus_addr))
+    {
+    }
+
+    virtual ~BusMapping() = default;
+
+    uint32_t start_page_index() { return start_page_index_; }
+    uint32_t page_count() { return bus_addr_.size(); }
+    const std::vector<uint64_t>& bus_addr() { return bus_addr_; }
+
+private:
+    uint32_t start_page_index_;
+    std::vector<uint64_t> bus_addr_;
+};
+
+// Maps buffer pages for the gpu. A simulated gpu supplies its own mapper to the device, to learn
+// which buffer pages the bus addresses belong to.
+class BusMapper {
+public:
+    virtual ~BusMapper() = default;
+
+    // Maps the given pages, which must stay pinned while the mapping exists.
+    virtual std::unique_ptr<BusMapping>
+    MapPageRange(magma::PlatformBuffer* buffer, uint32_t start_page_index, uint32_t page_count) = 0;
+
+    // Maps through the platform buffer; it has no state, so all address spaces may share it.
+    static BusMapper* Platform();
+};
+
+#endif // BUS_MAPPING_H
@@ -50,17 +50,27 @@ void CacheConfig::GetMemoryObjectControlState(std::vector<uint32_t>& mocs)
 {
     mocs.resize(kMemoryObjectControlStateEntries);
 
-    // Mesa assumes index 0 = uncached, 1 = use pagetable settings, 2 = cached
     uint32_t index = 0;
+    DASSERT(index == kMocsUncachedIndex);
     mocs[index++] = MemoryObjectControlState::format(MemoryObjectControlState::UNCACHED,
                                                      MemoryObjectControlState::LLC_ELLC,
                                                      MemoryObjectControlState::LRU_0);
+    DASSERT(index == kMocsPagetableIndex);
     mocs[index++] = MemoryObjectControlState::format(MemoryObjectControlState::PAGETABLE,
                                                      MemoryObjectControlState::LLC_ELLC,
                                                      MemoryObjectControlState::LRU_3);
+    DASSERT(index == kMocsCachedIndex);
     mocs[index++] = MemoryObjectControlState::format(MemoryObjectControlState::WRITEBACK,
                                                      MemoryObjectControlState::LLC_ELLC,
                                                      MemoryObjectControlState::LRU_3);
+    DASSERT(index == kMocsWriteThroughIndex);
+    mocs[index++] = MemoryObjectControlState::format(MemoryObjectControlState::WRITETHROUGH,
+                                                     MemoryObjectControlState::LLC_ELLC,
+                                                     MemoryObjectControlState::LRU_3);
+    DASSERT(index == kMocsCachedStreamingIndex);
+    mocs[index++] = MemoryObjectControlState::format(MemoryObjectControlState::WRITEBACK,
+                                                     MemoryObjectControlState::LLC_ELLC,
+                                                     MemoryObjectControlState::LRU_0);
 
     while (index < kMemoryObjectControlStateEntries) {
         mocs[index++] = MemoryObjectControlState::format(MemoryObjectControlState::UNCACHED,
@@ -73,11 +83,14 @@ void CacheConfig::GetLncfMemoryObjectControlState(std::vector<uint16_t>& mocs)
 {
     mocs.resize(kMemoryObjectControlStateEntries);
 
-    // Mesa assumes index 0 = uncached, 1 = use pagetable settings, 2 = cached
+    // Same indices as the graphics table.
     uint32_t index = 0;
     mocs[index++] = LncfMemoryObjectControlState::format(LncfMemoryObjectControlState::UNCACHED);
     mocs[index++] = LncfMemoryObjectControlState::format(LncfMemoryObjectControlState::WRITEBACK);
     mocs[index++] = LncfMemoryObjectControlState::format(LncfMemoryObjectControlState::WRITEBACK);
+    mocs[index++] =
+        LncfMemoryObjectControlState::format(LncfMemoryObjectControlState::WRITETHROUGH);
+    mocs[index++] = LncfMemoryObjectControlState::format(LncfMemoryObjectControlState::WRITEBACK);
 
     while (index < kMemoryObjectControlStateEntries) {
         mocs[index++] =
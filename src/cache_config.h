@@ -13,6 +13,15 @@ class InstructionWriter;
 
 class CacheConfig {
 public:
+    // Memory object control state indices programmed by InitCacheConfig.
+    // Mesa assumes index 0 = uncached, 1 = use pagetable settings, 2 = cached.
+    static constexpr uint32_t kMocsUncachedIndex = 0;
+    static constexpr uint32_t kMocsPagetableIndex = 1;
+    static constexpr uint32_t kMocsCachedIndex = 2;
+    static constexpr uint32_t kMocsWriteThroughIndex = 3;
+    // Cached with LRU age 0, for streaming data that shouldn't displace other cache lines.
+    static constexpr uint32_t kMocsCachedStreamingIndex = 4;
+
     // Returns the number of bytes required to write into the instruction stream.
     static uint64_t InstructionBytesRequired();
 
@@ -4,6 +4,7 @@
 
 #include "command_buffer.h"
 #include "address_space.h"
+#include "completion_signaler.h"
 #include "engine_command_streamer.h"
 #include "instructions.h"
 #include "msd_intel_context.h"
@@ -57,6 +58,10 @@ CommandBuffer::CommandBuffer(std::shared_ptr<MsdIntelBuffer> abi_cmd_buf,
 
 CommandBuffer::~CommandBuffer()
 {
+    // Signal semaphores are taken by the engine command streamer once executing.
+    if (completion_signaler_ && !signal_semaphores_.empty())
+        completion_signaler_->Unregister(signal_semaphores_);
+
     for (auto res : exec_resources_) {
         res.buffer->DecrementInflightCounter();
     }
@@ -72,12 +77,20 @@ CommandBuffer::~CommandBuffer()
 
     UnmapResourcesGpu();
 
+    // Normally taken at submission and signalled on completion by the engine command streamer.
     for (auto& semaphore : signal_semaphores_) {
         semaphore->Signal();
     }
     TRACE_ASYNC_END("magma-exec", "CommandBuffer Exec", nonce_);
 }
 
+void CommandBuffer::RegisterSignalSemaphores(CompletionSignaler* completion_signaler)
+{
+    DASSERT(!completion_signaler_);
+    completion_signaler_ = completion_signaler;
+    completion_signaler_->Register(signal_semaphores_);
+}
+
 void CommandBuffer::SetSequenceNumber(uint32_t sequence_number)
 {
     uint64_t ATTRIBUTE_UNUSED buffer_id = resource(batch_buffer_resource_index()).buffer_id();
@@ -127,25 +140,45 @@ bool CommandBuffer::InitializeResources(
 
 std::weak_ptr<MsdIntelContext> CommandBuffer::GetContext() { return context_; }
 
-uint32_t CommandBuffer::GetPipeControlFlags()
+uint32_t CommandBuffer::GetPipeControlFlags(MappedBatch* next_batch)
 {
     uint32_t flags = MiPipeControl::kCommandStreamerStallEnableBit;
 
-    // Experimentally including this bit has been shown to resolve gpu faults where a batch
-    // completes; we clear gtt mappings for resources; then on the next batch,
-    // an invalid address is emitted corresponding to a cleared gpu mapping.  This was
-    // first seen when a compute shader was introduced.
-    flags |= MiPipeControl::kGenericMediaStateClearBit;
+    // Resources also used by the next batch stay mapped and inflight until it completes, so
+    // their flushes can be left to that batch.
+    bool resources_released = !next_batch;
+    for (uint32_t i = 0; i < exec_resources_.size() && !resources_released; i++) {
+        resources_released = !next_batch->UsesBuffer(exec_resources_[i].buffer.get());
+    }
 
-    // Similarly, including this bit was shown to resolve the emission of an invalid address.
-    flags |= MiPipeControl::kIndirectStatePointersDisableBit;
+    if (resources_released) {
+        // Experimentally including this bit has been shown to resolve gpu faults where a batch
+        // completes; we clear gtt mappings for resources; then on the next batch,
+        // an invalid address is emitted corresponding to a cleared gpu mapping.  This was
+        // first seen when a compute shader was introduced.
+        flags |= MiPipeControl::kGenericMediaStateClearBit;
 
-    // This one is needed when l3 caching enabled via mocs (memory object control state).
-    flags |= MiPipeControl::kDcFlushEnableBit;
+        // Similarly, including this bit was shown to resolve the emission of an invalid address.
+        flags |= MiPipeControl::kIndirectStatePointersDisableBit;
+    }
+
+    // This one is needed when l3 caching enabled via mocs (memory object control state), before
+    // results may be observed through a released resource or a signalled semaphore.
+    if (resources_released || !signal_semaphores_.empty())
+        flags |= MiPipeControl::kDcFlushEnableBit;
 
     return flags;
 }
 
+bool CommandBuffer::UsesBuffer(MsdIntelBuffer* buffer)
+{
+    for (auto& res : exec_resources_) {
+        if (res.buffer.get() == buffer)
+            return true;
+    }
+    return false;
+}
+
 bool CommandBuffer::GetGpuAddress(gpu_addr_t* gpu_addr_out)
 {
     if (!prepared_to_execute_)
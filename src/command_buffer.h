@@ -16,6 +16,7 @@
 
 class AddressSpace;
 class ClientContext;
+class CompletionSignaler;
 class EngineCommandStreamer;
 class MsdIntelContext;
 
@@ -47,7 +48,9 @@ public:
 
     uint64_t GetBatchBufferId();
 
-    uint32_t GetPipeControlFlags() override;
+    uint32_t GetPipeControlFlags(MappedBatch* next_batch) override;
+
+    bool UsesBuffer(MsdIntelBuffer* buffer) override;
 
     // Takes ownership of the wait semaphores array
     std::vector<std::shared_ptr<magma::PlatformSemaphore>> wait_semaphores()
@@ -55,6 +58,34 @@ public:
         return std::move(wait_semaphores_);
     }
 
+    std::vector<std::shared_ptr<magma::PlatformSemaphore>> TakeSignalSemaphores() override
+    {
+        return std::move(signal_semaphores_);
+    }
+
+    void ReturnSignalSemaphores(
+        std::vector<std::shared_ptr<magma::PlatformSemaphore>> semaphores) override
+    {
+        signal_semaphores_ = std::move(semaphores);
+    }
+
+    std::vector<std::shared_ptr<magma::PlatformSemaphore>> TakeGpuWaitSemaphores() override
+    {
+        return std::move(gpu_wait_semaphores_);
+    }
+
+    bool HasGpuWaitSemaphores() override { return !gpu_wait_semaphores_.empty(); }
+
+    void AddGpuWaitSemaphores(std::vector<std::shared_ptr<magma::PlatformSemaphore>> semaphores)
+    {
+        gpu_wait_semaphores_.insert(gpu_wait_semaphores_.end(), semaphores.begin(),
+                                    semaphores.end());
+    }
+
+    // Registers the signal semaphores with |completion_signaler| so later command buffers can
+    // wait on them from the gpu. Call just before submitting to the device.
+    void RegisterSignalSemaphores(CompletionSignaler* completion_signaler);
+
     std::vector<std::shared_ptr<GpuMapping>>& exec_resource_mappings()
     {
         return exec_resource_mappings_;
@@ -66,6 +97,12 @@ public:
         return exec_resource_mappings_[batch_buffer_index_].get();
     }
 
+    std::shared_ptr<GpuMapping> ShareBatchMapping() override
+    {
+        DASSERT(prepared_to_execute_);
+        return exec_resource_mappings_[batch_buffer_index_];
+    }
+
 private:
     CommandBuffer(std::shared_ptr<MsdIntelBuffer> abi_cmd_buf,
                   std::weak_ptr<ClientContext> context);
@@ -105,6 +142,8 @@ private:
     std::vector<ExecResource> exec_resources_;
     std::vector<std::shared_ptr<magma::PlatformSemaphore>> wait_semaphores_;
     std::vector<std::shared_ptr<magma::PlatformSemaphore>> signal_semaphores_;
+    std::vector<std::shared_ptr<magma::PlatformSemaphore>> gpu_wait_semaphores_;
+    CompletionSignaler* completion_signaler_ = nullptr;
     std::vector<std::shared_ptr<GpuMapping>> exec_resource_mappings_;
     std::weak_ptr<ClientContext> context_;
 
@@ -0,0 +1,176 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "completion_signaler.h"
+#include "platform_trace.h"
+#include <chrono>
+
+void CompletionSignaler::Add(uint32_t sequence_number,
+                             std::vector<std::shared_ptr<magma::PlatformSemaphore>> semaphores)
+{
+    if (semaphores.empty())
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    DASSERT(pending_.empty() || SequenceAfter(sequence_number, pending_.back().sequence_number));
+    for (auto& semaphore : semaphores) {
+        pending_sequence_numbers_[semaphore->id()] = sequence_number;
+    }
+    pending_.push_back(Entry{sequence_number, std::move(semaphores)});
+}
+
+uint32_t CompletionSignaler::Signal(uint32_t sequence_number, uint64_t observed_time_ns)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return SignalLocked(sequence_number, observed_time_ns);
+}
+
+uint32_t CompletionSignaler::SignalAll()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pending_.empty())
+        return 0;
+    return SignalLocked(pending_.back().sequence_number, 0);
+}
+
+std::vector<std::shared_ptr<magma::PlatformSemaphore>>
+CompletionSignaler::Take(uint32_t sequence_number)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto iter = pending_.begin(); iter != pending_.end(); iter++) {
+        if (iter->sequence_number == sequence_number) {
+            RemovePendingLocked(sequence_number, iter->semaphores);
+            auto semaphores = std::move(iter->semaphores);
+            pending_.erase(iter);
+            return semaphores;
+        }
+    }
+    return {};
+}
+
+// Signalling under the lock keeps semaphores ordered by sequence number and ensures each is
+// signalled exactly once when several threads observe the same completion.
+uint32_t CompletionSignaler::SignalLocked(uint32_t sequence_number, uint64_t observed_time_ns)
+{
+    if (pending_.empty() || SequenceAfter(pending_.front().sequence_number, sequence_number))
+        return 0;
+
+    TRACE_DURATION("magma", "SignalCompletion");
+
+    uint32_t count = 0;
+    while (!pending_.empty() && !SequenceAfter(pending_.front().sequence_number, sequence_number)) {
+        for (auto& semaphore : pending_.front().semaphores) {
+            semaphore->Signal();
+        }
+        RemovePendingLocked(pending_.front().sequence_number, pending_.front().semaphores);
+        UnregisterLocked(pending_.front().semaphores);
+        count += pending_.front().semaphores.size();
+        pending_.pop_front();
+    }
+
+    stats_.signal_count += count;
+    stats_.batch_count++;
+
+    if (observed_time_ns) {
+        uint64_t latency_ns = GetCurrentTimeNs() - observed_time_ns;
+        stats_.latency_count++;
+        stats_.total_latency_ns += latency_ns;
+        if (latency_ns > stats_.max_latency_ns)
+            stats_.max_latency_ns = latency_ns;
+    }
+
+    return count;
+}
+
+void CompletionSignaler::Register(
+    const std::vector<std::shared_ptr<magma::PlatformSemaphore>>& semaphores)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& semaphore : semaphores) {
+        registered_[semaphore->id()]++;
+    }
+}
+
+void CompletionSignaler::Unregister(
+    const std::vector<std::shared_ptr<magma::PlatformSemaphore>>& semaphores)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    UnregisterLocked(semaphores);
+}
+
+// Semaphores from batches that were never registered are ignored.
+void CompletionSignaler::UnregisterLocked(
+    const std::vector<std::shared_ptr<magma::PlatformSemaphore>>& semaphores)
+{
+    for (auto& semaphore : semaphores) {
+        auto iter = registered_.find(semaphore->id());
+        if (iter == registered_.end())
+            continue;
+        if (--iter->second == 0)
+            registered_.erase(iter);
+    }
+}
+
+// A semaphore added again under a later sequence keeps that sequence's entry.
+void CompletionSignaler::RemovePendingLocked(
+    uint32_t sequence_number,
+    const std::vector<std::shared_ptr<magma::PlatformSemaphore>>& semaphores)
+{
+    for (auto& semaphore : semaphores) {
+        auto iter = pending_sequence_numbers_.find(semaphore->id());
+        if (iter != pending_sequence_numbers_.end() && iter->second == sequence_number)
+            pending_sequence_numbers_.erase(iter);
+    }
+}
+
+std::vector<std::shared_ptr<magma::PlatformSemaphore>> CompletionSignaler::TakeRegistered(
+    std::vector<std::shared_ptr<magma::PlatformSemaphore>>* semaphores)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::vector<std::shared_ptr<magma::PlatformSemaphore>> registered;
+    for (auto iter = semaphores->begin(); iter != semaphores->end();) {
+        if (registered_.find((*iter)->id()) != registered_.end()) {
+            registered.push_back(std::move(*iter));
+            iter = semaphores->erase(iter);
+        } else {
+            iter++;
+        }
+    }
+    return registered;
+}
+
+bool CompletionSignaler::GetWaitSequenceNumber(
+    const std::vector<std::shared_ptr<magma::PlatformSemaphore>>& semaphores,
+    uint32_t* sequence_number_out)
+{
+    if (semaphores.empty())
+        return false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    bool found = false;
+    for (auto& semaphore : semaphores) {
+        auto iter = pending_sequence_numbers_.find(semaphore->id());
+        if (iter == pending_sequence_numbers_.end())
+            continue;
+        if (!found || SequenceAfter(iter->second, *sequence_number_out))
+            *sequence_number_out = iter->second;
+        found = true;
+    }
+    return found;
+}
+
+CompletionSignaler::Stats CompletionSignaler::stats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+uint64_t CompletionSignaler::GetCurrentTimeNs()
+{
+    return std::chrono::time_point_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now())
+        .time_since_epoch()
+        .count();
+}
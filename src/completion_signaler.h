@@ -0,0 +1,103 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef COMPLETION_SIGNALER_H
+#define COMPLETION_SIGNALER_H
+
+#include "platform_semaphore.h"
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Signals the semaphores of submitted batches as soon as their sequence number is observed
+// complete, independent of when the batches themselves are retired.
+// Sequences are added from the device thread; completions may be processed from any thread.
+//
+// Also tracks which semaphores will be signalled by command buffers already submitted to the
+// device, so that dependent command buffers can wait on the GPU instead of the CPU.
+class CompletionSignaler {
+public:
+    struct Stats {
+        uint64_t signal_count;
+        uint64_t batch_count;
+        uint64_t latency_count;
+        uint64_t total_latency_ns;
+        uint64_t max_latency_ns;
+    };
+
+    // |sequence_number| must come after any previously added.
+    void Add(uint32_t sequence_number,
+             std::vector<std::shared_ptr<magma::PlatformSemaphore>> semaphores);
+
+    // Signals all semaphores for sequences up to and including |sequence_number| in one batch.
+    // |observed_time_ns| is when the sequence number write was noticed (0 if unknown) and is used
+    // to track signal latency. Returns the number of semaphores signalled.
+    uint32_t Signal(uint32_t sequence_number, uint64_t observed_time_ns);
+
+    // Signals every pending semaphore, for when inflight sequences are abandoned.
+    uint32_t SignalAll();
+
+    // Removes and returns the pending semaphores for |sequence_number|, for a batch that will be
+    // resubmitted under a new sequence number. The semaphores stay registered.
+    std::vector<std::shared_ptr<magma::PlatformSemaphore>> Take(uint32_t sequence_number);
+
+    Stats stats();
+
+    // Held while checking a command buffer's wait semaphores and submitting it, so that device
+    // submission order matches registration order and a GPU wait never precedes its producer.
+    std::mutex& submit_mutex() { return submit_mutex_; }
+
+    // Records that |semaphores| will be signalled by a command buffer submitted to the device.
+    // Call with submit_mutex() held.
+    void Register(const std::vector<std::shared_ptr<magma::PlatformSemaphore>>& semaphores);
+
+    // Drops registrations for a command buffer that won't execute.
+    void Unregister(const std::vector<std::shared_ptr<magma::PlatformSemaphore>>& semaphores);
+
+    // Moves out of |semaphores| those that are registered and returns them.
+    // Call with submit_mutex() held.
+    std::vector<std::shared_ptr<magma::PlatformSemaphore>>
+    TakeRegistered(std::vector<std::shared_ptr<magma::PlatformSemaphore>>* semaphores);
+
+    // Returns true if any of |semaphores| belongs to a pending sequence, along with the latest
+    // such sequence number. False means every producer has already completed.
+    bool GetWaitSequenceNumber(
+        const std::vector<std::shared_ptr<magma::PlatformSemaphore>>& semaphores,
+        uint32_t* sequence_number_out);
+
+    static uint64_t GetCurrentTimeNs();
+
+    // Whether |sequence_number| comes after |other|, allowing for the sequence numbers wrapping.
+    static bool SequenceAfter(uint32_t sequence_number, uint32_t other)
+    {
+        return static_cast<int32_t>(sequence_number - other) > 0;
+    }
+
+private:
+    uint32_t SignalLocked(uint32_t sequence_number, uint64_t observed_time_ns);
+    void UnregisterLocked(const std::vector<std::shared_ptr<magma::PlatformSemaphore>>& semaphores);
+    void
+    RemovePendingLocked(uint32_t sequence_number,
+                        const std::vector<std::shared_ptr<magma::PlatformSemaphore>>& semaphores);
+
+    struct Entry {
+        uint32_t sequence_number;
+        std::vector<std::shared_ptr<magma::PlatformSemaphore>> semaphores;
+    };
+
+    std::mutex submit_mutex_;
+    std::mutex mutex_;
+    std::deque<Entry> pending_;
+    // Semaphore id to the latest pending sequence that will signal it.
+    std::unordered_map<uint64_t, uint32_t> pending_sequence_numbers_;
+    // Semaphore id to the number of submitted command buffers that will signal it.
+    std::unordered_map<uint64_t, uint32_t> registered_;
+    Stats stats_{};
+
+    friend class TestCompletionSignaler;
+};
+
+#endif // COMPLETION_SIGNALER_H
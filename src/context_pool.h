@@ -0,0 +1,95 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CONTEXT_POOL_H
+#define CONTEXT_POOL_H
+
+#include "msd_intel_context.h"
+#include <deque>
+#include <memory>
+#include <vector>
+
+// Holds context backing stores and ringbuffers that are already allocated and mapped, so a
+// context's first command buffer doesn't pay for creating them.
+// Not thread safe; used from the device thread only.
+class ContextPool {
+public:
+    ContextPool(uint32_t capacity) : capacity_(capacity) {}
+
+    ~ContextPool()
+    {
+        for (auto& state : pool_) {
+            MsdIntelContext::ReleaseEngineState(state.get());
+        }
+        for (auto& recycled : recycled_) {
+            MsdIntelContext::ReleaseEngineState(recycled.state.get());
+        }
+    }
+
+    uint32_t capacity() { return capacity_; }
+
+    size_t size() { return pool_.size(); }
+
+    // Recycled states count towards the capacity.
+    bool full() { return pool_.size() + recycled_.size() >= capacity_; }
+
+    // Returns nullptr if the pool is empty.
+    std::unique_ptr<MsdIntelContext::PerEngineState> Take()
+    {
+        if (pool_.empty())
+            return nullptr;
+        auto state = std::move(pool_.back());
+        pool_.pop_back();
+        return state;
+    }
+
+    // The state is released if the pool is full.
+    void Add(std::unique_ptr<MsdIntelContext::PerEngineState> state)
+    {
+        if (full()) {
+            MsdIntelContext::ReleaseEngineState(state.get());
+            return;
+        }
+        pool_.push_back(std::move(state));
+    }
+
+    // Holds back the state of a destroyed context until ReleaseRecycled sees |sequence_number|
+    // complete. Until the hardware has run another context it may still be saving the context
+    // image, and it could treat a new context with the same descriptor as a lite restore.
+    void AddRecycled(std::unique_ptr<MsdIntelContext::PerEngineState> state,
+                     uint32_t sequence_number)
+    {
+        if (full()) {
+            MsdIntelContext::ReleaseEngineState(state.get());
+            return;
+        }
+        recycled_.push_back({sequence_number, std::move(state)});
+    }
+
+    // Moves recycled states into the pool once their sequence number has completed.
+    void ReleaseRecycled(uint32_t last_completed_sequence)
+    {
+        while (!recycled_.empty() &&
+               recycled_.front().sequence_number <= last_completed_sequence) {
+            pool_.push_back(std::move(recycled_.front().state));
+            recycled_.pop_front();
+        }
+    }
+
+    // For after an engine reset, when the hardware no longer holds any context.
+    void ReleaseAllRecycled() { ReleaseRecycled(UINT32_MAX); }
+
+private:
+    struct Recycled {
+        uint32_t sequence_number;
+        std::unique_ptr<MsdIntelContext::PerEngineState> state;
+    };
+
+    uint32_t capacity_;
+    std::vector<std::unique_ptr<MsdIntelContext::PerEngineState>> pool_;
+    // In recycling order, so sequence numbers are increasing.
+    std::deque<Recycled> recycled_;
+};
+
+#endif // CONTEXT_POOL_H
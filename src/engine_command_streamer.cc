@@ -5,27 +5,39 @@
 #include "engine_command_streamer.h"
 #include "cache_config.h"
 #include "device_id.h"
+#include "flight_recorder.h"
 #include "instructions.h"
 #include "magma_util/macros.h"
-#include "magma_util/sleep.h"
 #include "msd_intel_buffer.h"
 #include "msd_intel_connection.h"
 #include "platform_trace.h"
 #include "registers.h"
 #include "render_init_batch.h"
 #include "ringbuffer.h"
+#include <algorithm>
+#include <thread>
+#include <unordered_map>
 
 EngineCommandStreamer::EngineCommandStreamer(Owner* owner, EngineCommandStreamerId id,
                                              uint32_t mmio_base)
-    : owner_(owner), id_(id), mmio_base_(mmio_base)
+    : owner_(owner), id_(id), mmio_base_(mmio_base), context_pool_(kContextPoolCapacity)
 {
     DASSERT(owner);
+    InitGoldenContextImage();
 }
 
-bool EngineCommandStreamer::InitContext(MsdIntelContext* context) const
+bool EngineCommandStreamer::InitContext(MsdIntelContext* context)
 {
     DASSERT(context);
 
+    std::unique_ptr<MsdIntelContext::PerEngineState> state = context_pool_.Take();
+    if (state) {
+        WriteContextState(state->register_state, state->ringbuffer.get(),
+                          context->exec_address_space().get());
+        context->SetEngineState(id(), std::move(*state));
+        return true;
+    }
+
     uint32_t context_size = GetContextSize();
     DASSERT(context_size > 0 && magma::is_page_aligned(context_size));
 
@@ -35,7 +47,7 @@ bool EngineCommandStreamer::InitContext(MsdIntelContext* context) const
         return DRETF(false, "couldn't create context buffer");
 
     std::unique_ptr<Ringbuffer> ringbuffer(
-        new Ringbuffer(MsdIntelBuffer::Create(32 * PAGE_SIZE, "ring-buffer")));
+        new Ringbuffer(MsdIntelBuffer::Create(kRingbufferSize, "ring-buffer")));
 
     if (!InitContextBuffer(context_buffer.get(), ringbuffer.get(),
                            context->exec_address_space().get()))
@@ -47,15 +59,85 @@ bool EngineCommandStreamer::InitContext(MsdIntelContext* context) const
     return true;
 }
 
+bool EngineCommandStreamer::RefillContextPool(std::shared_ptr<AddressSpace> address_space,
+                                              uint32_t max_count)
+{
+    TRACE_DURATION("magma", "RefillContextPool");
+
+    for (uint32_t i = 0; i < max_count && !context_pool_.full(); i++) {
+        auto state = CreatePooledEngineState(address_space);
+        if (!state)
+            return DRETF(false, "failed to create pooled engine state");
+        context_pool_.Add(std::move(state));
+    }
+
+    return !context_pool_.full();
+}
+
+void EngineCommandStreamer::RecycleContext(MsdIntelContext* context)
+{
+    DASSERT(context->pending_batch_queue().empty());
+
+    if (!context->IsInitializedForEngine(id()) || context_pool_.full())
+        return;
+
+    // Pooled state keeps its register state page mapped.
+    if (!context->GetRegisterState(id()))
+        return;
+
+    auto state = std::make_unique<MsdIntelContext::PerEngineState>();
+    if (!context->TakeEngineState(id(), state.get()))
+        return;
+
+    if (!state->context_mapping) {
+        MsdIntelContext::ReleaseEngineState(state.get());
+        return;
+    }
+
+    // Reusable once a sequence submitted after this point completes, since the hardware must
+    // first have switched away from the context.
+    context_pool_.AddRecycled(std::move(state), sequencer()->peek_next_sequence_number());
+}
+
+std::unique_ptr<MsdIntelContext::PerEngineState>
+EngineCommandStreamer::CreatePooledEngineState(std::shared_ptr<AddressSpace> address_space)
+{
+    auto state = std::make_unique<MsdIntelContext::PerEngineState>();
+
+    state->context_buffer = MsdIntelBuffer::Create(GetContextSize(), "context-buffer");
+    if (!state->context_buffer)
+        return DRETP(nullptr, "couldn't create context buffer");
+
+    state->ringbuffer = std::unique_ptr<Ringbuffer>(
+        new Ringbuffer(MsdIntelBuffer::Create(kRingbufferSize, "ring-buffer")));
+
+    state->context_mapping =
+        AddressSpace::MapBufferGpu(address_space, state->context_buffer, PAGE_SIZE);
+    if (!state->context_mapping)
+        return DRETP(nullptr, "context map failed");
+
+    if (!state->ringbuffer->Map(address_space))
+        return DRETP(nullptr, "ringbuffer map failed");
+
+    void* cpu_addr;
+    if (!state->context_buffer->platform_buffer()->MapPageCpu(
+            MsdIntelContext::kRegisterStatePageIndex, &cpu_addr))
+        return DRETP(nullptr, "failed to map register state page");
+    state->register_state = reinterpret_cast<uint32_t*>(cpu_addr);
+
+    return state;
+}
+
 bool EngineCommandStreamer::InitContextCacheConfig(std::shared_ptr<MsdIntelContext> context)
 {
     auto ringbuffer = context->get_ringbuffer(id());
 
-    if (!ringbuffer->HasSpace(CacheConfig::InstructionBytesRequired()))
+    if (!ringbuffer->HasSpace(golden_cache_config_.size() * sizeof(uint32_t)))
         return DRETF(false, "insufficient ringbuffer space for cache config");
 
-    if (!CacheConfig::InitCacheConfig(ringbuffer, id()))
-        return DRETF(false, "failed to init cache config buffer");
+    for (uint32_t dword : golden_cache_config_) {
+        ringbuffer->write_tail(dword);
+    }
 
     return true;
 }
@@ -288,26 +370,30 @@ private:
     uint32_t* state_;
 };
 
-bool EngineCommandStreamer::InitContextBuffer(MsdIntelBuffer* buffer, Ringbuffer* ringbuffer,
-                                              AddressSpace* address_space) const
-{
-    DASSERT(buffer->write_domain() == MEMORY_DOMAIN_CPU);
+class VectorInstructionWriter : public InstructionWriter {
+public:
+    VectorInstructionWriter(std::vector<uint32_t>* dwords) : dwords_(dwords) {}
 
-    auto platform_buf = buffer->platform_buffer();
-    void* addr;
-    if (!platform_buf->MapCpu(&addr))
-        return DRETF(false, "Couldn't map context buffer");
+    void write_dword(uint32_t dword) override { dwords_->push_back(dword); }
 
-    uint32_t* state = reinterpret_cast<uint32_t*>(reinterpret_cast<uint8_t*>(addr) + PAGE_SIZE);
-    RegisterStateHelper helper(id(), mmio_base_, state);
+private:
+    std::vector<uint32_t>* dwords_;
+};
+
+void EngineCommandStreamer::InitGoldenContextImage()
+{
+    golden_register_state_.assign(PAGE_SIZE / sizeof(uint32_t), 0);
+
+    RegisterStateHelper helper(id(), mmio_base_, golden_register_state_.data());
 
     helper.write_load_register_immediate_headers();
     helper.write_context_save_restore_control();
-    helper.write_ring_head_pointer(ringbuffer->head());
+    // Ring buffer head and pdps are patched per context (see InitContextBuffer).
+    helper.write_ring_head_pointer(0);
     // Ring buffer tail and start is patched in later (see UpdateContext).
     helper.write_ring_tail_pointer(0);
     helper.write_ring_buffer_start(~0);
-    helper.write_ring_buffer_control(ringbuffer->size());
+    helper.write_ring_buffer_control(kRingbufferSize);
     helper.write_batch_buffer_upper_head_pointer();
     helper.write_batch_buffer_head_pointer();
     helper.write_batch_buffer_state();
@@ -318,6 +404,52 @@ bool EngineCommandStreamer::InitContextBuffer(MsdIntelBuffer* buffer, Ringbuffer
     helper.write_indirect_context_pointer();
     helper.write_indirect_context_offset_pointer();
     helper.write_context_timestamp();
+    helper.write_pdp3_upper(0);
+    helper.write_pdp3_lower(0);
+    helper.write_pdp2_upper(0);
+    helper.write_pdp2_lower(0);
+    helper.write_pdp1_upper(0);
+    helper.write_pdp1_lower(0);
+    helper.write_pdp0_upper(0);
+    helper.write_pdp0_lower(0);
+
+    if (id() == RENDER_COMMAND_STREAMER) {
+        helper.write_render_power_clock_state();
+    }
+
+    golden_cache_config_.clear();
+    VectorInstructionWriter writer(&golden_cache_config_);
+    if (!CacheConfig::InitCacheConfig(&writer, id()))
+        DLOG("failed to init golden cache config");
+}
+
+bool EngineCommandStreamer::InitContextBuffer(MsdIntelBuffer* buffer, Ringbuffer* ringbuffer,
+                                              AddressSpace* address_space) const
+{
+    DASSERT(buffer->write_domain() == MEMORY_DOMAIN_CPU);
+    DASSERT(ringbuffer->size() == kRingbufferSize);
+
+    auto platform_buf = buffer->platform_buffer();
+    void* addr;
+    if (!platform_buf->MapPageCpu(MsdIntelContext::kRegisterStatePageIndex, &addr))
+        return DRETF(false, "Couldn't map context buffer");
+
+    WriteContextState(reinterpret_cast<uint32_t*>(addr), ringbuffer, address_space);
+
+    if (!platform_buf->UnmapPageCpu(MsdIntelContext::kRegisterStatePageIndex))
+        return DRETF(false, "Couldn't unmap context buffer");
+
+    return true;
+}
+
+void EngineCommandStreamer::WriteContextState(uint32_t* state, Ringbuffer* ringbuffer,
+                                              AddressSpace* address_space) const
+{
+    memcpy(state, golden_register_state_.data(), PAGE_SIZE);
+
+    RegisterStateHelper helper(id(), mmio_base_, state);
+
+    helper.write_ring_head_pointer(ringbuffer->head());
     if (address_space->type() == ADDRESS_SPACE_PPGTT) {
         auto ppgtt = static_cast<PerProcessGtt*>(address_space);
         helper.write_pdp3_upper(ppgtt->get_pdp(3));
@@ -328,35 +460,50 @@ bool EngineCommandStreamer::InitContextBuffer(MsdIntelBuffer* buffer, Ringbuffer
         helper.write_pdp1_lower(ppgtt->get_pdp(1));
         helper.write_pdp0_upper(ppgtt->get_pdp(0));
         helper.write_pdp0_lower(ppgtt->get_pdp(0));
-    } else {
-        helper.write_pdp3_upper(0);
-        helper.write_pdp3_lower(0);
-        helper.write_pdp2_upper(0);
-        helper.write_pdp2_lower(0);
-        helper.write_pdp1_upper(0);
-        helper.write_pdp1_lower(0);
-        helper.write_pdp0_upper(0);
-        helper.write_pdp0_lower(0);
     }
+}
 
-    if (id() == RENDER_COMMAND_STREAMER) {
-        helper.write_render_power_clock_state();
+bool EngineCommandStreamer::SubmitContext(MsdIntelContext* context, uint32_t tail,
+                                          bool lite_restore, MsdIntelContext* preceding_context)
+{
+    TRACE_DURATION("magma", "SubmitContext");
+    if (lite_restore) {
+        if (!UpdateContextTail(context, tail))
+            return DRETF(false, "UpdateContextTail failed");
+    } else if (!UpdateContext(context, tail)) {
+        return DRETF(false, "UpdateContext failed");
     }
 
-    if (!platform_buf->UnmapCpu())
-        return DRETF(false, "Couldn't unmap context buffer");
+    UpdateSubmitStats(lite_restore);
 
+    SubmitExeclists(context, preceding_context);
     return true;
 }
 
-bool EngineCommandStreamer::SubmitContext(MsdIntelContext* context, uint32_t tail)
+void EngineCommandStreamer::UpdateSubmitStats(bool lite_restore)
 {
-    TRACE_DURATION("magma", "SubmitContext");
-    if (!UpdateContext(context, tail))
-        return DRETF(false, "UpdateContext failed");
+    auto now = std::chrono::steady_clock::now();
+    if (submit_interval_start_ == std::chrono::steady_clock::time_point())
+        submit_interval_start_ = now;
+
+    uint64_t elapsed_ms =
+        std::chrono::duration_cast<std::chrono::milliseconds>(now - submit_interval_start_)
+            .count();
+    if (elapsed_ms >= 1000) {
+        submit_stats_.context_switches_per_second = interval_context_switches_ * 1000 / elapsed_ms;
+        submit_stats_.lite_restores_per_second = interval_lite_restores_ * 1000 / elapsed_ms;
+        interval_context_switches_ = 0;
+        interval_lite_restores_ = 0;
+        submit_interval_start_ = now;
+    }
 
-    SubmitExeclists(context);
-    return true;
+    if (lite_restore) {
+        submit_stats_.lite_restore_count++;
+        interval_lite_restores_++;
+    } else {
+        submit_stats_.context_switch_count++;
+        interval_context_switches_++;
+    }
 }
 
 bool EngineCommandStreamer::UpdateContext(MsdIntelContext* context, uint32_t tail)
@@ -365,26 +512,66 @@ bool EngineCommandStreamer::UpdateContext(MsdIntelContext* context, uint32_t tai
     if (!context->GetRingbufferGpuAddress(id(), &gpu_addr))
         return DRETF(false, "failed to get ringbuffer gpu address");
 
-    void* cpu_addr;
-    if (!context->get_context_buffer(id())->platform_buffer()->MapPageCpu(1, &cpu_addr))
-        return DRETF(false, "failed to map context page 1");
+    uint32_t* register_state = context->GetRegisterState(id());
+    if (!register_state)
+        return DRETF(false, "failed to get register state");
 
-    RegisterStateHelper helper(id(), mmio_base_, reinterpret_cast<uint32_t*>(cpu_addr));
+    RegisterStateHelper helper(id(), mmio_base_, register_state);
 
     DLOG("UpdateContext ringbuffer gpu_addr 0x%lx tail 0x%x", gpu_addr, tail);
 
     helper.write_ring_tail_pointer(tail);
     helper.write_ring_buffer_start(gpu_addr);
 
-    if (!context->get_context_buffer(id())->platform_buffer()->UnmapPageCpu(1))
-        DLOG("UnmapPageCpu failed");
+    return true;
+}
+
+bool EngineCommandStreamer::RewindContext(MsdIntelContext* context, uint32_t head, uint32_t tail)
+{
+    uint32_t* register_state = context->GetRegisterState(id());
+    if (!register_state)
+        return DRETF(false, "failed to get register state");
+
+    DLOG("RewindContext head 0x%x tail 0x%x", head, tail);
+
+    auto ringbuffer = context->get_ringbuffer(id());
+    ringbuffer->update_head(head);
+    ringbuffer->update_tail(tail);
+
+    RegisterStateHelper helper(id(), mmio_base_, register_state);
+    helper.write_ring_head_pointer(head);
+    helper.write_ring_tail_pointer(tail);
+
+    return true;
+}
+
+bool EngineCommandStreamer::UpdateContextTail(MsdIntelContext* context, uint32_t tail)
+{
+    uint32_t* register_state = context->GetRegisterState(id());
+    if (!register_state)
+        return DRETF(false, "failed to get register state");
+
+    DLOG("UpdateContextTail tail 0x%x", tail);
+
+    RegisterStateHelper(id(), mmio_base_, register_state).write_ring_tail_pointer(tail);
 
     return true;
 }
 
-void EngineCommandStreamer::SubmitExeclists(MsdIntelContext* context)
+void EngineCommandStreamer::SubmitExeclists(MsdIntelContext* context,
+                                            MsdIntelContext* preceding_context)
 {
     TRACE_DURATION("magma", "SubmitExeclists");
+
+    // The hardware runs element 0 and then element 1.
+    uint64_t descriptor0 = GetContextDescriptor(preceding_context ? preceding_context : context);
+    uint64_t descriptor1 = preceding_context ? GetContextDescriptor(context) : 0;
+
+    registers::ExeclistSubmitPort::write(register_io(), mmio_base_, descriptor1, descriptor0);
+}
+
+uint64_t EngineCommandStreamer::GetContextDescriptor(MsdIntelContext* context)
+{
     gpu_addr_t gpu_addr;
     if (!context->GetGpuAddress(id(), &gpu_addr)) {
         // Shouldn't happen.
@@ -392,15 +579,12 @@ void EngineCommandStreamer::SubmitExeclists(MsdIntelContext* context)
         gpu_addr = kInvalidGpuAddr;
     }
 
-    DLOG("SubmitExeclists context descriptor id 0x%lx", gpu_addr >> 12);
+    DLOG("context descriptor id 0x%lx", gpu_addr >> 12);
 
     // Use most significant bits of context gpu_addr as globally unique context id
     DASSERT(PAGE_SIZE == 4096);
-    uint64_t descriptor0 = registers::ExeclistSubmitPort::context_descriptor(
+    return registers::ExeclistSubmitPort::context_descriptor(
         gpu_addr, gpu_addr >> 12, context->exec_address_space()->type() == ADDRESS_SPACE_PPGTT);
-    uint64_t descriptor1 = 0;
-
-    registers::ExeclistSubmitPort::write(register_io(), mmio_base_, descriptor1, descriptor0);
 }
 
 uint64_t EngineCommandStreamer::GetActiveHeadPointer()
@@ -422,7 +606,7 @@ bool EngineCommandStreamer::Reset()
 
     registers::ResetControl::request(register_io(), mmio_base());
 
-    constexpr uint32_t kRetryMs = 10;
+    // The handshake usually completes within microseconds, so poll rather than sleep.
     constexpr uint32_t kRetryTimeoutMs = 100;
 
     auto start = std::chrono::high_resolution_clock::now();
@@ -434,16 +618,19 @@ bool EngineCommandStreamer::Reset()
 
             start = std::chrono::high_resolution_clock::now();
             do {
-                if (registers::GraphicsDeviceResetControl::is_reset_complete(register_io(), engine))
+                if (registers::GraphicsDeviceResetControl::is_reset_complete(register_io(),
+                                                                              engine)) {
+                    context_pool_.ReleaseAllRecycled();
                     return true;
-                magma::msleep(kRetryMs);
+                }
+                std::this_thread::yield();
                 elapsed = std::chrono::high_resolution_clock::now() - start;
 
             } while (elapsed.count() < kRetryTimeoutMs);
 
             return DRETF(false, "reset failed to complete");
         }
-        magma::msleep(kRetryMs);
+        std::this_thread::yield();
         elapsed = std::chrono::high_resolution_clock::now() - start;
 
     } while (elapsed.count() < kRetryTimeoutMs);
@@ -477,14 +664,14 @@ RenderEngineCommandStreamer::RenderEngineCommandStreamer(EngineCommandStreamer::
     scheduler_ = Scheduler::CreateFifoScheduler();
 }
 
-bool RenderEngineCommandStreamer::RenderInit(std::shared_ptr<MsdIntelContext> context,
-                                             std::unique_ptr<RenderInitBatch> init_batch,
-                                             std::shared_ptr<AddressSpace> address_space)
+bool RenderEngineCommandStreamer::InitRenderInitBatch(std::unique_ptr<RenderInitBatch> init_batch,
+                                                      std::shared_ptr<AddressSpace> address_space)
 {
-    DASSERT(context);
-    DASSERT(init_batch);
     DASSERT(address_space);
 
+    if (!init_batch)
+        return DRETF(false, "no render init batch");
+
     auto buffer = std::unique_ptr<MsdIntelBuffer>(
         MsdIntelBuffer::Create(init_batch->size(), "render-init-batch"));
     if (!buffer)
@@ -494,15 +681,41 @@ bool RenderEngineCommandStreamer::RenderInit(std::shared_ptr<MsdIntelContext> co
     if (!mapping)
         return DRETF(false, "batch init failed");
 
+    render_init_batch_mapping_ = std::move(mapping);
+    return true;
+}
+
+bool RenderEngineCommandStreamer::RenderInit(std::shared_ptr<MsdIntelContext> context)
+{
+    DASSERT(context);
+
+    if (!render_init_batch_mapping_)
+        return DRETF(false, "render init batch not initialized");
+
     std::unique_ptr<SimpleMappedBatch> mapped_batch(
-        new SimpleMappedBatch(context, std::move(mapping)));
+        new SimpleMappedBatch(context, render_init_batch_mapping_));
 
     return ExecBatch(std::move(mapped_batch));
 }
 
+// The most ring space ExecBatch writes for one batch: a semaphore wait, the start and end
+// timestamps, the batch start, the sequence number write and the user interrupt.
+constexpr uint32_t kMaxBatchDwords =
+    MiSemaphoreWait::kDwordCount + 3 * MiPipeControl::kDwordCount +
+    MiBatchBufferStart::kDwordCount + MiNoop::kDwordCount + MiUserInterrupt::kDwordCount;
+
+// Whether |batch| can be timed with |inflight_count| sequences in flight; simple batches aren't
+// timed.
+static bool HasTimestampSlot(MappedBatch* batch, size_t inflight_count)
+{
+    return batch->IsSimple() || inflight_count < HardwareStatusPage::kTimestampSlotCount;
+}
+
 bool RenderEngineCommandStreamer::ExecBatch(std::unique_ptr<MappedBatch> mapped_batch)
 {
     TRACE_DURATION("magma", "ExecBatch");
+    next_batch_flushes_pending_ = false;
+
     auto context = mapped_batch->GetContext().lock();
     DASSERT(context);
 
@@ -510,11 +723,48 @@ bool RenderEngineCommandStreamer::ExecBatch(std::unique_ptr<MappedBatch> mapped_
     if (!mapped_batch->GetGpuAddress(&gpu_addr))
         return DRETF(false, "couldn't get batch gpu address");
 
+    uint32_t ringbuffer_start_offset = context->get_ringbuffer(id())->tail();
+
+    // Dependencies on batches still executing are resolved by the gpu.
+    uint32_t wait_sequence_number;
+    if (completion_signaler_.GetWaitSequenceNumber(mapped_batch->TakeGpuWaitSemaphores(),
+                                                   &wait_sequence_number)) {
+        if (!WaitSequenceNumber(context.get(), wait_sequence_number))
+            return DRETF(false, "failed to emit semaphore wait");
+    }
+
+    // User batches are timed by the gpu. Slots are handed out in order and sequences retire in
+    // order, so the next slot is free while fewer sequences than slots are in flight, which
+    // ScheduleContext ensures.
+    uint32_t timestamp_slot = kNoTimestampSlot;
+    if (!mapped_batch->IsSimple()) {
+        DASSERT(HasTimestampSlot(mapped_batch.get(), inflight_command_sequences_.size()));
+        timestamp_slot = next_timestamp_slot_;
+        next_timestamp_slot_ = (next_timestamp_slot_ + 1) % HardwareStatusPage::kTimestampSlotCount;
+        hardware_status_page(id())->clear_timestamps(timestamp_slot);
+        if (!WriteTimestamp(context.get(), timestamp_slot, false))
+            return DRETF(false, "failed to emit start timestamp");
+    }
+
     if (!StartBatchBuffer(context.get(), gpu_addr, context->exec_address_space()->type()))
         return DRETF(false, "failed to emit batch");
 
+    if (timestamp_slot != kNoTimestampSlot && !WriteTimestamp(context.get(), timestamp_slot, true))
+        return DRETF(false, "failed to emit end timestamp");
+
+    // This batch's flushes may be left to the context's next batch only if that batch goes into
+    // the ring right behind this one (see ScheduleContext); a batch still queued may never run.
+    MappedBatch* next_batch = nullptr;
+    if (mapped_batch->was_scheduled() && !context->pending_batch_queue().empty() &&
+        scheduler_->PeekContext() == context &&
+        HasTimestampSlot(context->pending_batch_queue().front().get(),
+                         inflight_command_sequences_.size() + 1) &&
+        context->get_ringbuffer(id())->HasSpace(2 * kMaxBatchDwords * sizeof(uint32_t)))
+        next_batch = context->pending_batch_queue().front().get();
+
     uint32_t sequence_number;
-    if (!PipeControl(context.get(), mapped_batch->GetPipeControlFlags(), &sequence_number))
+    if (!PipeControl(context.get(), mapped_batch->GetPipeControlFlags(next_batch),
+                     &sequence_number))
         return DRETF(false, "PipeControl failed");
 
     auto ringbuffer = context->get_ringbuffer(id());
@@ -526,17 +776,44 @@ bool RenderEngineCommandStreamer::ExecBatch(std::unique_ptr<MappedBatch> mapped_
     MiUserInterrupt::write(ringbuffer);
 
     mapped_batch->SetSequenceNumber(sequence_number);
+    completion_signaler_.Add(sequence_number, mapped_batch->TakeSignalSemaphores());
+
+    // The context of the latest incomplete sequence is the one the hardware is running, unless
+    // the scheduler dispatched it behind another context (see Scheduler::ScheduleContext); that
+    // context must stay first in the execlist. If its sequences have completed, the hardware
+    // finds its ring empty and moves on.
+    bool lite_restore = false;
+    std::shared_ptr<MsdIntelContext> preceding_context;
+    if (!inflight_command_sequences_.empty()) {
+        preceding_context = inflight_command_sequences_.back().GetContext().lock();
+        lite_restore = preceding_context == context;
+        if (lite_restore)
+            preceding_context = inflight_command_sequences_.front().GetContext().lock();
+        if (preceding_context == context)
+            preceding_context = nullptr;
+    }
+
+    BatchTimes& times = mapped_batch->times();
+    times.submit_ns = BatchTimes::now_ns();
+    if (timestamp_slot != kNoTimestampSlot)
+        times.submit_ticks = registers::Timestamp::read(register_io(), mmio_base());
 
     uint32_t ringbuffer_offset = context->get_ringbuffer(id())->tail();
-    inflight_command_sequences_.emplace(sequence_number, ringbuffer_offset,
+    inflight_command_sequences_.emplace(sequence_number, ringbuffer_start_offset,
+                                        ringbuffer_offset, timestamp_slot,
                                         std::move(mapped_batch));
 
     uint32_t tail = inflight_command_sequences_.back().ringbuffer_offset();
     DLOG("Submitting context for sequence_number 0x%x", sequence_number);
 
-    SubmitContext(context.get(), tail);
+    FlightRecorder::Get()->Record(lite_restore ? FlightRecorder::kLiteRestore
+                                               : FlightRecorder::kExeclistSubmit,
+                                  sequence_number, reinterpret_cast<uintptr_t>(context.get()));
+    SubmitContext(context.get(), tail, lite_restore, preceding_context.get());
+
+    batch_submitted(sequence_number, context->hang_budget_ms());
 
-    batch_submitted(sequence_number);
+    next_batch_flushes_pending_ = next_batch != nullptr;
 
     return true;
 }
@@ -563,6 +840,16 @@ void RenderEngineCommandStreamer::ScheduleContext()
     }
 
     while (true) {
+        // A user batch waits for a sequence to retire once every timestamp slot is in use. If
+        // the next context isn't known, waiting is safe as sequences are in flight.
+        if (inflight_command_sequences_.size() >= HardwareStatusPage::kTimestampSlotCount) {
+            auto next_context = scheduler_->PeekContext();
+            if (!next_context ||
+                !HasTimestampSlot(next_context->pending_batch_queue().front().get(),
+                                  inflight_command_sequences_.size()))
+                break;
+        }
+
         auto context = scheduler_->ScheduleContext();
         if (!context)
             break;
@@ -570,11 +857,18 @@ void RenderEngineCommandStreamer::ScheduleContext()
         auto mapped_batch = std::move(context->pending_batch_queue().front());
         mapped_batch->scheduled();
         context->pending_batch_queue().pop();
+        FlightRecorder::Get()->Record(FlightRecorder::kSchedule,
+                                      context->pending_batch_queue().size(),
+                                      reinterpret_cast<uintptr_t>(context.get()));
 
         // TODO(MA-142) - ExecBatch should not fail.  Scheduler should verify there is
         // sufficient room in the ringbuffer before selecting a context.
         // For now, drop the command buffer and try another context.
         if (ExecBatch(std::move(mapped_batch))) {
+            // The context's next batch carries this one's flushes, so it must follow at once;
+            // PeekContext has already confirmed it is scheduled next.
+            if (next_batch_flushes_pending_)
+                continue;
             break;
         }
 
@@ -619,10 +913,23 @@ bool RenderEngineCommandStreamer::WaitIdle()
 
         std::this_thread::yield();
     }
+
+    retire_queue_.RetireAll();
     return true;
 }
 
 void RenderEngineCommandStreamer::ProcessCompletedCommandBuffers(uint32_t last_completed_sequence)
+{
+    // Usually already done by the interrupt thread.
+    completion_signaler_.Signal(last_completed_sequence, 0);
+
+    ReleaseRecycledContexts(last_completed_sequence);
+
+    if (ProcessCompletedSequences(last_completed_sequence))
+        ScheduleContext();
+}
+
+bool RenderEngineCommandStreamer::ProcessCompletedSequences(uint32_t last_completed_sequence)
 {
     bool progress = false;
 
@@ -644,12 +951,23 @@ void RenderEngineCommandStreamer::ProcessCompletedCommandBuffers(uint32_t last_c
         if (sequence.mapped_batch()->was_scheduled())
             scheduler_->CommandBufferCompleted(context);
 
+        BatchTimes& times = sequence.mapped_batch()->times();
+        times.complete_ns = BatchTimes::now_ns();
+        if (sequence.timestamp_slot() != kNoTimestampSlot) {
+            HardwareStatusPage* status_page = hardware_status_page(id());
+            times.gpu_start_ticks = status_page->read_timestamp(sequence.timestamp_slot(), false);
+            times.gpu_end_ticks = status_page->read_timestamp(sequence.timestamp_slot(), true);
+        }
+        batch_completed(sequence.mapped_batch());
+        FlightRecorder::Get()->Record(FlightRecorder::kRetire, sequence.sequence_number(),
+                                      reinterpret_cast<uintptr_t>(context.get()));
+
+        retire_queue_.Add(sequence.release_mapped_batch());
         inflight_command_sequences_.pop();
         progress = true;
     }
 
-    if (progress)
-        ScheduleContext();
+    return progress;
 }
 
 bool EngineCommandStreamer::PipeControl(MsdIntelContext* context, uint32_t flags,
@@ -676,6 +994,41 @@ bool EngineCommandStreamer::PipeControl(MsdIntelContext* context, uint32_t flags
     return true;
 }
 
+bool EngineCommandStreamer::WaitSequenceNumber(MsdIntelContext* context,
+                                               uint32_t sequence_number)
+{
+    auto ringbuffer = context->get_ringbuffer(id());
+
+    if (!ringbuffer->HasSpace(MiSemaphoreWait::kDwordCount * sizeof(uint32_t)))
+        return DRETF(false, "ringbuffer has insufficient space");
+
+    gpu_addr_t gpu_addr =
+        hardware_status_page(id())->gpu_addr() + HardwareStatusPage::kSequenceNumberOffset;
+
+    DLOG("waiting for sequence number 0x%x", sequence_number);
+    MiSemaphoreWait::write(ringbuffer, sequence_number, gpu_addr);
+
+    return true;
+}
+
+bool EngineCommandStreamer::WriteTimestamp(MsdIntelContext* context, uint32_t slot, bool end)
+{
+    auto ringbuffer = context->get_ringbuffer(id());
+
+    if (!ringbuffer->HasSpace(MiPipeControl::kDwordCount * sizeof(uint32_t)))
+        return DRETF(false, "ringbuffer has insufficient space");
+
+    gpu_addr_t gpu_addr =
+        hardware_status_page(id())->gpu_addr() + HardwareStatusPage::timestamp_offset(slot, end);
+
+    // Without the stall a start timestamp could be taken while the previous batch still runs,
+    // and an end timestamp before this one finishes.
+    MiPipeControl::write_timestamp(ringbuffer, gpu_addr,
+                                   MiPipeControl::kCommandStreamerStallEnableBit);
+
+    return true;
+}
+
 bool RenderEngineCommandStreamer::StartBatchBuffer(MsdIntelContext* context, gpu_addr_t gpu_addr,
                                                    AddressSpaceType address_space_type)
 {
@@ -694,33 +1047,170 @@ bool RenderEngineCommandStreamer::StartBatchBuffer(MsdIntelContext* context, gpu
     return true;
 }
 
+std::shared_ptr<MsdIntelContext>
+RenderEngineCommandStreamer::FindGuiltyContext(gpu_addr_t ringbuffer_start,
+                                               uint32_t ringbuffer_head)
+{
+    if (inflight_command_sequences_.empty())
+        return nullptr;
+
+    std::shared_ptr<MsdIntelContext> guilty_context;
+
+    for (uint32_t i = 0; i < inflight_command_sequences_.size(); i++) {
+        auto sequence = std::move(inflight_command_sequences_.front());
+        inflight_command_sequences_.pop();
+
+        auto context = sequence.GetContext().lock();
+        DASSERT(context);
+
+        // Rings are all in the global gtt. Batch addresses aren't compared: they may be in a
+        // ppgtt, and while a batch executes the ring head is just past its batch buffer start.
+        gpu_addr_t ringbuffer_gpu_addr;
+        if (!guilty_context &&
+            context->get_ringbuffer(id())->GetGpuAddress(&ringbuffer_gpu_addr) &&
+            ringbuffer_gpu_addr == ringbuffer_start) {
+            uint32_t start = sequence.ringbuffer_start_offset();
+            uint32_t end = sequence.ringbuffer_offset();
+            // The sequence may wrap around the end of the ringbuffer. The head is past the
+            // last command fetched, so it may equal the end.
+            if (start <= end ? (ringbuffer_head > start && ringbuffer_head <= end)
+                             : (ringbuffer_head > start || ringbuffer_head <= end))
+                guilty_context = context;
+        }
+
+        inflight_command_sequences_.push(std::move(sequence));
+    }
+
+    if (!guilty_context) {
+        magma::log(magma::LOG_WARNING,
+                   "ring 0x%lx head 0x%x not in any inflight sequence", ringbuffer_start,
+                   ringbuffer_head);
+        guilty_context = inflight_command_sequences_.front().GetContext().lock();
+    }
+
+    return guilty_context;
+}
+
 void RenderEngineCommandStreamer::ResetCurrentContext()
 {
     DLOG("ResetCurrentContext");
 
     DASSERT(!inflight_command_sequences_.empty());
 
-    auto context = inflight_command_sequences_.front().GetContext().lock();
-
-    // Do this before releasing any connection threads block in wait rendering
-    auto connection = context->connection().lock();
-    if (connection) {
-        connection->set_context_killed();
-    } else {
-        magma::log(magma::LOG_WARNING, "Attempting to reset global context");
+    // Sequences that completed before the hang are retired normally.
+    uint32_t last_completed_sequence = hardware_status_page(id())->read_sequence_number();
+    completion_signaler_.Signal(last_completed_sequence, 0);
+    ProcessCompletedSequences(last_completed_sequence);
+
+    uint64_t active_head = GetActiveHeadPointer();
+    FlightRecorder::Get()->Record(FlightRecorder::kReset, last_completed_sequence, active_head);
+
+    auto guilty_context =
+        FindGuiltyContext(registers::RingbufferStart::read(register_io(), mmio_base()),
+                          registers::RingbufferHead::read(register_io(), mmio_base()));
+
+    if (guilty_context) {
+        // Do this before releasing any connection threads block in wait rendering
+        auto connection = guilty_context->connection().lock();
+        if (connection) {
+            connection->set_context_killed();
+        } else {
+            magma::log(magma::LOG_WARNING, "Attempting to reset global context");
+        }
     }
 
-    // Cleanup resources for any inflight command sequences on this context
+    // Where each innocent context's first incomplete sequence begins.
+    std::unordered_map<MsdIntelContext*, uint32_t> rewind_offsets;
+
     while (!inflight_command_sequences_.empty()) {
         auto& sequence = inflight_command_sequences_.front();
+        auto context = sequence.GetContext().lock();
+        DASSERT(context);
+
+        // Replayed batches are scheduled again.
         if (sequence.mapped_batch()->was_scheduled())
-            scheduler_->CommandBufferCompleted(
-                inflight_command_sequences_.front().GetContext().lock());
+            scheduler_->CommandBufferCompleted(context);
+
+        if (context != guilty_context) {
+            rewind_offsets.emplace(context.get(), sequence.ringbuffer_start_offset());
+            auto mapped_batch = sequence.release_mapped_batch();
+            mapped_batch->ReturnSignalSemaphores(
+                completion_signaler_.Take(sequence.sequence_number()));
+            replay_batches_.push_back(std::move(mapped_batch));
+        }
         inflight_command_sequences_.pop();
     }
 
+    // Only the guilty context's semaphores are still pending.
+    completion_signaler_.SignalAll();
+
     // Reset the engine hardware
     EngineCommandStreamer::Reset();
+
+    if (guilty_context) {
+        // Skip anything left in the guilty context's ring.
+        uint32_t tail = guilty_context->get_ringbuffer(id())->tail();
+        RewindContext(guilty_context.get(), tail, tail);
+    }
+
+    // Innocent contexts restart from their first incomplete sequence. Commands emitted ahead of
+    // it, such as the cache config of a new context, are executed again.
+    for (auto& pair : rewind_offsets) {
+        RewindContext(pair.first, pair.first->get_ringbuffer(id())->head(), pair.second);
+    }
+}
+
+void RenderEngineCommandStreamer::ReplayInflightBatches()
+{
+    // The batches go back ahead of their contexts' queued batches, so the scheduler runs them
+    // first, in their original order and one context at a time.
+    std::unordered_map<MsdIntelContext*, std::queue<std::unique_ptr<MappedBatch>>> queues;
+    std::vector<std::weak_ptr<MsdIntelContext>> contexts;
+
+    if (replay_batches_.size())
+        magma::log(magma::LOG_WARNING, "replaying %zu inflight batches of innocent contexts",
+                   replay_batches_.size());
+
+    for (auto& mapped_batch : replay_batches_) {
+        auto context = mapped_batch->GetContext().lock();
+        if (!context)
+            continue;
+        contexts.push_back(context);
+        queues[context.get()].push(std::move(mapped_batch));
+    }
+    replay_batches_.clear();
+
+    for (auto& pair : queues) {
+        auto& pending_batch_queue = pair.first->pending_batch_queue();
+        while (!pending_batch_queue.empty()) {
+            pair.second.push(std::move(pending_batch_queue.front()));
+            pending_batch_queue.pop();
+        }
+        pending_batch_queue = std::move(pair.second);
+    }
+
+    scheduler_->CommandBuffersRequeued(std::move(contexts));
+
+    ScheduleContext();
+}
+
+void RenderEngineCommandStreamer::DropInflightBatches()
+{
+    for (auto& mapped_batch : replay_batches_) {
+        auto context = mapped_batch->GetContext().lock();
+        if (!context)
+            continue;
+        auto connection = context->connection().lock();
+        if (connection)
+            connection->set_context_killed();
+    }
+
+    if (replay_batches_.size())
+        magma::log(magma::LOG_WARNING, "dropping %zu inflight batches of innocent contexts",
+                   replay_batches_.size());
+
+    // Destroying the batches signals their semaphores.
+    replay_batches_.clear();
 }
 
 std::vector<MappedBatch*> RenderEngineCommandStreamer::GetInflightBatches()
@@ -738,3 +1228,117 @@ std::vector<MappedBatch*> RenderEngineCommandStreamer::GetInflightBatches()
     }
     return inflight_batches;
 }
+
+void RenderEngineCommandStreamer::CaptureErrorState(ErrorStateWriter* writer,
+                                                    std::vector<ErrorStateBatch>* batches)
+{
+    // Relative to the mmio base.
+    static constexpr uint32_t kRegisterOffsets[] = {
+        0x30,  // RING_BUFFER_TAIL
+        0x34,  // RING_BUFFER_HEAD
+        0x38,  // RING_BUFFER_START
+        0x3C,  // RING_BUFFER_CTL
+        registers::ActiveHeadPointer::kOffset,
+        registers::ActiveHeadPointer::kUpperOffset,
+        0x64,  // IPEIR
+        0x68,  // IPEHR
+        0x6C,  // INSTDONE
+        registers::HardwareStatusPageAddress::kOffset,
+        0x9C,  // MI_MODE
+        0x110, // BB_STATE
+        0x140, // BB_ADDR
+        0x168, // BB_ADDR_UDW
+        0x180, // CCID
+        registers::ExeclistStatus::kOffset,
+        registers::ExeclistStatus::kOffset + 4,
+        registers::GraphicsMode::kOffset,
+        registers::Timestamp::kOffset,
+        registers::Timestamp::kOffset + 4,
+    };
+
+    writer->BeginSection(ErrorState::kRegisters);
+    for (uint32_t offset : kRegisterOffsets) {
+        writer->Write32(mmio_base() + offset);
+        writer->Write32(register_io()->Read32(mmio_base() + offset));
+    }
+    writer->EndSection();
+
+    writer->BeginSection(ErrorState::kStatusPage);
+    writer->WriteDwords(hardware_status_page(id())->cpu_addr(), PAGE_SIZE / sizeof(uint32_t));
+    writer->EndSection();
+
+    // Contexts whose ring is captured; rings past the first kMaxRingbuffers are left out.
+    constexpr uint32_t kMaxRingbuffers = 16;
+    MsdIntelContext* captured_contexts[kMaxRingbuffers];
+    uint32_t captured_context_count = 0;
+
+    for (uint32_t i = 0; i < inflight_command_sequences_.size(); i++) {
+        auto sequence = std::move(inflight_command_sequences_.front());
+        inflight_command_sequences_.pop();
+
+        auto context = sequence.GetContext().lock();
+        Ringbuffer* ringbuffer = context ? context->get_ringbuffer(id()) : nullptr;
+        gpu_addr_t ringbuffer_gpu_addr;
+        if (ringbuffer && ringbuffer->GetGpuAddress(&ringbuffer_gpu_addr) &&
+            captured_context_count < kMaxRingbuffers &&
+            std::find(captured_contexts, captured_contexts + captured_context_count,
+                      context.get()) == captured_contexts + captured_context_count) {
+            captured_contexts[captured_context_count++] = context.get();
+            writer->BeginSection(ErrorState::kRingbuffer);
+            writer->Write64(reinterpret_cast<uintptr_t>(context.get()));
+            writer->Write64(ringbuffer_gpu_addr);
+            writer->Write32(ringbuffer->size());
+            writer->Write32(ringbuffer->head());
+            writer->Write32(ringbuffer->tail());
+            for (uint32_t offset = ringbuffer->head(); offset != ringbuffer->tail();
+                 offset = (offset + sizeof(uint32_t)) % ringbuffer->size()) {
+                if (!writer->Write32(ringbuffer->read_dword(offset)))
+                    break;
+            }
+            writer->EndSection();
+        }
+
+        // The batch contents are copied later; mapping a buffer here could allocate.
+        MappedBatch* batch = sequence.mapped_batch();
+        std::shared_ptr<GpuMapping> batch_mapping = batch->ShareBatchMapping();
+        if (batch_mapping && batches->size() < batches->capacity()) {
+            batches->push_back(ErrorStateBatch{sequence.sequence_number(),
+                                               reinterpret_cast<uintptr_t>(context.get()),
+                                               std::move(batch_mapping)});
+        }
+
+        if (!batch->IsSimple()) {
+            for (auto& mapping : static_cast<CommandBuffer*>(batch)->exec_resource_mappings()) {
+                writer->BeginSection(ErrorState::kMapping);
+                writer->Write32(sequence.sequence_number());
+                writer->Write64(mapping->buffer()->platform_buffer()->id());
+                writer->Write64(mapping->gpu_addr());
+                writer->Write64(mapping->offset());
+                writer->Write64(mapping->length());
+                writer->EndSection();
+            }
+        }
+
+        inflight_command_sequences_.push(std::move(sequence));
+    }
+}
+
+void RenderEngineCommandStreamer::WriteErrorStateBatch(ErrorStateWriter* writer,
+                                                       const ErrorStateBatch& batch)
+{
+    GpuMapping* mapping = batch.mapping.get();
+    writer->BeginSection(ErrorState::kBatch);
+    writer->Write32(batch.sequence_number);
+    writer->Write64(batch.context_id);
+    writer->Write64(mapping->gpu_addr());
+    writer->Write32(mapping->length());
+    magma::PlatformBuffer* platform_buffer = mapping->buffer()->platform_buffer();
+    void* cpu_addr;
+    if (platform_buffer->MapCpu(&cpu_addr)) {
+        writer->WriteDwords(
+            reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(cpu_addr) + mapping->offset()),
+            mapping->length() / sizeof(uint32_t));
+        platform_buffer->UnmapCpu();
+    }
+    writer->EndSection();
+}
@@ -6,6 +6,9 @@
 #define ENGINE_COMMAND_STREAMER_H
 
 #include "address_space.h"
+#include "completion_signaler.h"
+#include "context_pool.h"
+#include "error_state.h"
 #include "hardware_status_page.h"
 #include "magma_util/status.h"
 #include "mapped_batch.h"
@@ -13,10 +16,13 @@
 #include "pagetable.h"
 #include "register_io.h"
 #include "render_init_batch.h"
+#include "retire_queue.h"
 #include "scheduler.h"
 #include "sequencer.h"
+#include <chrono>
 #include <memory>
 #include <queue>
+#include <vector>
 
 class EngineCommandStreamer {
 public:
@@ -26,18 +32,47 @@ public:
         virtual Sequencer* sequencer() = 0;
         virtual HardwareStatusPage* hardware_status_page(EngineCommandStreamerId id) = 0;
         // Keep the device informed when we have scheduled command sequences
-        virtual void batch_submitted(uint32_t sequence_number) = 0;
+        virtual void batch_submitted(uint32_t sequence_number, uint32_t hang_budget_ms) = 0;
+        // Called from the device thread when a batch completes, with its times filled in.
+        virtual void batch_completed(MappedBatch* mapped_batch) = 0;
     };
 
     EngineCommandStreamer(Owner* owner, EngineCommandStreamerId id, uint32_t mmio_base);
 
     virtual ~EngineCommandStreamer() {}
 
+    struct SubmitStats {
+        uint64_t context_switch_count;
+        uint64_t lite_restore_count;
+        // Rates over the most recent one second interval.
+        uint32_t context_switches_per_second;
+        uint32_t lite_restores_per_second;
+    };
+
     EngineCommandStreamerId id() const { return id_; }
 
-    // Initialize backing store for the given context on this engine command streamer.
-    bool InitContext(MsdIntelContext* context) const;
+    // Must be called from the device thread.
+    SubmitStats submit_stats() { return submit_stats_; }
+
+    // Initialize backing store for the given context on this engine command streamer, from the
+    // golden context image. Backing store is taken from the context pool when available.
+    bool InitContext(MsdIntelContext* context);
+
+    // Adds up to |max_count| backing stores, mapped into |address_space|, to the context pool;
+    // returns true if the pool is still not full.
+    bool RefillContextPool(std::shared_ptr<AddressSpace> address_space, uint32_t max_count);
+
+    // Moves the backing store of |context|, which must have no work outstanding, into the context
+    // pool. It can't be reused until a later sequence completes (see ReleaseRecycledContexts),
+    // and the context image is reset when it is.
+    void RecycleContext(MsdIntelContext* context);
+
+    void ReleaseRecycledContexts(uint32_t last_completed_sequence)
+    {
+        context_pool_.ReleaseRecycled(last_completed_sequence);
+    }
 
+    // Copies the golden cache config into the context's ringbuffer.
     bool InitContextCacheConfig(std::shared_ptr<MsdIntelContext> context);
 
     // Initialize engine command streamer hardware.
@@ -54,10 +89,24 @@ public:
 protected:
     virtual bool ExecBatch(std::unique_ptr<MappedBatch> mapped_batch) = 0;
 
-    bool SubmitContext(MsdIntelContext* context, uint32_t tail);
+    // If |lite_restore| the hardware is already running |context|, so only the ring tail is
+    // updated; the resubmission is then a lite restore that doesn't reload the context image.
+    // If |preceding_context| is given, the hardware runs it to completion before |context|.
+    bool SubmitContext(MsdIntelContext* context, uint32_t tail, bool lite_restore,
+                       MsdIntelContext* preceding_context);
     bool UpdateContext(MsdIntelContext* context, uint32_t tail);
-    void SubmitExeclists(MsdIntelContext* context);
+    bool UpdateContextTail(MsdIntelContext* context, uint32_t tail);
+    // Moves the context's ring pointers, in both the ringbuffer and the context image; the
+    // engine must not be running the context.
+    bool RewindContext(MsdIntelContext* context, uint32_t head, uint32_t tail);
+    void SubmitExeclists(MsdIntelContext* context, MsdIntelContext* preceding_context);
+    uint64_t GetContextDescriptor(MsdIntelContext* context);
     bool PipeControl(MsdIntelContext* context, uint32_t flags, uint32_t* sequence_number);
+    // Emits a wait until this engine's sequence number reaches |sequence_number|.
+    bool WaitSequenceNumber(MsdIntelContext* context, uint32_t sequence_number);
+    // Emits a write of the gpu timestamp into the start, or if |end| the end, of |slot| in the
+    // hardware status page. The write stalls until earlier commands have completed.
+    bool WriteTimestamp(MsdIntelContext* context, uint32_t slot, bool end);
 
     // from intel-gfx-prm-osrc-bdw-vol03-gpu_overview_3.pdf p.7
     static constexpr uint32_t kRenderEngineMmioBase = 0x2000;
@@ -73,19 +122,45 @@ protected:
         return owner_->hardware_status_page(id);
     }
 
-    void batch_submitted(uint32_t sequence_number) { owner_->batch_submitted(sequence_number); }
+    void batch_submitted(uint32_t sequence_number, uint32_t hang_budget_ms)
+    {
+        owner_->batch_submitted(sequence_number, hang_budget_ms);
+    }
+
+    void batch_completed(MappedBatch* mapped_batch) { owner_->batch_completed(mapped_batch); }
 
 private:
     virtual uint32_t GetContextSize() const { return PAGE_SIZE * 2; }
 
+    // Builds the register state and cache config shared by every context on this engine.
+    void InitGoldenContextImage();
+
     bool InitContextBuffer(MsdIntelBuffer* context_buffer, Ringbuffer* ringbuffer,
                            AddressSpace* address_space) const;
+    void WriteContextState(uint32_t* state, Ringbuffer* ringbuffer,
+                           AddressSpace* address_space) const;
+
+    std::unique_ptr<MsdIntelContext::PerEngineState>
+    CreatePooledEngineState(std::shared_ptr<AddressSpace> address_space);
+
+    void UpdateSubmitStats(bool lite_restore);
+
+    static constexpr uint32_t kRingbufferSize = 32 * PAGE_SIZE;
+    static constexpr uint32_t kContextPoolCapacity = 4;
 
     Owner* owner_;
     EngineCommandStreamerId id_;
     uint32_t mmio_base_;
+    std::vector<uint32_t> golden_register_state_;
+    std::vector<uint32_t> golden_cache_config_;
+    ContextPool context_pool_;
+    SubmitStats submit_stats_{};
+    std::chrono::steady_clock::time_point submit_interval_start_;
+    uint32_t interval_context_switches_{};
+    uint32_t interval_lite_restores_{};
 
     friend class TestEngineCommandStreamer;
+    friend class BenchmarkEngineCommandStreamer;
 };
 
 class RenderEngineCommandStreamer : public EngineCommandStreamer {
@@ -94,22 +169,61 @@ public:
 
     static std::unique_ptr<RenderInitBatch> CreateRenderInitBatch(uint32_t device_id);
 
-    // |address_space| used to map the render init batch.
-    bool RenderInit(std::shared_ptr<MsdIntelContext> context,
-                    std::unique_ptr<RenderInitBatch> init_batch,
-                    std::shared_ptr<AddressSpace> address_space);
+    // Relocates |init_batch| into a buffer mapped into |address_space|; the mapping is kept for
+    // the lifetime of the engine so resets don't recreate it.
+    bool InitRenderInitBatch(std::unique_ptr<RenderInitBatch> init_batch,
+                             std::shared_ptr<AddressSpace> address_space);
+
+    // Submits the render init batch on |context|.
+    bool RenderInit(std::shared_ptr<MsdIntelContext> context);
 
     void SubmitCommandBuffer(std::unique_ptr<CommandBuffer> cmd_buf) override;
 
+    // Advances ringbuffer heads and notifies the scheduler for completed sequences; the
+    // completed batches are handed to the retire queue.
     void ProcessCompletedCommandBuffers(uint32_t last_completed_sequence);
+
+    // Resets the engine after a hang. The context the hardware was executing, found from the
+    // active head pointer, is killed and its inflight batches dropped. Other contexts' rings are
+    // rewound to their first incomplete batch, and their batches kept for ReplayInflightBatches.
     void ResetCurrentContext();
 
+    // Requeues the batches kept by ResetCurrentContext ahead of their contexts' queued batches,
+    // in their original order, and schedules them.
+    void ReplayInflightBatches();
+
+    // Drops the batches kept by ResetCurrentContext, killing their contexts' connections as the
+    // guilty context's is; for when the engine couldn't be reinitialized.
+    void DropInflightBatches();
+
+    // Releases up to |max_count| completed batches; returns true if more remain.
+    bool RetireCompletedBatches(uint32_t max_count) { return retire_queue_.Retire(max_count); }
+
+    // Thread safe.
+    CompletionSignaler* completion_signaler() { return &completion_signaler_; }
+
     bool WaitIdle() override;
 
     // This does not return ownership of the mapped batches so it is not safe
     // to safe the result and this method must be called from the device thread
     std::vector<MappedBatch*> GetInflightBatches();
 
+    // An inflight batch whose contents are left out of a captured error state, to be added by
+    // WriteErrorStateBatch once mapping the batch is affordable.
+    struct ErrorStateBatch {
+        uint32_t sequence_number;
+        uint64_t context_id;
+        std::shared_ptr<GpuMapping> mapping;
+    };
+
+    // Appends the engine registers, hardware status page, and the rings and mappings of the
+    // inflight sequences to |writer|, and adds the inflight batches to |batches| up to its
+    // capacity. Doesn't allocate or map buffers. Must be called from the device thread.
+    void CaptureErrorState(ErrorStateWriter* writer, std::vector<ErrorStateBatch>* batches);
+
+    // Appends a kBatch section holding |batch| and its contents to |writer|.
+    static void WriteErrorStateBatch(ErrorStateWriter* writer, const ErrorStateBatch& batch);
+
 private:
     RenderEngineCommandStreamer(EngineCommandStreamer::Owner* owner);
 
@@ -122,38 +236,72 @@ private:
     bool WriteSequenceNumber(MsdIntelContext* context, uint32_t* sequence_number_out);
     void ScheduleContext();
 
+    // Hands completed sequences to the retire queue; returns true if there were any.
+    bool ProcessCompletedSequences(uint32_t last_completed_sequence);
+
+    // Returns the context of the inflight sequence whose ring commands, in the ring at
+    // |ringbuffer_start|, end at or contain |ringbuffer_head|, or the oldest inflight sequence's
+    // context if none do.
+    std::shared_ptr<MsdIntelContext> FindGuiltyContext(gpu_addr_t ringbuffer_start,
+                                                       uint32_t ringbuffer_head);
+
     class InflightCommandSequence {
     public:
-        InflightCommandSequence(uint32_t sequence_number, uint32_t ringbuffer_offset,
+        InflightCommandSequence(uint32_t sequence_number, uint32_t ringbuffer_start_offset,
+                                uint32_t ringbuffer_offset, uint32_t timestamp_slot,
                                 std::unique_ptr<MappedBatch> mapped_batch)
-            : sequence_number_(sequence_number), ringbuffer_offset_(ringbuffer_offset),
+            : sequence_number_(sequence_number), ringbuffer_start_offset_(ringbuffer_start_offset),
+              ringbuffer_offset_(ringbuffer_offset), timestamp_slot_(timestamp_slot),
               mapped_batch_(std::move(mapped_batch))
         {
         }
 
         uint32_t sequence_number() { return sequence_number_; }
 
+        // Where the sequence's commands begin in the ringbuffer.
+        uint32_t ringbuffer_start_offset() { return ringbuffer_start_offset_; }
+
+        // Where the sequence's commands end in the ringbuffer.
         uint32_t ringbuffer_offset() { return ringbuffer_offset_; }
 
+        // The hardware status page slot of the batch's gpu timestamps, or kNoTimestampSlot.
+        uint32_t timestamp_slot() { return timestamp_slot_; }
+
         std::weak_ptr<MsdIntelContext> GetContext() { return mapped_batch_->GetContext(); }
 
         MappedBatch* mapped_batch() { return mapped_batch_.get(); }
 
+        std::unique_ptr<MappedBatch> release_mapped_batch() { return std::move(mapped_batch_); }
+
         InflightCommandSequence(InflightCommandSequence&& seq)
         {
             sequence_number_ = seq.sequence_number_;
+            ringbuffer_start_offset_ = seq.ringbuffer_start_offset_;
             ringbuffer_offset_ = seq.ringbuffer_offset_;
+            timestamp_slot_ = seq.timestamp_slot_;
             mapped_batch_ = std::move(seq.mapped_batch_);
         }
 
     private:
         uint32_t sequence_number_;
+        uint32_t ringbuffer_start_offset_;
         uint32_t ringbuffer_offset_;
+        uint32_t timestamp_slot_;
         std::unique_ptr<MappedBatch> mapped_batch_;
     };
 
+    static constexpr uint32_t kNoTimestampSlot = ~0u;
+
     std::unique_ptr<Scheduler> scheduler_;
+    // Outlives batches, which may unregister semaphores when destroyed.
+    CompletionSignaler completion_signaler_;
     std::queue<InflightCommandSequence> inflight_command_sequences_;
+    RetireQueue retire_queue_;
+    std::shared_ptr<GpuMapping> render_init_batch_mapping_;
+    std::vector<std::unique_ptr<MappedBatch>> replay_batches_;
+    uint32_t next_timestamp_slot_ = 0;
+    // Set when the last ExecBatch left its flushes to the context's next batch.
+    bool next_batch_flushes_pending_ = false;
 
     friend class TestEngineCommandStreamer;
 };
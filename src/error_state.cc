@@ -0,0 +1,98 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "error_state.h"
+#include <algorithm>
+
+constexpr uint32_t ErrorState::kMagic;
+constexpr uint32_t ErrorState::kVersion;
+constexpr uint32_t ErrorState::kHeaderDwords;
+constexpr uint32_t ErrorState::kSectionHeaderDwords;
+constexpr uint32_t ErrorState::kRingbufferFieldDwords;
+constexpr uint32_t ErrorState::kBatchFieldDwords;
+constexpr uint32_t ErrorState::kMappingDwords;
+
+namespace {
+constexpr size_t kNoSection = ~static_cast<size_t>(0);
+} // namespace
+
+ErrorStateWriter::ErrorStateWriter(uint32_t capacity_bytes)
+    : capacity_dwords_(std::max(capacity_bytes / static_cast<uint32_t>(sizeof(uint32_t)),
+                                ErrorState::kHeaderDwords)),
+      section_start_(kNoSection)
+{
+    // Reserved up front so capturing never reallocates.
+    dwords_.reserve(capacity_dwords_);
+}
+
+void ErrorStateWriter::Begin(uint32_t device_id, ErrorState::Reason reason,
+                             uint32_t last_completed_sequence, uint32_t last_submitted_sequence)
+{
+    dwords_.clear();
+    dwords_.push_back(ErrorState::kMagic);
+    dwords_.push_back(ErrorState::kVersion);
+    dwords_.push_back(device_id);
+    dwords_.push_back(reason);
+    dwords_.push_back(0);
+    dwords_.push_back(last_completed_sequence);
+    dwords_.push_back(last_submitted_sequence);
+    dwords_.push_back(++generation_);
+    section_start_ = kNoSection;
+}
+
+void ErrorStateWriter::BeginSection(ErrorState::SectionType type)
+{
+    if (complete())
+        return;
+    if (dwords_.empty() || capacity_dwords_ - dwords_.size() < ErrorState::kSectionHeaderDwords) {
+        if (!dwords_.empty())
+            dwords_[ErrorState::kHeaderFlags] |= ErrorState::kFlagTruncated;
+        section_start_ = kNoSection;
+        return;
+    }
+    section_start_ = dwords_.size();
+    dwords_.push_back(type);
+    dwords_.push_back(0);
+}
+
+bool ErrorStateWriter::Write32(uint32_t dword)
+{
+    if (section_start_ == kNoSection)
+        return false;
+    if (dwords_.size() == capacity_dwords_) {
+        dwords_[ErrorState::kHeaderFlags] |= ErrorState::kFlagTruncated;
+        return false;
+    }
+    dwords_.push_back(dword);
+    return true;
+}
+
+uint32_t ErrorStateWriter::WriteDwords(const uint32_t* src, uint32_t dword_count)
+{
+    if (section_start_ == kNoSection)
+        return 0;
+    uint32_t count =
+        std::min(dword_count, static_cast<uint32_t>(capacity_dwords_ - dwords_.size()));
+    if (count < dword_count)
+        dwords_[ErrorState::kHeaderFlags] |= ErrorState::kFlagTruncated;
+    dwords_.insert(dwords_.end(), src, src + count);
+    return count;
+}
+
+void ErrorStateWriter::EndSection()
+{
+    if (section_start_ == kNoSection)
+        return;
+    dwords_[section_start_ + 1] =
+        dwords_.size() - section_start_ - ErrorState::kSectionHeaderDwords;
+    section_start_ = kNoSection;
+}
+
+void ErrorStateWriter::Complete()
+{
+    if (dwords_.empty())
+        return;
+    EndSection();
+    dwords_[ErrorState::kHeaderFlags] |= ErrorState::kFlagComplete;
+}
@@ -0,0 +1,106 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef ERROR_STATE_H
+#define ERROR_STATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// An error state is a binary snapshot of the gpu taken when a hang or fault is detected, in
+// little endian dwords:
+//   header: kMagic, kVersion, device id, reason, flags, last completed sequence number,
+//           last submitted sequence number, generation
+//   sections: type, payload dword count, payload
+// Payloads by section type; 64 bit values are stored low dword first:
+//   kRegisters: (offset, value) pairs
+//   kRingbuffer: context id (64), gpu address (64), size, head, tail, then the ring contents
+//                from head up to tail
+//   kBatch: sequence number, context id (64), gpu address (64), length in bytes, then the batch
+//           contents
+//   kMapping: sequence number of the batch using it, buffer id (64), gpu address (64),
+//             offset (64), length (64)
+//   kStatusPage: the hardware status page
+// Contents that don't fit are cut short and kFlagTruncated is set. kFlagComplete is set once
+// nothing more will be added. The generation counts the error states captured since the driver
+// started. This header has no dependencies so host tools can read error states.
+class ErrorState {
+public:
+    static constexpr uint32_t kMagic = 0x54535245; // "ERST"
+    static constexpr uint32_t kVersion = 2;
+    static constexpr uint32_t kHeaderDwords = 8;
+    static constexpr uint32_t kSectionHeaderDwords = 2;
+
+    // Dword indices of the header fields.
+    enum HeaderField {
+        kHeaderMagic,
+        kHeaderVersion,
+        kHeaderDeviceId,
+        kHeaderReason,
+        kHeaderFlags,
+        kHeaderLastCompletedSequence,
+        kHeaderLastSubmittedSequence,
+        kHeaderGeneration,
+    };
+
+    enum Reason { kReasonHang = 1, kReasonFault = 2 };
+
+    enum Flags { kFlagTruncated = 1, kFlagComplete = 2 };
+
+    enum SectionType {
+        kRegisters = 1,
+        kRingbuffer = 2,
+        kBatch = 3,
+        kMapping = 4,
+        kStatusPage = 5,
+    };
+
+    // Dwords before the contents of kRingbuffer and kBatch sections.
+    static constexpr uint32_t kRingbufferFieldDwords = 7;
+    static constexpr uint32_t kBatchFieldDwords = 6;
+    static constexpr uint32_t kMappingDwords = 9;
+};
+
+// Writes error states into a buffer allocated up front, so capturing one doesn't allocate.
+// Not thread safe.
+class ErrorStateWriter {
+public:
+    ErrorStateWriter(uint32_t capacity_bytes);
+
+    // Discards any previous error state and writes the header of a new one, of the next
+    // generation.
+    void Begin(uint32_t device_id, ErrorState::Reason reason, uint32_t last_completed_sequence,
+               uint32_t last_submitted_sequence);
+
+    void BeginSection(ErrorState::SectionType type);
+    // Returns false, and marks the error state truncated, once the buffer is full.
+    bool Write32(uint32_t dword);
+    bool Write64(uint64_t val) { return Write32(val) && Write32(val >> 32); }
+    // Writes up to |dword_count| dwords from |src|; returns the number written.
+    uint32_t WriteDwords(const uint32_t* src, uint32_t dword_count);
+    void EndSection();
+
+    // Marks the error state complete; it takes no more sections.
+    void Complete();
+
+    // Discards the error state.
+    void Clear() { dwords_.clear(); }
+
+    bool empty() { return dwords_.empty(); }
+    bool complete()
+    {
+        return !dwords_.empty() && (dwords_[ErrorState::kHeaderFlags] & ErrorState::kFlagComplete);
+    }
+    uint32_t size_bytes() { return dwords_.size() * sizeof(uint32_t); }
+    const uint32_t* dwords() { return dwords_.data(); }
+
+private:
+    std::vector<uint32_t> dwords_;
+    uint32_t capacity_dwords_;
+    size_t section_start_;
+    uint32_t generation_ = 0;
+};
+
+#endif // ERROR_STATE_H
@@ -0,0 +1,74 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "flight_recorder.h"
+#include <algorithm>
+
+constexpr uint32_t FlightRecorder::kCapacity;
+
+FlightRecorder* FlightRecorder::Get()
+{
+    static FlightRecorder recorder;
+    return &recorder;
+}
+
+std::vector<FlightRecorder::Event> FlightRecorder::GetEvents(uint32_t count)
+{
+    uint64_t end = next_index_.load(std::memory_order_acquire);
+    uint64_t begin = end - std::min<uint64_t>({count, kCapacity, end});
+
+    std::vector<Event> events;
+    events.reserve(end - begin);
+    for (uint64_t index = begin; index < end; index++) {
+        Slot& slot = slots_[index & (kCapacity - 1)];
+
+        uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence != index + 1)
+            continue;
+
+        Event event;
+        event.index = index;
+        event.timestamp_ns = slot.timestamp_ns.load(std::memory_order_relaxed);
+        uint64_t header = slot.header.load(std::memory_order_relaxed);
+        event.type = static_cast<EventType>(header >> 32);
+        event.id = static_cast<uint32_t>(header);
+        event.data = slot.data.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != sequence)
+            continue;
+
+        events.push_back(event);
+    }
+    return events;
+}
+
+const char* FlightRecorder::EventName(EventType type)
+{
+    switch (type) {
+        case kEnqueue:
+            return "enqueue";
+        case kSchedule:
+            return "schedule";
+        case kExeclistSubmit:
+            return "execlist submit";
+        case kLiteRestore:
+            return "lite restore";
+        case kInterrupt:
+            return "interrupt";
+        case kRetire:
+            return "retire";
+        case kReset:
+            return "reset";
+        case kHang:
+            return "hang";
+        case kFlip:
+            return "flip";
+        case kMappingCreate:
+            return "mapping create";
+        case kMappingDestroy:
+            return "mapping destroy";
+    }
+    return "unknown";
+}
@@ -0,0 +1,93 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+// A fixed size ring of the most recent driver events, decoded into hang dumps. Any thread may
+// record; recording is lock free and doesn't allocate, and the oldest events are overwritten.
+class FlightRecorder {
+public:
+    // The meaning of an event's id and data depends on its type.
+    enum EventType : uint8_t {
+        // id: client id, data: context
+        kEnqueue = 1,
+        // id: batches still pending on the context, data: context
+        kSchedule,
+        // id: sequence number, data: context
+        kExeclistSubmit,
+        // id: sequence number, data: context
+        kLiteRestore,
+        // id: sequence number read from the hardware status page
+        kInterrupt,
+        // id: sequence number, data: context
+        kRetire,
+        // id: last completed sequence number, data: active head pointer
+        kReset,
+        // id: last submitted sequence number
+        kHang,
+        // id: buffer id, data: gpu address
+        kFlip,
+        // id: buffer id, data: gpu address
+        kMappingCreate,
+        // id: buffer id, data: gpu address
+        kMappingDestroy,
+    };
+
+    struct Event {
+        // Counts all events ever recorded.
+        uint64_t index;
+        uint64_t timestamp_ns;
+        EventType type;
+        uint32_t id;
+        uint64_t data;
+    };
+
+    // Must be a power of 2.
+    static constexpr uint32_t kCapacity = 1024;
+
+    // The recorder shared by all the driver's threads.
+    static FlightRecorder* Get();
+
+    void Record(EventType type, uint32_t id, uint64_t data = 0)
+    {
+        uint64_t index = next_index_.fetch_add(1, std::memory_order_relaxed);
+        Slot& slot = slots_[index & (kCapacity - 1)];
+
+        // Readers skip the slot while it's being written.
+        slot.sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.timestamp_ns.store(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                    std::chrono::steady_clock::now().time_since_epoch())
+                                    .count(),
+                                std::memory_order_relaxed);
+        slot.header.store(static_cast<uint64_t>(type) << 32 | id, std::memory_order_relaxed);
+        slot.data.store(data, std::memory_order_relaxed);
+        slot.sequence.store(index + 1, std::memory_order_release);
+    }
+
+    // Returns up to |count| of the most recent events, oldest first. Events overwritten while
+    // being read are left out.
+    std::vector<Event> GetEvents(uint32_t count);
+
+    static const char* EventName(EventType type);
+
+private:
+    struct Slot {
+        // The event's index plus one, or 0 if the slot is empty or being written.
+        std::atomic_uint64_t sequence{};
+        std::atomic_uint64_t timestamp_ns{};
+        std::atomic_uint64_t header{};
+        std::atomic_uint64_t data{};
+    };
+
+    std::atomic_uint64_t next_index_{};
+    Slot slots_[kCapacity];
+};
+
+#endif // FLIGHT_RECORDER_H
@@ -6,9 +6,10 @@
 #define FORCEWAKE_H
 
 #include "magma_util/macros.h"
-#include "magma_util/sleep.h"
 #include "register_io.h"
 #include "registers.h"
+#include <chrono>
+#include <thread>
 
 class ForceWake {
 public:
@@ -36,15 +37,21 @@ public:
     }
 
 private:
+    // The acknowledgement usually arrives within tens of microseconds, so poll finely rather
+    // than sleeping in millisecond steps.
     static void wait(RegisterIo* reg_io, registers::ForceWake::Domain domain, bool set)
     {
+        constexpr auto kPollInterval = std::chrono::microseconds(10);
+        auto deadline =
+            std::chrono::steady_clock::now() + std::chrono::microseconds(kRetryMaxMs * 1000);
         uint32_t status;
-        for (unsigned int ms = 0; ms < kRetryMaxMs; ms++) {
+        while (true) {
             status = registers::ForceWake::read_status(reg_io, domain);
             if (((status >> kThreadShift) & 1) == (set ? 1 : 0))
                 return;
-            magma::msleep(1);
-            DLOG("forcewake wait retrying");
+            if (std::chrono::steady_clock::now() >= deadline)
+                break;
+            std::this_thread::sleep_for(kPollInterval);
         }
         DLOG("timed out waiting for forcewake, status 0x%x", status);
     }
@@ -0,0 +1,180 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "forcewake_manager.h"
+#include "forcewake.h"
+#include "magma_util/macros.h"
+#include <algorithm>
+
+struct RegisterRange {
+    uint32_t start;
+    uint32_t end; // exclusive
+};
+
+// The whole GT register range is in one domain; the forcewake request register itself is
+// excluded so the handshake doesn't recurse.
+static const std::vector<RegisterRange> kGen8Ranges = {
+    {0x0, registers::ForceWake::kOffset}, {registers::ForceWake::kOffset + 4, 0x40000},
+};
+
+// Render power well ranges, from the Skylake register spec.
+static const std::vector<RegisterRange> kGen9RenderRanges = {
+    {0x2000, 0x2700}, {0x3000, 0x4000}, {0x5200, 0x8000}, {0x8140, 0x8160}, {0x8300, 0x8500},
+    {0x8C00, 0x8D00}, {0x9400, 0x9800}, {0xB000, 0xB480}, {0xE000, 0xE900}, {0x24400, 0x24800},
+};
+
+// GT power well ranges: the rest of 0x0-0x40000 outside the render and media wells, less
+// 0xB00-0x2000 which needs no wake. The forcewake request registers are excluded. The driver
+// doesn't access the media well.
+static const std::vector<RegisterRange> kGen9GtRanges = {
+    {0x0, 0xB00},       {0x2700, 0x3000},   {0x4000, 0x5200},   {0x8000, 0x8130},
+    {0x8160, 0x8300},   {0x8500, 0x8800},   {0x8A00, 0x8C00},   {0x8D00, 0x9400},
+    {0x9800, registers::ForceWake::kOffset},
+    {registers::ForceWake::kOffset + 4, registers::ForceWake::kRenderOffset},
+    {registers::ForceWake::kRenderOffset + 4, 0xB000},
+    {0xB480, 0xD000},   {0xD800, 0xE000},   {0xE900, 0x12000},  {0x14000, 0x1A000},
+    {0x1EA00, 0x24400}, {0x24800, 0x30000},
+};
+
+std::unique_ptr<ForceWakeManager>
+ForceWakeManager::Create(RegisterIo* register_io,
+                         const std::vector<registers::ForceWake::Domain>& domains,
+                         uint32_t release_delay_us)
+{
+    DASSERT(domains.size() <= 32);
+
+    std::vector<Range> ranges;
+    std::vector<DomainState> domain_states;
+    for (uint32_t i = 0; i < domains.size(); i++) {
+        const std::vector<RegisterRange>* domain_ranges = nullptr;
+        switch (domains[i]) {
+            case registers::ForceWake::GEN8:
+                domain_ranges = &kGen8Ranges;
+                break;
+            case registers::ForceWake::GEN9_RENDER:
+                domain_ranges = &kGen9RenderRanges;
+                break;
+            case registers::ForceWake::GEN9_GT:
+                domain_ranges = &kGen9GtRanges;
+                break;
+        }
+        DASSERT(domain_ranges);
+
+        // Each domain is identified by its index.
+        for (auto& range : *domain_ranges) {
+            ranges.push_back({range.start, range.end, 1u << i});
+        }
+        domain_states.push_back({domains[i], 0, false, time_point(), time_point()});
+    }
+
+    return std::unique_ptr<ForceWakeManager>(new ForceWakeManager(
+        register_io, std::move(domain_states), std::move(ranges), release_delay_us));
+}
+
+uint32_t ForceWakeManager::LookupDomains(uint32_t offset)
+{
+    for (auto& range : ranges_) {
+        if (offset >= range.start && offset < range.end)
+            return range.domains;
+    }
+    return 0;
+}
+
+uint32_t ForceWakeManager::Acquire(uint32_t offset)
+{
+    uint32_t domains = LookupDomains(offset);
+    if (!domains)
+        return 0;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (uint32_t i = 0; i < domains_.size(); i++) {
+        if ((domains & (1u << i)) == 0)
+            continue;
+        DomainState& state = domains_[i];
+        if (state.ref_count++ == 0 && !state.awake)
+            WakeLocked(&state, std::chrono::steady_clock::now());
+    }
+    return domains;
+}
+
+void ForceWakeManager::Release(uint32_t domains)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    time_point now = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < domains_.size(); i++) {
+        if ((domains & (1u << i)) == 0)
+            continue;
+        DomainState& state = domains_[i];
+        DASSERT(state.ref_count > 0);
+        if (--state.ref_count == 0) {
+            state.idle_time = now;
+            if (release_delay_.count() == 0)
+                SleepLocked(&state, now);
+        }
+    }
+}
+
+void ForceWakeManager::ReleaseIdle(time_point now)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& state : domains_) {
+        if (state.awake && state.ref_count == 0 && now - state.idle_time >= release_delay_)
+            SleepLocked(&state, now);
+    }
+}
+
+bool ForceWakeManager::release_pending()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& state : domains_) {
+        if (state.awake && state.ref_count == 0)
+            return true;
+    }
+    return false;
+}
+
+void ForceWakeManager::set_release_delay_us(uint32_t release_delay_us)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    release_delay_ = std::chrono::microseconds(release_delay_us);
+}
+
+ForceWakeManager::Stats ForceWakeManager::stats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats = stats_;
+    time_point now = std::chrono::steady_clock::now();
+    for (auto& state : domains_) {
+        if (state.awake)
+            stats.awake_us +=
+                std::chrono::duration_cast<std::chrono::microseconds>(now - state.wake_time)
+                    .count();
+    }
+    return stats;
+}
+
+void ForceWakeManager::WakeLocked(DomainState* state, time_point now)
+{
+    ForceWake::request(register_io_, state->domain);
+    state->awake = true;
+    state->wake_time = now;
+    stats_.acquire_count++;
+}
+
+void ForceWakeManager::SleepLocked(DomainState* state, time_point now)
+{
+    time_point handshake_start = std::chrono::steady_clock::now();
+    ForceWake::release(register_io_, state->domain);
+    auto handshake = std::chrono::steady_clock::now() - handshake_start;
+    state->awake = false;
+    stats_.release_count++;
+
+    uint64_t latency_us =
+        std::chrono::duration_cast<std::chrono::microseconds>(now - state->idle_time + handshake)
+            .count();
+    stats_.total_release_latency_us += latency_us;
+    stats_.max_release_latency_us = std::max(stats_.max_release_latency_us, latency_us);
+    stats_.awake_us +=
+        std::chrono::duration_cast<std::chrono::microseconds>(now - state->wake_time).count();
+}
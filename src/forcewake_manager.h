@@ -0,0 +1,95 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef FORCEWAKE_MANAGER_H
+#define FORCEWAKE_MANAGER_H
+
+#include "register_io.h"
+#include "registers.h"
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Reference counts forcewake per power domain. Installed into a RegisterIo, a reference is held
+// around each access to a register range that needs the domain awake. A domain isn't released
+// as soon as its last reference is dropped but only once it has been unreferenced for the
+// release delay, by ReleaseIdle, so bursts of accesses don't pay for a wake handshake each.
+// Thread safe.
+class ForceWakeManager : public RegisterIo::ForceWakeHook {
+public:
+    using time_point = std::chrono::steady_clock::time_point;
+
+    struct Stats {
+        // Domain wakes and releases requested from the hardware.
+        uint64_t acquire_count;
+        uint64_t release_count;
+        // From a domain's last reference being dropped to the hardware acknowledging its
+        // release.
+        uint64_t total_release_latency_us;
+        uint64_t max_release_latency_us;
+        // Time spent with a domain awake, including any current wake.
+        uint64_t awake_us;
+    };
+
+    // The register io must own the returned manager, via InstallForceWakeHook. |domains| are
+    // all of the device's domains; register ranges in none of them are accessed without a wake.
+    static std::unique_ptr<ForceWakeManager>
+    Create(RegisterIo* register_io, const std::vector<registers::ForceWake::Domain>& domains,
+           uint32_t release_delay_us);
+
+    // RegisterIo::ForceWakeHook
+    uint32_t Acquire(uint32_t offset) override;
+    void Release(uint32_t domains) override;
+
+    // Releases domains that have been unreferenced for at least the release delay.
+    void ReleaseIdle(time_point now);
+
+    // True if a domain is awake without references, so a later ReleaseIdle has work to do.
+    bool release_pending();
+
+    void set_release_delay_us(uint32_t release_delay_us);
+
+    Stats stats();
+
+private:
+    struct Range {
+        uint32_t start;
+        uint32_t end; // exclusive
+        uint32_t domains;
+    };
+
+    struct DomainState {
+        registers::ForceWake::Domain domain;
+        uint32_t ref_count;
+        bool awake;
+        time_point wake_time;
+        time_point idle_time;
+    };
+
+    ForceWakeManager(RegisterIo* register_io, std::vector<DomainState> domains,
+                     std::vector<Range> ranges, uint32_t release_delay_us)
+        : register_io_(register_io), ranges_(std::move(ranges)), domains_(std::move(domains)),
+          release_delay_(release_delay_us)
+    {
+    }
+
+    uint32_t LookupDomains(uint32_t offset);
+
+    void WakeLocked(DomainState* state, time_point now);
+    void SleepLocked(DomainState* state, time_point now);
+
+    RegisterIo* register_io_;
+    // Immutable, so lookups don't take the lock.
+    const std::vector<Range> ranges_;
+
+    std::mutex mutex_;
+    std::vector<DomainState> domains_;
+    std::chrono::microseconds release_delay_;
+    Stats stats_{};
+
+    friend class TestForceWakeManager;
+};
+
+#endif // FORCEWAKE_MANAGER_H
@@ -0,0 +1,60 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "frequency_governor.h"
+#include "registers.h"
+#include <algorithm>
+
+constexpr uint32_t FrequencyGovernor::kEvaluationPeriodMs;
+
+std::unique_ptr<FrequencyGovernor> FrequencyGovernor::Create(RegisterIo* register_io)
+{
+    uint32_t rp0_mhz = registers::RenderPerformanceStateCapability::read_rp0_frequency(register_io);
+    uint32_t rp1_mhz = registers::RenderPerformanceStateCapability::read_rp1_frequency(register_io);
+    uint32_t rpn_mhz = registers::RenderPerformanceStateCapability::read_rpn_frequency(register_io);
+    DLOG("frequency capabilities: RPn %u MHz RP1 %u MHz RP0 %u MHz", rpn_mhz, rp1_mhz, rp0_mhz);
+
+    // Keep the levels ordered even if the fused values aren't.
+    rp1_mhz = std::min(rp1_mhz, rp0_mhz);
+    rpn_mhz = std::min(rpn_mhz, rp1_mhz);
+
+    return std::unique_ptr<FrequencyGovernor>(
+        new FrequencyGovernor(register_io, rpn_mhz, rp1_mhz, rp0_mhz));
+}
+
+void FrequencyGovernor::Sample(bool busy, bool boost, time_point now)
+{
+    if (!sampling_) {
+        sampling_ = true;
+        interval_start_ = now;
+    } else if (last_busy_) {
+        interval_busy_ += now - last_sample_time_;
+    }
+    last_busy_ = busy;
+    last_sample_time_ = now;
+
+    auto elapsed = now - interval_start_;
+    if (elapsed >= std::chrono::milliseconds(kEvaluationPeriodMs)) {
+        uint64_t busy_percent = interval_busy_ * 100 / elapsed;
+        if (busy_percent > kStepUpBusyPercent && level_ < kLevelCount - 1) {
+            level_++;
+        } else if (busy_percent < kStepDownBusyPercent && level_ > 0) {
+            level_--;
+        }
+        interval_start_ = now;
+        interval_busy_ = std::chrono::steady_clock::duration::zero();
+    }
+
+    Request(boost || boosted() ? max_mhz() : rp_mhz_[level_]);
+}
+
+void FrequencyGovernor::Request(uint32_t mhz)
+{
+    if (mhz == requested_mhz_)
+        return;
+    DLOG("requesting frequency %u MHz", mhz);
+    registers::RenderPerformanceNormalFrequencyRequest::write_frequency_request_gen9(register_io_,
+                                                                                     mhz);
+    requested_mhz_ = mhz;
+}
@@ -0,0 +1,79 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef FREQUENCY_GOVERNOR_H
+#define FREQUENCY_GOVERNOR_H
+
+#include "magma_util/macros.h"
+#include "register_io.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+// Chooses the render frequency request from how busy the engine has been. Busyness is sampled
+// over evaluation intervals; the request steps between RPn, RP1 and RP0 when an interval is
+// mostly busy or mostly idle, and the request register is written only when it changes.
+// While boosted the request is held at RP0.
+class FrequencyGovernor {
+public:
+    using time_point = std::chrono::steady_clock::time_point;
+
+    static constexpr uint32_t kEvaluationPeriodMs = 50;
+    static constexpr uint32_t kStepUpBusyPercent = 85;
+    static constexpr uint32_t kStepDownBusyPercent = 30;
+
+    // Reads the frequency capabilities; nothing is written until the first Sample.
+    static std::unique_ptr<FrequencyGovernor> Create(RegisterIo* register_io);
+
+    // Thread safe. Holds the request at RP0 until the matching EndBoost.
+    void BeginBoost() { boost_count_++; }
+    void EndBoost()
+    {
+        DASSERT(boost_count_ > 0);
+        boost_count_--;
+    }
+
+    // Must be called from the device thread. |busy| is whether the engine has had work
+    // outstanding since the previous sample; |boost| boosts for this sample only.
+    void Sample(bool busy, bool boost, time_point now);
+
+    // True if the governor has nothing left to do until the engine becomes busy.
+    bool idle() { return !boosted() && level_ == 0 && requested_mhz_ == rp_mhz_[0]; }
+
+    bool boosted() { return boost_count_ > 0; }
+
+    // The frequency last written to the request register, or 0 if none has been.
+    uint32_t requested_mhz() { return requested_mhz_; }
+
+    uint32_t min_mhz() { return rp_mhz_[0]; }
+    uint32_t max_mhz() { return rp_mhz_[kLevelCount - 1]; }
+
+private:
+    static constexpr uint32_t kLevelCount = 3;
+
+    FrequencyGovernor(RegisterIo* register_io, uint32_t rpn_mhz, uint32_t rp1_mhz,
+                      uint32_t rp0_mhz)
+        : register_io_(register_io), rp_mhz_{rpn_mhz, rp1_mhz, rp0_mhz}
+    {
+    }
+
+    void Request(uint32_t mhz);
+
+    RegisterIo* register_io_;
+    // Indexed by level: RPn, RP1, RP0.
+    uint32_t rp_mhz_[kLevelCount];
+    uint32_t level_ = 0;
+    uint32_t requested_mhz_ = 0;
+    std::atomic_uint boost_count_{0};
+
+    bool sampling_ = false;
+    bool last_busy_ = false;
+    time_point last_sample_time_;
+    time_point interval_start_;
+    std::chrono::steady_clock::duration interval_busy_{};
+
+    friend class TestFrequencyGovernor;
+};
+
+#endif // FREQUENCY_GOVERNOR_H
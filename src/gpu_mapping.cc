@@ -4,6 +4,7 @@
 
 #include "gpu_mapping.h"
 #include "address_space.h"
+#include "flight_recorder.h"
 #include "msd_intel_buffer.h"
 
 GpuMapping::GpuMapping(std::shared_ptr<AddressSpace> address_space,
@@ -12,10 +13,15 @@ GpuMapping::GpuMapping(std::shared_ptr<AddressSpace> address_space,
     : address_space_(address_space), buffer_(buffer), offset_(offset), length_(length),
       gpu_addr_(gpu_addr)
 {
+    FlightRecorder::Get()->Record(FlightRecorder::kMappingCreate,
+                                  buffer_->platform_buffer()->id(), gpu_addr_);
 }
 
 GpuMapping::~GpuMapping()
 {
+    FlightRecorder::Get()->Record(FlightRecorder::kMappingDestroy,
+                                  buffer_->platform_buffer()->id(), gpu_addr_);
+
     if (!buffer_->platform_buffer()->UnpinPages(offset_ / PAGE_SIZE, length_ / PAGE_SIZE))
         DLOG("failed to unpin pages");
 
@@ -8,35 +8,83 @@
 #include "magma_util/dlog.h"
 #include "magma_util/macros.h"
 #include "sequencer.h"
+#include <chrono>
+#include <deque>
 
+// Tracks submitted and completed sequence numbers and detects hangs: the engine is considered
+// hung when neither the completed sequence number nor the active head pointer has advanced
+// within the hang budget of the oldest incomplete sequence.
 class GpuProgress {
 public:
-    void Submitted(uint32_t sequence_number)
+    using time_point = std::chrono::steady_clock::time_point;
+
+    void Submitted(uint32_t sequence_number, uint32_t hang_budget_ms, time_point time)
     {
         DASSERT(sequence_number != Sequencer::kInvalidSequenceNumber);
         if (sequence_number != last_submitted_sequence_number_) {
             DLOG("Submitted 0x%x", sequence_number);
             DASSERT(sequence_number > last_submitted_sequence_number_);
+            // The budget of work submitted to an idle engine starts now.
+            if (!work_outstanding())
+                last_progress_time_ = time;
             last_submitted_sequence_number_ = sequence_number;
+            inflight_.push_back({sequence_number, hang_budget_ms});
         }
     }
 
-    void Completed(uint32_t sequence_number)
+    void Completed(uint32_t sequence_number, time_point time)
     {
         DASSERT(sequence_number != Sequencer::kInvalidSequenceNumber);
         if (sequence_number != last_completed_sequence_number_) {
             DLOG("Completed 0x%x", sequence_number);
             DASSERT(sequence_number > last_completed_sequence_number_);
             last_completed_sequence_number_ = sequence_number;
+            last_progress_time_ = time;
         } else {
             DLOG("completed 0x%x AGAIN\n", sequence_number);
         }
 
+        while (!inflight_.empty() && inflight_.front().sequence_number <= sequence_number) {
+            inflight_.pop_front();
+        }
+
         // Handle initial condition - init batch isn't submitted as a command buffer.
         if (last_submitted_sequence_number_ == Sequencer::kInvalidSequenceNumber)
             last_submitted_sequence_number_ = last_completed_sequence_number_;
     }
 
+    // Samples the engine's completed |sequence_number| and |active_head| pointer; returns true if
+    // the engine is hung.
+    bool CheckForHang(uint32_t sequence_number, uint64_t active_head, time_point time)
+    {
+        if (sequence_number != Sequencer::kInvalidSequenceNumber &&
+            sequence_number > last_completed_sequence_number_)
+            Completed(sequence_number, time);
+
+        if (!work_outstanding() || inflight_.empty())
+            return false;
+
+        if (active_head != last_active_head_) {
+            last_active_head_ = active_head;
+            last_progress_time_ = time;
+            return false;
+        }
+
+        return time - last_progress_time_ >
+               std::chrono::milliseconds(inflight_.front().hang_budget_ms);
+    }
+
+    // After an engine reset: sequences up to |sequence_number| completed, and the rest were
+    // dropped or will be submitted again, with budgets that start from their resubmission.
+    void Reset(uint32_t sequence_number)
+    {
+        DLOG("Reset 0x%x", sequence_number);
+        last_submitted_sequence_number_ = sequence_number;
+        last_completed_sequence_number_ = sequence_number;
+        last_active_head_ = 0;
+        inflight_.clear();
+    }
+
     bool work_outstanding()
     {
         return last_submitted_sequence_number_ > last_completed_sequence_number_;
@@ -45,8 +93,18 @@ public:
     uint32_t last_submitted_sequence_number() { return last_submitted_sequence_number_; }
 
 private:
+    struct Sequence {
+        uint32_t sequence_number;
+        uint32_t hang_budget_ms;
+    };
+
     uint32_t last_submitted_sequence_number_ = Sequencer::kInvalidSequenceNumber;
     uint32_t last_completed_sequence_number_ = Sequencer::kInvalidSequenceNumber;
+    uint64_t last_active_head_ = 0;
+    time_point last_progress_time_;
+    std::deque<Sequence> inflight_;
+
+    friend class TestGpuProgress;
 };
 
 #endif // GPU_PROGRESS_H
@@ -17,7 +17,10 @@ static inline gen_pte_t gen_pte_encode(uint64_t bus_addr, bool valid)
     return pte;
 }
 
-Gtt::Gtt(std::shared_ptr<GpuMappingCache> cache) : AddressSpace(ADDRESS_SPACE_GGTT, cache) {}
+Gtt::Gtt(std::shared_ptr<GpuMappingCache> cache, BusMapper* bus_mapper)
+    : AddressSpace(ADDRESS_SPACE_GGTT, cache), bus_mapper_(bus_mapper)
+{
+}
 
 bool Gtt::Init(uint64_t gtt_size, magma::PlatformPciDevice* platform_device)
 {
@@ -73,8 +76,10 @@ bool Gtt::InitScratch()
     if (!scratch_->PinPages(0, 1))
         return DRETF(false, "PinPages failed");
 
-    if (!scratch_->MapPageRangeBus(0, 1, &scratch_bus_addr_))
-        return DRETF(false, "MapPageBus failed");
+    scratch_bus_mapping_ = bus_mapper_->MapPageRange(scratch_.get(), 0, 1);
+    if (!scratch_bus_mapping_)
+        return DRETF(false, "MapPageRange failed");
+    scratch_bus_addr_ = scratch_bus_mapping_->bus_addr()[0];
 
     return true;
 }
@@ -93,6 +98,7 @@ bool Gtt::Alloc(size_t size, uint8_t align_pow2, uint64_t* addr_out)
 bool Gtt::Free(uint64_t addr)
 {
     DASSERT(allocator_);
+    bus_mappings_.erase(addr);
     return allocator_->Free(addr);
 }
 
@@ -104,6 +110,7 @@ bool Gtt::Clear(uint64_t addr)
         return DRETF(false, "couldn't get size for addr");
     if (!Clear(addr, length))
         return DRETF(false, "clear failed");
+    bus_mappings_.erase(addr);
     return true;
 }
 
@@ -136,7 +143,7 @@ bool Gtt::Clear(uint64_t start, uint64_t length)
 }
 
 bool Gtt::Insert(uint64_t addr, magma::PlatformBuffer* buffer, uint64_t offset, uint64_t length,
-                 CachingType caching_type)
+                 CachingType caching_type, LruAge lru_age)
 {
     DLOG("InsertEntries addr 0x%lx", addr);
 
@@ -160,11 +167,11 @@ bool Gtt::Insert(uint64_t addr, magma::PlatformBuffer* buffer, uint64_t offset,
     uint64_t first_entry = addr >> PAGE_SHIFT;
     uint64_t pte_offset = pte_mmio_offset() + first_entry * sizeof(gen_pte_t);
 
-    std::vector<uint64_t> bus_addr_array;
-    bus_addr_array.resize(num_pages);
-
-    if (!buffer->MapPageRangeBus(start_page_index, num_pages, bus_addr_array.data()))
+    std::unique_ptr<BusMapping> bus_mapping =
+        bus_mapper_->MapPageRange(buffer, start_page_index, num_pages);
+    if (!bus_mapping)
         return DRETF(false, "failed obtaining bus addresses");
+    const std::vector<uint64_t>& bus_addr_array = bus_mapping->bus_addr();
 
     for (unsigned int i = 0; i < num_pages; i++) {
         auto pte = gen_pte_encode(bus_addr_array[i], true);
@@ -185,5 +192,7 @@ bool Gtt::Insert(uint64_t addr, magma::PlatformBuffer* buffer, uint64_t offset,
         }
     }
 
+    bus_mappings_[addr] = std::move(bus_mapping);
+
     return true;
 }
@@ -6,15 +6,17 @@
 #define GTT_H
 
 #include "address_space.h"
+#include "bus_mapping.h"
 #include "magma_util/address_space_allocator.h"
 #include "platform_buffer.h"
 #include "platform_pci_device.h"
 #include "register_io.h"
 #include <memory>
+#include <unordered_map>
 
 class Gtt : public AddressSpace {
 public:
-    Gtt(std::shared_ptr<GpuMappingCache> cache);
+    Gtt(std::shared_ptr<GpuMappingCache> cache, BusMapper* bus_mapper);
 
     uint64_t Size() const override { return size_; }
 
@@ -26,7 +28,7 @@ public:
 
     bool Clear(uint64_t addr) override;
     bool Insert(uint64_t addr, magma::PlatformBuffer* buffer, uint64_t offset, uint64_t length,
-                CachingType caching_type) override;
+                CachingType caching_type, LruAge lru_age) override;
 
 private:
     uint64_t pte_mmio_offset() { return mmio_->size() / 2; }
@@ -39,11 +41,15 @@ private:
     bool Clear(uint64_t start, uint64_t length);
 
 private:
+    BusMapper* bus_mapper_;
     std::unique_ptr<magma::PlatformMmio> mmio_;
     std::unique_ptr<magma::PlatformBuffer> scratch_;
+    std::unique_ptr<BusMapping> scratch_bus_mapping_;
     std::unique_ptr<magma::AddressSpaceAllocator> allocator_;
     uint64_t scratch_bus_addr_;
     uint64_t size_;
+    // The bus mappings of inserted pages, by gpu address; released when the entries are cleared.
+    std::unordered_map<uint64_t, std::unique_ptr<BusMapping>> bus_mappings_;
 
     friend class TestGtt;
 };
@@ -33,6 +33,34 @@ public:
 
     uint32_t read_sequence_number() { return read_general_purpose_offset(kSequenceNumberOffset); }
 
+    // Returns the start, or if |end| the end, gpu timestamp written into |slot|.
+    uint64_t read_timestamp(uint32_t slot, bool end)
+    {
+        uint32_t offset = timestamp_offset(slot, end);
+        return static_cast<uint64_t>(read_general_purpose_offset(offset + 4)) << 32 |
+               read_general_purpose_offset(offset);
+    }
+
+    void clear_timestamps(uint32_t slot)
+    {
+        for (uint32_t offset = timestamp_offset(slot, false);
+             offset < timestamp_offset(slot, false) + kTimestampSlotSize; offset += 4) {
+            write_general_purpose_offset(0, offset);
+        }
+    }
+
+    static uint32_t timestamp_offset(uint32_t slot, bool end)
+    {
+        DASSERT(slot < kTimestampSlotCount);
+        return kTimestampOffset + slot * kTimestampSlotSize + (end ? sizeof(uint64_t) : 0);
+    }
+
+    const uint32_t* cpu_addr()
+    {
+        return reinterpret_cast<uint32_t*>(
+            owner_->hardware_status_page_cpu_addr(engine_command_streamer_id_));
+    }
+
     uint32_t read_interrupt_status()
     {
         return reinterpret_cast<uint32_t*>(
@@ -43,6 +71,12 @@ public:
     // Render Logical Context Data - The Per-Process Hardware Status Page
     static constexpr uint32_t kSequenceNumberOffset = 0x20;
 
+    // Slots for the gpu timestamps taken at the start and end of a batch, filling the rest of
+    // the general purpose area; user batches wait for a free slot.
+    static constexpr uint32_t kTimestampOffset = 0x100;
+    static constexpr uint32_t kTimestampSlotSize = 2 * sizeof(uint64_t);
+    static constexpr uint32_t kTimestampSlotCount = (0x400 - kTimestampOffset) / kTimestampSlotSize;
+
 private:
     void write_general_purpose_offset(uint32_t val, uint32_t offset)
     {
@@ -82,6 +82,7 @@ public:
     static constexpr uint32_t kDcFlushEnableBit = 1 << 5;
     static constexpr uint32_t kIndirectStatePointersDisableBit = 1 << 9;
     static constexpr uint32_t kPostSyncWriteImmediateBit = 1 << 14;
+    static constexpr uint32_t kPostSyncWriteTimestampBits = 0x3 << 14;
     static constexpr uint32_t kGenericMediaStateClearBit = 1 << 16;
     static constexpr uint32_t kCommandStreamerStallEnableBit = 1 << 20;
     static constexpr uint32_t kAddressSpaceGlobalGttBit = 1 << 24;
@@ -100,6 +101,20 @@ public:
         writer->write_dword(sequence_number);
         writer->write_dword(0);
     }
+
+    // Writes the engine's 64 bit timestamp to |gpu_addr|, which must be qword aligned.
+    static void write_timestamp(InstructionWriter* writer, uint64_t gpu_addr, uint32_t flags)
+    {
+        DASSERT((gpu_addr & 0x7) == 0);
+        DASSERT((flags & ~kCommandStreamerStallEnableBit) == 0);
+        writer->write_dword(kCommandType | kCommandSubType | k3dCommandOpcode |
+                            k3dCommandSubOpcode | (kDwordCount - 2));
+        writer->write_dword(flags | kPostSyncWriteTimestampBits | kAddressSpaceGlobalGttBit);
+        writer->write_dword(magma::lower_32_bits(gpu_addr));
+        writer->write_dword(magma::upper_32_bits(gpu_addr));
+        writer->write_dword(0);
+        writer->write_dword(0);
+    }
 };
 
 // intel-gfx-prm-osrc-skl-vol02a-commandreference-instructions.pdf pp.1010
@@ -111,4 +126,24 @@ public:
     static void write(InstructionWriter* writer) { writer->write_dword(kCommandType); }
 };
 
+// intel-gfx-prm-osrc-bdw-vol02a-commandreference-instructions.pdf pp.868
+class MiSemaphoreWait {
+public:
+    static constexpr uint32_t kDwordCount = 4;
+    static constexpr uint32_t kCommandType = 0x1C << 23;
+    static constexpr uint32_t kMemoryTypeGlobalGttBit = 1 << 22;
+    static constexpr uint32_t kWaitModePollingBit = 1 << 15;
+    static constexpr uint32_t kCompareSadGreaterThanOrEqualSdd = 1 << 12;
+
+    // Stalls the command streamer until the dword at |gpu_addr| (global gtt) is >= |value|.
+    static void write(InstructionWriter* writer, uint32_t value, uint64_t gpu_addr)
+    {
+        writer->write_dword(kCommandType | kMemoryTypeGlobalGttBit | kWaitModePollingBit |
+                            kCompareSadGreaterThanOrEqualSdd | (kDwordCount - 2));
+        writer->write_dword(value);
+        writer->write_dword(magma::lower_32_bits(gpu_addr));
+        writer->write_dword(magma::upper_32_bits(gpu_addr));
+    }
+};
+
 #endif // INSTRUCTIONS_H
@@ -5,8 +5,10 @@
 #ifndef MAPPED_BATCH_H
 #define MAPPED_BATCH_H
 
+#include "batch_latency.h"
 #include "gpu_mapping.h"
 #include "msd_intel_buffer.h"
+#include "platform_semaphore.h"
 #include "sequencer.h"
 
 class MsdIntelContext;
@@ -18,21 +20,50 @@ public:
     virtual std::weak_ptr<MsdIntelContext> GetContext() = 0;
     virtual bool GetGpuAddress(gpu_addr_t* gpu_addr_out) = 0;
     virtual void SetSequenceNumber(uint32_t sequence_number) = 0;
-    virtual uint32_t GetPipeControlFlags() { return 0; }
+    // |next_batch| is the batch emitted into the ring right behind this one, if any.
+    virtual uint32_t GetPipeControlFlags(MappedBatch* next_batch) { return 0; }
+    // Returns true if |buffer| is one of the batch's execution resources.
+    virtual bool UsesBuffer(MsdIntelBuffer* buffer) { return false; }
     virtual bool IsSimple() { return false; }
     virtual GpuMapping* GetBatchMapping() = 0;
+    // Like GetBatchMapping, but shared so the mapping can outlive the batch; may be null.
+    virtual std::shared_ptr<GpuMapping> ShareBatchMapping() { return nullptr; }
+
+    // Takes ownership of the semaphores to be signalled when the batch completes.
+    virtual std::vector<std::shared_ptr<magma::PlatformSemaphore>> TakeSignalSemaphores()
+    {
+        return {};
+    }
+
+    // Gives back semaphores taken with TakeSignalSemaphores, when the batch is to be submitted
+    // again after a reset.
+    virtual void
+    ReturnSignalSemaphores(std::vector<std::shared_ptr<magma::PlatformSemaphore>> semaphores)
+    {
+    }
+
+    // Takes ownership of the semaphores to be waited on by the gpu before the batch starts.
+    virtual std::vector<std::shared_ptr<magma::PlatformSemaphore>> TakeGpuWaitSemaphores()
+    {
+        return {};
+    }
+
+    virtual bool HasGpuWaitSemaphores() { return false; }
 
     void scheduled() { scheduled_ = true; }
     bool was_scheduled() { return scheduled_; }
 
+    BatchTimes& times() { return times_; }
+
 private:
     bool scheduled_ = false;
+    BatchTimes times_;
 };
 
 class SimpleMappedBatch : public MappedBatch {
 public:
     SimpleMappedBatch(std::shared_ptr<MsdIntelContext> context,
-                      std::unique_ptr<GpuMapping> batch_buffer_mapping)
+                      std::shared_ptr<GpuMapping> batch_buffer_mapping)
         : context_(context), batch_buffer_mapping_(std::move(batch_buffer_mapping))
     {
         batch_buffer_mapping_->buffer()->IncrementInflightCounter();
@@ -56,10 +87,11 @@ public:
     bool IsSimple() override { return true; }
 
     GpuMapping* GetBatchMapping() override { return batch_buffer_mapping_.get(); }
+    std::shared_ptr<GpuMapping> ShareBatchMapping() override { return batch_buffer_mapping_; }
 
 private:
     std::shared_ptr<MsdIntelContext> context_;
-    std::unique_ptr<GpuMapping> batch_buffer_mapping_;
+    std::shared_ptr<GpuMapping> batch_buffer_mapping_;
     uint32_t sequence_number_ = Sequencer::kInvalidSequenceNumber;
 };
 
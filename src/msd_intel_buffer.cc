@@ -6,6 +6,7 @@
 #include "address_space.h"
 #include "gpu_mapping.h"
 #include "msd.h"
+#include <algorithm>
 
 MsdIntelBuffer::MsdIntelBuffer(std::unique_ptr<magma::PlatformBuffer> platform_buf)
     : platform_buf_(std::move(platform_buf))
@@ -31,6 +32,30 @@ std::unique_ptr<MsdIntelBuffer> MsdIntelBuffer::Create(uint64_t size, const char
     return std::unique_ptr<MsdIntelBuffer>(new MsdIntelBuffer(std::move(platform_buf)));
 }
 
+std::unique_ptr<MsdIntelBuffer> MsdIntelBuffer::Create(uint64_t size, const char* name,
+                                                       CachingType caching_type, LruAge lru_age)
+{
+    auto buffer = Create(size, name);
+    if (!buffer)
+        return nullptr;
+
+    if (!buffer->SetCachingType(caching_type, lru_age))
+        return DRETP(nullptr, "SetCachingType failed");
+
+    return buffer;
+}
+
+bool MsdIntelBuffer::SetCachingType(CachingType caching_type, LruAge lru_age)
+{
+    std::lock_guard<std::mutex> lock(caching_mutex_);
+    if (gpu_mapped_)
+        return DRETF(false, "can't change caching type of a mapped buffer");
+
+    caching_type_ = caching_type;
+    lru_age_ = lru_age;
+    return true;
+}
+
 std::shared_ptr<GpuMapping> MsdIntelBuffer::ShareBufferMapping(std::unique_ptr<GpuMapping> mapping)
 {
     if (mapping->buffer() != this)
@@ -93,44 +118,104 @@ void MsdIntelBuffer::DecrementInflightCounter()
 {
     DASSERT(inflight_counter_ > 0);
 
-    while (true) {
-        uint64_t counter = inflight_counter_;
-        if (counter & 0xFFFFFFFF00000000) {
-            uint64_t new_counter = counter - 0x0000000100000001;
-            if (inflight_counter_.compare_exchange_strong(counter, new_counter)) {
-                if (new_counter == 0)
-                    wait_rendering_event_->Signal();
-                break;
-            }
-        } else if (inflight_counter_.compare_exchange_strong(counter, counter - 1))
-            break;
+    if (--inflight_counter_ > 0 || waiter_count_ == 0)
+        return;
+
+    std::lock_guard<std::mutex> lock(waiters_mutex_);
+    for (auto waiter : waiters_)
+        waiter->Notify();
+    waiter_count_ -= waiters_.size();
+    waiters_.clear();
+}
+
+bool MsdIntelBuffer::AddWaiter(BufferWaiter* waiter)
+{
+    std::lock_guard<std::mutex> lock(waiters_mutex_);
+
+    // Publish the waiter before checking the counter so a concurrent decrement to zero
+    // either sees the waiter or is seen here.
+    ++waiter_count_;
+    if (inflight_counter_ == 0) {
+        --waiter_count_;
+        return false;
     }
+    waiters_.push_back(waiter);
+    return true;
 }
 
-void MsdIntelBuffer::WaitRendering()
+void MsdIntelBuffer::RemoveWaiter(BufferWaiter* waiter)
 {
-    if (!wait_rendering_event_)
-        wait_rendering_event_ = magma::PlatformEvent::Create();
+    std::lock_guard<std::mutex> lock(waiters_mutex_);
 
-    std::unique_lock<std::mutex> lock(wait_rendering_mutex_);
+    auto iter = std::find(waiters_.begin(), waiters_.end(), waiter);
+    if (iter == waiters_.end())
+        return;
+    waiters_.erase(iter);
+    --waiter_count_;
+}
 
-    while (true) {
-        uint64_t counter = inflight_counter_;
-        if (counter == 0)
-            return;
-        if (inflight_counter_.compare_exchange_strong(counter, counter | (counter << 32)))
-            break;
-    };
+magma::Status MsdIntelBuffer::WaitRendering(const std::vector<MsdIntelBuffer*>& buffers,
+                                            WaitMode mode, uint64_t timeout_ms,
+                                            BufferWaiter* waiter)
+{
+    DASSERT(waiter);
+    waiter->Reset();
 
-    while (true) {
-        constexpr uint32_t kTimeoutMs = 5000;
-        bool result = wait_rendering_event_->Wait(kTimeoutMs);
-        if (result)
-            break;
-        magma::log(magma::LOG_WARNING, "WaitRendering timedout after %u ms", kTimeoutMs);
+    uint32_t busy_count = 0;
+    for (auto buffer : buffers) {
+        if (buffer->AddWaiter(waiter))
+            busy_count++;
     }
 
-    wait_rendering_event_ = magma::PlatformEvent::Create();
+    uint32_t wait_count = busy_count;
+    if (mode == WAIT_ANY)
+        wait_count = busy_count < buffers.size() ? 0 : std::min(busy_count, 1u);
+
+    bool result = waiter->Wait(wait_count, timeout_ms);
+
+    // Once removed from every buffer the waiter can't be notified again, so it's safe to reuse.
+    for (auto buffer : buffers)
+        buffer->RemoveWaiter(waiter);
+
+    if (!result)
+        return MAGMA_STATUS_TIMED_OUT;
+
+    return MAGMA_STATUS_OK;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void BufferWaiter::Reset()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    notify_count_ = 0;
+}
+
+void BufferWaiter::Notify()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    notify_count_++;
+    cond_.notify_one();
+}
+
+bool BufferWaiter::Wait(uint32_t count, uint64_t timeout_ms)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto done = [this, count] { return notify_count_ >= count; };
+
+    // Longer timeouts would overflow the steady clock's deadline, so they don't time out.
+    constexpr uint64_t kMaxTimeoutMs = 1ull << 40;
+    if (timeout_ms >= kMaxTimeoutMs) {
+        cond_.wait(lock, done);
+        return true;
+    }
+    return cond_.wait_for(lock, std::chrono::milliseconds(timeout_ms), done);
+}
+
+uint32_t BufferWaiter::notify_count()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return notify_count_;
 }
 
 //////////////////////////////////////////////////////////////////////////////
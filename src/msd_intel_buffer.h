@@ -6,11 +6,12 @@
 #define MSD_INTEL_BUFFER_H
 
 #include "magma_util/macros.h"
+#include "magma_util/status.h"
 #include "msd.h"
 #include "platform_buffer.h"
-#include "platform_event.h"
 #include "types.h"
 #include <atomic>
+#include <condition_variable>
 #include <memory>
 #include <mutex>
 #include <unordered_map>
@@ -19,10 +20,34 @@
 class GpuMapping;
 class AddressSpace;
 
+// Reusable wait primitive owned by a waiting thread. Buffers notify it from the device thread
+// when their inflight counter drops to zero.
+class BufferWaiter {
+public:
+    void Reset();
+
+    // device thread
+    void Notify();
+
+    // Waits until at least |count| notifications have arrived; returns false on timeout.
+    bool Wait(uint32_t count, uint64_t timeout_ms);
+
+    uint32_t notify_count();
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    uint32_t notify_count_ = 0;
+};
+
 class MsdIntelBuffer {
 public:
+    enum WaitMode { WAIT_ANY, WAIT_ALL };
+
     static std::unique_ptr<MsdIntelBuffer> Import(uint32_t handle);
     static std::unique_ptr<MsdIntelBuffer> Create(uint64_t size, const char* name);
+    static std::unique_ptr<MsdIntelBuffer> Create(uint64_t size, const char* name,
+                                                  CachingType caching_type, LruAge lru_age);
 
     magma::PlatformBuffer* platform_buffer()
     {
@@ -40,13 +65,34 @@ public:
     // device thread
     void DecrementInflightCounter();
 
+    // Waits until any or all of the given |buffers| have no inflight command buffers.
+    // A |timeout_ms| of UINT64_MAX, or any too long for the steady clock, waits forever.
     // connection thread
-    void WaitRendering();
+    static magma::Status WaitRendering(const std::vector<MsdIntelBuffer*>& buffers, WaitMode mode,
+                                       uint64_t timeout_ms, BufferWaiter* waiter);
 
-    uint32_t inflight_counter() { return inflight_counter_ & 0xFFFFFFFF; }
+    uint32_t inflight_counter() { return inflight_counter_; }
 
+    // Callers racing with SetCachingType must hold the lock from LockCachingType.
     CachingType caching_type() { return caching_type_; }
 
+    LruAge lru_age() { return lru_age_; }
+
+    // Selects the PAT entry used for gpu mappings of this buffer; fails once the buffer has been
+    // mapped. |lru_age| applies to CACHING_LLC only.
+    bool SetCachingType(CachingType caching_type, LruAge lru_age);
+
+    // Holds off SetCachingType while the buffer's pages are inserted into an address space with
+    // its caching type, until set_gpu_mapped is called.
+    std::unique_lock<std::mutex> LockCachingType()
+    {
+        return std::unique_lock<std::mutex>(caching_mutex_);
+    }
+
+    // Called with the LockCachingType lock held, once the buffer's pages have been inserted into
+    // an address space.
+    void set_gpu_mapped() { gpu_mapped_ = true; }
+
     // Retains a weak reference to the given mapping so it can be reused.
     std::shared_ptr<GpuMapping> ShareBufferMapping(std::unique_ptr<GpuMapping> mapping);
 
@@ -66,18 +112,28 @@ public:
 private:
     MsdIntelBuffer(std::unique_ptr<magma::PlatformBuffer> platform_buf);
 
+    // Returns false if the buffer is already idle, in which case the waiter is not registered.
+    bool AddWaiter(BufferWaiter* waiter);
+    void RemoveWaiter(BufferWaiter* waiter);
+
     std::unique_ptr<magma::PlatformBuffer> platform_buf_;
 
+    std::mutex caching_mutex_;
     CachingType caching_type_ = CACHING_LLC;
+    LruAge lru_age_ = LRU_AGE_FROM_UNCORE;
+    std::atomic_bool gpu_mapped_{};
 
     uint32_t read_domains_bitfield_ = MEMORY_DOMAIN_CPU;
     uint32_t write_domain_bitfield_ = MEMORY_DOMAIN_CPU;
 
-    std::atomic_uint64_t inflight_counter_{};
-    std::unique_ptr<magma::PlatformEvent> wait_rendering_event_;
-    std::mutex wait_rendering_mutex_;
+    std::atomic_uint32_t inflight_counter_{};
+    std::atomic_uint32_t waiter_count_{};
+    std::vector<BufferWaiter*> waiters_;
+    std::mutex waiters_mutex_;
 
     std::unordered_map<GpuMapping*, std::weak_ptr<GpuMapping>> shared_mappings_;
+
+    friend class TestMsdIntelBuffer;
 };
 
 class MsdIntelAbiBuffer : public msd_buffer_t {
@@ -6,6 +6,7 @@
 #include "magma_util/dlog.h"
 #include "msd_intel_semaphore.h"
 #include "ppgtt.h"
+#include <algorithm>
 
 void msd_connection_close(msd_connection_t* connection)
 {
@@ -17,8 +18,8 @@ msd_context_t* msd_connection_create_context(msd_connection_t* abi_connection)
     auto connection = MsdIntelAbiConnection::cast(abi_connection)->ptr();
 
     // Backing store creation deferred until context is used.
-    return new MsdIntelAbiContext(
-        std::make_unique<ClientContext>(connection, connection->per_process_gtt()));
+    auto context = std::make_shared<ClientContext>(connection, connection->per_process_gtt());
+    return new MsdIntelAbiContext(std::move(context));
 }
 
 void msd_connection_present_buffer(msd_connection_t* abi_connection, msd_buffer_t* abi_buffer,
@@ -50,18 +51,47 @@ void msd_connection_present_buffer(msd_connection_t* abi_connection, msd_buffer_
 }
 
 magma_status_t msd_connection_wait_rendering(msd_connection_t* abi_connection, msd_buffer_t* buffer)
+{
+    return msd_intel_connection_wait_rendering(abi_connection, &buffer, 1, true, UINT64_MAX);
+}
+
+magma_status_t msd_intel_connection_wait_rendering(msd_connection_t* abi_connection,
+                                                   msd_buffer_t** abi_buffers,
+                                                   uint32_t buffer_count, bool wait_all,
+                                                   uint64_t timeout_ms)
 {
     auto connection = MsdIntelAbiConnection::cast(abi_connection)->ptr();
 
     if (connection->context_killed())
         return DRET(MAGMA_STATUS_CONTEXT_KILLED);
 
-    MsdIntelAbiBuffer::cast(buffer)->ptr()->WaitRendering();
+    std::vector<MsdIntelBuffer*> buffers(buffer_count);
+    for (uint32_t i = 0; i < buffer_count; i++) {
+        buffers[i] = MsdIntelAbiBuffer::cast(abi_buffers[i])->ptr().get();
+    }
 
-    if (connection->context_killed())
-        return DRET(MAGMA_STATUS_CONTEXT_KILLED);
+    // Waits in slices so a killed context is noticed.
+    constexpr uint64_t kSliceMs = 5000;
+    uint64_t remaining_ms = timeout_ms;
+    while (true) {
+        uint64_t slice_ms = std::min(remaining_ms, kSliceMs);
+        magma::Status status = connection->WaitRendering(
+            buffers, wait_all ? MsdIntelBuffer::WAIT_ALL : MsdIntelBuffer::WAIT_ANY, slice_ms);
+
+        if (connection->context_killed())
+            return DRET(MAGMA_STATUS_CONTEXT_KILLED);
 
-    return MAGMA_STATUS_OK;
+        if (status.ok())
+            return MAGMA_STATUS_OK;
+
+        if (timeout_ms != UINT64_MAX) {
+            remaining_ms -= slice_ms;
+            if (remaining_ms == 0)
+                return MAGMA_STATUS_TIMED_OUT;
+        } else {
+            magma::log(magma::LOG_WARNING, "WaitRendering timedout after %lu ms", slice_ms);
+        }
+    }
 }
 
 std::unique_ptr<MsdIntelConnection>
@@ -72,6 +102,8 @@ MsdIntelConnection::Create(Owner* owner, std::shared_ptr<magma::PlatformBuffer>
 #if MSD_INTEL_ENABLE_MAPPING_CACHE
     cache = GpuMappingCache::Create();
 #endif
-    return std::unique_ptr<MsdIntelConnection>(new MsdIntelConnection(
-        owner, PerProcessGtt::Create(std::move(scratch_buffer), std::move(cache)), client_id));
+    auto ppgtt =
+        PerProcessGtt::Create(std::move(scratch_buffer), std::move(cache), owner->bus_mapper());
+    return std::unique_ptr<MsdIntelConnection>(
+        new MsdIntelConnection(owner, std::move(ppgtt), client_id));
 }
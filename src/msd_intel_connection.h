@@ -5,10 +5,13 @@
 #ifndef MSD_INTEL_CONNECTION_H
 #define MSD_INTEL_CONNECTION_H
 
+#include "batch_latency.h"
+#include "bus_mapping.h"
 #include "command_buffer.h"
 #include "engine_command_streamer.h"
 #include "magma_util/macros.h"
 #include "msd.h"
+#include "wait_reactor.h"
 #include <memory>
 
 class ClientContext;
@@ -29,6 +32,13 @@ public:
                       std::vector<std::shared_ptr<magma::PlatformSemaphore>> wait_semaphores,
                       std::vector<std::shared_ptr<magma::PlatformSemaphore>> signal_semaphores,
                       present_buffer_callback_t callback) = 0;
+        virtual WaitReactor* wait_reactor() = 0;
+        virtual CompletionSignaler* completion_signaler() = 0;
+        // Maps the pages of the connection's address space for the gpu.
+        virtual BusMapper* bus_mapper() = 0;
+        // Thread safe; each begin must be matched by an end.
+        virtual void BeginFrequencyBoost() = 0;
+        virtual void EndFrequencyBoost() = 0;
     };
 
     static std::unique_ptr<MsdIntelConnection>
@@ -41,6 +51,9 @@ public:
 
     msd_client_id_t client_id() { return client_id_; }
 
+    // Shared with the device, which keeps a weak reference for queries.
+    std::shared_ptr<BatchLatencyStats> latency_stats() { return latency_stats_; }
+
     magma::Status SubmitCommandBuffer(std::unique_ptr<CommandBuffer> cmd_buf)
     {
         return owner_->SubmitCommandBuffer(std::move(cmd_buf));
@@ -66,6 +79,22 @@ public:
                                      std::move(signal_semaphores), std::move(callback));
     }
 
+    // Waits for any or all of |buffers| to be idle. The GPU frequency is boosted while the
+    // client is blocked. Each call has its own waiter so concurrent waits don't interfere.
+    magma::Status WaitRendering(const std::vector<MsdIntelBuffer*>& buffers,
+                                MsdIntelBuffer::WaitMode mode, uint64_t timeout_ms)
+    {
+        BufferWaiter waiter;
+        owner_->BeginFrequencyBoost();
+        magma::Status status = MsdIntelBuffer::WaitRendering(buffers, mode, timeout_ms, &waiter);
+        owner_->EndFrequencyBoost();
+        return status;
+    }
+
+    WaitReactor* wait_reactor() { return owner_->wait_reactor(); }
+
+    CompletionSignaler* completion_signaler() { return owner_->completion_signaler(); }
+
     bool context_killed() { return context_killed_; }
 
     void set_context_killed() { context_killed_ = true; }
@@ -73,7 +102,8 @@ public:
 private:
     MsdIntelConnection(Owner* owner, std::shared_ptr<PerProcessGtt> ppgtt,
                        msd_client_id_t client_id)
-        : owner_(owner), ppgtt_(std::move(ppgtt)), client_id_(client_id)
+        : owner_(owner), ppgtt_(std::move(ppgtt)), client_id_(client_id),
+          latency_stats_(std::make_shared<BatchLatencyStats>(client_id))
     {
     }
 
@@ -83,6 +113,7 @@ private:
     std::shared_ptr<PerProcessGtt> ppgtt_;
     msd_client_id_t client_id_;
     bool context_killed_ = false;
+    std::shared_ptr<BatchLatencyStats> latency_stats_;
 };
 
 class MsdIntelAbiConnection : public msd_connection_t {
@@ -106,4 +137,11 @@ private:
     static const uint32_t kMagic = 0x636f6e6e; // "conn" (Connection)
 };
 
+// Extends msd_connection_wait_rendering, which waits for a single buffer without a timeout, to
+// waiting for all or any one of |buffers|. A |timeout_ms| of UINT64_MAX waits until the buffers are
+// idle or the context is killed.
+magma_status_t msd_intel_connection_wait_rendering(msd_connection_t* connection,
+                                                   msd_buffer_t** buffers, uint32_t buffer_count,
+                                                   bool wait_all, uint64_t timeout_ms);
+
 #endif // MSD_INTEL_CONNECTION_H
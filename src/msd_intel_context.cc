@@ -6,9 +6,25 @@
 #include "address_space.h"
 #include "command_buffer.h"
 #include "msd_intel_connection.h"
-#include "platform_thread.h"
 #include "platform_trace.h"
 
+constexpr uint32_t MsdIntelContext::kDefaultHangBudgetMs;
+
+MsdIntelContext::~MsdIntelContext()
+{
+    for (auto& pair : state_map_) {
+        ReleaseEngineState(&pair.second);
+    }
+}
+
+void MsdIntelContext::ReleaseEngineState(PerEngineState* state)
+{
+    if (state->register_state &&
+        !state->context_buffer->platform_buffer()->UnmapPageCpu(kRegisterStatePageIndex))
+        DLOG("UnmapPageCpu failed");
+    state->register_state = nullptr;
+}
+
 void MsdIntelContext::SetEngineState(EngineCommandStreamerId id,
                                      std::unique_ptr<MsdIntelBuffer> context_buffer,
                                      std::unique_ptr<Ringbuffer> ringbuffer)
@@ -16,10 +32,30 @@ void MsdIntelContext::SetEngineState(EngineCommandStreamerId id,
     DASSERT(context_buffer);
     DASSERT(ringbuffer);
 
+    SetEngineState(id, PerEngineState{std::move(context_buffer), nullptr, std::move(ringbuffer),
+                                      nullptr});
+}
+
+void MsdIntelContext::SetEngineState(EngineCommandStreamerId id, PerEngineState state)
+{
+    DASSERT(state.context_buffer);
+    DASSERT(state.ringbuffer);
+
     auto iter = state_map_.find(id);
     DASSERT(iter == state_map_.end());
 
-    state_map_[id] = PerEngineState{std::move(context_buffer), nullptr, std::move(ringbuffer)};
+    state_map_[id] = std::move(state);
+}
+
+bool MsdIntelContext::TakeEngineState(EngineCommandStreamerId id, PerEngineState* state_out)
+{
+    auto iter = state_map_.find(id);
+    if (iter == state_map_.end())
+        return DRETF(false, "couldn't find engine command streamer");
+
+    *state_out = std::move(iter->second);
+    state_map_.erase(iter);
+    return true;
 }
 
 bool MsdIntelContext::Map(std::shared_ptr<AddressSpace> address_space, EngineCommandStreamerId id)
@@ -86,6 +122,24 @@ bool MsdIntelContext::GetGpuAddress(EngineCommandStreamerId id, gpu_addr_t* addr
     return true;
 }
 
+uint32_t* MsdIntelContext::GetRegisterState(EngineCommandStreamerId id)
+{
+    auto iter = state_map_.find(id);
+    if (iter == state_map_.end())
+        return DRETP(nullptr, "couldn't find engine command streamer");
+
+    PerEngineState& state = iter->second;
+    if (!state.register_state) {
+        void* cpu_addr;
+        if (!state.context_buffer->platform_buffer()->MapPageCpu(kRegisterStatePageIndex,
+                                                                 &cpu_addr))
+            return DRETP(nullptr, "failed to map register state page");
+        state.register_state = reinterpret_cast<uint32_t*>(cpu_addr);
+    }
+
+    return state.register_state;
+}
+
 bool MsdIntelContext::GetRingbufferGpuAddress(EngineCommandStreamerId id, gpu_addr_t* addr_out)
 {
     auto iter = state_map_.find(id);
@@ -102,20 +156,17 @@ bool MsdIntelContext::GetRingbufferGpuAddress(EngineCommandStreamerId id, gpu_ad
     return true;
 }
 
-ClientContext::~ClientContext() { DASSERT(!wait_thread_.joinable()); }
-
 void ClientContext::Shutdown()
 {
-    if (semaphore_port_)
-        semaphore_port_->Close();
-
-    if (wait_thread_.joinable()) {
-        DLOG("joining wait thread");
-        wait_thread_.join();
-        DLOG("joined wait thread");
-    }
+    // A callback already running on the reactor sees this flag and leaves any pending command
+    // buffers to be released with the context.
+    std::unique_lock<std::mutex> lock(pending_command_buffer_mutex_);
+    shutdown_ = true;
 
-    semaphore_port_.reset();
+    // Otherwise a wait set whose semaphores never signal stays in the reactor for good. The
+    // connection may already be gone, so the reactor is reached directly.
+    if (wait_reactor_)
+        wait_reactor_->RemoveWaitSets(this);
 }
 
 magma::Status ClientContext::SubmitCommandBuffer(std::unique_ptr<CommandBuffer> command_buffer)
@@ -131,19 +182,6 @@ magma::Status ClientContext::SubmitCommandBuffer(std::unique_ptr<CommandBuffer>
     if (connection->context_killed())
         return DRET(MAGMA_STATUS_CONTEXT_KILLED);
 
-    if (!semaphore_port_) {
-        semaphore_port_ = magma::SemaphorePort::Create();
-
-        DASSERT(!wait_thread_.joinable());
-        wait_thread_ = std::thread([this] {
-            magma::PlatformThreadHelper::SetCurrentThreadName("ConnectionWaitThread");
-            DLOG("context wait thread started");
-            while (semaphore_port_->WaitOne()) {
-            }
-            DLOG("context wait thread exited");
-        });
-    }
-
     std::unique_lock<std::mutex> lock(pending_command_buffer_mutex_);
     pending_command_buffer_queue_.push(std::move(command_buffer));
 
@@ -155,28 +193,42 @@ magma::Status ClientContext::SubmitCommandBuffer(std::unique_ptr<CommandBuffer>
 
 magma::Status ClientContext::SubmitPendingCommandBuffer(bool have_lock)
 {
-    auto callback = [this](magma::SemaphorePort::WaitSet* wait_set) {
-        this->SubmitPendingCommandBuffer(false);
+    // The reactor outlives contexts, so callbacks hold only a weak reference.
+    std::weak_ptr<ClientContext> weak_context = shared_from_this();
+    auto callback = [weak_context]() {
+        auto context = weak_context.lock();
+        if (context)
+            context->SubmitPendingCommandBuffer(false);
     };
 
     auto lock = have_lock
                     ? std::unique_lock<std::mutex>(pending_command_buffer_mutex_, std::adopt_lock)
                     : std::unique_lock<std::mutex>(pending_command_buffer_mutex_);
 
+    if (shutdown_)
+        return MAGMA_STATUS_OK;
+
+    // Only the front command buffer is ever waited on, preserving submission order.
     while (pending_command_buffer_queue_.size()) {
         DLOG("pending_command_buffer_queue_ size %zu", pending_command_buffer_queue_.size());
 
         std::unique_ptr<CommandBuffer>& command_buffer = pending_command_buffer_queue_.front();
 
+        auto connection = connection_.lock();
+        if (!connection)
+            return DRET_MSG(MAGMA_STATUS_CONNECTION_LOST, "couldn't lock reference to connection");
+
+        CompletionSignaler* completion_signaler = connection->completion_signaler();
+        std::unique_lock<std::mutex> submit_lock(completion_signaler->submit_mutex());
+
         // Takes ownership
         auto semaphores = command_buffer->wait_semaphores();
 
-        if (semaphores.size() == 0) {
-            auto connection = connection_.lock();
-            if (!connection)
-                return DRET_MSG(MAGMA_STATUS_CONNECTION_LOST,
-                                "couldn't lock reference to connection");
+        // Semaphores due to be signalled by command buffers already submitted to this device are
+        // waited on by the gpu; only foreign semaphores need a cpu wait.
+        command_buffer->AddGpuWaitSemaphores(completion_signaler->TakeRegistered(&semaphores));
 
+        if (semaphores.size() == 0) {
             if (connection->context_killed())
                 return DRET(MAGMA_STATUS_CONTEXT_KILLED);
 
@@ -185,15 +237,18 @@ magma::Status ClientContext::SubmitPendingCommandBuffer(bool have_lock)
                 uint64_t ATTRIBUTE_UNUSED buffer_id = command_buffer->GetBatchBufferId();
                 TRACE_FLOW_STEP("magma", "command_buffer", buffer_id);
             }
+            command_buffer->RegisterSignalSemaphores(completion_signaler);
             connection->SubmitCommandBuffer(std::move(command_buffer));
             pending_command_buffer_queue_.pop();
         } else {
+            submit_lock.unlock();
+
             DLOG("adding waitset with %zu semaphores", semaphores.size());
 
             // Invoke the callback when semaphores are satisfied;
             // the next ProcessPendingFlip will see an empty semaphore array for the front request.
-            bool result = semaphore_port_->AddWaitSet(
-                std::make_unique<magma::SemaphorePort::WaitSet>(callback, std::move(semaphores)));
+            wait_reactor_ = connection->wait_reactor();
+            bool result = wait_reactor_->AddWaitSet(this, callback, std::move(semaphores));
             if (result) {
                 break;
             } else {
@@ -234,6 +289,22 @@ magma_status_t msd_context_execute_command_buffer(msd_context_t* ctx, msd_buffer
     return status.get();
 }
 
+magma_status_t msd_intel_context_set_hang_budget(msd_context_t* context, uint32_t hang_budget_ms)
+{
+    if (hang_budget_ms == 0)
+        return DRET_MSG(MAGMA_STATUS_INVALID_ARGS, "hang budget must be nonzero");
+
+    MsdIntelAbiContext::cast(context)->ptr()->set_hang_budget_ms(hang_budget_ms);
+    return MAGMA_STATUS_OK;
+}
+
+magma_status_t msd_intel_context_query_gpu_runtime(msd_context_t* context,
+                                                   uint64_t* gpu_runtime_ns_out)
+{
+    *gpu_runtime_ns_out = MsdIntelAbiContext::cast(context)->ptr()->gpu_runtime_ns();
+    return MAGMA_STATUS_OK;
+}
+
 void msd_context_release_buffer(msd_context_t* context, msd_buffer_t* buffer)
 {
     auto abi_context = MsdIntelAbiContext::cast(context);
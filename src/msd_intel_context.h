@@ -6,19 +6,20 @@
 #define MSD_INTEL_CONTEXT_H
 
 #include "command_buffer.h"
-#include "magma_util/semaphore_port.h"
 #include "magma_util/status.h"
 #include "msd.h"
 #include "msd_intel_buffer.h"
 #include "ppgtt.h"
 #include "ringbuffer.h"
 #include "types.h"
+#include <atomic>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <queue>
-#include <thread>
 
 class MsdIntelConnection;
+class WaitReactor;
 
 // Abstract base context.
 class MsdIntelContext {
@@ -28,10 +29,25 @@ public:
         DASSERT(address_space_);
     }
 
-    virtual ~MsdIntelContext() {}
+    virtual ~MsdIntelContext();
+
+    // Backing store for one engine; may be recycled between contexts through a ContextPool.
+    struct PerEngineState {
+        std::shared_ptr<MsdIntelBuffer> context_buffer;
+        std::unique_ptr<GpuMapping> context_mapping;
+        std::unique_ptr<Ringbuffer> ringbuffer;
+        uint32_t* register_state;
+    };
 
     void SetEngineState(EngineCommandStreamerId id, std::unique_ptr<MsdIntelBuffer> context_buffer,
                         std::unique_ptr<Ringbuffer> ringbuffer);
+    void SetEngineState(EngineCommandStreamerId id, PerEngineState state);
+
+    // Removes the engine state, leaving the context uninitialized for the engine.
+    bool TakeEngineState(EngineCommandStreamerId id, PerEngineState* state_out);
+
+    // Unmaps the register state page if it's mapped.
+    static void ReleaseEngineState(PerEngineState* state);
 
     virtual bool Map(std::shared_ptr<AddressSpace> address_space, EngineCommandStreamerId id);
     virtual bool Unmap(EngineCommandStreamerId id);
@@ -57,6 +73,10 @@ public:
         return iter == state_map_.end() ? nullptr : iter->second.ringbuffer.get();
     }
 
+    // Returns the register state page of the context buffer, which stays cpu mapped for the life
+    // of the engine state so per submission updates are plain stores.
+    uint32_t* GetRegisterState(EngineCommandStreamerId id);
+
     bool IsInitializedForEngine(EngineCommandStreamerId id)
     {
         return state_map_.find(id) != state_map_.end();
@@ -66,21 +86,31 @@ public:
 
     std::shared_ptr<AddressSpace> exec_address_space() { return address_space_; }
 
-private:
-    struct PerEngineState {
-        std::shared_ptr<MsdIntelBuffer> context_buffer;
-        std::unique_ptr<GpuMapping> context_mapping;
-        std::unique_ptr<Ringbuffer> ringbuffer;
-    };
+    // How long this context's batches may run without the engine making visible progress before
+    // a hang is declared. Clients running long compute jobs raise it with
+    // msd_intel_context_set_hang_budget.
+    uint32_t hang_budget_ms() { return hang_budget_ms_; }
+    void set_hang_budget_ms(uint32_t hang_budget_ms) { hang_budget_ms_ = hang_budget_ms; }
+
+    // The gpu time consumed by this context's batches, as timed by the gpu around each batch.
+    // Clients read it with msd_intel_context_query_gpu_runtime.
+    uint64_t gpu_runtime_ns() { return gpu_runtime_ns_; }
+    void AddGpuRuntime(uint64_t runtime_ns) { gpu_runtime_ns_ += runtime_ns; }
 
+    static constexpr uint32_t kRegisterStatePageIndex = 1;
+    static constexpr uint32_t kDefaultHangBudgetMs = 50;
+
+private:
     std::map<EngineCommandStreamerId, PerEngineState> state_map_;
     std::queue<std::unique_ptr<MappedBatch>> pending_batch_queue_;
     std::shared_ptr<AddressSpace> address_space_;
+    std::atomic_uint32_t hang_budget_ms_{kDefaultHangBudgetMs};
+    std::atomic_uint64_t gpu_runtime_ns_{};
 
     friend class TestContext;
 };
 
-class ClientContext : public MsdIntelContext {
+class ClientContext : public MsdIntelContext, public std::enable_shared_from_this<ClientContext> {
 public:
     ClientContext(std::weak_ptr<MsdIntelConnection> connection,
                   std::shared_ptr<AddressSpace> address_space)
@@ -88,8 +118,6 @@ public:
     {
     }
 
-    ~ClientContext();
-
     magma::Status SubmitCommandBuffer(std::unique_ptr<CommandBuffer> cmd_buf);
     void Shutdown();
 
@@ -99,9 +127,10 @@ private:
     magma::Status SubmitPendingCommandBuffer(bool have_lock);
 
     std::weak_ptr<MsdIntelConnection> connection_;
-    std::unique_ptr<magma::SemaphorePort> semaphore_port_;
-    std::thread wait_thread_;
     std::mutex pending_command_buffer_mutex_;
+    // Set when a wait set is first added; the device's reactor outlives the context.
+    WaitReactor* wait_reactor_ = nullptr;
+    bool shutdown_ = false;
     std::queue<std::unique_ptr<CommandBuffer>> pending_command_buffer_queue_;
 };
 
@@ -125,4 +154,12 @@ private:
     static const uint32_t kMagic = 0x63747874; // "ctxt"
 };
 
+// Sets how long the context's batches may run without the engine making visible progress before
+// a hang is declared; applies to batches submitted afterwards. |hang_budget_ms| must be nonzero.
+magma_status_t msd_intel_context_set_hang_budget(msd_context_t* context, uint32_t hang_budget_ms);
+
+// Returns the gpu time in nanoseconds consumed by the context's batches so far.
+magma_status_t msd_intel_context_query_gpu_runtime(msd_context_t* context,
+                                                   uint64_t* gpu_runtime_ns_out);
+
 #endif // MSD_INTEL_CONTEXT_H
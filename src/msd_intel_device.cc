@@ -4,20 +4,33 @@
 
 #include "msd_intel_device.h"
 #include "device_id.h"
+#include "flight_recorder.h"
 #include "forcewake.h"
+#include "forcewake_manager.h"
 #include "global_context.h"
 #include "magma_util/dlog.h"
 #include "magma_util/macros.h"
 #include "modeset/displayport.h"
+#include "msd_intel_gen_query.h"
 #include "msd_intel_semaphore.h"
 #include "platform_trace.h"
 #include "registers.h"
 #include "registers_pipe.h"
+#include <algorithm>
 #include <bitset>
 #include <cstdio>
+#include <cstring>
 #include <string>
 
 constexpr bool kWaitForFlip = MSD_INTEL_WAIT_FOR_FLIP ? true : false;
+constexpr uint32_t kForceWakeReleaseDelayUs = MSD_INTEL_FORCEWAKE_RELEASE_DELAY_US;
+constexpr bool kEnableRegisterProfiler = MSD_INTEL_ENABLE_REGISTER_PROFILER ? true : false;
+constexpr uint32_t kRegisterTraceSize = MSD_INTEL_REGISTER_TRACE_SIZE;
+constexpr uint32_t kErrorStateSize = MSD_INTEL_ERROR_STATE_SIZE;
+// Inflight batches whose contents an error state holds.
+constexpr uint32_t kErrorStateMaxBatches = 32;
+
+constexpr uint32_t MsdIntelDevice::kHangCheckPeriodMs;
 
 inline uint64_t get_current_time_ns()
 {
@@ -140,6 +153,14 @@ protected:
     }
 };
 
+class MsdIntelDevice::ErrorStateRequest : public DeviceRequest {
+public:
+    ErrorStateRequest() {}
+
+protected:
+    magma::Status Process(MsdIntelDevice* device) override { return device->ProcessErrorState(); }
+};
+
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
 std::unique_ptr<MsdIntelDevice> MsdIntelDevice::Create(void* device_handle,
@@ -156,6 +177,23 @@ std::unique_ptr<MsdIntelDevice> MsdIntelDevice::Create(void* device_handle,
     return device;
 }
 
+std::unique_ptr<MsdIntelDevice>
+MsdIntelDevice::Create(std::unique_ptr<magma::PlatformPciDevice> platform_device,
+                       std::unique_ptr<RegisterIo::Hook> register_hook,
+                       std::unique_ptr<BusMapper> bus_mapper, bool start_device_thread)
+{
+    std::unique_ptr<MsdIntelDevice> device(new MsdIntelDevice());
+
+    if (!device->Init(std::move(platform_device), std::move(register_hook),
+                      std::move(bus_mapper)))
+        return DRETP(nullptr, "Failed to initialize MsdIntelDevice");
+
+    if (start_device_thread)
+        device->StartDeviceThread();
+
+    return device;
+}
+
 MsdIntelDevice::MsdIntelDevice() { magic_ = kMagic; }
 
 MsdIntelDevice::~MsdIntelDevice() { Destroy(); }
@@ -189,23 +227,65 @@ void MsdIntelDevice::Destroy()
         device_thread_.join();
         DLOG("joined");
     }
+
+    // Stops the wait reactor thread.
+    wait_reactor_.reset();
 }
 
 std::unique_ptr<MsdIntelConnection> MsdIntelDevice::Open(msd_client_id_t client_id)
 {
-    return MsdIntelConnection::Create(this, scratch_buffer_, client_id);
+    auto connection = MsdIntelConnection::Create(this, scratch_buffer_, client_id);
+    if (!connection)
+        return nullptr;
+
+    std::lock_guard<std::mutex> lock(latency_stats_mutex_);
+    latency_stats_.erase(std::remove_if(latency_stats_.begin(), latency_stats_.end(),
+                                        [](std::weak_ptr<BatchLatencyStats>& stats) {
+                                            return stats.expired();
+                                        }),
+                         latency_stats_.end());
+    latency_stats_.push_back(connection->latency_stats());
+
+    return connection;
 }
 
-bool MsdIntelDevice::Init(void* device_handle)
+std::vector<std::shared_ptr<BatchLatencyStats>>
+MsdIntelDevice::GetLatencyStats(bool match_client_id, uint32_t client_id)
 {
-    DASSERT(!platform_device_);
+    std::lock_guard<std::mutex> lock(latency_stats_mutex_);
+    std::vector<std::shared_ptr<BatchLatencyStats>> result;
+    for (auto& weak_stats : latency_stats_) {
+        auto stats = weak_stats.lock();
+        if (!stats)
+            continue;
+        if (match_client_id && static_cast<uint32_t>(stats->client_id()) != client_id)
+            continue;
+        result.push_back(std::move(stats));
+    }
+    return result;
+}
 
+bool MsdIntelDevice::Init(void* device_handle)
+{
     DLOG("Init device_handle %p", device_handle);
 
-    platform_device_ = magma::PlatformPciDevice::Create(device_handle);
-    if (!platform_device_)
+    auto platform_device = magma::PlatformPciDevice::Create(device_handle);
+    if (!platform_device)
         return DRETF(false, "failed to create platform device");
 
+    return Init(std::move(platform_device), nullptr, nullptr);
+}
+
+bool MsdIntelDevice::Init(std::unique_ptr<magma::PlatformPciDevice> platform_device,
+                          std::unique_ptr<RegisterIo::Hook> register_hook,
+                          std::unique_ptr<BusMapper> bus_mapper)
+{
+    DASSERT(!platform_device_);
+    DASSERT(platform_device);
+
+    platform_device_ = std::move(platform_device);
+    bus_mapper_ = std::move(bus_mapper);
+
     uint16_t pci_dev_id;
     if (!platform_device_->ReadPciConfig16(2, &pci_dev_id))
         return DRETF(false, "ReadPciConfig16 failed");
@@ -213,6 +293,9 @@ bool MsdIntelDevice::Init(void* device_handle)
     device_id_ = pci_dev_id;
     DLOG("device_id 0x%x", device_id_);
 
+    timestamp_period_ps_ = DeviceId::is_gen9(device_id_) ? registers::Timestamp::kPeriodPsGen9
+                                                         : registers::Timestamp::kPeriodPsGen8;
+
     uint16_t gmch_graphics_ctrl;
     if (!platform_device_->ReadPciConfig16(registers::GmchGraphicsControl::kOffset,
                                            &gmch_graphics_ctrl))
@@ -229,23 +312,57 @@ bool MsdIntelDevice::Init(void* device_handle)
 
     register_io_ = std::unique_ptr<RegisterIo>(new RegisterIo(std::move(mmio)));
 
+    if (register_hook)
+        register_io_->InstallHook(std::move(register_hook));
+    if (kRegisterTraceSize) {
+        auto recorder = std::make_unique<RegisterTraceRecorder>(device_id_, gmch_graphics_ctrl,
+                                                                kRegisterTraceSize);
+        register_trace_recorder_ = recorder.get();
+        register_io_->InstallHook(std::move(recorder));
+    }
+    if (kEnableRegisterProfiler) {
+        auto profiler = std::make_unique<RegisterProfiler>();
+        register_profiler_ = profiler.get();
+        register_io_->InstallHook(std::move(profiler));
+    }
+
+    // Registers only the driver changes, rewritten mostly unchanged on every flip or frequency
+    // update. The plane surface address isn't shadowed because writing it arms the flip.
+    registers::PipeRegs pipe(0);
+    register_io_->ShadowRegister(pipe.PlaneControl().addr());
+    register_io_->ShadowRegister(pipe.PlaneSurfaceSize().addr());
+    register_io_->ShadowRegister(pipe.PlaneSurfaceStride().addr());
+    register_io_->ShadowRegister(registers::DisplayPipeInterrupt::kMaskOffsetPipeA);
+    register_io_->ShadowRegister(registers::DisplayPipeInterrupt::kEnableOffsetPipeA);
+    register_io_->ShadowRegister(registers::RenderPerformanceNormalFrequencyRequest::kOffset);
+
+    std::vector<registers::ForceWake::Domain> forcewake_domains;
     if (DeviceId::is_gen8(device_id_)) {
-        ForceWake::reset(register_io_.get(), registers::ForceWake::GEN8);
-        ForceWake::request(register_io_.get(), registers::ForceWake::GEN8);
+        forcewake_domains = {registers::ForceWake::GEN8};
     } else if (DeviceId::is_gen9(device_id_)) {
-        ForceWake::reset(register_io_.get(), registers::ForceWake::GEN9_RENDER);
-        ForceWake::request(register_io_.get(), registers::ForceWake::GEN9_RENDER);
+        forcewake_domains = {registers::ForceWake::GEN9_RENDER, registers::ForceWake::GEN9_GT};
     } else {
         magma::log(magma::LOG_WARNING, "Unrecognized graphics PCI device id 0x%x", device_id_);
         return false;
     }
 
+    // From here on forcewake is taken as needed around register accesses.
+    for (auto domain : forcewake_domains) {
+        ForceWake::reset(register_io_.get(), domain);
+    }
+    auto forcewake =
+        ForceWakeManager::Create(register_io_.get(), forcewake_domains, kForceWakeReleaseDelayUs);
+    forcewake_ = forcewake.get();
+    register_io_->InstallForceWakeHook(std::move(forcewake));
+
     // Clear faults
     registers::AllEngineFault::clear(register_io_.get());
 
     QuerySliceInfo(&subslice_total_, &eu_total_);
     ReadDisplaySize();
 
+    frequency_governor_ = FrequencyGovernor::Create(register_io_.get());
+
     interrupt_ = platform_device_->RegisterInterrupt();
     if (!interrupt_)
         return DRETF(false, "failed to register interrupt");
@@ -256,7 +373,7 @@ bool MsdIntelDevice::Init(void* device_handle)
     mapping_cache_ = GpuMappingCache::Create();
 #endif
 
-    gtt_ = std::make_shared<Gtt>(mapping_cache_);
+    gtt_ = std::make_shared<Gtt>(mapping_cache_, this->bus_mapper());
 
     if (!gtt_->Init(gtt_size, platform_device_.get()))
         return DRETF(false, "failed to Init gtt");
@@ -276,17 +393,30 @@ bool MsdIntelDevice::Init(void* device_handle)
     if (!global_context_->Map(gtt_, render_engine_cs_->id()))
         return DRETF(false, "global context init failed");
 
+    if (!render_engine_cs_->InitRenderInitBatch(
+            render_engine_cs_->CreateRenderInitBatch(device_id_), gtt_))
+        return DRETF(false, "failed to init render init batch");
+
+    progress_ = std::make_unique<GpuProgress>();
+
     if (!RenderEngineInit())
         return DRETF(false, "failed to init render engine");
 
     device_request_semaphore_ = magma::PlatformSemaphore::Create();
 
+    if (kErrorStateSize) {
+        error_state_ = std::make_unique<ErrorStateWriter>(kErrorStateSize);
+        error_state_batches_.reserve(kErrorStateMaxBatches);
+    }
+
     if (kWaitForFlip) {
         flip_ready_semaphore_ = magma::PlatformSemaphore::Create();
         flip_ready_semaphore_->Signal();
     }
 
-    semaphore_port_ = magma::SemaphorePort::Create();
+    wait_reactor_ = WaitReactor::Create();
+    if (!wait_reactor_)
+        return DRETF(false, "failed to create wait reactor");
 
     scratch_buffer_ =
         std::shared_ptr<magma::PlatformBuffer>(magma::PlatformBuffer::Create(PAGE_SIZE, "scratch"));
@@ -309,15 +439,9 @@ bool MsdIntelDevice::RenderEngineInit()
 {
     CHECK_THREAD_IS_CURRENT(device_thread_id_);
 
-    progress_ = std::make_unique<GpuProgress>();
-
     render_engine_cs_->InitHardware();
 
-    auto init_batch = render_engine_cs_->CreateRenderInitBatch(device_id_);
-    if (!init_batch)
-        return DRETF(false, "failed to create render init batch");
-
-    if (!render_engine_cs_->RenderInit(global_context_, std::move(init_batch), gtt_))
+    if (!render_engine_cs_->RenderInit(global_context_))
         return DRETF(false, "render_engine_cs failed RenderInit");
 
     registers::MasterInterruptControl::write(register_io_.get(), true);
@@ -327,13 +451,28 @@ bool MsdIntelDevice::RenderEngineInit()
 
 bool MsdIntelDevice::RenderEngineReset()
 {
-    magma::log(magma::LOG_WARNING, "resetting render engine");
+    uint64_t start_ns = get_current_time_ns();
 
     render_engine_cs_->ResetCurrentContext();
 
+    // Budgets of replayed batches start when they're resubmitted.
+    progress_->Reset(hardware_status_page(RENDER_COMMAND_STREAMER)->read_sequence_number());
+
     registers::AllEngineFault::clear(register_io_.get());
 
-    return RenderEngineInit();
+    bool result = RenderEngineInit();
+
+    // Innocent batches are only replayed onto a reinitialized engine.
+    if (result) {
+        render_engine_cs_->ReplayInflightBatches();
+    } else {
+        render_engine_cs_->DropInflightBatches();
+    }
+
+    magma::log(magma::LOG_WARNING, "reset render engine: %s in %lu us",
+               result ? "ready" : "failed", (get_current_time_ns() - start_ns) / 1000);
+
+    return result;
 }
 
 void MsdIntelDevice::StartDeviceThread()
@@ -346,12 +485,6 @@ void MsdIntelDevice::StartDeviceThread()
     // requires the device thread.
     DASSERT(!interrupt_thread_.joinable());
     interrupt_thread_ = std::thread([this] { this->InterruptThreadLoop(); });
-
-    DASSERT(!wait_thread_.joinable());
-    wait_thread_ = std::thread([this] { this->WaitThreadLoop(); });
-
-    // TODO(ZX-594): stop the wait thread like other threads
-    wait_thread_.detach();
 }
 
 int MsdIntelDevice::InterruptThreadLoop()
@@ -367,7 +500,17 @@ int MsdIntelDevice::InterruptThreadLoop()
         if (interrupt_thread_quit_flag_)
             break;
 
-        auto request = std::make_unique<InterruptRequest>(get_current_time_ns());
+        uint64_t interrupt_time_ns = get_current_time_ns();
+
+        uint32_t sequence_number =
+            global_context_->hardware_status_page(RENDER_COMMAND_STREAMER)->read_sequence_number();
+        FlightRecorder::Get()->Record(FlightRecorder::kInterrupt, sequence_number);
+
+        // Signal completion semaphores here rather than after the device thread processes the
+        // interrupt; the sequence number is written immediately before the user interrupt.
+        render_engine_cs_->completion_signaler()->Signal(sequence_number, interrupt_time_ns);
+
+        auto request = std::make_unique<InterruptRequest>(interrupt_time_ns);
         auto reply = request->GetReply();
 
         EnqueueDeviceRequest(std::move(request), true);
@@ -380,17 +523,6 @@ int MsdIntelDevice::InterruptThreadLoop()
     return 0;
 }
 
-void MsdIntelDevice::WaitThreadLoop()
-{
-    magma::PlatformThreadHelper::SetCurrentThreadName("FlipWaitThread");
-    DLOG("Wait thread started");
-
-    while (semaphore_port_->WaitOne()) {
-    }
-
-    DLOG("Wait thread exited");
-}
-
 void MsdIntelDevice::DumpStatusToLog() { EnqueueDeviceRequest(std::make_unique<DumpRequest>()); }
 
 magma::Status MsdIntelDevice::SubmitCommandBuffer(std::unique_ptr<CommandBuffer> command_buffer)
@@ -398,6 +530,14 @@ magma::Status MsdIntelDevice::SubmitCommandBuffer(std::unique_ptr<CommandBuffer>
     DLOG("SubmitCommandBuffer");
     CHECK_THREAD_NOT_CURRENT(device_thread_id_);
 
+    command_buffer->times().enqueue_ns = BatchTimes::now_ns();
+
+    auto context = command_buffer->GetContext().lock();
+    auto connection = context ? context->connection().lock() : nullptr;
+    FlightRecorder::Get()->Record(FlightRecorder::kEnqueue,
+                                  connection ? connection->client_id() : 0,
+                                  reinterpret_cast<uintptr_t>(context.get()));
+
     EnqueueDeviceRequest(std::make_unique<CommandBufferRequest>(std::move(command_buffer)));
     return MAGMA_STATUS_OK;
 }
@@ -445,7 +585,7 @@ void MsdIntelDevice::PresentBuffer(
 
 void MsdIntelDevice::ProcessPendingFlip()
 {
-    auto callback = [this](magma::SemaphorePort::WaitSet* wait_set) {
+    auto callback = [this]() {
         std::unique_lock<std::mutex> lock(pageflip_request_mutex_);
         this->ProcessPendingFlip();
     };
@@ -474,8 +614,7 @@ void MsdIntelDevice::ProcessPendingFlip()
 
             // Invoke the callback when semaphores are satisfied;
             // the next ProcessPendingFlip will see an empty semaphore array for the front request.
-            bool result = semaphore_port_->AddWaitSet(
-                std::make_unique<magma::SemaphorePort::WaitSet>(callback, std::move(semaphores)));
+            bool result = wait_reactor_->AddWaitSet(this, callback, std::move(semaphores));
             if (result) {
                 break;
             } else {
@@ -487,7 +626,7 @@ void MsdIntelDevice::ProcessPendingFlip()
 
 void MsdIntelDevice::ProcessPendingFlipSync()
 {
-    auto callback = [this](magma::SemaphorePort::WaitSet* wait_set) {
+    auto callback = [this]() {
         std::unique_lock<std::mutex> lock(pageflip_request_mutex_);
         this->ProcessPendingFlipSync();
     };
@@ -506,8 +645,7 @@ void MsdIntelDevice::ProcessPendingFlipSync()
         } else {
             DASSERT(semaphores.size() == 1); // flip ready semaphore only
             DLOG("adding waitset with flip ready semaphore");
-            bool result = semaphore_port_->AddWaitSet(
-                std::make_unique<magma::SemaphorePort::WaitSet>(callback, std::move(semaphores)));
+            bool result = wait_reactor_->AddWaitSet(this, callback, std::move(semaphores));
             if (result) {
                 break;
             } else {
@@ -541,20 +679,26 @@ int MsdIntelDevice::DeviceThreadLoop()
 
     DLOG("DeviceThreadLoop starting thread 0x%lx", device_thread_id_->id());
 
-    constexpr uint32_t kTimeoutMs = 300;
-
     std::unique_lock<std::mutex> lock(device_request_mutex_, std::defer_lock);
 
+    // Start filling the context pool.
+    device_request_semaphore_->Signal();
+
     while (true) {
-        if (progress_->work_outstanding()) {
+        // Keep waking while the frequency governor may still lower the frequency, or forcewake
+        // has a deferred release.
+        if (progress_->work_outstanding() || !frequency_governor_->idle() ||
+            forcewake_->release_pending()) {
             DLOG("waiting with timeout");
             // When the semaphore wait returns the semaphore will be reset.
             // The reset may race with subsequent enqueue/signals on the semaphore,
             // which is fine because we process everything available in the queue
             // before returning here to wait.
-            bool timed_out = !device_request_semaphore_->Wait(kTimeoutMs);
-            if (timed_out)
-                SuspectedGpuHang();
+            device_request_semaphore_->Wait(kHangCheckPeriodMs);
+            // Check on every pass, not just on timeout, since a busy client can keep the
+            // semaphore signalled.
+            if (progress_->work_outstanding())
+                HangCheck();
         } else {
             DLOG("waiting, no timeout");
             device_request_semaphore_->Wait();
@@ -571,6 +715,19 @@ int MsdIntelDevice::DeviceThreadLoop()
         }
         lock.unlock();
 
+        UpdateFrequency();
+        forcewake_->ReleaseIdle(std::chrono::steady_clock::now());
+
+        // Retire a bounded number of completed batches per pass so new requests aren't held up
+        // behind a large backlog; signal ourselves to come back for the rest.
+        constexpr uint32_t kRetireBatchCount = 16;
+        if (render_engine_cs_->RetireCompletedBatches(kRetireBatchCount))
+            device_request_semaphore_->Signal();
+
+        // Likewise top up the context pool one backing store at a time.
+        if (render_engine_cs_->RefillContextPool(gtt_, 1))
+            device_request_semaphore_->Signal();
+
         if (device_thread_quit_flag_)
             break;
     }
@@ -591,7 +748,7 @@ void MsdIntelDevice::ProcessCompletedCommandBuffers()
         hardware_status_page(RENDER_COMMAND_STREAMER)->read_sequence_number();
     render_engine_cs_->ProcessCompletedCommandBuffers(sequence_number);
 
-    progress_->Completed(sequence_number);
+    progress_->Completed(sequence_number, std::chrono::steady_clock::now());
 }
 
 magma::Status MsdIntelDevice::ProcessInterrupts(uint64_t interrupt_time_ns)
@@ -617,9 +774,7 @@ magma::Status MsdIntelDevice::ProcessInterrupts(uint64_t interrupt_time_ns)
             bool fault = registers::AllEngineFault::read(register_io_.get()) &
                          registers::AllEngineFault::kValid;
             if (fault) {
-                std::string s;
-                DumpToString(s);
-                magma::log(magma::LOG_WARNING, "GPU fault detected\n%s", s.c_str());
+                ReportGpuError(ErrorState::kReasonFault, "GPU fault detected");
                 RenderEngineReset();
             } else {
                 ProcessCompletedCommandBuffers();
@@ -655,15 +810,70 @@ magma::Status MsdIntelDevice::ProcessDumpStatusToLog()
     return MAGMA_STATUS_OK;
 }
 
+magma::Status MsdIntelDevice::ProcessErrorState()
+{
+    CHECK_THREAD_IS_CURRENT(device_thread_id_);
+
+    uint32_t size_bytes;
+    {
+        std::lock_guard<std::mutex> lock(error_state_mutex_);
+        for (auto& batch : error_state_batches_) {
+            RenderEngineCommandStreamer::WriteErrorStateBatch(error_state_.get(), batch);
+        }
+        error_state_->Complete();
+        size_bytes = error_state_->size_bytes();
+    }
+    // Releases the batch mappings outside the lock.
+    error_state_batches_.clear();
+
+    magma::log(magma::LOG_WARNING,
+               "%u bytes of error state available from msd_intel_device_export_error_state",
+               size_bytes);
+    return MAGMA_STATUS_OK;
+}
+
+void MsdIntelDevice::ReportGpuError(ErrorState::Reason reason, const char* message)
+{
+    if (!error_state_) {
+        std::string s;
+        DumpToString(s);
+        magma::log(magma::LOG_WARNING, "%s\n%s", message, s.c_str());
+        return;
+    }
+
+    CaptureErrorState(reason);
+    magma::log(magma::LOG_WARNING, "%s; error state captured", message);
+    // Batch contents are added once the engine has been reset.
+    EnqueueDeviceRequest(std::make_unique<ErrorStateRequest>());
+}
+
+void MsdIntelDevice::HangCheck()
+{
+    CHECK_THREAD_IS_CURRENT(device_thread_id_);
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_hang_check_time_ < std::chrono::milliseconds(kHangCheckPeriodMs))
+        return;
+    last_hang_check_time_ = now;
+
+    uint32_t sequence_number =
+        hardware_status_page(RENDER_COMMAND_STREAMER)->read_sequence_number();
+    if (progress_->CheckForHang(sequence_number, render_engine_cs_->GetActiveHeadPointer(), now))
+        SuspectedGpuHang();
+}
+
 void MsdIntelDevice::SuspectedGpuHang()
 {
-    std::string s;
-    DumpToString(s);
+    FlightRecorder::Get()->Record(FlightRecorder::kHang,
+                                  progress_->last_submitted_sequence_number());
+
     uint32_t master_interrupt_control = registers::MasterInterruptControl::read(register_io_.get());
-    magma::log(magma::LOG_WARNING,
-               "Suspected GPU hang: last submitted sequence number "
-               "0x%x master_interrupt_control 0x%08x\n%s",
-               progress_->last_submitted_sequence_number(), master_interrupt_control, s.c_str());
+    char message[128];
+    std::snprintf(message, sizeof(message),
+                  "Suspected GPU hang: last submitted sequence number 0x%x "
+                  "master_interrupt_control 0x%08x",
+                  progress_->last_submitted_sequence_number(), master_interrupt_control);
+    ReportGpuError(ErrorState::kReasonHang, message);
     RenderEngineReset();
 }
 
@@ -672,6 +882,8 @@ magma::Status MsdIntelDevice::ProcessCommandBuffer(std::unique_ptr<CommandBuffer
     CHECK_THREAD_IS_CURRENT(device_thread_id_);
     TRACE_DURATION("magma", "ProcessCommandBuffer");
 
+    command_buffer->times().pickup_ns = BatchTimes::now_ns();
+
     DLOG("preparing command buffer for execution");
 
     auto context = command_buffer->GetContext().lock();
@@ -692,18 +904,33 @@ magma::Status MsdIntelDevice::ProcessCommandBuffer(std::unique_ptr<CommandBuffer
     render_engine_cs_->SubmitCommandBuffer(std::move(command_buffer));
     TRACE_DURATION_END("magma", "SubmitCommandBuffer");
 
-    RequestMaxFreq();
-
     return MAGMA_STATUS_OK;
 }
 
+void MsdIntelDevice::batch_completed(MappedBatch* mapped_batch)
+{
+    auto context = mapped_batch->GetContext().lock();
+    if (!context)
+        return;
+    context->AddGpuRuntime(mapped_batch->times().gpu_runtime_ns(timestamp_period_ps_));
+
+    auto connection = context->connection().lock();
+    if (!connection)
+        return;
+    connection->latency_stats()->Record(mapped_batch->times(), timestamp_period_ps_);
+}
+
 magma::Status MsdIntelDevice::ProcessDestroyContext(std::shared_ptr<ClientContext> client_context)
 {
     DLOG("ProcessDestroyContext");
     TRACE_DURATION("magma", "ProcessDestroyContext");
 
     CHECK_THREAD_IS_CURRENT(device_thread_id_);
-    // Just let it go out of scope
+
+    // If nothing else references the context then all of its batches have retired, so its
+    // backing store can be reused; otherwise just let it go out of scope.
+    if (client_context.use_count() == 1)
+        render_engine_cs_->RecycleContext(client_context.get());
 
     return MAGMA_STATUS_OK;
 }
@@ -746,6 +973,9 @@ magma::Status MsdIntelDevice::ProcessFlip(
         return DRET_MSG(MAGMA_STATUS_MEMORY_ERROR, "Couldn't map buffer to gtt");
     }
 
+    FlightRecorder::Get()->Record(FlightRecorder::kFlip, buffer->platform_buffer()->id(),
+                                  mapping->gpu_addr());
+
     uint32_t pipe_number = 0;
     registers::PipeRegs pipe(pipe_number);
 
@@ -834,13 +1064,26 @@ bool MsdIntelDevice::WaitIdle()
     return true;
 }
 
+void MsdIntelDevice::UpdateFrequency()
+{
+    CHECK_THREAD_IS_CURRENT(device_thread_id_);
+
+    // Boost while a flip waits on rendering.
+    bool flip_pending;
+    {
+        std::unique_lock<std::mutex> lock(pageflip_request_mutex_);
+        flip_pending = !pageflip_pending_queue_.empty();
+    }
+    frequency_governor_->Sample(progress_->work_outstanding(), flip_pending,
+                                std::chrono::steady_clock::now());
+}
+
 void MsdIntelDevice::RequestMaxFreq()
 {
     CHECK_THREAD_IS_CURRENT(device_thread_id_);
 
-    uint32_t mhz = registers::RenderPerformanceStateCapability::read_rp0_frequency(register_io());
-    registers::RenderPerformanceNormalFrequencyRequest::write_frequency_request_gen9(register_io(),
-                                                                                     mhz);
+    frequency_governor_->Sample(progress_->work_outstanding(), true,
+                                std::chrono::steady_clock::now());
 }
 
 uint32_t MsdIntelDevice::GetCurrentFrequency()
@@ -929,11 +1172,54 @@ uint32_t msd_device_get_id(msd_device_t* dev) { return MsdIntelDevice::cast(dev)
 magma_status_t msd_device_query(msd_device_t* device, uint64_t id, uint64_t* value_out)
 {
     switch (id) {
-        case MAGMA_QUERY_VENDOR_PARAM_0:
+        case kMsdIntelGenQuerySubsliceAndEuTotal:
             *value_out = MsdIntelDevice::cast(device)->subslice_total();
             *value_out = (*value_out << 32) | MsdIntelDevice::cast(device)->eu_total();
             return MAGMA_STATUS_OK;
     }
+
+    if (id >= kMsdIntelGenQueryRegisterProfile &&
+        id < kMsdIntelGenQueryRegisterProfile + kMsdIntelGenQueryRegisterProfileCount) {
+        RegisterProfiler* profiler = MsdIntelDevice::cast(device)->register_profiler();
+        if (!profiler)
+            return DRET_MSG(MAGMA_STATUS_INVALID_ARGS, "register profiler not enabled");
+        uint32_t rank = id - kMsdIntelGenQueryRegisterProfile;
+        auto registers = profiler->TopRegisters(rank + 1);
+        *value_out = 0;
+        if (rank < registers.size()) {
+            uint64_t count = registers[rank].read_count + registers[rank].write_count;
+            *value_out = static_cast<uint64_t>(registers[rank].offset) << 32 |
+                         std::min(count, static_cast<uint64_t>(UINT32_MAX));
+        }
+        return MAGMA_STATUS_OK;
+    }
+
+    uint32_t client_id = id >> 32;
+    auto connection_stats = [device, client_id]() {
+        return MsdIntelDevice::cast(device)->GetLatencyStats(client_id != 0, client_id);
+    };
+
+    uint32_t latency_index = static_cast<uint32_t>(id) - kMsdIntelGenQueryBatchLatency;
+    if (static_cast<uint32_t>(id) >= kMsdIntelGenQueryBatchLatency &&
+        latency_index < kMsdIntelGenBatchLatencyStageCount * kMsdIntelGenBatchLatencyBucketCount) {
+        auto stage = static_cast<MsdIntelGenBatchLatencyStage>(
+            latency_index / kMsdIntelGenBatchLatencyBucketCount);
+        uint32_t bucket = latency_index % kMsdIntelGenBatchLatencyBucketCount;
+        *value_out = 0;
+        for (auto& stats : connection_stats()) {
+            *value_out += stats->count(stage, bucket);
+        }
+        return MAGMA_STATUS_OK;
+    }
+
+    if (static_cast<uint32_t>(id) == kMsdIntelGenQueryGpuRuntime) {
+        *value_out = 0;
+        for (auto& stats : connection_stats()) {
+            *value_out += stats->gpu_runtime_ns();
+        }
+        return MAGMA_STATUS_OK;
+    }
+
     return DRET_MSG(MAGMA_STATUS_INVALID_ARGS, "unhandled id %" PRIu64, id);
 }
 
@@ -947,3 +1233,46 @@ magma_status_t msd_device_display_get_size(msd_device_t* dev, magma_display_size
     *size_out = MsdIntelDevice::cast(dev)->display_size();
     return MAGMA_STATUS_OK;
 }
+
+// Hands |data| to the client as a new buffer, which may be larger than the data.
+static magma_status_t ExportBuffer(const std::vector<uint8_t>& data, const char* name,
+                                   uint32_t* buffer_handle_out, uint64_t* size_out)
+{
+    if (data.empty())
+        return DRET_MSG(MAGMA_STATUS_INVALID_ARGS, "nothing to export");
+
+    auto buffer = magma::PlatformBuffer::Create(data.size(), name);
+    if (!buffer)
+        return DRET_MSG(MAGMA_STATUS_MEMORY_ERROR, "couldn't create buffer");
+
+    void* addr;
+    if (!buffer->MapCpu(&addr))
+        return DRET_MSG(MAGMA_STATUS_MEMORY_ERROR, "couldn't map buffer");
+    memcpy(addr, data.data(), data.size());
+    buffer->UnmapCpu();
+
+    if (!buffer->duplicate_handle(buffer_handle_out))
+        return DRET_MSG(MAGMA_STATUS_INTERNAL_ERROR, "couldn't duplicate buffer handle");
+    *size_out = data.size();
+    return MAGMA_STATUS_OK;
+}
+
+magma_status_t msd_intel_device_export_register_trace(msd_device_t* device,
+                                                      uint32_t* buffer_handle_out,
+                                                      uint64_t* size_out)
+{
+    RegisterTraceRecorder* recorder = MsdIntelDevice::cast(device)->register_trace_recorder();
+    if (!recorder)
+        return DRET_MSG(MAGMA_STATUS_INVALID_ARGS, "register trace not enabled");
+    return ExportBuffer(recorder->Serialize(), "register-trace", buffer_handle_out, size_out);
+}
+
+magma_status_t msd_intel_device_export_error_state(msd_device_t* device,
+                                                   uint32_t* buffer_handle_out,
+                                                   uint64_t* size_out)
+{
+    std::vector<uint8_t> error_state = MsdIntelDevice::cast(device)->CopyErrorState();
+    if (error_state.empty())
+        return DRET_MSG(MAGMA_STATUS_INVALID_ARGS, "no complete error state");
+    return ExportBuffer(error_state, "error-state", buffer_handle_out, size_out);
+}
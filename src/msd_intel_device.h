@@ -7,19 +7,26 @@
 
 #include "device_request.h"
 #include "engine_command_streamer.h"
+#include "error_state.h"
+#include "flight_recorder.h"
+#include "forcewake_manager.h"
+#include "frequency_governor.h"
 #include "global_context.h"
 #include "gpu_progress.h"
 #include "gtt.h"
 #include "magma_util/fps_printer.h"
 #include "magma_util/macros.h"
-#include "magma_util/semaphore_port.h"
 #include "magma_util/thread.h"
 #include "msd.h"
 #include "msd_intel_connection.h"
 #include "platform_pci_device.h"
 #include "platform_semaphore.h"
 #include "register_io.h"
+#include "register_profiler.h"
+#include "register_trace.h"
 #include "sequencer.h"
+#include "wait_reactor.h"
+#include <chrono>
 #include <deque>
 #include <list>
 #include <mutex>
@@ -34,6 +41,14 @@ public:
     // to enable device request processing.
     static std::unique_ptr<MsdIntelDevice> Create(void* device_handle, bool start_device_thread);
 
+    // Creates a device on |platform_device|. If given, |register_hook| is installed before the
+    // first register access, and buffer pages are mapped for the gpu through |bus_mapper| rather
+    // than the platform; a simulated gpu observes the driver this way.
+    static std::unique_ptr<MsdIntelDevice>
+    Create(std::unique_ptr<magma::PlatformPciDevice> platform_device,
+           std::unique_ptr<RegisterIo::Hook> register_hook, std::unique_ptr<BusMapper> bus_mapper,
+           bool start_device_thread);
+
     virtual ~MsdIntelDevice();
 
     // This takes ownership of the connection so that ownership can be
@@ -45,6 +60,17 @@ public:
     uint32_t eu_total() { return eu_total_; }
     magma_display_size display_size() { return display_size_; }
 
+    // Returns the batch stats of the open connections, or only those whose client id has
+    // |client_id| as its low 32 bits if |match_client_id|. Thread safe.
+    std::vector<std::shared_ptr<BatchLatencyStats>> GetLatencyStats(bool match_client_id,
+                                                                    uint32_t client_id);
+
+    // Null unless the driver was built with the register profiler enabled. Thread safe.
+    RegisterProfiler* register_profiler() { return register_profiler_; }
+
+    // Null unless the driver was built to record a register trace. Thread safe.
+    RegisterTraceRecorder* register_trace_recorder() { return register_trace_recorder_; }
+
     static MsdIntelDevice* cast(msd_device_t* dev)
     {
         DASSERT(dev);
@@ -53,12 +79,17 @@ public:
     }
 
     bool Init(void* device_handle);
+    bool Init(std::unique_ptr<magma::PlatformPciDevice> platform_device,
+              std::unique_ptr<RegisterIo::Hook> register_hook,
+              std::unique_ptr<BusMapper> bus_mapper);
 
     struct DumpState {
         struct RenderCommandStreamer {
             uint32_t sequence_number;
             uint64_t active_head_pointer;
             std::vector<MappedBatch*> inflight_batches;
+            CompletionSignaler::Stats completion_stats;
+            EngineCommandStreamer::SubmitStats submit_stats;
         } render_cs;
 
         bool fault_present;
@@ -67,12 +98,30 @@ public:
         uint8_t fault_type;
         uint64_t fault_gpu_address;
         bool global;
+
+        ForceWakeManager::Stats forcewake_stats;
+
+        // Empty unless the register profiler is enabled.
+        std::vector<RegisterProfiler::RegisterStats> register_profile;
+        uint64_t register_profile_untracked_count;
+
+        bool register_trace_enabled;
+        uint64_t register_trace_record_count;
+        uint64_t register_trace_dropped_count;
+
+        std::vector<std::shared_ptr<BatchLatencyStats>> connection_stats;
+
+        std::vector<FlightRecorder::Event> flight_recorder_events;
     };
 
     void Dump(DumpState* dump_state);
     void DumpToString(std::string& dump_string);
     void DumpStatusToLog();
 
+    // Returns a copy of the last error state captured, or nothing if there's none, it's still
+    // being captured, or capture is disabled. Thread safe.
+    std::vector<uint8_t> CopyErrorState();
+
     void DisplayGetSize(magma_display_size* size_out);
 
     void PresentBuffer(std::shared_ptr<MsdIntelBuffer> buffer,
@@ -81,6 +130,27 @@ public:
                        std::vector<std::shared_ptr<magma::PlatformSemaphore>> signal_semaphores,
                        present_buffer_callback_t callback) override;
 
+    WaitReactor* wait_reactor() override { return wait_reactor_.get(); }
+
+    CompletionSignaler* completion_signaler() override
+    {
+        return render_engine_cs_->completion_signaler();
+    }
+
+    BusMapper* bus_mapper() override
+    {
+        return bus_mapper_ ? bus_mapper_.get() : BusMapper::Platform();
+    }
+
+    void BeginFrequencyBoost() override
+    {
+        frequency_governor_->BeginBoost();
+        // Wake the device thread to apply the boost.
+        device_request_semaphore_->Signal();
+    }
+
+    void EndFrequencyBoost() override { frequency_governor_->EndBoost(); }
+
 private:
     MsdIntelDevice();
 
@@ -111,12 +181,15 @@ private:
     // EngineCommandStreamer::Owner
     HardwareStatusPage* hardware_status_page(EngineCommandStreamerId id) override;
 
-    void batch_submitted(uint32_t sequence_number) override
+    void batch_submitted(uint32_t sequence_number, uint32_t hang_budget_ms) override
     {
         DASSERT(progress_);
-        progress_->Submitted(sequence_number);
+        progress_->Submitted(sequence_number, hang_budget_ms, std::chrono::steady_clock::now());
     }
 
+    // EngineCommandStreamer::Owner
+    void batch_completed(MappedBatch* mapped_batch) override;
+
     // MsdIntelConnection::Owner
     magma::Status SubmitCommandBuffer(std::unique_ptr<CommandBuffer> cmd_buf) override;
     void DestroyContext(std::shared_ptr<ClientContext> client_context) override;
@@ -130,6 +203,8 @@ private:
     bool RenderEngineReset();
 
     void ProcessCompletedCommandBuffers();
+    // Samples engine progress at most once per kHangCheckPeriodMs.
+    void HangCheck();
     void SuspectedGpuHang();
 
     magma::Status ProcessCommandBuffer(std::unique_ptr<CommandBuffer> command_buffer);
@@ -143,6 +218,7 @@ private:
                 present_buffer_callback_t callback);
     magma::Status ProcessInterrupts(uint64_t interrupt_time_ns);
     magma::Status ProcessDumpStatusToLog();
+    magma::Status ProcessErrorState();
 
     void ProcessPendingFlip();
     void ProcessPendingFlipSync();
@@ -152,15 +228,25 @@ private:
     bool WaitIdle();
 
     uint32_t GetCurrentFrequency();
+    // Samples engine busyness for the frequency governor.
+    void UpdateFrequency();
+    // Requests RP0 for one governor sample.
     void RequestMaxFreq();
 
+    // Snapshots the gpu into the preallocated error state without allocating or mapping
+    // buffers; cheap enough to do before the engine is reset. The batch contents are added by
+    // ProcessErrorState.
+    void CaptureErrorState(ErrorState::Reason reason);
+    // Logs |message|, then the device dump; or if error state capture is enabled, captures the
+    // error state and completes it from a request once the engine has been reset.
+    void ReportGpuError(ErrorState::Reason reason, const char* message);
+
     static void DumpFault(DumpState* dump_out, uint32_t fault);
     static void DumpFaultAddress(DumpState* dump_out, RegisterIo* register_io);
     void FormatDump(DumpState& dump_state, std::string& dump_string);
 
     int DeviceThreadLoop();
     int InterruptThreadLoop();
-    void WaitThreadLoop();
 
     void QuerySliceInfo(uint32_t* subslice_total_out, uint32_t* eu_total_out);
     void ReadDisplaySize();
@@ -175,22 +261,39 @@ private:
 
     static const uint32_t kMagic = 0x64657669; //"devi"
 
+    // Engine progress is sampled this often while work is outstanding; each context's hang
+    // budget sets how long the engine may go without progress.
+    static constexpr uint32_t kHangCheckPeriodMs = 10;
+
     uint32_t device_id_{};
     uint32_t subslice_total_{};
     uint32_t eu_total_{};
     magma_display_size display_size_{};
+    uint64_t timestamp_period_ps_{};
 
     std::thread device_thread_;
     std::unique_ptr<magma::PlatformThreadId> device_thread_id_;
     std::atomic_bool device_thread_quit_flag_{false};
     std::atomic_bool interrupt_thread_quit_flag_{false};
     std::unique_ptr<GpuProgress> progress_;
+    std::unique_ptr<FrequencyGovernor> frequency_governor_;
+    std::chrono::steady_clock::time_point last_hang_check_time_;
 
     std::thread interrupt_thread_;
-    std::thread wait_thread_;
 
     std::unique_ptr<magma::PlatformPciDevice> platform_device_;
+    // Null to map through the platform; outlives the address spaces.
+    std::unique_ptr<BusMapper> bus_mapper_;
     std::unique_ptr<RegisterIo> register_io_;
+    // Owned by register_io_.
+    ForceWakeManager* forcewake_ = nullptr;
+    RegisterProfiler* register_profiler_ = nullptr;
+    RegisterTraceRecorder* register_trace_recorder_ = nullptr;
+    // Guards the error state, which is copied out from other threads.
+    std::mutex error_state_mutex_;
+    std::unique_ptr<ErrorStateWriter> error_state_;
+    // Reserved up front; batches captured but not yet added to the error state.
+    std::vector<RenderEngineCommandStreamer::ErrorStateBatch> error_state_batches_;
     std::shared_ptr<Gtt> gtt_;
     std::unique_ptr<RenderEngineCommandStreamer> render_engine_cs_;
     std::shared_ptr<GlobalContext> global_context_;
@@ -198,7 +301,7 @@ private:
     std::shared_ptr<magma::PlatformBuffer> scratch_buffer_;
     std::unique_ptr<magma::PlatformInterrupt> interrupt_;
     std::shared_ptr<GpuMappingCache> mapping_cache_;
-    std::unique_ptr<magma::SemaphorePort> semaphore_port_;
+    std::unique_ptr<WaitReactor> wait_reactor_;
 
     // page flipping
     std::shared_ptr<magma::PlatformSemaphore> flip_ready_semaphore_;
@@ -212,12 +315,16 @@ private:
     class ReleaseBufferRequest;
     class InterruptRequest;
     class DumpRequest;
+    class ErrorStateRequest;
 
     // Thread-shared data members
     std::unique_ptr<magma::PlatformSemaphore> device_request_semaphore_;
     std::mutex device_request_mutex_;
     std::list<std::unique_ptr<DeviceRequest>> device_request_list_;
 
+    std::mutex latency_stats_mutex_;
+    std::vector<std::weak_ptr<BatchLatencyStats>> latency_stats_;
+
     std::mutex pageflip_request_mutex_;
     std::queue<std::unique_ptr<FlipRequest>> pageflip_pending_queue_;
     std::queue<std::unique_ptr<FlipRequest>> pageflip_pending_sync_queue_;
@@ -228,4 +335,16 @@ private:
     friend class TestCommandBuffer;
 };
 
+// Returns a buffer holding, in its first |size_out| bytes, a snapshot of the register trace
+// recorded so far. Fails unless the driver was built with a register trace size.
+magma_status_t msd_intel_device_export_register_trace(msd_device_t* device,
+                                                      uint32_t* buffer_handle_out,
+                                                      uint64_t* size_out);
+
+// Returns a buffer holding, in its first |size_out| bytes, the error state captured at the last
+// gpu hang or fault. Fails if there's none or it isn't complete yet.
+magma_status_t msd_intel_device_export_error_state(msd_device_t* device,
+                                                   uint32_t* buffer_handle_out,
+                                                   uint64_t* size_out);
+
 #endif // MSD_DEVICE_H
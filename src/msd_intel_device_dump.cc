@@ -3,299 +3,39 @@
 // found in the LICENSE file.
 
 #include "msd_intel_device.h"
+#include "instruction_decoder.h"
 #include "registers.h"
 #include <memory>
 #include <string>
 
-class InstructionDecoder {
-public:
-    enum Id {
-        NOOP = 0x0,
-        MI_BATCH_BUFFER_END = 0x0500,
-        LOAD_REGISTER_IMM = 0x1100,
-        _3DSTATE_CLEAR_PARAMS = 0x7804,
-        _3DSTATE_DEPTH_BUFFER = 0x7805,
-        _3DSTATE_STENCIL_BUFFER = 0x7806,
-        _3DSTATE_HIER_DEPTH_BUFFER = 0x7807,
-        _3DSTATE_VERTEX_BUFFERS = 0x7808,
-        _3DSTATE_VERTEX_ELEMENTS = 0x7809,
-        _3DSTATE_MULTISAMPLE = 0x780d,
-        _3DSTATE_INDEX_BUFFER = 0x780a,
-        _3DSTATE_VF = 0x780c,
-        _3DSTATE_SCISSOR_STATE_POINTERS = 0x780f,
-        _3DSTATE_VS = 0x7810,
-        _3DSTATE_GS = 0x7811,
-        _3DSTATE_CLIP = 0x7812,
-        _3DSTATE_SF = 0x7813,
-        _3DSTATE_WM = 0x7814,
-        _3DSTATE_CONSTANT_VS = 0x7815,
-        _3DSTATE_CONSTANT_GS = 0x7816,
-        _3DSTATE_CONSTANT_PS = 0x7817,
-        _3DSTATE_SAMPLE_MASK = 0x7818,
-        _3DSTATE_CONSTANT_HS = 0x7819,
-        _3DSTATE_CONSTANT_DS = 0x781a,
-        _3DSTATE_HS = 0x781b,
-        _3DSTATE_TE = 0x781c,
-        _3DSTATE_DS = 0x781d,
-        _3DSTATE_STREAMOUT = 0x781e,
-        _3DSTATE_SBE = 0x781f,
-        _3DSTATE_PS = 0x7820,
-        _3DSTATE_VIEWPORT_STATE_POINTERS_SF_CLIP = 0x7821,
-        _3DSTATE_VIEWPORT_STATE_POINTERS_CC = 0x7823,
-        _3DSTATE_BINDING_TABLE_POINTERS_VS = 0x7826,
-        _3DSTATE_BINDING_TABLE_POINTERS_HS = 0x7827,
-        _3DSTATE_BINDING_TABLE_POINTERS_DS = 0x7828,
-        _3DSTATE_BINDING_TABLE_POINTERS_GS = 0x7829,
-        _3DSTATE_BINDING_TABLE_POINTERS_PS = 0x782a,
-        _3DSTATE_SAMPLER_STATE_POINTERS_PS = 0x782f,
-        _3DSTATE_CC_STATE_POINTERS = 0x780e,
-        _3DSTATE_BLEND_STATE_POINTERS = 0x7824,
-        _3DSTATE_URB_VS = 0x7830,
-        _3DSTATE_URB_HS = 0x7831,
-        _3DSTATE_URB_DS = 0x7832,
-        _3DSTATE_URB_GS = 0x7833,
-        _3DSTATE_VF_INSTANCING = 0x7849,
-        _3DSTATE_VF_SGVS = 0x784a,
-        _3DSTATE_VF_TOPOLOGY = 0x784b,
-        _3DSTATE_PS_BLEND = 0x784d,
-        _3DSTATE_WM_DEPTH_STENCIL = 0x784e,
-        _3DSTATE_PS_EXTRA = 0x784f,
-        _3DSTATE_RASTER = 0x7850,
-        _3DSTATE_SBE_SWIZ = 0x7851,
-        _3DSTATE_WM_HZ_OP = 0x7852,
-        _3DSTATE_PUSH_CONSTANT_ALLOC_VS = 0x7912,
-        _3DSTATE_PUSH_CONSTANT_ALLOC_HS = 0x7913,
-        _3DSTATE_PUSH_CONSTANT_ALLOC_DS = 0x7914,
-        _3DSTATE_PUSH_CONSTANT_ALLOC_GS = 0x7915,
-        _3DSTATE_PUSH_CONSTANT_ALLOC_PS = 0x7916,
-        PIPE_CONTROL = 0x7a00,
-        _3DPRIMITIVE = 0x7b00,
-        STATE_BASE_ADDRESS = 0x6101,
-        PIPELINE_SELECT = 0x6904,
-    };
-
-    static const char* name(Id id)
-    {
-        switch (id) {
-            case _3DSTATE_VERTEX_BUFFERS:
-                return "3DSTATE_VERTEX_BUFFERS";
-            case _3DSTATE_VERTEX_ELEMENTS:
-                return "3DSTATE_VERTEX_ELEMENTS";
-            case LOAD_REGISTER_IMM:
-                return "LOAD_REGISTER_IMM";
-            case PIPE_CONTROL:
-                return "PIPE_CONTROL";
-            case PIPELINE_SELECT:
-                return "PIPELINE_SELECT";
-            case STATE_BASE_ADDRESS:
-                return "STATE_BASE_ADDRESS";
-            case _3DSTATE_VF_SGVS:
-                return "3DSTATE_VF_SGVS";
-            case _3DSTATE_VF_INSTANCING:
-                return "3DSTATE_VF_INSTANCING";
-            case _3DSTATE_VF_TOPOLOGY:
-                return "3DSTATE_VF_TOPOLOGY";
-            case _3DSTATE_URB_VS:
-                return "3DSTATE_URB_VS";
-            case _3DSTATE_URB_HS:
-                return "3DSTATE_URB_HS";
-            case _3DSTATE_URB_DS:
-                return "3DSTATE_URB_DS";
-            case _3DSTATE_URB_GS:
-                return "3DSTATE_URB_GS";
-            case _3DSTATE_BLEND_STATE_POINTERS:
-                return "3DSTATE_BLEND_STATE_POINTERS";
-            case _3DSTATE_PS_BLEND:
-                return "3DSTATE_PS_BLEND";
-            case _3DSTATE_CC_STATE_POINTERS:
-                return "3DSTATE_CC_STATE_POINTERS";
-            case _3DSTATE_WM_DEPTH_STENCIL:
-                return "3DSTATE_WM_DEPTH_STENCIL";
-            case _3DSTATE_CONSTANT_VS:
-                return "3DSTATE_CONSTANT_VS";
-            case _3DSTATE_CONSTANT_HS:
-                return "3DSTATE_CONSTANT_HS";
-            case _3DSTATE_CONSTANT_DS:
-                return "3DSTATE_CONSTANT_DS";
-            case _3DSTATE_CONSTANT_GS:
-                return "3DSTATE_CONSTANT_GS";
-            case _3DSTATE_CONSTANT_PS:
-                return "3DSTATE_CONSTANT_PS";
-            case _3DSTATE_BINDING_TABLE_POINTERS_VS:
-                return "3DSTATE_BINDING_TABLE_POINTERS_VS";
-            case _3DSTATE_BINDING_TABLE_POINTERS_HS:
-                return "3DSTATE_BINDING_TABLE_POINTERS_HS";
-            case _3DSTATE_BINDING_TABLE_POINTERS_DS:
-                return "3DSTATE_BINDING_TABLE_POINTERS_DS";
-            case _3DSTATE_BINDING_TABLE_POINTERS_GS:
-                return "3DSTATE_BINDING_TABLE_POINTERS_GS";
-            case _3DSTATE_BINDING_TABLE_POINTERS_PS:
-                return "3DSTATE_BINDING_TABLE_POINTERS_PS";
-            case _3DSTATE_SAMPLER_STATE_POINTERS_PS:
-                return "3DSTATE_SAMPLER_STATE_POINTERS_PS";
-            case _3DSTATE_MULTISAMPLE:
-                return "3DSTATE_MULTISAMPLE";
-            case _3DSTATE_SAMPLE_MASK:
-                return "3DSTATE_SAMPLE_MASK";
-            case _3DSTATE_VS:
-                return "3DSTATE_VS";
-            case _3DSTATE_HS:
-                return "3DSTATE_HS";
-            case _3DSTATE_TE:
-                return "3DSTATE_TE";
-            case _3DSTATE_DS:
-                return "3DSTATE_DS";
-            case _3DSTATE_STREAMOUT:
-                return "3DSTATE_STREAMOUT";
-            case _3DSTATE_GS:
-                return "3DSTATE_GS";
-            case _3DSTATE_CLIP:
-                return "3DSTATE_CLIP";
-            case _3DSTATE_SF:
-                return "3DSTATE_SF";
-            case _3DSTATE_RASTER:
-                return "3DSTATE_RASTER";
-            case _3DSTATE_SBE:
-                return "3DSTATE_SBE";
-            case _3DSTATE_WM:
-                return "3DSTATE_WM";
-            case _3DSTATE_PS:
-                return "3DSTATE_PS";
-            case _3DSTATE_PS_EXTRA:
-                return "3DSTATE_PS_EXTRA";
-            case _3DSTATE_VIEWPORT_STATE_POINTERS_CC:
-                return "3DSTATE_VIEWPORT_STATE_POINTERS_CC";
-            case _3DSTATE_DEPTH_BUFFER:
-                return "3DSTATE_DEPTH_BUFFER";
-            case _3DSTATE_HIER_DEPTH_BUFFER:
-                return "3DSTATE_HIER_DEPTH_BUFFER";
-            case _3DSTATE_STENCIL_BUFFER:
-                return "3DSTATE_STENCIL_BUFFER";
-            case _3DSTATE_CLEAR_PARAMS:
-                return "3DSTATE_CLEAR_PARAMS";
-            case _3DPRIMITIVE:
-                return "3DPRIMITIVE";
-            case _3DSTATE_INDEX_BUFFER:
-                return "3DSTATE_INDEX_BUFFER";
-            case _3DSTATE_SBE_SWIZ:
-                return "3DSTATE_SBE_SWIZ";
-            case _3DSTATE_PUSH_CONSTANT_ALLOC_VS:
-                return "3DSTATE_PUSH_CONSTANT_ALLOC_VS";
-            case _3DSTATE_PUSH_CONSTANT_ALLOC_HS:
-                return "3DSTATE_PUSH_CONSTANT_ALLOC_HS";
-            case _3DSTATE_PUSH_CONSTANT_ALLOC_DS:
-                return "3DSTATE_PUSH_CONSTANT_ALLOC_DS";
-            case _3DSTATE_PUSH_CONSTANT_ALLOC_GS:
-                return "3DSTATE_PUSH_CONSTANT_ALLOC_GS";
-            case _3DSTATE_PUSH_CONSTANT_ALLOC_PS:
-                return "3DSTATE_PUSH_CONSTANT_ALLOC_PS";
-            case _3DSTATE_WM_HZ_OP:
-                return "3DSTATE_WM_HZ_OP";
-            case _3DSTATE_VIEWPORT_STATE_POINTERS_SF_CLIP:
-                return "3DSTATE_VIEWPORT_STATE_POINTERS_SF_CLIP";
-            case _3DSTATE_SCISSOR_STATE_POINTERS:
-                return "3DSTATE_SCISSOR_STATE_POINTERS";
-            case _3DSTATE_VF:
-                return "3DSTATE_VF";
-            case MI_BATCH_BUFFER_END:
-                return "MI_BATCH_BUFFER_END";
-            case NOOP:
-                return "NOOP";
-        }
-        return "UNKNOWN";
-    }
-
-    static bool Decode(uint32_t dword, Id* id_out, uint32_t* dword_count_out)
-    {
-        if (dword == 0) {
-            *id_out = NOOP;
-            *dword_count_out = 1;
-            return true;
-        }
-
-        uint16_t id = dword >> 16;
-        switch (id) {
-            case PIPELINE_SELECT:
-            case MI_BATCH_BUFFER_END:
-                *dword_count_out = 1;
-                break;
-            case LOAD_REGISTER_IMM:
-                *dword_count_out = 3;
-                break;
-            case _3DSTATE_BLEND_STATE_POINTERS:
-            case _3DSTATE_CC_STATE_POINTERS:
-            case _3DSTATE_VIEWPORT_STATE_POINTERS_CC:
-                *dword_count_out = 2;
-                break;
-            case _3DSTATE_VF:
-            case _3DSTATE_SCISSOR_STATE_POINTERS:
-            case _3DSTATE_VIEWPORT_STATE_POINTERS_SF_CLIP:
-            case _3DSTATE_PUSH_CONSTANT_ALLOC_PS:
-            case _3DSTATE_PUSH_CONSTANT_ALLOC_GS:
-            case _3DSTATE_PUSH_CONSTANT_ALLOC_DS:
-            case _3DSTATE_PUSH_CONSTANT_ALLOC_HS:
-            case _3DSTATE_PUSH_CONSTANT_ALLOC_VS:
-            case _3DSTATE_SBE_SWIZ:
-            case _3DSTATE_INDEX_BUFFER:
-            case _3DPRIMITIVE:
-            case _3DSTATE_CLEAR_PARAMS:
-            case _3DSTATE_STENCIL_BUFFER:
-            case _3DSTATE_HIER_DEPTH_BUFFER:
-            case _3DSTATE_DEPTH_BUFFER:
-            case _3DSTATE_PS_EXTRA:
-            case _3DSTATE_PS:
-            case _3DSTATE_WM:
-            case _3DSTATE_SBE:
-            case _3DSTATE_RASTER:
-            case _3DSTATE_SF:
-            case _3DSTATE_CLIP:
-            case _3DSTATE_GS:
-            case _3DSTATE_STREAMOUT:
-            case _3DSTATE_DS:
-            case _3DSTATE_TE:
-            case _3DSTATE_VS:
-            case _3DSTATE_HS:
-            case _3DSTATE_SAMPLE_MASK:
-            case _3DSTATE_MULTISAMPLE:
-            case _3DSTATE_SAMPLER_STATE_POINTERS_PS:
-            case _3DSTATE_BINDING_TABLE_POINTERS_PS:
-            case _3DSTATE_BINDING_TABLE_POINTERS_GS:
-            case _3DSTATE_BINDING_TABLE_POINTERS_DS:
-            case _3DSTATE_BINDING_TABLE_POINTERS_HS:
-            case _3DSTATE_BINDING_TABLE_POINTERS_VS:
-            case _3DSTATE_CONSTANT_PS:
-            case _3DSTATE_CONSTANT_GS:
-            case _3DSTATE_CONSTANT_DS:
-            case _3DSTATE_CONSTANT_HS:
-            case _3DSTATE_CONSTANT_VS:
-            case _3DSTATE_WM_DEPTH_STENCIL:
-            case _3DSTATE_PS_BLEND:
-            case _3DSTATE_URB_GS:
-            case _3DSTATE_URB_DS:
-            case _3DSTATE_URB_HS:
-            case _3DSTATE_URB_VS:
-            case _3DSTATE_VF_TOPOLOGY:
-            case _3DSTATE_VF_INSTANCING:
-            case _3DSTATE_VF_SGVS:
-            case _3DSTATE_VERTEX_BUFFERS:
-            case _3DSTATE_VERTEX_ELEMENTS:
-            case _3DSTATE_WM_HZ_OP:
-            case PIPE_CONTROL:
-            case STATE_BASE_ADDRESS:
-                *dword_count_out = (dword & 0xFF) + 2;
-                break;
-        }
-        *id_out = static_cast<Id>(id);
-        return true;
-    }
-};
-
 void MsdIntelDevice::Dump(DumpState* dump_out)
 {
     dump_out->render_cs.sequence_number =
         global_context_->hardware_status_page(render_engine_cs_->id())->read_sequence_number();
     dump_out->render_cs.active_head_pointer = render_engine_cs_->GetActiveHeadPointer();
     dump_out->render_cs.inflight_batches = render_engine_cs_->GetInflightBatches();
+    dump_out->render_cs.completion_stats = render_engine_cs_->completion_signaler()->stats();
+    dump_out->render_cs.submit_stats = render_engine_cs_->submit_stats();
+
+    dump_out->forcewake_stats = forcewake_->stats();
+
+    constexpr uint32_t kRegisterProfileDumpCount = 10;
+    dump_out->register_profile_untracked_count = 0;
+    if (register_profiler_) {
+        dump_out->register_profile = register_profiler_->TopRegisters(kRegisterProfileDumpCount);
+        dump_out->register_profile_untracked_count = register_profiler_->untracked_count();
+    }
+
+    dump_out->register_trace_enabled = register_trace_recorder_ != nullptr;
+    if (register_trace_recorder_) {
+        dump_out->register_trace_record_count = register_trace_recorder_->record_count();
+        dump_out->register_trace_dropped_count = register_trace_recorder_->dropped_count();
+    }
+
+    dump_out->connection_stats = GetLatencyStats(false, 0);
+
+    constexpr uint32_t kFlightRecorderDumpCount = 256;
+    dump_out->flight_recorder_events = FlightRecorder::Get()->GetEvents(kFlightRecorderDumpCount);
 
     DumpFault(dump_out, registers::AllEngineFault::read(register_io_.get()));
 
@@ -305,6 +45,54 @@ void MsdIntelDevice::Dump(DumpState* dump_out)
         DumpFaultAddress(dump_out, register_io_.get());
 }
 
+void MsdIntelDevice::CaptureErrorState(ErrorState::Reason reason)
+{
+    CHECK_THREAD_IS_CURRENT(device_thread_id_);
+    DASSERT(error_state_);
+
+    static constexpr uint32_t kRegisterOffsets[] = {
+        registers::AllEngineFault::kOffset,
+        0x40A0, // ERROR
+        registers::FaultTlbReadData::kOffset0,
+        registers::FaultTlbReadData::kOffset1,
+        registers::MasterInterruptControl::kOffset,
+        registers::GtInterruptMask0::kOffset,
+        registers::GtInterruptIdentity0::kOffset,
+        registers::GtInterruptEnable0::kOffset,
+        registers::RenderPerformanceStatus::kOffset,
+    };
+
+    // Uncontended unless the previous error state is being copied out.
+    std::lock_guard<std::mutex> lock(error_state_mutex_);
+    error_state_batches_.clear();
+
+    error_state_->Begin(
+        device_id_, reason,
+        global_context_->hardware_status_page(render_engine_cs_->id())->read_sequence_number(),
+        progress_->last_submitted_sequence_number());
+
+    error_state_->BeginSection(ErrorState::kRegisters);
+    for (uint32_t offset : kRegisterOffsets) {
+        error_state_->Write32(offset);
+        error_state_->Write32(register_io_->Read32(offset));
+    }
+    error_state_->EndSection();
+
+    render_engine_cs_->CaptureErrorState(error_state_.get(), &error_state_batches_);
+}
+
+std::vector<uint8_t> MsdIntelDevice::CopyErrorState()
+{
+    if (!error_state_)
+        return {};
+    // Holding the lock keeps a new capture from starting mid copy.
+    std::lock_guard<std::mutex> lock(error_state_mutex_);
+    if (!error_state_->complete())
+        return {};
+    auto bytes = reinterpret_cast<const uint8_t*>(error_state_->dwords());
+    return std::vector<uint8_t>(bytes, bytes + error_state_->size_bytes());
+}
+
 void MsdIntelDevice::DumpFault(DumpState* dump_out, uint32_t fault)
 {
     dump_out->fault_present = registers::AllEngineFault::valid(fault);
@@ -344,6 +132,98 @@ void MsdIntelDevice::FormatDump(DumpState& dump_state, std::string& dump_out)
                   dump_state.render_cs.sequence_number, dump_state.render_cs.active_head_pointer);
     dump_out.append(&buf[0]);
 
+    {
+        auto& stats = dump_state.render_cs.completion_stats;
+        fmt = "semaphores signalled %lu in %lu batches, latency avg %lu ns max %lu ns\n";
+        uint64_t avg_latency_ns =
+            stats.latency_count ? stats.total_latency_ns / stats.latency_count : 0;
+        size = std::snprintf(nullptr, 0, fmt, stats.signal_count, stats.batch_count,
+                             avg_latency_ns, stats.max_latency_ns);
+        std::vector<char> buf(size + 1);
+        std::snprintf(&buf[0], buf.size(), fmt, stats.signal_count, stats.batch_count,
+                      avg_latency_ns, stats.max_latency_ns);
+        dump_out.append(&buf[0]);
+    }
+
+    {
+        auto& stats = dump_state.render_cs.submit_stats;
+        fmt = "context switches %lu (%u/s) lite restores %lu (%u/s)\n";
+        size = std::snprintf(nullptr, 0, fmt, stats.context_switch_count,
+                             stats.context_switches_per_second, stats.lite_restore_count,
+                             stats.lite_restores_per_second);
+        std::vector<char> buf(size + 1);
+        std::snprintf(&buf[0], buf.size(), fmt, stats.context_switch_count,
+                      stats.context_switches_per_second, stats.lite_restore_count,
+                      stats.lite_restores_per_second);
+        dump_out.append(&buf[0]);
+    }
+
+    {
+        auto& stats = dump_state.forcewake_stats;
+        fmt = "forcewake acquires %lu releases %lu, release latency avg %lu us max %lu us, "
+              "awake %lu us\n";
+        uint64_t avg_latency_us =
+            stats.release_count ? stats.total_release_latency_us / stats.release_count : 0;
+        size = std::snprintf(nullptr, 0, fmt, stats.acquire_count, stats.release_count,
+                             avg_latency_us, stats.max_release_latency_us, stats.awake_us);
+        std::vector<char> buf(size + 1);
+        std::snprintf(&buf[0], buf.size(), fmt, stats.acquire_count, stats.release_count,
+                      avg_latency_us, stats.max_release_latency_us, stats.awake_us);
+        dump_out.append(&buf[0]);
+    }
+
+    if (!dump_state.register_profile.empty()) {
+        fmt = "most accessed registers (untracked accesses %lu):\n";
+        size = std::snprintf(nullptr, 0, fmt, dump_state.register_profile_untracked_count);
+        std::vector<char> buf(size + 1);
+        std::snprintf(&buf[0], buf.size(), fmt, dump_state.register_profile_untracked_count);
+        dump_out.append(&buf[0]);
+
+        fmt = "  0x%06x reads %lu writes %lu avg %lu ns\n";
+        for (auto& reg : dump_state.register_profile) {
+            size = std::snprintf(nullptr, 0, fmt, reg.offset, reg.read_count, reg.write_count,
+                                 reg.avg_access_ns);
+            std::vector<char> buf(size + 1);
+            std::snprintf(&buf[0], buf.size(), fmt, reg.offset, reg.read_count, reg.write_count,
+                          reg.avg_access_ns);
+            dump_out.append(&buf[0]);
+        }
+    }
+
+    if (dump_state.register_trace_enabled) {
+        fmt = "register trace: %lu records, %lu dropped\n";
+        size = std::snprintf(nullptr, 0, fmt, dump_state.register_trace_record_count,
+                             dump_state.register_trace_dropped_count);
+        std::vector<char> buf(size + 1);
+        std::snprintf(&buf[0], buf.size(), fmt, dump_state.register_trace_record_count,
+                      dump_state.register_trace_dropped_count);
+        dump_out.append(&buf[0]);
+    }
+
+    for (auto& stats : dump_state.connection_stats) {
+        fmt = "connection client_id %lu: gpu runtime %lu us, %lu batches (%lu untimed)\n";
+        size = std::snprintf(nullptr, 0, fmt, stats->client_id(), stats->gpu_runtime_ns() / 1000,
+                             stats->batch_count(), stats->untimed_batch_count());
+        std::vector<char> buf(size + 1);
+        std::snprintf(&buf[0], buf.size(), fmt, stats->client_id(), stats->gpu_runtime_ns() / 1000,
+                      stats->batch_count(), stats->untimed_batch_count());
+        dump_out.append(&buf[0]);
+    }
+
+    if (!dump_state.flight_recorder_events.empty()) {
+        dump_out.append("Recent events (ns before the last):\n");
+        uint64_t last_ns = dump_state.flight_recorder_events.back().timestamp_ns;
+        fmt = "  %12lu %-16s id 0x%x data 0x%lx\n";
+        for (auto& event : dump_state.flight_recorder_events) {
+            uint64_t age_ns = last_ns > event.timestamp_ns ? last_ns - event.timestamp_ns : 0;
+            const char* name = FlightRecorder::EventName(event.type);
+            size = std::snprintf(nullptr, 0, fmt, age_ns, name, event.id, event.data);
+            std::vector<char> buf(size + 1);
+            std::snprintf(&buf[0], buf.size(), fmt, age_ns, name, event.id, event.data);
+            dump_out.append(&buf[0]);
+        }
+    }
+
     if (dump_state.fault_present) {
         fmt = "ENGINE FAULT DETECTED\n"
               "engine 0x%x src 0x%x type 0x%x gpu_address 0x%lx global %d\n";
@@ -367,13 +247,14 @@ void MsdIntelDevice::FormatDump(DumpState& dump_state, std::string& dump_out)
     if (!dump_state.render_cs.inflight_batches.empty()) {
         dump_out.append("Inflight Batches:\n");
         for (auto batch : dump_state.render_cs.inflight_batches) {
-            fmt = "  Batch %p, context %p, connection client_id %lu\n";
+            fmt = "  Batch %p, context %p (gpu runtime %lu us), connection client_id %lu\n";
             auto context = batch->GetContext().lock().get();
             auto connection = context ? context->connection().lock() : nullptr;
-            size = std::snprintf(nullptr, 0, fmt, batch, context,
+            uint64_t context_runtime_us = context ? context->gpu_runtime_ns() / 1000 : 0;
+            size = std::snprintf(nullptr, 0, fmt, batch, context, context_runtime_us,
                                  connection ? connection->client_id() : 0u);
             std::vector<char> buf(size + 1);
-            std::snprintf(&buf[0], buf.size(), fmt, batch, context,
+            std::snprintf(&buf[0], buf.size(), fmt, batch, context, context_runtime_us,
                           connection ? connection->client_id() : 0u);
             dump_out.append(&buf[0]);
 
@@ -0,0 +1,55 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef MSD_INTEL_GEN_QUERY_H
+#define MSD_INTEL_GEN_QUERY_H
+
+#include "magma_common_defs.h"
+
+constexpr uint32_t kMsdIntelGenQueryRegisterProfileCount = 16;
+
+// Stages of a batch's way from the client to its retirement, for kMsdIntelGenQueryBatchLatency.
+enum MsdIntelGenBatchLatencyStage {
+    // Submitted by the client until picked up by the device thread.
+    kMsdIntelGenBatchLatencyQueue = 0,
+    // Picked up until submitted to the hardware, including preparation and scheduling.
+    kMsdIntelGenBatchLatencySchedule,
+    // Submitted to the hardware until started by the gpu, including earlier work and semaphore
+    // waits.
+    kMsdIntelGenBatchLatencyGpuWait,
+    // Started until completed by the gpu.
+    kMsdIntelGenBatchLatencyGpuExecution,
+    // Completed by the gpu until the driver processed the completion.
+    kMsdIntelGenBatchLatencyRetire,
+    // Submitted by the client until the driver processed the completion.
+    kMsdIntelGenBatchLatencyTotal,
+    kMsdIntelGenBatchLatencyStageCount,
+};
+
+// Bucket 0 counts latencies under 1us, bucket N latencies from 2^(N-1) up to 2^N us; the last
+// bucket also counts everything longer.
+constexpr uint32_t kMsdIntelGenBatchLatencyBucketCount = 24;
+
+// Vendor specific ids for msd_device_query.
+enum MsdIntelGenQuery {
+    // Returns (subslice total << 32) | EU total.
+    kMsdIntelGenQuerySubsliceAndEuTotal = MAGMA_QUERY_VENDOR_PARAM_0,
+    // The id plus N, for N less than kMsdIntelGenQueryRegisterProfileCount, returns the Nth most
+    // accessed register as (offset << 32) | access count, or 0 if fewer registers were
+    // accessed. Fails unless the driver was built with the register profiler enabled.
+    kMsdIntelGenQueryRegisterProfile = MAGMA_QUERY_VENDOR_PARAM_0 + 1,
+    // The id plus (stage * kMsdIntelGenBatchLatencyBucketCount + bucket) returns how many
+    // batches had a latency in the given bucket for the given MsdIntelGenBatchLatencyStage.
+    // Batches of all open connections are counted, or if bits 63:32 of the id are nonzero, only
+    // those of connections whose client id has those bits as its low 32 bits.
+    kMsdIntelGenQueryBatchLatency =
+        kMsdIntelGenQueryRegisterProfile + kMsdIntelGenQueryRegisterProfileCount,
+    // Returns the gpu time in nanoseconds consumed by batches, as timed by the gpu around each
+    // batch. Connections are selected as for kMsdIntelGenQueryBatchLatency.
+    kMsdIntelGenQueryGpuRuntime = kMsdIntelGenQueryBatchLatency +
+                                  kMsdIntelGenBatchLatencyStageCount *
+                                      kMsdIntelGenBatchLatencyBucketCount,
+};
+
+#endif // MSD_INTEL_GEN_QUERY_H
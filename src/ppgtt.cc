@@ -10,20 +10,33 @@
 
 constexpr bool kLogEnable = false;
 
-static unsigned int gen_ppat_index(CachingType caching_type)
+static unsigned int gen_ppat_index(CachingType caching_type, LruAge lru_age)
 {
     switch (caching_type) {
         case CACHING_NONE:
             return 3;
         case CACHING_WRITE_THROUGH:
             return 2;
+        case CACHING_WRITE_COMBINING:
+            return 1;
         case CACHING_LLC:
-            return 4;
+            switch (lru_age) {
+                case LRU_AGE_FROM_UNCORE:
+                    return 4;
+                case LRU_AGE_ZERO:
+                    return 5;
+                case LRU_AGE_NO_CHANGE:
+                    return 6;
+                case LRU_AGE_THREE:
+                    return 7;
+            }
     }
+    DASSERT(false);
+    return 3;
 }
 
-static inline gen_pte_t gen_pte_encode(uint64_t bus_addr, CachingType caching_type, bool valid,
-                                       bool writeable)
+static inline gen_pte_t gen_pte_encode(uint64_t bus_addr, CachingType caching_type,
+                                       LruAge lru_age, bool valid, bool writeable)
 {
     gen_pte_t pte = bus_addr;
 
@@ -33,7 +46,7 @@ static inline gen_pte_t gen_pte_encode(uint64_t bus_addr, CachingType caching_ty
     if (writeable)
         pte |= PAGE_RW;
 
-    unsigned int pat_index = gen_ppat_index(caching_type);
+    unsigned int pat_index = gen_ppat_index(caching_type, lru_age);
     if (pat_index & (1 << 0))
         pte |= PAGE_PWT;
     if (pat_index & (1 << 1))
@@ -49,7 +62,8 @@ static inline gen_pde_t gen_pde_encode(uint64_t bus_addr)
     return bus_addr | PAGE_RW | PAGE_PRESENT;
 }
 
-std::unique_ptr<PerProcessGtt::PageDirectory> PerProcessGtt::PageDirectory::Create()
+std::unique_ptr<PerProcessGtt::PageDirectory>
+PerProcessGtt::PageDirectory::Create(BusMapper* bus_mapper)
 {
     static_assert(offsetof(PageDirectoryGpu, entry) == 0,
                   "unexpected offsetof(PageDirectory,entry)");
@@ -71,25 +85,26 @@ std::unique_ptr<PerProcessGtt::PageDirectory> PerProcessGtt::PageDirectory::Crea
     if (!buffer->MapCpu(reinterpret_cast<void**>(&gpu)))
         return DRETP(nullptr, "failed to map cpu");
 
-    std::vector<uint64_t> page_bus_addresses(kPageCount);
-    if (!buffer->MapPageRangeBus(0, kPageCount, page_bus_addresses.data()))
+    auto bus_mapping = bus_mapper->MapPageRange(buffer.get(), 0, kPageCount);
+    if (!bus_mapping)
         return DRETP(nullptr, "failed to map page range bus");
 
     return std::unique_ptr<PageDirectory>(
-        new PageDirectory(std::move(buffer), gpu, std::move(page_bus_addresses)));
+        new PageDirectory(std::move(buffer), gpu, std::move(bus_mapping)));
 }
 
 PerProcessGtt::PageDirectory::PageDirectory(std::unique_ptr<magma::PlatformBuffer> buffer,
                                             PageDirectoryGpu* gpu,
-                                            std::vector<uint64_t> page_bus_addresses)
-    : buffer_(std::move(buffer)), gpu_(gpu), page_bus_addresses_(std::move(page_bus_addresses))
+                                            std::unique_ptr<BusMapping> bus_mapping)
+    : buffer_(std::move(buffer)), gpu_(gpu), bus_mapping_(std::move(bus_mapping))
 {
-    bus_addr_ = page_bus_addresses_[0];
+    const std::vector<uint64_t>& page_bus_addresses = bus_mapping_->bus_addr();
+    bus_addr_ = page_bus_addresses[0];
 
     for (uint32_t entry = 0; entry < kPageDirectoryEntries; entry++) {
         uint32_t page_index = entry + 1;
-        DASSERT(page_index < page_bus_addresses_.size());
-        write_pde(entry, gen_pde_encode(page_bus_addresses_[page_index]));
+        DASSERT(page_index < page_bus_addresses.size());
+        write_pde(entry, gen_pde_encode(page_bus_addresses[page_index]));
     }
 }
 
@@ -97,26 +112,26 @@ PerProcessGtt::PageDirectory::PageDirectory(std::unique_ptr<magma::PlatformBuffe
 
 std::unique_ptr<PerProcessGtt>
 PerProcessGtt::Create(std::shared_ptr<magma::PlatformBuffer> scratch_buffer,
-                      std::shared_ptr<GpuMappingCache> cache)
+                      std::shared_ptr<GpuMappingCache> cache, BusMapper* bus_mapper)
 {
     std::vector<std::unique_ptr<PageDirectory>> page_directories(kPageDirectories);
 
     for (uint32_t i = 0; i < page_directories.size(); i++) {
-        auto page_directory = PageDirectory::Create();
+        auto page_directory = PageDirectory::Create(bus_mapper);
         if (!page_directory)
             return DRETP(nullptr, "couldn't create page directory %d", i);
         page_directories[i] = std::move(page_directory);
     }
 
     return std::unique_ptr<PerProcessGtt>(new PerProcessGtt(
-        std::move(scratch_buffer), std::move(page_directories), std::move(cache)));
+        std::move(scratch_buffer), std::move(page_directories), std::move(cache), bus_mapper));
 }
 
 PerProcessGtt::PerProcessGtt(std::shared_ptr<magma::PlatformBuffer> scratch_buffer,
                              std::vector<std::unique_ptr<PageDirectory>> page_directories,
-                             std::shared_ptr<GpuMappingCache> cache)
-    : AddressSpace(ADDRESS_SPACE_PPGTT, cache), scratch_buffer_(std::move(scratch_buffer)),
-      page_directories_(std::move(page_directories))
+                             std::shared_ptr<GpuMappingCache> cache, BusMapper* bus_mapper)
+    : AddressSpace(ADDRESS_SPACE_PPGTT, cache), bus_mapper_(bus_mapper),
+      scratch_buffer_(std::move(scratch_buffer)), page_directories_(std::move(page_directories))
 {
 }
 
@@ -126,8 +141,10 @@ bool PerProcessGtt::Init()
     DASSERT(!initialized_);
     DASSERT(page_directories_.size() == kPageDirectories);
 
-    if (!scratch_buffer_->MapPageRangeBus(0, 1, &scratch_bus_addr_))
-        return DRETF(false, "MapPageBus failed");
+    scratch_bus_mapping_ = bus_mapper_->MapPageRange(scratch_buffer_.get(), 0, 1);
+    if (!scratch_bus_mapping_)
+        return DRETF(false, "MapPageRange failed");
+    scratch_bus_addr_ = scratch_bus_mapping_->bus_addr()[0];
 
     uint64_t start = 0;
 
@@ -152,6 +169,7 @@ bool PerProcessGtt::Clear(uint64_t addr)
         return DRETF(false, "couldn't get size for addr");
     if (!Clear(addr, length))
         return DRETF(false, "clear failed");
+    bus_mappings_.erase(addr);
     return true;
 }
 
@@ -168,7 +186,8 @@ bool PerProcessGtt::Clear(uint64_t start, uint64_t length)
         return DRETF(false, "invalid start + length");
 
     // readable, because mesa doesn't properly handle overfetching
-    gen_pte_t pte = gen_pte_encode(scratch_bus_addr_, CACHING_NONE, true, false);
+    gen_pte_t pte =
+        gen_pte_encode(scratch_bus_addr_, CACHING_NONE, LRU_AGE_FROM_UNCORE, true, false);
 
     uint32_t page_table_index = (start >> PAGE_SHIFT) & kPageTableMask;
     uint32_t page_directory_index = (start >> (PAGE_SHIFT + kPageTableShift)) & kPageDirectoryMask;
@@ -222,11 +241,12 @@ bool PerProcessGtt::Free(uint64_t addr)
         magma::log(magma::LOG_INFO, "ppgtt free (%p) 0x%" PRIx64 "-0x%" PRIx64 " length 0x%" PRIx64,
                    this, addr, addr + length - 1, length);
 
+    bus_mappings_.erase(addr);
     return allocator_->Free(addr);
 }
 
 bool PerProcessGtt::Insert(uint64_t addr, magma::PlatformBuffer* buffer, uint64_t offset,
-                           uint64_t length, CachingType caching_type)
+                           uint64_t length, CachingType caching_type, LruAge lru_age)
 {
     if (kLogEnable)
         magma::log(magma::LOG_INFO,
@@ -251,11 +271,11 @@ bool PerProcessGtt::Insert(uint64_t addr, magma::PlatformBuffer* buffer, uint64_
 
     DLOG("start_page_index 0x%x num_pages 0x%x", start_page_index, num_pages);
 
-    std::vector<uint64_t> bus_addr_array;
-    bus_addr_array.resize(num_pages);
-
-    if (!buffer->MapPageRangeBus(start_page_index, num_pages, bus_addr_array.data()))
+    std::unique_ptr<BusMapping> bus_mapping =
+        bus_mapper_->MapPageRange(buffer, start_page_index, num_pages);
+    if (!bus_mapping)
         return DRETF(false, "failed obtaining bus addresses");
+    const std::vector<uint64_t>& bus_addr_array = bus_mapping->bus_addr();
 
     uint32_t page_table_index = (addr >> PAGE_SHIFT) & kPageTableMask;
     uint32_t page_directory_index = (addr >> (PAGE_SHIFT + kPageTableShift)) & kPageDirectoryMask;
@@ -268,17 +288,19 @@ bool PerProcessGtt::Insert(uint64_t addr, magma::PlatformBuffer* buffer, uint64_
     for (uint64_t i = 0; i < num_pages + kOverfetchPageCount + kGuardPageCount; i++) {
         if (i < num_pages) {
             // buffer pages
-            gen_pte_t pte = gen_pte_encode(bus_addr_array[i], caching_type, true, true);
+            gen_pte_t pte = gen_pte_encode(bus_addr_array[i], caching_type, lru_age, true, true);
             page_directories_[page_directory_pointer_index]->write_pte(page_directory_index,
                                                                        page_table_index, pte);
         } else if (i < num_pages + kOverfetchPageCount) {
             // overfetch page: readable
-            gen_pte_t pte = gen_pte_encode(scratch_bus_addr_, CACHING_NONE, true, false);
+            gen_pte_t pte =
+                gen_pte_encode(scratch_bus_addr_, CACHING_NONE, LRU_AGE_FROM_UNCORE, true, false);
             page_directories_[page_directory_pointer_index]->write_pte(page_directory_index,
                                                                        page_table_index, pte);
         } else {
             // guard page: also readable, because mesa doesn't properly handle overfetching
-            gen_pte_t pte = gen_pte_encode(scratch_bus_addr_, CACHING_NONE, true, false);
+            gen_pte_t pte =
+                gen_pte_encode(scratch_bus_addr_, CACHING_NONE, LRU_AGE_FROM_UNCORE, true, false);
             page_directories_[page_directory_pointer_index]->write_pte(page_directory_index,
                                                                        page_table_index, pte);
         }
@@ -292,6 +314,8 @@ bool PerProcessGtt::Insert(uint64_t addr, magma::PlatformBuffer* buffer, uint64_
             }
         }
     }
+
+    bus_mappings_[addr] = std::move(bus_mapping);
     return true;
 }
 
@@ -308,9 +332,13 @@ PerProcessGtt::get_page_directory_gpu(uint32_t page_directory_pointer_index)
 // of the pat bits in the page table entries.
 void PerProcessGtt::InitPrivatePat(RegisterIo* reg_io)
 {
-    DASSERT(gen_ppat_index(CACHING_WRITE_THROUGH) == 2);
-    DASSERT(gen_ppat_index(CACHING_NONE) == 3);
-    DASSERT(gen_ppat_index(CACHING_LLC) == 4);
+    DASSERT(gen_ppat_index(CACHING_WRITE_COMBINING, LRU_AGE_FROM_UNCORE) == 1);
+    DASSERT(gen_ppat_index(CACHING_WRITE_THROUGH, LRU_AGE_FROM_UNCORE) == 2);
+    DASSERT(gen_ppat_index(CACHING_NONE, LRU_AGE_FROM_UNCORE) == 3);
+    DASSERT(gen_ppat_index(CACHING_LLC, LRU_AGE_FROM_UNCORE) == 4);
+    DASSERT(gen_ppat_index(CACHING_LLC, LRU_AGE_ZERO) == 5);
+    DASSERT(gen_ppat_index(CACHING_LLC, LRU_AGE_NO_CHANGE) == 6);
+    DASSERT(gen_ppat_index(CACHING_LLC, LRU_AGE_THREE) == 7);
 
     uint64_t pat =
         registers::PatIndex::ppat(0, registers::PatIndex::kLruAgeFromUncore,
@@ -6,10 +6,12 @@
 #define PPGTT_H
 
 #include "address_space.h"
+#include "bus_mapping.h"
 #include "magma_util/address_space_allocator.h"
 #include "platform_buffer.h"
 #include "register_io.h"
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
 using gen_pde_t = uint64_t;
@@ -19,7 +21,7 @@ public:
     // Create with the given scratch_buffer, which should be one page that has already been pinned.
     static std::unique_ptr<PerProcessGtt>
     Create(std::shared_ptr<magma::PlatformBuffer> scratch_buffer,
-           std::shared_ptr<GpuMappingCache> cache);
+           std::shared_ptr<GpuMappingCache> cache, BusMapper* bus_mapper);
 
     uint64_t Size() const override { return kSize; }
 
@@ -31,7 +33,7 @@ public:
 
     bool Clear(uint64_t addr) override;
     bool Insert(uint64_t addr, magma::PlatformBuffer* buffer, uint64_t offset, uint64_t length,
-                CachingType caching_type) override;
+                CachingType caching_type, LruAge lru_age) override;
 
     uint64_t get_pdp(uint32_t index)
     {
@@ -44,7 +46,7 @@ private:
 
     PerProcessGtt(std::shared_ptr<magma::PlatformBuffer> scratch_buffer,
                   std::vector<std::unique_ptr<PageDirectory>> page_directories,
-                  std::shared_ptr<GpuMappingCache> cache);
+                  std::shared_ptr<GpuMappingCache> cache, BusMapper* bus_mapper);
 
     // Legacy 32-bit ppgtt = 4 PDP registers; each PD handles 1GB (512 * 512 * 4096) = 4GB total
     static constexpr uint64_t kPageDirectories = 4; // aka page directory pointer entries
@@ -79,7 +81,7 @@ private:
 
     class PageDirectory {
     public:
-        static std::unique_ptr<PageDirectory> Create();
+        static std::unique_ptr<PageDirectory> Create(BusMapper* bus_mapper);
 
         void write_pte(uint32_t page_directory_index, uint32_t page_table_index,
                        gen_pte_t page_table_entry)
@@ -95,7 +97,7 @@ private:
 
     private:
         PageDirectory(std::unique_ptr<magma::PlatformBuffer> buffer, PageDirectoryGpu* gpu,
-                      std::vector<uint64_t> page_bus_addresses);
+                      std::unique_ptr<BusMapping> bus_mapping);
 
         void write_pde(uint32_t index, gen_pde_t pde)
         {
@@ -105,16 +107,20 @@ private:
 
         std::unique_ptr<magma::PlatformBuffer> buffer_;
         PageDirectoryGpu* gpu_;
-        std::vector<uint64_t> page_bus_addresses_;
+        std::unique_ptr<BusMapping> bus_mapping_;
         std::shared_ptr<magma::PlatformBuffer> scratch_buffer_;
         uint64_t bus_addr_;
     };
 
     bool initialized_ = false;
+    BusMapper* bus_mapper_;
     std::shared_ptr<magma::PlatformBuffer> scratch_buffer_;
+    std::unique_ptr<BusMapping> scratch_bus_mapping_;
     std::vector<std::unique_ptr<PageDirectory>> page_directories_;
     std::unique_ptr<magma::AddressSpaceAllocator> allocator_;
     uint64_t scratch_bus_addr_{};
+    // The bus mappings of inserted pages, by gpu address; released when the entries are cleared.
+    std::unordered_map<uint64_t, std::unique_ptr<BusMapping>> bus_mappings_;
 
     // For testing
     friend class TestPerProcessGtt;
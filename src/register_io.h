@@ -7,7 +7,9 @@
 
 #include "magma_util/dlog.h"
 #include "platform_mmio.h"
+#include <chrono>
 #include <memory>
+#include <unordered_map>
 
 // RegisterIo wraps mmio access.
 class RegisterIo {
@@ -16,22 +18,41 @@ public:
 
     void Write32(uint32_t offset, uint32_t val)
     {
-        mmio_->Write32(offset, val);
+        Shadow* shadow = FindShadow(offset);
+        if (shadow) {
+            if (shadow->valid && shadow->value == val)
+                return;
+            shadow->valid = true;
+            shadow->value = val;
+        }
+
+        Access(offset, [this, offset, val] { mmio_->Write32(offset, val); });
         if (hook_)
             hook_->Write32(offset, val);
     }
 
     uint32_t Read32(uint32_t offset)
     {
-        uint32_t val = mmio_->Read32(offset);
+        Shadow* shadow = FindShadow(offset);
+        if (shadow && shadow->valid)
+            return shadow->value;
+
+        uint32_t val;
+        Access(offset, [this, offset, &val] { val = mmio_->Read32(offset); });
         if (hook_)
             hook_->Read32(offset, val);
+
+        if (shadow) {
+            shadow->valid = true;
+            shadow->value = val;
+        }
         return val;
     }
 
     uint64_t Read64(uint32_t offset)
     {
-        uint64_t val = mmio_->Read64(offset);
+        uint64_t val;
+        Access(offset, [this, offset, &val] { val = mmio_->Read64(offset); });
         if (hook_)
             hook_->Read64(offset, val);
         return val;
@@ -39,6 +60,13 @@ public:
 
     magma::PlatformMmio* mmio() { return mmio_.get(); }
 
+    // Declares the 32 bit register at |offset| write-shadowable: its value changes only when
+    // written through this RegisterIo, and rewriting its current value has no effect. Once the
+    // value is known, writes of the same value are skipped and reads are served from the
+    // shadow. Declare before the RegisterIo is shared between threads; a shadowed register must
+    // only be accessed from one thread.
+    void ShadowRegister(uint32_t offset) { shadows_.emplace(offset, Shadow{}); }
+
     class Hook {
     public:
         virtual ~Hook() = default;
@@ -46,19 +74,120 @@ public:
         virtual void Write32(uint32_t offset, uint32_t val) = 0;
         virtual void Read32(uint32_t offset, uint32_t val) = 0;
         virtual void Read64(uint32_t offset, uint64_t val) = 0;
+
+        // If this returns true the coming access is timed, and AccessTime is called once it
+        // completes, before the Write32, Read32 or Read64 call. When several hooks are
+        // installed, each is also given the time of accesses another hook asked to sample.
+        virtual bool SampleAccessTime() { return false; }
+        virtual void AccessTime(uint32_t offset, uint64_t elapsed_ns) {}
     };
 
+    // Hooks installed later are called after those installed earlier.
     void InstallHook(std::unique_ptr<Hook> hook)
     {
-        DASSERT(!hook_);
-        hook_ = std::move(hook);
+        if (hook_) {
+            hook_ = std::unique_ptr<Hook>(new ChainedHook(std::move(hook_), std::move(hook)));
+        } else {
+            hook_ = std::move(hook);
+        }
     }
 
+    // Returns the installed hook, or the hook chaining them if several were installed.
     Hook* hook() { return hook_.get(); }
 
+    // Keeps power domains awake around accesses to registers that need them.
+    class ForceWakeHook {
+    public:
+        virtual ~ForceWakeHook() = default;
+
+        // Returns a mask of the domains held awake for an access to |offset|; a non-zero mask is
+        // passed to Release once the access is done.
+        virtual uint32_t Acquire(uint32_t offset) = 0;
+        virtual void Release(uint32_t domains) = 0;
+    };
+
+    void InstallForceWakeHook(std::unique_ptr<ForceWakeHook> forcewake)
+    {
+        DASSERT(!forcewake_);
+        forcewake_ = std::move(forcewake);
+    }
+
+    ForceWakeHook* forcewake_hook() { return forcewake_.get(); }
+
 private:
+    class ChainedHook : public Hook {
+    public:
+        ChainedHook(std::unique_ptr<Hook> first, std::unique_ptr<Hook> second)
+            : first_(std::move(first)), second_(std::move(second))
+        {
+        }
+
+        void Write32(uint32_t offset, uint32_t val) override
+        {
+            first_->Write32(offset, val);
+            second_->Write32(offset, val);
+        }
+        void Read32(uint32_t offset, uint32_t val) override
+        {
+            first_->Read32(offset, val);
+            second_->Read32(offset, val);
+        }
+        void Read64(uint32_t offset, uint64_t val) override
+        {
+            first_->Read64(offset, val);
+            second_->Read64(offset, val);
+        }
+
+        // Both are asked, so each keeps its own sampling rate.
+        bool SampleAccessTime() override
+        {
+            bool sample = first_->SampleAccessTime();
+            return second_->SampleAccessTime() || sample;
+        }
+        void AccessTime(uint32_t offset, uint64_t elapsed_ns) override
+        {
+            first_->AccessTime(offset, elapsed_ns);
+            second_->AccessTime(offset, elapsed_ns);
+        }
+
+    private:
+        std::unique_ptr<Hook> first_;
+        std::unique_ptr<Hook> second_;
+    };
+
+    template <typename AccessFunc> void Access(uint32_t offset, AccessFunc access)
+    {
+        uint32_t domains = forcewake_ ? forcewake_->Acquire(offset) : 0;
+        if (hook_ && hook_->SampleAccessTime()) {
+            auto start = std::chrono::steady_clock::now();
+            access();
+            hook_->AccessTime(offset, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                          std::chrono::steady_clock::now() - start)
+                                          .count());
+        } else {
+            access();
+        }
+        if (domains)
+            forcewake_->Release(domains);
+    }
+
+    struct Shadow {
+        bool valid;
+        uint32_t value;
+    };
+
+    Shadow* FindShadow(uint32_t offset)
+    {
+        if (shadows_.empty())
+            return nullptr;
+        auto iter = shadows_.find(offset);
+        return iter == shadows_.end() ? nullptr : &iter->second;
+    }
+
     std::unique_ptr<magma::PlatformMmio> mmio_;
     std::unique_ptr<Hook> hook_;
+    std::unique_ptr<ForceWakeHook> forcewake_;
+    std::unordered_map<uint32_t, Shadow> shadows_;
 };
 
 #endif // REGISTER_IO_H
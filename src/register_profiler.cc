@@ -0,0 +1,96 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "register_profiler.h"
+#include <algorithm>
+
+constexpr uint32_t RegisterProfiler::kSampleInterval;
+constexpr uint32_t RegisterProfiler::kMaxProbes;
+
+RegisterProfiler::RegisterProfiler()
+{
+    for (auto& entry : table_) {
+        entry.offset = kEmpty;
+        entry.read_count = 0;
+        entry.write_count = 0;
+        entry.timed_count = 0;
+        entry.total_time_ns = 0;
+    }
+}
+
+RegisterProfiler::Entry* RegisterProfiler::FindEntry(uint32_t offset)
+{
+    // Registers are dword aligned.
+    uint32_t index = offset >> 2;
+    for (uint32_t probe = 0; probe < kMaxProbes; probe++) {
+        Entry& entry = table_[(index + probe) % kTableSize];
+        uint32_t entry_offset = entry.offset.load(std::memory_order_relaxed);
+        if (entry_offset == offset)
+            return &entry;
+        if (entry_offset == kEmpty) {
+            if (entry.offset.compare_exchange_strong(entry_offset, offset,
+                                                     std::memory_order_relaxed))
+                return &entry;
+            // Lost a race to claim the entry; it may have been for the same offset.
+            if (entry_offset == offset)
+                return &entry;
+        }
+    }
+    return nullptr;
+}
+
+void RegisterProfiler::Record(uint32_t offset, bool read)
+{
+    Entry* entry = FindEntry(offset);
+    if (!entry) {
+        untracked_count_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (read) {
+        entry->read_count.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        entry->write_count.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+bool RegisterProfiler::SampleAccessTime()
+{
+    return access_count_.fetch_add(1, std::memory_order_relaxed) % kSampleInterval == 0;
+}
+
+void RegisterProfiler::AccessTime(uint32_t offset, uint64_t elapsed_ns)
+{
+    Entry* entry = FindEntry(offset);
+    if (!entry)
+        return;
+    entry->timed_count.fetch_add(1, std::memory_order_relaxed);
+    entry->total_time_ns.fetch_add(elapsed_ns, std::memory_order_relaxed);
+}
+
+std::vector<RegisterProfiler::RegisterStats> RegisterProfiler::TopRegisters(uint32_t count)
+{
+    std::vector<RegisterStats> registers;
+    for (auto& entry : table_) {
+        uint32_t offset = entry.offset.load(std::memory_order_relaxed);
+        if (offset == kEmpty)
+            continue;
+        uint64_t timed_count = entry.timed_count.load(std::memory_order_relaxed);
+        uint64_t total_time_ns = entry.total_time_ns.load(std::memory_order_relaxed);
+        registers.push_back({offset, entry.read_count.load(std::memory_order_relaxed),
+                             entry.write_count.load(std::memory_order_relaxed),
+                             timed_count ? total_time_ns / timed_count : 0});
+    }
+
+    auto by_access_count = [](const RegisterStats& a, const RegisterStats& b) {
+        return a.read_count + a.write_count > b.read_count + b.write_count;
+    };
+    if (registers.size() > count) {
+        std::partial_sort(registers.begin(), registers.begin() + count, registers.end(),
+                          by_access_count);
+        registers.resize(count);
+    } else {
+        std::sort(registers.begin(), registers.end(), by_access_count);
+    }
+    return registers;
+}
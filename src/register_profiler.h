@@ -0,0 +1,66 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef REGISTER_PROFILER_H
+#define REGISTER_PROFILER_H
+
+#include "register_io.h"
+#include <atomic>
+#include <vector>
+
+// A RegisterIo hook that counts reads and writes per register and times one access in every
+// kSampleInterval. Counts are kept in a fixed size table; registers that don't fit are only
+// counted in untracked_count().
+// Thread safe.
+class RegisterProfiler : public RegisterIo::Hook {
+public:
+    static constexpr uint32_t kTableSize = 256;
+    static constexpr uint32_t kSampleInterval = 16;
+
+    struct RegisterStats {
+        uint32_t offset;
+        uint64_t read_count;
+        uint64_t write_count;
+        // Average over the timed accesses; 0 if none were timed.
+        uint64_t avg_access_ns;
+    };
+
+    RegisterProfiler();
+
+    // RegisterIo::Hook
+    void Write32(uint32_t offset, uint32_t val) override { Record(offset, false); }
+    void Read32(uint32_t offset, uint32_t val) override { Record(offset, true); }
+    void Read64(uint32_t offset, uint64_t val) override { Record(offset, true); }
+    bool SampleAccessTime() override;
+    void AccessTime(uint32_t offset, uint64_t elapsed_ns) override;
+
+    // Returns up to |count| registers, most accessed first.
+    std::vector<RegisterStats> TopRegisters(uint32_t count);
+
+    uint64_t untracked_count() { return untracked_count_.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr uint32_t kEmpty = 0xFFFFFFFF;
+    static constexpr uint32_t kMaxProbes = 8;
+
+    struct Entry {
+        std::atomic_uint offset;
+        std::atomic<uint64_t> read_count;
+        std::atomic<uint64_t> write_count;
+        std::atomic<uint64_t> timed_count;
+        std::atomic<uint64_t> total_time_ns;
+    };
+
+    // Returns the entry for |offset|, claiming one if needed; null if the table is full.
+    Entry* FindEntry(uint32_t offset);
+    void Record(uint32_t offset, bool read);
+
+    Entry table_[kTableSize];
+    std::atomic<uint64_t> untracked_count_{0};
+    std::atomic_uint access_count_{0};
+
+    friend class TestRegisterProfiler;
+};
+
+#endif // REGISTER_PROFILER_H
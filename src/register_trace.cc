@@ -0,0 +1,134 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "register_trace.h"
+#include <algorithm>
+#include <cstring>
+
+constexpr uint32_t RegisterTrace::kMagic;
+constexpr uint32_t RegisterTrace::kVersion;
+constexpr uint32_t RegisterTrace::kHeaderDwords;
+
+std::unique_ptr<RegisterTrace> RegisterTrace::Parse(const std::vector<uint8_t>& data)
+{
+    if (data.size() % sizeof(uint32_t))
+        return DRETP(nullptr, "trace size %zu isn't a multiple of 4", data.size());
+
+    std::vector<uint32_t> dwords(data.size() / sizeof(uint32_t));
+    memcpy(dwords.data(), data.data(), data.size());
+
+    if (dwords.size() < kHeaderDwords || dwords[0] != kMagic)
+        return DRETP(nullptr, "not a register trace");
+    if (dwords[1] != kVersion)
+        return DRETP(nullptr, "unsupported register trace version %u", dwords[1]);
+
+    std::vector<Operation> operations;
+    uint64_t timestamp_ns = 0;
+    for (size_t i = kHeaderDwords; i < dwords.size();) {
+        if (dwords.size() - i < 3)
+            return DRETP(nullptr, "truncated record at dword %zu", i);
+
+        uint32_t type = dwords[i] >> kTypeShift;
+        if (type > Operation::READ64)
+            return DRETP(nullptr, "bad record type %u at dword %zu", type, i);
+
+        Operation operation;
+        operation.type = static_cast<Operation::Type>(type);
+        operation.offset = dwords[i] & kOffsetMask;
+        timestamp_ns += operations.empty() ? 0 : dwords[i + 1];
+        operation.timestamp_ns = timestamp_ns;
+        operation.val = dwords[i + 2];
+
+        switch (operation.type) {
+            case Operation::WRITE32:
+            case Operation::READ32:
+                i += 3;
+                break;
+            case Operation::READ64:
+                if (dwords.size() - i < 4)
+                    return DRETP(nullptr, "truncated record at dword %zu", i);
+                operation.val |= static_cast<uint64_t>(dwords[i + 3]) << 32;
+                i += 4;
+                break;
+        }
+        operations.push_back(operation);
+    }
+
+    return std::unique_ptr<RegisterTrace>(
+        new RegisterTrace(dwords[2], dwords[3], std::move(operations)));
+}
+
+size_t RegisterTrace::FirstDifference(const std::vector<Operation>& a,
+                                      const std::vector<Operation>& b)
+{
+    size_t count = std::min(a.size(), b.size());
+    for (size_t i = 0; i < count; i++) {
+        if (a[i].type != b[i].type || a[i].offset != b[i].offset)
+            return i;
+        if (a[i].type == Operation::WRITE32 && a[i].val != b[i].val)
+            return i;
+    }
+    return count;
+}
+
+RegisterTraceRecorder::RegisterTraceRecorder(uint32_t device_id, uint16_t gmch_graphics_control,
+                                             uint32_t capacity_bytes)
+    : capacity_dwords_(capacity_bytes / sizeof(uint32_t))
+{
+    // Reserved up front so recording never reallocates.
+    dwords_.reserve(std::max(capacity_dwords_, RegisterTrace::kHeaderDwords));
+    dwords_.push_back(RegisterTrace::kMagic);
+    dwords_.push_back(RegisterTrace::kVersion);
+    dwords_.push_back(device_id);
+    dwords_.push_back(gmch_graphics_control);
+}
+
+void RegisterTraceRecorder::Record(RegisterTrace::Operation::Type type, uint32_t offset,
+                                   uint64_t val)
+{
+    DASSERT(offset <= RegisterTrace::kOffsetMask);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    uint32_t record_dwords = type == RegisterTrace::Operation::READ64 ? 4 : 3;
+    if (dwords_.size() + record_dwords > capacity_dwords_) {
+        dropped_count_++;
+        return;
+    }
+
+    // Taken under the lock so timestamps are ordered as the records are.
+    auto now = std::chrono::steady_clock::now();
+    uint64_t delta_ns =
+        record_count_
+            ? std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_time_).count()
+            : 0;
+    last_time_ = now;
+    record_count_++;
+
+    dwords_.push_back(type << RegisterTrace::kTypeShift | offset);
+    dwords_.push_back(std::min(delta_ns, static_cast<uint64_t>(UINT32_MAX)));
+    dwords_.push_back(static_cast<uint32_t>(val));
+    if (type == RegisterTrace::Operation::READ64)
+        dwords_.push_back(static_cast<uint32_t>(val >> 32));
+}
+
+std::vector<uint8_t> RegisterTraceRecorder::Serialize()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<uint8_t> data(dwords_.size() * sizeof(uint32_t));
+    memcpy(data.data(), dwords_.data(), data.size());
+    return data;
+}
+
+uint64_t RegisterTraceRecorder::record_count()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return record_count_;
+}
+
+uint64_t RegisterTraceRecorder::dropped_count()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return dropped_count_;
+}
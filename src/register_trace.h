@@ -0,0 +1,99 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef REGISTER_TRACE_H
+#define REGISTER_TRACE_H
+
+#include "register_io.h"
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+// A register trace is a binary log of the mmio accesses made through a RegisterIo, in
+// little endian dwords:
+//   header: kMagic, kVersion, device id, gmch graphics control
+//   records: (type << 24) | offset, nanoseconds since the previous record (saturating),
+//            value low dword, and the value high dword for READ64 only.
+class RegisterTrace {
+public:
+    static constexpr uint32_t kMagic = 0x43525452; // "RTRC"
+    static constexpr uint32_t kVersion = 1;
+    static constexpr uint32_t kHeaderDwords = 4;
+    static constexpr uint32_t kOffsetMask = 0xFFFFFF;
+    static constexpr uint32_t kTypeShift = 24;
+
+    struct Operation {
+        enum Type { WRITE32, READ32, READ64 };
+        Type type;
+        uint32_t offset;
+        uint64_t val;
+        // Since the first operation.
+        uint64_t timestamp_ns;
+    };
+
+    static std::unique_ptr<RegisterTrace> Parse(const std::vector<uint8_t>& data);
+
+    uint32_t device_id() { return device_id_; }
+    uint16_t gmch_graphics_control() { return gmch_graphics_control_; }
+    const std::vector<Operation>& operations() { return operations_; }
+
+    // Returns the index of the first operation that differs in type, offset or written value,
+    // ignoring read values and timing; or the length of the shorter trace if one is a prefix of
+    // the other.
+    static size_t FirstDifference(const std::vector<Operation>& a,
+                                  const std::vector<Operation>& b);
+
+private:
+    RegisterTrace(uint32_t device_id, uint16_t gmch_graphics_control,
+                  std::vector<Operation> operations)
+        : device_id_(device_id), gmch_graphics_control_(gmch_graphics_control),
+          operations_(std::move(operations))
+    {
+    }
+
+    uint32_t device_id_;
+    uint16_t gmch_graphics_control_;
+    std::vector<Operation> operations_;
+};
+
+// A RegisterIo hook that records a register trace into a buffer of fixed capacity; once full,
+// further accesses are only counted in dropped_count().
+// Thread safe.
+class RegisterTraceRecorder : public RegisterIo::Hook {
+public:
+    RegisterTraceRecorder(uint32_t device_id, uint16_t gmch_graphics_control,
+                          uint32_t capacity_bytes);
+
+    // RegisterIo::Hook
+    void Write32(uint32_t offset, uint32_t val) override
+    {
+        Record(RegisterTrace::Operation::WRITE32, offset, val);
+    }
+    void Read32(uint32_t offset, uint32_t val) override
+    {
+        Record(RegisterTrace::Operation::READ32, offset, val);
+    }
+    void Read64(uint32_t offset, uint64_t val) override
+    {
+        Record(RegisterTrace::Operation::READ64, offset, val);
+    }
+
+    // Returns a copy of the trace recorded so far, unaffected by later records.
+    std::vector<uint8_t> Serialize();
+
+    uint64_t record_count();
+    uint64_t dropped_count();
+
+private:
+    void Record(RegisterTrace::Operation::Type type, uint32_t offset, uint64_t val);
+
+    std::mutex mutex_;
+    std::vector<uint32_t> dwords_;
+    uint32_t capacity_dwords_;
+    std::chrono::steady_clock::time_point last_time_;
+    uint64_t record_count_ = 0;
+    uint64_t dropped_count_ = 0;
+};
+
+#endif // REGISTER_TRACE_H
@@ -162,6 +162,45 @@ public:
     }
 };
 
+// RING_BUFFER_HEAD: the offset in the ring of the next command to be fetched. While a batch
+// executes it points just past the batch buffer start.
+class RingbufferHead {
+public:
+    static constexpr uint32_t kOffset = 0x34;
+    static constexpr uint32_t kHeadOffsetMask = 0x1FFFFC;
+
+    static uint32_t read(RegisterIo* reg_io, uint64_t mmio_base)
+    {
+        return reg_io->Read32(mmio_base + kOffset) & kHeadOffsetMask;
+    }
+};
+
+// RING_BUFFER_START: the global gtt address of the current context's ring.
+class RingbufferStart {
+public:
+    static constexpr uint32_t kOffset = 0x38;
+
+    static uint32_t read(RegisterIo* reg_io, uint64_t mmio_base)
+    {
+        return reg_io->Read32(mmio_base + kOffset);
+    }
+};
+
+// RING_TIMESTAMP, also what PIPE_CONTROL timestamp writes store.
+// from intel-gfx-prm-osrc-skl-vol02c-commandreference-registers-part2.pdf
+class Timestamp {
+public:
+    static constexpr uint32_t kOffset = 0x358;
+    // The counter runs at 12.5MHz on gen8 and 12MHz on gen9.
+    static constexpr uint32_t kPeriodPsGen8 = 80000;
+    static constexpr uint32_t kPeriodPsGen9 = 83333;
+
+    static uint64_t read(RegisterIo* reg_io, uint64_t mmio_base)
+    {
+        return reg_io->Read64(mmio_base + kOffset);
+    }
+};
+
 // from intel-gfx-prm-osrc-bdw-vol02c-commandreference-registers_4.pdf p.75
 class AllEngineFault {
 public:
@@ -203,8 +242,9 @@ public:
 // from intel-gfx-prm-osrc-bdw-vol02c-commandreference-registers_4.pdf p.493
 class ForceWake {
 public:
-    enum Domain { GEN8, GEN9_RENDER };
+    enum Domain { GEN8, GEN9_RENDER, GEN9_GT };
 
+    // Also the gen9 GT domain's request and status registers.
     static constexpr uint32_t kOffset = 0xA188;
     static constexpr uint32_t kStatusOffset = 0x130044;
 
@@ -219,6 +259,7 @@ public:
         val32 = (val32 << 16) | val;
         switch (domain) {
             case GEN8:
+            case GEN9_GT:
                 reg_io->Write32(kOffset, val32);
                 break;
             case GEN9_RENDER:
@@ -231,6 +272,7 @@ public:
     {
         switch (domain) {
             case GEN8:
+            case GEN9_GT:
                 return static_cast<uint16_t>(reg_io->Read32(kStatusOffset));
             case GEN9_RENDER:
                 return static_cast<uint16_t>(reg_io->Read32(kRenderStatusOffset));
@@ -289,6 +331,16 @@ public:
         // Register units are 50Mhz
         return (register_io->Read32(kOffset) & 0xff) * 50;
     }
+
+    static uint32_t read_rp1_frequency(RegisterIo* register_io)
+    {
+        return ((register_io->Read32(kOffset) >> 8) & 0xff) * 50;
+    }
+
+    static uint32_t read_rpn_frequency(RegisterIo* register_io)
+    {
+        return ((register_io->Read32(kOffset) >> 16) & 0xff) * 50;
+    }
 };
 
 // from intel-gfx-prm-osrc-skl-vol02c-commandreference-registers-part2.pdf p.741
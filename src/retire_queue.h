@@ -0,0 +1,38 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef RETIRE_QUEUE_H
+#define RETIRE_QUEUE_H
+
+#include "mapped_batch.h"
+#include "platform_trace.h"
+#include <memory>
+#include <queue>
+
+// Holds completed batches so the next context can be scheduled before paying for their cleanup:
+// unmapping resources, dropping buffer references and signalling semaphores.
+// Batches are released in the order they were added, which is sequence number order.
+class RetireQueue {
+public:
+    void Add(std::unique_ptr<MappedBatch> mapped_batch) { queue_.push(std::move(mapped_batch)); }
+
+    // Releases up to |max_count| batches; returns true if more remain.
+    bool Retire(uint32_t max_count)
+    {
+        TRACE_DURATION("magma", "Retire");
+        for (uint32_t i = 0; i < max_count && !queue_.empty(); i++) {
+            queue_.pop();
+        }
+        return !queue_.empty();
+    }
+
+    void RetireAll() { Retire(queue_.size()); }
+
+    size_t size() { return queue_.size(); }
+
+private:
+    std::queue<std::unique_ptr<MappedBatch>> queue_;
+};
+
+#endif // RETIRE_QUEUE_H
@@ -36,6 +36,14 @@ public:
 
     uint32_t head() { return head_; }
 
+    uint32_t read_dword(uint32_t offset)
+    {
+        DASSERT(vaddr_);
+        DASSERT((offset & 0x3) == 0);
+        DASSERT(offset < size_);
+        return vaddr_[offset >> 2];
+    }
+
     void update_head(uint32_t head)
     {
         DASSERT((head & 0x3) == 0);
@@ -44,6 +52,15 @@ public:
         head_ = head;
     }
 
+    // Discards anything written after |tail|.
+    void update_tail(uint32_t tail)
+    {
+        DASSERT((tail & 0x3) == 0);
+        DASSERT(tail < size_);
+        DLOG("updating tail 0x%x", tail);
+        tail_ = tail;
+    }
+
     bool HasSpace(uint32_t bytes);
 
     // Maps to both cpu and gpu.
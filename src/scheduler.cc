@@ -6,19 +6,30 @@
 #include "msd_intel_connection.h"
 #include "msd_intel_context.h"
 #include "platform_trace.h"
+#include <deque>
 
 class FifoScheduler : public Scheduler {
 public:
     void CommandBufferQueued(std::weak_ptr<MsdIntelContext> context) override;
+    void CommandBuffersRequeued(std::vector<std::weak_ptr<MsdIntelContext>> contexts) override;
     void CommandBufferCompleted(std::shared_ptr<MsdIntelContext> context) override;
 
     std::shared_ptr<MsdIntelContext> ScheduleContext() override;
+    std::shared_ptr<MsdIntelContext> PeekContext() override;
 
 private:
+    // Whether |context|'s next command buffer may execute now.
+    bool CanSelect(const std::shared_ptr<MsdIntelContext>& context);
+
+    struct ExecutingContext {
+        std::shared_ptr<MsdIntelContext> context;
+        uint32_t count;
+        uint32_t nonce;
+    };
+
     std::queue<std::weak_ptr<MsdIntelContext>> fifo_;
-    std::shared_ptr<MsdIntelContext> current_context_;
-    uint32_t current_count_{};
-    uint32_t nonce_;
+    // Contexts with command buffers executing, in the order they execute.
+    std::deque<ExecutingContext> executing_;
 };
 
 void FifoScheduler::CommandBufferQueued(std::weak_ptr<MsdIntelContext> context)
@@ -26,6 +37,29 @@ void FifoScheduler::CommandBufferQueued(std::weak_ptr<MsdIntelContext> context)
     fifo_.push(context);
 }
 
+void FifoScheduler::CommandBuffersRequeued(std::vector<std::weak_ptr<MsdIntelContext>> contexts)
+{
+    std::queue<std::weak_ptr<MsdIntelContext>> fifo;
+    for (auto& context : contexts) {
+        fifo.push(std::move(context));
+    }
+    while (!fifo_.empty()) {
+        fifo.push(std::move(fifo_.front()));
+        fifo_.pop();
+    }
+    fifo_ = std::move(fifo);
+}
+
+bool FifoScheduler::CanSelect(const std::shared_ptr<MsdIntelContext>& context)
+{
+    if (executing_.empty() || executing_.back().context == context)
+        return true;
+
+    // Queued behind the executing context, whose work the command buffer waits on.
+    return executing_.size() == 1 && !context->pending_batch_queue().empty() &&
+           context->pending_batch_queue().front()->HasGpuWaitSemaphores();
+}
+
 std::shared_ptr<MsdIntelContext> FifoScheduler::ScheduleContext()
 {
     std::shared_ptr<MsdIntelContext> context;
@@ -48,27 +82,44 @@ std::shared_ptr<MsdIntelContext> FifoScheduler::ScheduleContext()
         }
     }
 
-    if (current_context_ == nullptr || current_context_ == context) {
-        if(current_context_ == nullptr){
-            nonce_ = TRACE_NONCE();
-            TRACE_ASYNC_BEGIN("magma", "Context Exec", nonce_, "id", context.get());
-        }
+    if (!CanSelect(context))
+        return nullptr;
 
-        fifo_.pop();
-        current_context_ = context;
-        current_count_++;
-        return context;
+    if (executing_.empty() || executing_.back().context != context) {
+        uint32_t nonce = TRACE_NONCE();
+        TRACE_ASYNC_BEGIN("magma", "Context Exec", nonce, "id", context.get());
+        executing_.push_back({context, 0, nonce});
     }
 
-    return nullptr;
+    fifo_.pop();
+    executing_.back().count++;
+    return context;
+}
+
+std::shared_ptr<MsdIntelContext> FifoScheduler::PeekContext()
+{
+    // Entries ScheduleContext would skip just make this conservative.
+    if (fifo_.empty())
+        return nullptr;
+
+    auto context = fifo_.front().lock();
+    if (!context)
+        return nullptr;
+
+    auto connection = context->connection().lock();
+    if (connection && connection->context_killed())
+        return nullptr;
+
+    return CanSelect(context) ? context : nullptr;
 }
 
 void FifoScheduler::CommandBufferCompleted(std::shared_ptr<MsdIntelContext> context)
 {
-    DASSERT(current_count_);
-    if (--current_count_ == 0){
-        TRACE_ASYNC_END("magma", "Context Exec", nonce_);
-        current_context_.reset();
+    // Command buffers complete in the order they execute.
+    DASSERT(!executing_.empty() && executing_.front().context == context);
+    if (--executing_.front().count == 0) {
+        TRACE_ASYNC_END("magma", "Context Exec", executing_.front().nonce);
+        executing_.pop_front();
     }
 }
 
@@ -6,6 +6,7 @@
 #define SCHEDULER_H
 
 #include <memory>
+#include <vector>
 
 class MsdIntelContext;
 class CommandBuffer;
@@ -17,12 +18,24 @@ public:
     // Notifies the scheduler that a command buffer has been scheduled on the given context.
     virtual void CommandBufferQueued(std::weak_ptr<MsdIntelContext> context) = 0;
 
+    // Notifies the scheduler that command buffers, one per entry of |contexts|, have been put
+    // back at the front of their contexts' queues. They are selected in order, ahead of those
+    // already queued.
+    virtual void CommandBuffersRequeued(std::vector<std::weak_ptr<MsdIntelContext>> contexts) = 0;
+
     // Notifies the scheduler that a command buffer has been completed on the given context.
     virtual void CommandBufferCompleted(std::shared_ptr<MsdIntelContext> context) = 0;
 
-    // Selects the context whose command buffer will be executed next.
+    // Selects the context whose command buffer will be executed next. Command buffers of one
+    // context execute at a time, except that a context whose next command buffer waits on the
+    // gpu for earlier work may be selected while the current context still has command buffers
+    // executing; the engine queues it to run behind them, so the wait doesn't need a trip
+    // through the cpu. At most two contexts are executing at once.
     virtual std::shared_ptr<MsdIntelContext> ScheduleContext() = 0;
 
+    // Returns the context ScheduleContext would select, without selecting it.
+    virtual std::shared_ptr<MsdIntelContext> PeekContext() = 0;
+
     static std::unique_ptr<Scheduler> CreateFifoScheduler();
 };
 
@@ -19,6 +19,9 @@ public:
         return sequence_number;
     }
 
+    // The sequence number the next call to next_sequence_number will return.
+    uint32_t peek_next_sequence_number() { return next_sequence_number_; }
+
     static constexpr uint32_t kInvalidSequenceNumber = 0;
 
 private:
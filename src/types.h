@@ -22,6 +22,16 @@ enum CachingType {
     CACHING_NONE,
     CACHING_LLC,
     CACHING_WRITE_THROUGH,
+    CACHING_WRITE_COMBINING,
+};
+
+// Age given to lines a CACHING_LLC mapping allocates in the last level cache; lines with a lower
+// age are evicted first.
+enum LruAge {
+    LRU_AGE_FROM_UNCORE,
+    LRU_AGE_ZERO,
+    LRU_AGE_NO_CHANGE,
+    LRU_AGE_THREE,
 };
 
 enum AddressSpaceType {
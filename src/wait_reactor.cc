@@ -0,0 +1,92 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "wait_reactor.h"
+#include "magma_util/dlog.h"
+#include "platform_thread.h"
+
+std::unique_ptr<WaitReactor> WaitReactor::Create()
+{
+    auto port = magma::PlatformPort::Create();
+    if (!port)
+        return DRETP(nullptr, "failed to create port");
+
+    auto reactor = std::unique_ptr<WaitReactor>(new WaitReactor(std::move(port)));
+    reactor->thread_ = std::thread([reactor = reactor.get()] { reactor->ThreadLoop(); });
+
+    return reactor;
+}
+
+WaitReactor::~WaitReactor()
+{
+    port_->Close();
+
+    if (thread_.joinable()) {
+        DLOG("joining wait reactor thread");
+        thread_.join();
+        DLOG("joined wait reactor thread");
+    }
+}
+
+bool WaitReactor::AddWaitSet(const void* owner, Callback callback,
+                             std::vector<std::shared_ptr<magma::PlatformSemaphore>> semaphores)
+{
+    DASSERT(semaphores.size());
+
+    auto wait_set = std::make_shared<WaitSet>();
+    wait_set->owner = owner;
+    wait_set->callback = std::move(callback);
+    wait_set->semaphores = std::move(semaphores);
+    wait_set->pending_count = wait_set->semaphores.size();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& semaphore : wait_set->semaphores) {
+        wait_sets_.emplace(semaphore->id(), wait_set);
+        if (!semaphore->WaitAsync(port_.get())) {
+            for (auto iter = wait_sets_.begin(); iter != wait_sets_.end();) {
+                iter = iter->second == wait_set ? wait_sets_.erase(iter) : std::next(iter);
+            }
+            return DRETF(false, "WaitAsync failed");
+        }
+    }
+
+    return true;
+}
+
+void WaitReactor::RemoveWaitSets(const void* owner)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto iter = wait_sets_.begin(); iter != wait_sets_.end();) {
+        iter = iter->second->owner == owner ? wait_sets_.erase(iter) : std::next(iter);
+    }
+}
+
+void WaitReactor::ThreadLoop()
+{
+    magma::PlatformThreadHelper::SetCurrentThreadName("WaitReactorThread");
+    DLOG("wait reactor thread started");
+
+    uint64_t key;
+    while (port_->Wait(&key)) {
+        Callback callback;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto iter = wait_sets_.find(key);
+            if (iter == wait_sets_.end()) {
+                // The wait set was removed; the port still delivers its semaphore's packet.
+                DLOG("no wait set for semaphore 0x%lx", key);
+                continue;
+            }
+            std::shared_ptr<WaitSet> wait_set = iter->second;
+            wait_sets_.erase(iter);
+            if (--wait_set->pending_count > 0)
+                continue;
+            callback = std::move(wait_set->callback);
+        }
+        // Without the lock, so the callback may add wait sets.
+        callback();
+    }
+
+    DLOG("wait reactor thread exited");
+}
@@ -0,0 +1,56 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef WAIT_REACTOR_H
+#define WAIT_REACTOR_H
+
+#include "platform_port.h"
+#include "platform_semaphore.h"
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Services semaphore wait sets for every client context and the flip path on a single thread,
+// instead of a wait thread per context.
+// Wait set callbacks run on the reactor thread and may add further wait sets.
+class WaitReactor {
+public:
+    using Callback = std::function<void()>;
+
+    static std::unique_ptr<WaitReactor> Create();
+
+    // Stops the reactor thread; pending wait sets are dropped without their callbacks running.
+    ~WaitReactor();
+
+    // Runs |callback| once every semaphore in |semaphores| has been signalled. |owner| identifies
+    // the wait set to RemoveWaitSets.
+    bool AddWaitSet(const void* owner, Callback callback,
+                    std::vector<std::shared_ptr<magma::PlatformSemaphore>> semaphores);
+
+    // Drops the pending wait sets of |owner| without running their callbacks.
+    void RemoveWaitSets(const void* owner);
+
+private:
+    struct WaitSet {
+        const void* owner;
+        Callback callback;
+        std::vector<std::shared_ptr<magma::PlatformSemaphore>> semaphores;
+        uint32_t pending_count;
+    };
+
+    WaitReactor(std::unique_ptr<magma::PlatformPort> port) : port_(std::move(port)) {}
+
+    void ThreadLoop();
+
+    std::unique_ptr<magma::PlatformPort> port_;
+    std::thread thread_;
+    std::mutex mutex_;
+    // One entry per semaphore still to be signalled, keyed by semaphore id as port packets are.
+    std::unordered_multimap<uint64_t, std::shared_ptr<WaitSet>> wait_sets_;
+};
+
+#endif // WAIT_REACTOR_H
@@ -0,0 +1,141 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "benchmark_runner.h"
+#include "gpu_mapping_cache.h"
+#include "gtt.h"
+#include "mock/mock_address_space.h"
+#include "mock/mock_mmio.h"
+#include "msd_intel_buffer.h"
+#include "ppgtt.h"
+#include <vector>
+
+namespace {
+
+// Bar 0 in system memory, so gtt updates cost what a write combined mapping would.
+class MemoryPciDevice : public magma::PlatformPciDevice {
+public:
+    MemoryPciDevice(uint64_t bar0_size) : bar0_size_(bar0_size) {}
+
+    void* GetDeviceHandle() override { return nullptr; }
+
+    std::unique_ptr<magma::PlatformMmio>
+    CpuMapPciMmio(unsigned int pci_bar, magma::PlatformMmio::CachePolicy cache_policy) override
+    {
+        if (pci_bar != 0)
+            return DRETP(nullptr, "unexpected bar %u", pci_bar);
+        return MockMmio::Create(bar0_size_);
+    }
+
+private:
+    uint64_t bar0_size_;
+};
+
+// Inserts and clears a buffer of |page_count| pages.
+void RunInsertClear(BenchmarkRunner* runner, const std::string& name, AddressSpace* address_space,
+                    uint32_t page_count)
+{
+    if (!runner->Enabled(name))
+        return;
+
+    auto buffer = magma::PlatformBuffer::Create(page_count * PAGE_SIZE, "benchmark");
+    if (!buffer || !buffer->PinPages(0, page_count))
+        return runner->Fail(name, "couldn't create buffer");
+
+    uint64_t addr;
+    if (!address_space->Alloc(buffer->size(), 0, &addr))
+        return runner->Fail(name, "couldn't allocate");
+
+    runner->Run(name, page_count, [address_space, &buffer, addr]() {
+        return address_space->Insert(addr, buffer.get(), 0, buffer->size(), CACHING_LLC,
+                                     LRU_AGE_FROM_UNCORE) &&
+               address_space->Clear(addr);
+    });
+
+    address_space->Free(addr);
+    buffer->UnpinPages(0, page_count);
+}
+
+void RunPerProcessGttBenchmarks(BenchmarkRunner* runner)
+{
+    std::shared_ptr<magma::PlatformBuffer> scratch_buffer =
+        magma::PlatformBuffer::Create(PAGE_SIZE, "scratch");
+    if (!scratch_buffer || !scratch_buffer->PinPages(0, 1))
+        return runner->Fail("ppgtt", "couldn't create scratch buffer");
+
+    auto ppgtt = PerProcessGtt::Create(scratch_buffer, nullptr, BusMapper::Platform());
+    if (!ppgtt)
+        return runner->Fail("ppgtt", "couldn't create ppgtt");
+
+    for (uint32_t page_count : {1, 16, 256, 4096}) {
+        RunInsertClear(runner, "ppgtt/insert_clear/pages:" + std::to_string(page_count),
+                       ppgtt.get(), page_count);
+    }
+}
+
+void RunGttBenchmarks(BenchmarkRunner* runner)
+{
+    constexpr uint64_t kGttSize = 8ull * 1024 * 1024;
+
+    MemoryPciDevice platform_device(kGttSize * 2);
+    Gtt gtt(nullptr, BusMapper::Platform());
+    if (!gtt.Init(kGttSize, &platform_device))
+        return runner->Fail("gtt", "couldn't init gtt");
+
+    for (uint32_t page_count : {1, 16, 256, 4096}) {
+        RunInsertClear(runner, "gtt/insert_clear/pages:" + std::to_string(page_count), &gtt,
+                       page_count);
+    }
+}
+
+// Looks up one of |mapping_count| shared mappings of the same buffer.
+void RunFindBufferMappingBenchmarks(BenchmarkRunner* runner)
+{
+    for (uint32_t mapping_count : {1, 16, 256, 1024}) {
+        std::string name = "buffer/find_mapping/mappings:" + std::to_string(mapping_count);
+        if (!runner->Enabled(name + "/hit") && !runner->Enabled(name + "/miss"))
+            continue;
+
+        std::shared_ptr<AddressSpace> address_space =
+            std::make_shared<MockAddressSpace>(0, 2ull * mapping_count * PAGE_SIZE);
+        std::shared_ptr<MsdIntelBuffer> buffer =
+            MsdIntelBuffer::Create(mapping_count * PAGE_SIZE, "benchmark");
+        if (!buffer) {
+            runner->Fail(name, "couldn't create buffer");
+            continue;
+        }
+
+        std::vector<std::shared_ptr<GpuMapping>> mappings;
+        for (uint32_t i = 0; i < mapping_count; i++) {
+            auto mapping = AddressSpace::MapBufferGpu(address_space, buffer, i * PAGE_SIZE,
+                                                      PAGE_SIZE, PAGE_SIZE);
+            if (!mapping)
+                break;
+            mappings.push_back(buffer->ShareBufferMapping(std::move(mapping)));
+        }
+        if (mappings.size() != mapping_count) {
+            runner->Fail(name, "couldn't map buffer");
+            continue;
+        }
+
+        uint64_t last_offset = (mapping_count - 1) * PAGE_SIZE;
+        runner->Run(name + "/hit", 1, [&address_space, &buffer, last_offset]() {
+            return buffer->FindBufferMapping(address_space, last_offset, PAGE_SIZE, PAGE_SIZE) !=
+                   nullptr;
+        });
+        runner->Run(name + "/miss", 1, [&address_space, &buffer, mapping_count]() {
+            return buffer->FindBufferMapping(address_space, mapping_count * PAGE_SIZE, PAGE_SIZE,
+                                             PAGE_SIZE) == nullptr;
+        });
+    }
+}
+
+} // namespace
+
+void RunAddressSpaceBenchmarks(BenchmarkRunner* runner)
+{
+    RunPerProcessGttBenchmarks(runner);
+    RunGttBenchmarks(runner);
+    RunFindBufferMappingBenchmarks(runner);
+}
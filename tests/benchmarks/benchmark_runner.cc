@@ -0,0 +1,48 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "benchmark_runner.h"
+#include <inttypes.h>
+
+constexpr std::chrono::milliseconds BenchmarkRunner::kMinDuration;
+
+void BenchmarkRunner::Run(const std::string& name, uint64_t items_per_iteration,
+                          std::function<bool()> body)
+{
+    if (!Enabled(name))
+        return;
+
+    // Warm up, then double the iteration count until a run takes long enough to time.
+    if (!body())
+        return Fail(name, "failed");
+
+    uint64_t iterations = 1;
+    std::chrono::nanoseconds elapsed;
+    while (true) {
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < iterations; i++) {
+            if (!body())
+                return Fail(name, "failed");
+        }
+        elapsed = std::chrono::steady_clock::now() - start;
+        if (elapsed >= kMinDuration)
+            break;
+        iterations *= 2;
+    }
+
+    double ns_per_iteration = static_cast<double>(elapsed.count()) / iterations;
+    fprintf(output_,
+            "{\"name\":\"%s\",\"iterations\":%" PRIu64 ",\"ns_per_iteration\":%.1f,"
+            "\"items_per_second\":%.1f}\n",
+            name.c_str(), iterations, ns_per_iteration,
+            items_per_iteration * 1e9 / ns_per_iteration);
+    fflush(output_);
+}
+
+void BenchmarkRunner::Fail(const std::string& name, const char* reason)
+{
+    failure_count_++;
+    fprintf(output_, "{\"name\":\"%s\",\"error\":\"%s\"}\n", name.c_str(), reason);
+    fflush(output_);
+}
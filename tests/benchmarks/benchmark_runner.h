@@ -0,0 +1,51 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BENCHMARK_RUNNER_H
+#define BENCHMARK_RUNNER_H
+
+#include <chrono>
+#include <functional>
+#include <stdio.h>
+#include <string>
+
+// Times benchmark bodies and writes each result as a json object on its own line, eg:
+// {"name":"ringbuffer/batch","iterations":65536,"ns_per_iteration":41.2,"items_per_second":...}
+// A benchmark that fails is reported with an "error" member instead of timings.
+class BenchmarkRunner {
+public:
+    // Each benchmark runs for at least this long.
+    static constexpr std::chrono::milliseconds kMinDuration{200};
+
+    // Only benchmarks whose name contains |filter| are run.
+    BenchmarkRunner(FILE* output, std::string filter)
+        : output_(output), filter_(std::move(filter))
+    {
+    }
+
+    // Times |body|, which performs |items_per_iteration| operations per call and returns false
+    // on failure.
+    void Run(const std::string& name, uint64_t items_per_iteration, std::function<bool()> body);
+
+    // Reports a benchmark that couldn't be set up.
+    void Fail(const std::string& name, const char* reason);
+
+    bool Enabled(const std::string& name) { return name.find(filter_) != std::string::npos; }
+
+    uint32_t failure_count() { return failure_count_; }
+
+private:
+    FILE* output_;
+    std::string filter_;
+    uint32_t failure_count_ = 0;
+};
+
+void RunAddressSpaceBenchmarks(BenchmarkRunner* runner);
+void RunCommandBufferBenchmarks(BenchmarkRunner* runner);
+void RunContextBenchmarks(BenchmarkRunner* runner);
+void RunEngineBenchmarks(BenchmarkRunner* runner);
+// Replays the register trace at |trace_path|, as recorded by RegisterTraceRecorder.
+void RunRegisterTraceBenchmarks(BenchmarkRunner* runner, const char* trace_path);
+
+#endif // BENCHMARK_RUNNER_H
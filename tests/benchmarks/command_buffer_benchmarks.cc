@@ -0,0 +1,221 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "benchmark_runner.h"
+#include "engine_command_streamer.h"
+#include "engine_owner.h"
+#include "instructions.h"
+#include "magma_common_defs.h"
+#include "mock/mock_address_space.h"
+#include "msd_intel_context.h"
+#include "ppgtt.h"
+#include "unit_tests/test_command_buffer.h"
+#include <chrono>
+#include <vector>
+
+namespace {
+
+// Builds a command buffer whose batch buffer (resource 0) has |relocation_count| relocations
+// spread over the other |resource_count| - 1 resources.
+std::unique_ptr<CommandBuffer> CreateCommandBuffer(std::weak_ptr<ClientContext> context,
+                                                   uint32_t resource_count,
+                                                   uint32_t relocation_count)
+{
+    DASSERT(resource_count > 1 && relocation_count > 0);
+
+    // Each relocation patches a qword of the batch buffer.
+    std::vector<std::shared_ptr<MsdIntelBuffer>> buffers;
+    buffers.push_back(MsdIntelBuffer::Create(
+        magma::round_up(relocation_count * sizeof(uint64_t), PAGE_SIZE), "batch"));
+    for (uint32_t i = 1; i < resource_count; i++) {
+        buffers.push_back(MsdIntelBuffer::Create(PAGE_SIZE, "resource"));
+    }
+
+    uint64_t descriptor_size = sizeof(magma_system_command_buffer) +
+                               resource_count * sizeof(magma_system_exec_resource) +
+                               relocation_count * sizeof(magma_system_relocation_entry);
+    std::shared_ptr<MsdIntelBuffer> descriptor =
+        MsdIntelBuffer::Create(descriptor_size, "descriptor");
+    if (!descriptor)
+        return DRETP(nullptr, "couldn't create descriptor");
+
+    void* addr;
+    if (!descriptor->platform_buffer()->MapCpu(&addr))
+        return DRETP(nullptr, "couldn't map descriptor");
+
+    auto command_buffer = reinterpret_cast<magma_system_command_buffer*>(addr);
+    command_buffer->batch_buffer_resource_index = 0;
+    command_buffer->batch_start_offset = 0;
+    command_buffer->num_resources = resource_count;
+    command_buffer->wait_semaphore_count = 0;
+    command_buffer->signal_semaphore_count = 0;
+
+    auto resources = reinterpret_cast<magma_system_exec_resource*>(command_buffer + 1);
+    auto relocations =
+        reinterpret_cast<magma_system_relocation_entry*>(resources + resource_count);
+
+    for (uint32_t i = 0; i < resource_count; i++) {
+        if (!buffers[i])
+            return DRETP(nullptr, "couldn't create buffer %u", i);
+        resources[i].buffer_id = buffers[i]->platform_buffer()->id();
+        resources[i].num_relocations = i == 0 ? relocation_count : 0;
+        resources[i].offset = 0;
+        resources[i].length = buffers[i]->platform_buffer()->size();
+    }
+
+    for (uint32_t i = 0; i < relocation_count; i++) {
+        relocations[i].offset = i * sizeof(uint64_t);
+        relocations[i].target_resource_index = 1 + i % (resource_count - 1);
+        relocations[i].target_offset = 0;
+    }
+
+    descriptor->platform_buffer()->UnmapCpu();
+
+    return TestCommandBuffer::Create(descriptor, context, std::move(buffers), {}, {});
+}
+
+// Builds a command buffer with no relocations over |buffers|; the first is the batch buffer.
+std::unique_ptr<CommandBuffer>
+CreateCommandBuffer(std::weak_ptr<ClientContext> context,
+                    std::vector<std::shared_ptr<MsdIntelBuffer>> buffers)
+{
+    uint32_t resource_count = buffers.size();
+    std::shared_ptr<MsdIntelBuffer> descriptor = MsdIntelBuffer::Create(
+        sizeof(magma_system_command_buffer) + resource_count * sizeof(magma_system_exec_resource),
+        "descriptor");
+    if (!descriptor)
+        return DRETP(nullptr, "couldn't create descriptor");
+
+    void* addr;
+    if (!descriptor->platform_buffer()->MapCpu(&addr))
+        return DRETP(nullptr, "couldn't map descriptor");
+
+    auto command_buffer = reinterpret_cast<magma_system_command_buffer*>(addr);
+    command_buffer->batch_buffer_resource_index = 0;
+    command_buffer->batch_start_offset = 0;
+    command_buffer->num_resources = resource_count;
+    command_buffer->wait_semaphore_count = 0;
+    command_buffer->signal_semaphore_count = 0;
+
+    auto resources = reinterpret_cast<magma_system_exec_resource*>(command_buffer + 1);
+    for (uint32_t i = 0; i < resource_count; i++) {
+        resources[i].buffer_id = buffers[i]->platform_buffer()->id();
+        resources[i].num_relocations = 0;
+        resources[i].offset = 0;
+        resources[i].length = buffers[i]->platform_buffer()->size();
+    }
+
+    descriptor->platform_buffer()->UnmapCpu();
+
+    return TestCommandBuffer::Create(descriptor, context, std::move(buffers), {}, {});
+}
+
+// Stands in for the gpu time a pipe control's flushes and state clears take.
+void SimulateFlushCost(uint32_t flags)
+{
+    constexpr std::chrono::nanoseconds kDcFlushCost(4000);
+    constexpr std::chrono::nanoseconds kStateClearCost(1000);
+
+    std::chrono::nanoseconds cost(0);
+    if (flags & MiPipeControl::kDcFlushEnableBit)
+        cost += kDcFlushCost;
+    if (flags & MiPipeControl::kGenericMediaStateClearBit)
+        cost += kStateClearCost;
+    if (flags & MiPipeControl::kIndirectStatePointersDisableBit)
+        cost += kStateClearCost;
+
+    auto end = std::chrono::steady_clock::now() + cost;
+    while (std::chrono::steady_clock::now() < end)
+        ;
+}
+
+// Ends each batch of a frame-like mix with the flags GetPipeControlFlags picks, and for
+// comparison with the flags every batch used to get, paying the simulated flush cost of each.
+// Each frame is several batches over the same render targets, queued together so each is
+// emitted right behind the one before; the next frame uses other buffers.
+void RunFlushFlagsBenchmarks(BenchmarkRunner* runner, std::weak_ptr<ClientContext> context)
+{
+    constexpr uint32_t kFrameCount = 4;
+    constexpr uint32_t kBatchesPerFrame = 6;
+    constexpr uint32_t kResourcesPerFrame = 4;
+    constexpr uint32_t kAlwaysFlags =
+        MiPipeControl::kCommandStreamerStallEnableBit | MiPipeControl::kDcFlushEnableBit |
+        MiPipeControl::kGenericMediaStateClearBit | MiPipeControl::kIndirectStatePointersDisableBit;
+
+    std::vector<std::unique_ptr<CommandBuffer>> batches;
+    for (uint32_t frame = 0; frame < kFrameCount; frame++) {
+        std::vector<std::shared_ptr<MsdIntelBuffer>> buffers;
+        for (uint32_t i = 0; i < kResourcesPerFrame; i++) {
+            buffers.push_back(MsdIntelBuffer::Create(PAGE_SIZE, "resource"));
+        }
+        for (uint32_t i = 0; i < kBatchesPerFrame; i++) {
+            auto batch = CreateCommandBuffer(context, buffers);
+            if (!batch)
+                return runner->Fail("command_buffer/flush_flags", "couldn't create command buffer");
+            batches.push_back(std::move(batch));
+        }
+    }
+
+    for (bool adaptive : {true, false}) {
+        std::string name = std::string("command_buffer/flush_flags/") +
+                           (adaptive ? "adaptive" : "always");
+        if (!runner->Enabled(name))
+            continue;
+
+        runner->Run(name, batches.size(), [&batches, adaptive]() {
+            for (uint32_t i = 0; i < batches.size(); i++) {
+                MappedBatch* next_batch = i + 1 < batches.size() ? batches[i + 1].get() : nullptr;
+                SimulateFlushCost(adaptive ? batches[i]->GetPipeControlFlags(next_batch)
+                                           : kAlwaysFlags);
+            }
+            return true;
+        });
+    }
+}
+
+} // namespace
+
+void RunCommandBufferBenchmarks(BenchmarkRunner* runner)
+{
+    EngineOwner owner;
+    auto engine = RenderEngineCommandStreamer::Create(&owner);
+    auto global_gtt = std::make_shared<MockAddressSpace>(0, 64 * 1024 * 1024);
+
+    std::shared_ptr<magma::PlatformBuffer> scratch_buffer =
+        magma::PlatformBuffer::Create(PAGE_SIZE, "scratch");
+    if (!scratch_buffer || !scratch_buffer->PinPages(0, 1))
+        return runner->Fail("command_buffer", "couldn't create scratch buffer");
+
+    std::shared_ptr<AddressSpace> ppgtt =
+        PerProcessGtt::Create(scratch_buffer, nullptr, BusMapper::Platform());
+    std::weak_ptr<MsdIntelConnection> connection;
+    auto context = std::make_shared<ClientContext>(connection, ppgtt);
+
+    const struct {
+        uint32_t resource_count;
+        uint32_t relocation_count;
+    } kConfigs[] = {{2, 1}, {8, 32}, {32, 256}, {128, 1024}};
+
+    for (auto& config : kConfigs) {
+        std::string name = "command_buffer/prepare/resources:" +
+                           std::to_string(config.resource_count) +
+                           "/relocations:" + std::to_string(config.relocation_count);
+        if (!runner->Enabled(name))
+            continue;
+
+        auto command_buffer =
+            CreateCommandBuffer(context, config.resource_count, config.relocation_count);
+        if (!command_buffer) {
+            runner->Fail(name, "couldn't create command buffer");
+            continue;
+        }
+
+        // Each preparation maps the resources afresh and patches every relocation.
+        runner->Run(name, 1, [&command_buffer, &engine, &global_gtt]() {
+            return command_buffer->PrepareForExecution(engine.get(), global_gtt);
+        });
+    }
+
+    RunFlushFlagsBenchmarks(runner, context);
+}
@@ -0,0 +1,116 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "benchmark_runner.h"
+#include "engine_owner.h"
+#include "mock/mock_address_space.h"
+#include "msd_intel_context.h"
+#include "ppgtt.h"
+#include <vector>
+
+class BenchmarkEngineCommandStreamer {
+public:
+    static bool SubmitContext(EngineCommandStreamer* engine, MsdIntelContext* context,
+                              uint32_t tail)
+    {
+        return engine->SubmitContext(context, tail, false, nullptr);
+    }
+
+    static void InitGoldenContextImage(EngineCommandStreamer* engine)
+    {
+        engine->InitGoldenContextImage();
+    }
+
+    static void WriteContextState(EngineCommandStreamer* engine, uint32_t* state,
+                                  Ringbuffer* ringbuffer, AddressSpace* address_space)
+    {
+        engine->WriteContextState(state, ringbuffer, address_space);
+    }
+};
+
+namespace {
+
+// Submits a context as ExecBatch does after writing its ring: the tail and ring start are
+// stored into the context image and the context is written to the execlist port. For
+// comparison, the map_per_submit variant maps and unmaps the register state page around each
+// submission, as UpdateContext used to.
+void RunContextSubmitBenchmarks(BenchmarkRunner* runner, EngineCommandStreamer* engine)
+{
+    auto address_space = std::make_shared<MockAddressSpace>(0, 64 * 1024 * 1024);
+    std::weak_ptr<MsdIntelConnection> connection;
+    auto context = std::make_shared<ClientContext>(connection, address_space);
+    if (!engine->InitContext(context.get()) || !context->Map(address_space, engine->id()))
+        return runner->Fail("context/submit", "couldn't init context");
+
+    magma::PlatformBuffer* context_buffer =
+        context->get_context_buffer(engine->id())->platform_buffer();
+    uint32_t ringbuffer_size = context->get_ringbuffer(engine->id())->size();
+
+    for (bool map_per_submit : {false, true}) {
+        std::string name =
+            std::string("context/submit/") + (map_per_submit ? "map_per_submit" : "persistent_map");
+        if (!runner->Enabled(name))
+            continue;
+
+        uint32_t tail = 0;
+        runner->Run(name, 1, [engine, &context, context_buffer, ringbuffer_size, map_per_submit,
+                              &tail]() {
+            tail = (tail + 8 * sizeof(uint32_t)) % ringbuffer_size;
+            void* cpu_addr;
+            if (map_per_submit &&
+                !context_buffer->MapPageCpu(MsdIntelContext::kRegisterStatePageIndex, &cpu_addr))
+                return false;
+            if (!BenchmarkEngineCommandStreamer::SubmitContext(engine, context.get(), tail))
+                return false;
+            return !map_per_submit ||
+                   context_buffer->UnmapPageCpu(MsdIntelContext::kRegisterStatePageIndex);
+        });
+    }
+}
+
+// Writes a new ppgtt context's image: a copy of the golden image with the ring head and pdps
+// patched. For comparison, the from_scratch variant first builds the register state and cache
+// config field by field, as every context init used to.
+void RunContextInitBenchmarks(BenchmarkRunner* runner, EngineCommandStreamer* engine)
+{
+    std::shared_ptr<magma::PlatformBuffer> scratch_buffer =
+        magma::PlatformBuffer::Create(PAGE_SIZE, "scratch");
+    if (!scratch_buffer || !scratch_buffer->PinPages(0, 1))
+        return runner->Fail("context/init", "couldn't create scratch buffer");
+
+    std::shared_ptr<AddressSpace> ppgtt =
+        PerProcessGtt::Create(scratch_buffer, nullptr, BusMapper::Platform());
+    if (!ppgtt)
+        return runner->Fail("context/init", "couldn't create ppgtt");
+
+    auto ringbuffer = std::unique_ptr<Ringbuffer>(
+        new Ringbuffer(MsdIntelBuffer::Create(32 * PAGE_SIZE, "ring-buffer")));
+    std::vector<uint32_t> state(PAGE_SIZE / sizeof(uint32_t));
+
+    for (bool from_scratch : {false, true}) {
+        std::string name =
+            std::string("context/init/") + (from_scratch ? "from_scratch" : "golden");
+        if (!runner->Enabled(name))
+            continue;
+
+        runner->Run(name, 1, [engine, &ppgtt, &ringbuffer, &state, from_scratch]() {
+            if (from_scratch)
+                BenchmarkEngineCommandStreamer::InitGoldenContextImage(engine);
+            BenchmarkEngineCommandStreamer::WriteContextState(engine, state.data(),
+                                                              ringbuffer.get(), ppgtt.get());
+            return true;
+        });
+    }
+}
+
+} // namespace
+
+void RunContextBenchmarks(BenchmarkRunner* runner)
+{
+    EngineOwner owner;
+    auto engine = RenderEngineCommandStreamer::Create(&owner);
+
+    RunContextInitBenchmarks(runner, engine.get());
+    RunContextSubmitBenchmarks(runner, engine.get());
+}
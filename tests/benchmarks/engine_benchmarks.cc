@@ -0,0 +1,162 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "benchmark_runner.h"
+#include "flight_recorder.h"
+#include "hardware_status_page.h"
+#include "instruction_decoder.h"
+#include "instructions.h"
+#include "mock/mock_address_space.h"
+#include "msd_intel_context.h"
+#include "ringbuffer.h"
+#include "scheduler.h"
+#include <vector>
+
+namespace {
+
+// Emits the commands the engine writes per batch: the batch start, the sequence number write
+// and the user interrupt.
+void RunRingbufferBenchmarks(BenchmarkRunner* runner)
+{
+    const std::string name = "ringbuffer/batch";
+    if (!runner->Enabled(name))
+        return;
+
+    constexpr uint32_t kRingbufferSize = 32 * PAGE_SIZE;
+    constexpr uint32_t kBatchDwords =
+        MiBatchBufferStart::kDwordCount + MiPipeControl::kDwordCount + MiUserInterrupt::kDwordCount;
+
+    auto ringbuffer = std::unique_ptr<Ringbuffer>(
+        new Ringbuffer(MsdIntelBuffer::Create(kRingbufferSize, "ring-buffer")));
+    auto address_space = std::make_shared<MockAddressSpace>(0, kRingbufferSize);
+    if (!ringbuffer->Map(address_space))
+        return runner->Fail(name, "couldn't map ringbuffer");
+
+    uint32_t sequence_number = 0;
+    runner->Run(name, 1, [&ringbuffer, &sequence_number]() {
+        if (!ringbuffer->HasSpace(kBatchDwords * sizeof(uint32_t)))
+            ringbuffer->update_head(ringbuffer->tail());
+        MiBatchBufferStart::write(ringbuffer.get(), 0x10000, ADDRESS_SPACE_PPGTT);
+        MiPipeControl::write(ringbuffer.get(), ++sequence_number,
+                             HardwareStatusPage::kSequenceNumberOffset,
+                             MiPipeControl::kCommandStreamerStallEnableBit);
+        MiUserInterrupt::write(ringbuffer.get());
+        return true;
+    });
+
+    ringbuffer->Unmap();
+}
+
+// Queues a command buffer on each of |context_count| contexts, then schedules and completes
+// them all.
+void RunSchedulerBenchmarks(BenchmarkRunner* runner)
+{
+    for (uint32_t context_count : {1, 8, 64}) {
+        std::string name = "scheduler/fifo/contexts:" + std::to_string(context_count);
+        if (!runner->Enabled(name))
+            continue;
+
+        auto address_space = std::make_shared<MockAddressSpace>(0, PAGE_SIZE);
+        std::weak_ptr<MsdIntelConnection> connection;
+        std::vector<std::shared_ptr<MsdIntelContext>> contexts;
+        for (uint32_t i = 0; i < context_count; i++) {
+            contexts.push_back(std::make_shared<ClientContext>(connection, address_space));
+        }
+
+        auto scheduler = Scheduler::CreateFifoScheduler();
+        runner->Run(name, context_count, [&scheduler, &contexts]() {
+            for (auto& context : contexts) {
+                scheduler->CommandBufferQueued(context);
+            }
+            for (uint32_t i = 0; i < contexts.size(); i++) {
+                std::shared_ptr<MsdIntelContext> context = scheduler->ScheduleContext();
+                if (!context)
+                    return false;
+                scheduler->CommandBufferCompleted(context);
+            }
+            return true;
+        });
+    }
+}
+
+// Walks a batch made of typical 3d state and pipe control commands, as the device dump does.
+void RunInstructionDecoderBenchmarks(BenchmarkRunner* runner)
+{
+    const std::string name = "instruction_decoder/batch";
+    if (!runner->Enabled(name))
+        return;
+
+    // Id and length in dwords of each command.
+    const struct {
+        InstructionDecoder::Id id;
+        uint32_t dword_count;
+    } kCommands[] = {
+        {InstructionDecoder::PIPELINE_SELECT, 1},
+        {InstructionDecoder::STATE_BASE_ADDRESS, 19},
+        {InstructionDecoder::_3DSTATE_VERTEX_BUFFERS, 5},
+        {InstructionDecoder::_3DSTATE_VERTEX_ELEMENTS, 5},
+        {InstructionDecoder::_3DSTATE_BINDING_TABLE_POINTERS_PS, 2},
+        {InstructionDecoder::_3DSTATE_CONSTANT_PS, 11},
+        {InstructionDecoder::_3DSTATE_PS, 12},
+        {InstructionDecoder::LOAD_REGISTER_IMM, 3},
+        {InstructionDecoder::_3DPRIMITIVE, 7},
+        {InstructionDecoder::PIPE_CONTROL, 6},
+        {InstructionDecoder::NOOP, 1},
+    };
+
+    std::vector<uint32_t> batch;
+    uint32_t command_count = 0;
+    while (batch.size() < PAGE_SIZE / sizeof(uint32_t)) {
+        for (auto& command : kCommands) {
+            uint32_t header = command.id << 16;
+            if (command.dword_count > 2)
+                header |= command.dword_count - 2;
+            batch.push_back(header);
+            batch.resize(batch.size() + command.dword_count - 1);
+            command_count++;
+        }
+    }
+    batch.push_back(static_cast<uint32_t>(InstructionDecoder::MI_BATCH_BUFFER_END) << 16);
+    command_count++;
+
+    runner->Run(name, command_count, [&batch, command_count]() {
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < batch.size();) {
+            InstructionDecoder::Id id;
+            uint32_t dword_count = 0;
+            if (!InstructionDecoder::Decode(batch[i], &id, &dword_count) || dword_count == 0)
+                return false;
+            i += dword_count;
+            count++;
+            if (id == InstructionDecoder::MI_BATCH_BUFFER_END)
+                break;
+        }
+        return count == command_count;
+    });
+}
+
+// Records the event the engine emits per retired batch, which every submission pays for.
+void RunFlightRecorderBenchmarks(BenchmarkRunner* runner)
+{
+    const std::string name = "flight_recorder/record";
+    if (!runner->Enabled(name))
+        return;
+
+    FlightRecorder* recorder = FlightRecorder::Get();
+    uint32_t sequence_number = 0;
+    runner->Run(name, 1, [recorder, &sequence_number]() {
+        recorder->Record(FlightRecorder::kRetire, ++sequence_number, 0x10000);
+        return true;
+    });
+}
+
+} // namespace
+
+void RunEngineBenchmarks(BenchmarkRunner* runner)
+{
+    RunRingbufferBenchmarks(runner);
+    RunSchedulerBenchmarks(runner);
+    RunInstructionDecoderBenchmarks(runner);
+    RunFlightRecorderBenchmarks(runner);
+}
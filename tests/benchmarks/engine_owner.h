@@ -0,0 +1,38 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BENCHMARK_ENGINE_OWNER_H
+#define BENCHMARK_ENGINE_OWNER_H
+
+#include "engine_command_streamer.h"
+#include "mock/mock_mmio.h"
+#include "sequencer.h"
+
+// Just enough of a device to initialize and submit contexts; nothing executes.
+class EngineOwner : public EngineCommandStreamer::Owner {
+public:
+    EngineOwner()
+        : register_io_(new RegisterIo(MockMmio::Create(2 * 1024 * 1024))), sequencer_(1)
+    {
+    }
+
+    RegisterIo* register_io() override { return register_io_.get(); }
+
+    Sequencer* sequencer() override { return &sequencer_; }
+
+    HardwareStatusPage* hardware_status_page(EngineCommandStreamerId id) override
+    {
+        return nullptr;
+    }
+
+    void batch_submitted(uint32_t sequence_number, uint32_t hang_budget_ms) override {}
+
+    void batch_completed(MappedBatch* mapped_batch) override {}
+
+private:
+    std::unique_ptr<RegisterIo> register_io_;
+    Sequencer sequencer_;
+};
+
+#endif // BENCHMARK_ENGINE_OWNER_H
@@ -0,0 +1,50 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "benchmark_runner.h"
+#include <string.h>
+
+// Usage: msd_intel_gen_benchmarks [--output=<file>] [--replay=<register trace>] [filter]
+// Results go to stdout unless an output file is given. Device init is benchmarked only when a
+// register trace is given to replay.
+int main(int argc, char** argv)
+{
+    const char* output_path = nullptr;
+    const char* replay_path = nullptr;
+    std::string filter;
+
+    const char kOutputFlag[] = "--output=";
+    const char kReplayFlag[] = "--replay=";
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], kOutputFlag, strlen(kOutputFlag)) == 0) {
+            output_path = argv[i] + strlen(kOutputFlag);
+        } else if (strncmp(argv[i], kReplayFlag, strlen(kReplayFlag)) == 0) {
+            replay_path = argv[i] + strlen(kReplayFlag);
+        } else {
+            filter = argv[i];
+        }
+    }
+
+    FILE* output = stdout;
+    if (output_path) {
+        output = fopen(output_path, "w");
+        if (!output) {
+            fprintf(stderr, "couldn't open %s\n", output_path);
+            return 1;
+        }
+    }
+
+    BenchmarkRunner runner(output, filter);
+    RunAddressSpaceBenchmarks(&runner);
+    RunCommandBufferBenchmarks(&runner);
+    RunContextBenchmarks(&runner);
+    RunEngineBenchmarks(&runner);
+    if (replay_path)
+        RunRegisterTraceBenchmarks(&runner, replay_path);
+
+    if (output != stdout)
+        fclose(output);
+
+    return runner.failure_count() ? 1 : 0;
+}
@@ -0,0 +1,67 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "benchmark_runner.h"
+#include "mock/register_trace_replayer.h"
+#include "msd_intel_device.h"
+#include <vector>
+
+namespace {
+
+std::vector<uint8_t> ReadFile(const char* path)
+{
+    std::vector<uint8_t> data;
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return data;
+
+    uint8_t buf[4096];
+    size_t size;
+    while ((size = fread(buf, 1, sizeof(buf), file)) > 0) {
+        data.insert(data.end(), buf, buf + size);
+    }
+    fclose(file);
+    return data;
+}
+
+// Replays device init against |trace|. Fails if the driver diverged from the trace.
+bool ReplayDeviceInit(std::shared_ptr<RegisterTrace> trace, size_t* access_count_out)
+{
+    auto replayer = RegisterTraceReplayer::Create(std::move(trace));
+    if (!replayer)
+        return DRETF(false, "couldn't create replayer");
+
+    auto device = MsdIntelDevice::Create(replayer->CreatePciDevice(),
+                                         replayer->CreateRegisterHook(), nullptr, false);
+    if (!device)
+        return DRETF(false, "device init failed");
+
+    if (replayer->mismatch_count())
+        return DRETF(false, "diverged from the trace at access %zu", replayer->first_mismatch());
+
+    // Taken before the device is torn down, which accesses registers past the init.
+    *access_count_out = replayer->position();
+    return true;
+}
+
+} // namespace
+
+void RunRegisterTraceBenchmarks(BenchmarkRunner* runner, const char* trace_path)
+{
+    const std::string name = "register_trace/replay/device_init";
+    if (!runner->Enabled(name))
+        return;
+
+    std::shared_ptr<RegisterTrace> trace = RegisterTrace::Parse(ReadFile(trace_path));
+    if (!trace)
+        return runner->Fail(name, "couldn't read trace");
+
+    size_t access_count;
+    if (!ReplayDeviceInit(trace, &access_count))
+        return runner->Fail(name, "replay failed");
+
+    runner->Run(name, access_count, [&trace, &access_count]() {
+        return ReplayDeviceInit(trace, &access_count);
+    });
+}
@@ -33,7 +33,7 @@ bool MockAddressSpace::Clear(uint64_t addr)
 }
 
 bool MockAddressSpace::Insert(uint64_t addr, magma::PlatformBuffer* buffer, uint64_t offset,
-                              uint64_t length, CachingType caching_type)
+                              uint64_t length, CachingType caching_type, LruAge lru_age)
 {
     auto iter = allocations_.find(addr);
     if (iter == allocations_.end())
@@ -22,7 +22,7 @@ public:
     bool Free(uint64_t addr) override;
     bool Clear(uint64_t addr) override;
     bool Insert(uint64_t addr, magma::PlatformBuffer* buffer, uint64_t offset, uint64_t length,
-                CachingType caching_type) override;
+                CachingType caching_type, LruAge lru_age) override;
 
     bool is_allocated(uint64_t addr)
     {
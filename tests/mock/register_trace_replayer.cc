@@ -0,0 +1,172 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "register_trace_replayer.h"
+#include "magma_util/macros.h"
+#include "registers.h"
+#include <stdlib.h>
+#include <string.h>
+
+class RegisterTraceReplayer::Mmio : public magma::PlatformMmio {
+public:
+    Mmio(void* addr, uint64_t size) : magma::PlatformMmio(addr, size) {}
+};
+
+class RegisterTraceReplayer::PciDevice : public magma::PlatformPciDevice {
+public:
+    PciDevice(RegisterTraceReplayer* replayer) : replayer_(replayer) {}
+
+    void* GetDeviceHandle() override { return nullptr; }
+
+    bool ReadPciConfig16(uint64_t addr, uint16_t* value) override
+    {
+        switch (addr) {
+            case 2:
+                *value = replayer_->trace_->device_id();
+                return true;
+            case registers::GmchGraphicsControl::kOffset:
+                *value = replayer_->trace_->gmch_graphics_control();
+                return true;
+        }
+        *value = 0;
+        return true;
+    }
+
+    std::unique_ptr<magma::PlatformMmio>
+    CpuMapPciMmio(unsigned int pci_bar, magma::PlatformMmio::CachePolicy cache_policy) override
+    {
+        if (pci_bar != 0)
+            return DRETP(nullptr, "no bar %u", pci_bar);
+        return std::make_unique<Mmio>(replayer_->bar_, replayer_->bar_size_);
+    }
+
+    std::unique_ptr<magma::PlatformInterrupt> RegisterInterrupt() override { return nullptr; }
+
+private:
+    RegisterTraceReplayer* replayer_;
+};
+
+class RegisterTraceReplayer::Hook : public RegisterIo::Hook {
+public:
+    Hook(RegisterTraceReplayer* replayer) : replayer_(replayer) {}
+
+    void Write32(uint32_t offset, uint32_t val) override
+    {
+        replayer_->Access(RegisterTrace::Operation::WRITE32, offset, val);
+    }
+    void Read32(uint32_t offset, uint32_t val) override
+    {
+        replayer_->Access(RegisterTrace::Operation::READ32, offset, val);
+    }
+    void Read64(uint32_t offset, uint64_t val) override
+    {
+        replayer_->Access(RegisterTrace::Operation::READ64, offset, val);
+    }
+
+private:
+    RegisterTraceReplayer* replayer_;
+};
+
+std::unique_ptr<RegisterTraceReplayer>
+RegisterTraceReplayer::Create(std::shared_ptr<RegisterTrace> trace)
+{
+    // Registers in the first half, gtt in the second.
+    uint64_t bar_size =
+        2 * registers::GmchGraphicsControl::gtt_size(trace->gmch_graphics_control());
+    if (bar_size == 0)
+        return DRETP(nullptr, "trace has no gtt size");
+
+    void* bar = calloc(1, bar_size);
+    if (!bar)
+        return DRETP(nullptr, "couldn't allocate bar");
+
+    return std::unique_ptr<RegisterTraceReplayer>(
+        new RegisterTraceReplayer(std::move(trace), bar, bar_size));
+}
+
+RegisterTraceReplayer::RegisterTraceReplayer(std::shared_ptr<RegisterTrace> trace, void* bar,
+                                             uint64_t bar_size)
+    : trace_(std::move(trace)), bar_(bar), bar_size_(bar_size)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    PrimeNextReadLocked();
+}
+
+RegisterTraceReplayer::~RegisterTraceReplayer() { free(bar_); }
+
+std::unique_ptr<magma::PlatformPciDevice> RegisterTraceReplayer::CreatePciDevice()
+{
+    return std::make_unique<PciDevice>(this);
+}
+
+std::unique_ptr<RegisterIo::Hook> RegisterTraceReplayer::CreateRegisterHook()
+{
+    return std::make_unique<Hook>(this);
+}
+
+size_t RegisterTraceReplayer::position()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return position_;
+}
+
+uint64_t RegisterTraceReplayer::mismatch_count()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return mismatch_count_;
+}
+
+size_t RegisterTraceReplayer::first_mismatch()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return first_mismatch_;
+}
+
+void RegisterTraceReplayer::Access(RegisterTrace::Operation::Type type, uint32_t offset,
+                                   uint64_t val)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto& operations = trace_->operations();
+    bool match = false;
+    if (position_ < operations.size()) {
+        const RegisterTrace::Operation& expected = operations[position_];
+        match = expected.type == type && expected.offset == offset &&
+                (type != RegisterTrace::Operation::WRITE32 || expected.val == val);
+    }
+    if (!match) {
+        if (mismatch_count_++ == 0)
+            first_mismatch_ = position_;
+        DLOG("register trace mismatch at %zu: type %d offset 0x%x val 0x%lx", position_, type,
+             offset, val);
+    }
+
+    position_++;
+    PrimeNextReadLocked();
+}
+
+void RegisterTraceReplayer::PrimeNextReadLocked()
+{
+    auto& operations = trace_->operations();
+    if (position_ >= operations.size())
+        return;
+
+    const RegisterTrace::Operation& next = operations[position_];
+    if (next.offset + sizeof(uint64_t) > bar_size_ / 2)
+        return;
+
+    uint8_t* addr = reinterpret_cast<uint8_t*>(bar_) + next.offset;
+    switch (next.type) {
+        case RegisterTrace::Operation::READ32: {
+            uint32_t val = next.val;
+            memcpy(addr, &val, sizeof(val));
+            break;
+        }
+        case RegisterTrace::Operation::READ64:
+            memcpy(addr, &next.val, sizeof(next.val));
+            break;
+        case RegisterTrace::Operation::WRITE32:
+            break;
+    }
+}
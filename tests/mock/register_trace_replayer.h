@@ -0,0 +1,62 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef REGISTER_TRACE_REPLAYER_H
+#define REGISTER_TRACE_REPLAYER_H
+
+#include "platform_pci_device.h"
+#include "register_trace.h"
+#include <mutex>
+
+// Replays a register trace against a memory backed bar 0: the driver's register reads return
+// the recorded values, and its accesses are compared with the recorded ones.
+// Since mmio is plain memory, the replayer follows the driver through a RegisterIo hook and
+// stores each recorded read value into the bar just before the driver reads it. Accesses are
+// matched in order; a mismatched access still consumes its recorded operation.
+class RegisterTraceReplayer {
+public:
+    static std::unique_ptr<RegisterTraceReplayer> Create(std::shared_ptr<RegisterTrace> trace);
+
+    ~RegisterTraceReplayer();
+
+    // Returns a pci device with the traced device's id and gtt size, whose bar 0 is replayed.
+    // The replayer must outlive it.
+    std::unique_ptr<magma::PlatformPciDevice> CreatePciDevice();
+
+    // Returns the hook through which the replayer follows the driver. It must be installed on
+    // the RegisterIo of the driver before its first register access.
+    std::unique_ptr<RegisterIo::Hook> CreateRegisterHook();
+
+    // The number of accesses replayed so far, matched or not.
+    size_t position();
+    bool done() { return position() >= trace_->operations().size(); }
+
+    // Accesses that differed from the trace in type, offset or written value, or came after its
+    // end.
+    uint64_t mismatch_count();
+    // The position of the first mismatch, if any.
+    size_t first_mismatch();
+
+private:
+    class PciDevice;
+    class Mmio;
+    class Hook;
+
+    RegisterTraceReplayer(std::shared_ptr<RegisterTrace> trace, void* bar, uint64_t bar_size);
+
+    void Access(RegisterTrace::Operation::Type type, uint32_t offset, uint64_t val);
+    // Requires |mutex_|.
+    void PrimeNextReadLocked();
+
+    std::shared_ptr<RegisterTrace> trace_;
+    void* bar_;
+    uint64_t bar_size_;
+
+    std::mutex mutex_;
+    size_t position_ = 0;
+    uint64_t mismatch_count_ = 0;
+    size_t first_mismatch_ = 0;
+};
+
+#endif // REGISTER_TRACE_REPLAYER_H
@@ -0,0 +1,91 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sim_bus_mapper.h"
+#include "magma_util/macros.h"
+
+class SimBusMapper::Mapping : public BusMapping {
+public:
+    Mapping(SimBusMapper* owner, magma::PlatformBuffer* buffer, uint32_t start_page_index,
+            std::vector<uint64_t> bus_addr)
+        : BusMapping(start_page_index, std::move(bus_addr)), owner_(owner), buffer_(buffer)
+    {
+    }
+
+    ~Mapping() override
+    {
+        owner_->RemovePages(bus_addr());
+        buffer_->UnmapCpu();
+    }
+
+private:
+    SimBusMapper* owner_;
+    magma::PlatformBuffer* buffer_;
+};
+
+class SimBusMapper::Mapper : public BusMapper {
+public:
+    Mapper(SimBusMapper* owner) : owner_(owner) {}
+
+    std::unique_ptr<BusMapping> MapPageRange(magma::PlatformBuffer* buffer,
+                                             uint32_t start_page_index,
+                                             uint32_t page_count) override
+    {
+        std::vector<uint64_t> bus_addr(page_count);
+        if (!buffer->MapPageRangeBus(start_page_index, page_count, bus_addr.data()))
+            return DRETP(nullptr, "failed to map page range to bus");
+
+        // Cpu mappings are reference counted; each bus mapping holds one.
+        void* cpu_addr;
+        if (!buffer->MapCpu(&cpu_addr))
+            return DRETP(nullptr, "couldn't map buffer %lu for the simulator", buffer->id());
+
+        owner_->AddPages(bus_addr,
+                         reinterpret_cast<uint8_t*>(cpu_addr) + start_page_index * PAGE_SIZE);
+        return std::unique_ptr<BusMapping>(
+            new Mapping(owner_, buffer, start_page_index, std::move(bus_addr)));
+    }
+
+private:
+    SimBusMapper* owner_;
+};
+
+std::unique_ptr<BusMapper> SimBusMapper::CreateBusMapper()
+{
+    return std::unique_ptr<BusMapper>(new Mapper(this));
+}
+
+void SimBusMapper::AddPages(const std::vector<uint64_t>& bus_addr, void* cpu_addr)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (uint32_t i = 0; i < bus_addr.size(); i++) {
+        Page& page = pages_[bus_addr[i]];
+        page.cpu_addr = reinterpret_cast<uint8_t*>(cpu_addr) + i * PAGE_SIZE;
+        page.refs++;
+    }
+}
+
+void SimBusMapper::RemovePages(const std::vector<uint64_t>& bus_addr)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (uint64_t addr : bus_addr) {
+        auto iter = pages_.find(addr);
+        DASSERT(iter != pages_.end());
+        if (--iter->second.refs == 0)
+            pages_.erase(iter);
+    }
+}
+
+void* SimBusMapper::Resolve(uint64_t bus_addr)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto iter = pages_.find(bus_addr);
+    return iter == pages_.end() ? nullptr : iter->second.cpu_addr;
+}
+
+uint32_t SimBusMapper::mapped_page_count()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pages_.size();
+}
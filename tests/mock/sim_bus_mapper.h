@@ -0,0 +1,50 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIM_BUS_MAPPER_H
+#define SIM_BUS_MAPPER_H
+
+#include "bus_mapping.h"
+#include "sim_gpu.h"
+#include <mutex>
+#include <unordered_map>
+
+// Resolves the bus addresses in the driver's page tables for a SimGpu running under
+// MsdIntelDevice. The device maps buffer pages through the mapper returned by CreateBusMapper,
+// which maps each buffer for cpu access so the simulator can reach its pages while the driver
+// holds the mapping. It must outlive the device and the simulator.
+class SimBusMapper {
+public:
+    // Returns a mapper to pass to MsdIntelDevice::Create.
+    std::unique_ptr<BusMapper> CreateBusMapper();
+
+    // Returns the cpu address of the page at |bus_addr|, or null if the driver hasn't mapped it.
+    void* Resolve(uint64_t bus_addr);
+
+    SimGpu::BusMapper bus_mapper()
+    {
+        return [this](uint64_t bus_addr) { return Resolve(bus_addr); };
+    }
+
+    uint32_t mapped_page_count();
+
+private:
+    class Mapper;
+    class Mapping;
+
+    void AddPages(const std::vector<uint64_t>& bus_addr, void* cpu_addr);
+    void RemovePages(const std::vector<uint64_t>& bus_addr);
+
+    struct Page {
+        void* cpu_addr;
+        // A page may be mapped by more than one address space.
+        uint32_t refs;
+    };
+
+    std::mutex mutex_;
+    // Pages by bus address.
+    std::unordered_map<uint64_t, Page> pages_;
+};
+
+#endif // SIM_BUS_MAPPER_H
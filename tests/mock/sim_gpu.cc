@@ -0,0 +1,587 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sim_gpu.h"
+#include "instructions.h"
+#include "magma_util/macros.h"
+#include "pagetable.h"
+#include "registers.h"
+#include <stdlib.h>
+
+constexpr uint64_t SimGpu::kGttSize;
+
+// from intel-gfx-prm-osrc-bdw-vol03-gpu_overview_3.pdf p.7
+static constexpr uint32_t kRenderEngineMmioBase = 0x2000;
+
+// Bounds the commands executed per batch, in case a batch is missing its end.
+static constexpr uint32_t kMaxBatchCommands = 1 << 20;
+
+static constexpr uint32_t kMiCommandMask = 0xFF800000;
+static constexpr uint64_t kDescriptorValid = 1;
+static constexpr uint32_t kPipeControlHeader =
+    MiPipeControl::kCommandType | MiPipeControl::kCommandSubType |
+    MiPipeControl::k3dCommandOpcode | MiPipeControl::k3dCommandSubOpcode;
+
+class SimGpu::Mmio : public magma::PlatformMmio {
+public:
+    Mmio(void* addr, uint64_t size) : magma::PlatformMmio(addr, size) {}
+};
+
+class SimGpu::Interrupt : public magma::PlatformInterrupt {
+public:
+    Interrupt(InterruptLine* line) : line_(line) {}
+
+    void Signal() override { line_->Signal(); }
+    bool Wait() override
+    {
+        line_->Wait();
+        return true;
+    }
+    void Complete() override {}
+
+private:
+    InterruptLine* line_;
+};
+
+class SimGpu::PciDevice : public magma::PlatformPciDevice {
+public:
+    PciDevice(SimGpu* gpu) : gpu_(gpu) {}
+
+    void* GetDeviceHandle() override { return nullptr; }
+
+    bool ReadPciConfig16(uint64_t addr, uint16_t* value) override
+    {
+        switch (addr) {
+            case 2:
+                *value = gpu_->device_id_;
+                return true;
+            case registers::GmchGraphicsControl::kOffset:
+                // 8MB gtt
+                *value = 3 << registers::GmchGraphicsControl::kGttSizeShift;
+                return true;
+        }
+        *value = 0;
+        return true;
+    }
+
+    std::unique_ptr<magma::PlatformMmio>
+    CpuMapPciMmio(unsigned int pci_bar, magma::PlatformMmio::CachePolicy cache_policy) override
+    {
+        if (pci_bar != 0)
+            return DRETP(nullptr, "no bar %u", pci_bar);
+        return std::make_unique<Mmio>(gpu_->bar_, gpu_->bar_size_);
+    }
+
+    std::unique_ptr<magma::PlatformInterrupt> RegisterInterrupt() override
+    {
+        return std::make_unique<Interrupt>(&gpu_->interrupt_line_);
+    }
+
+private:
+    SimGpu* gpu_;
+};
+
+class SimGpu::Hook : public RegisterIo::Hook {
+public:
+    Hook(SimGpu* gpu) : gpu_(gpu) {}
+
+    void Write32(uint32_t offset, uint32_t val) override { gpu_->RegisterWritten(offset, val); }
+    void Read32(uint32_t offset, uint32_t val) override {}
+    void Read64(uint32_t offset, uint64_t val) override {}
+
+private:
+    SimGpu* gpu_;
+};
+
+void SimGpu::InterruptLine::Signal()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    count_++;
+    cv_.notify_one();
+}
+
+void SimGpu::InterruptLine::Wait()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return count_ > 0; });
+    count_--;
+}
+
+std::unique_ptr<SimGpu> SimGpu::Create(uint32_t device_id, BusMapper bus_mapper)
+{
+    // Registers in the first half, gtt in the second.
+    uint64_t bar_size = 2 * kGttSize;
+    void* bar = calloc(1, bar_size);
+    if (!bar)
+        return DRETP(nullptr, "couldn't allocate bar");
+
+    if (!bus_mapper)
+        bus_mapper = [](uint64_t bus_addr) { return reinterpret_cast<void*>(bus_addr); };
+
+    return std::unique_ptr<SimGpu>(new SimGpu(device_id, std::move(bus_mapper), bar, bar_size));
+}
+
+SimGpu::SimGpu(uint32_t device_id, BusMapper bus_mapper, void* bar, uint64_t bar_size)
+    : device_id_(device_id), bus_mapper_(std::move(bus_mapper)), bar_(bar), bar_size_(bar_size)
+{
+    // RP0 1150MHz, RP1 700MHz, RPn 300MHz, in 50MHz units.
+    WriteRegister(registers::RenderPerformanceStateCapability::kOffset, (6 << 16) | (14 << 8) | 23);
+    // One slice of three subslices, all eus enabled.
+    WriteRegister(registers::Fuse2ControlDwordMirror::kOffset,
+                  (1 << registers::Fuse2ControlDwordMirror::kSliceEnableShift) |
+                      (0x8 << registers::Fuse2ControlDwordMirror::kSubsliceDisableShift));
+
+    engine_thread_ = std::thread([this] { EngineLoop(); });
+}
+
+SimGpu::~SimGpu()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+        engine_cv_.notify_all();
+    }
+    engine_thread_.join();
+    free(bar_);
+}
+
+std::unique_ptr<magma::PlatformPciDevice> SimGpu::CreatePciDevice()
+{
+    return std::make_unique<PciDevice>(this);
+}
+
+std::unique_ptr<RegisterIo::Hook> SimGpu::CreateRegisterHook()
+{
+    return std::make_unique<Hook>(this);
+}
+
+uint32_t SimGpu::ReadRegister(uint32_t offset)
+{
+    return reinterpret_cast<volatile uint32_t*>(bar_)[offset >> 2];
+}
+
+void SimGpu::WriteRegister(uint32_t offset, uint32_t val)
+{
+    reinterpret_cast<volatile uint32_t*>(bar_)[offset >> 2] = val;
+}
+
+void SimGpu::RegisterWritten(uint32_t offset, uint32_t val)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Masked registers: the upper 16 bits select which of the lower 16 bits are written.
+    uint32_t mask = val >> 16;
+
+    switch (offset) {
+        case registers::ForceWake::kOffset:
+        case registers::ForceWake::kRenderOffset: {
+            uint32_t status_offset = offset == registers::ForceWake::kOffset
+                                         ? registers::ForceWake::kStatusOffset
+                                         : registers::ForceWake::kRenderStatusOffset;
+            uint32_t status = ReadRegister(status_offset);
+            WriteRegister(status_offset, (status & ~mask) | (val & mask & 0xFFFF));
+            break;
+        }
+
+        case kRenderEngineMmioBase + registers::ExeclistSubmitPort::kSubmitOffset:
+            elsp_dwords_[elsp_count_++] = val;
+            if (elsp_count_ == 4) {
+                // Element 1 is written first.
+                SubmitLocked((static_cast<uint64_t>(elsp_dwords_[2]) << 32) | elsp_dwords_[3],
+                             (static_cast<uint64_t>(elsp_dwords_[0]) << 32) | elsp_dwords_[1]);
+                elsp_count_ = 0;
+            }
+            break;
+
+        case kRenderEngineMmioBase + registers::ResetControl::kOffset:
+            if (mask & (1 << registers::ResetControl::kRequestResetBit)) {
+                WriteRegister(offset, (val & (1 << registers::ResetControl::kRequestResetBit))
+                                          ? (1 << registers::ResetControl::kRequestResetBit) |
+                                                (1 << registers::ResetControl::kReadyForResetBit)
+                                          : 0);
+            }
+            break;
+
+        case registers::GraphicsDeviceResetControl::kOffset:
+            if (val & (1 << registers::GraphicsDeviceResetControl::kRenderResetBit)) {
+                ResetEngineLocked();
+                WriteRegister(offset, 0);
+            }
+            break;
+
+        case registers::GtInterruptIdentity0::kOffset:
+            // Write one to clear.
+            interrupt_identity_ &= ~val;
+            WriteRegister(offset, interrupt_identity_);
+            UpdateMasterInterruptLocked();
+            break;
+
+        case registers::MasterInterruptControl::kOffset:
+            UpdateMasterInterruptLocked();
+            break;
+    }
+}
+
+void SimGpu::SubmitLocked(uint64_t descriptor0, uint64_t descriptor1)
+{
+    pending_descriptors_[0] = descriptor0;
+    pending_descriptors_[1] = descriptor1;
+    submit_pending_ = true;
+
+    uint32_t status_offset = kRenderEngineMmioBase + registers::ExeclistStatus::kOffset;
+    WriteRegister(status_offset, ReadRegister(status_offset) |
+                                     (1 << registers::ExeclistStatus::kExeclistQueueFullShift));
+    engine_cv_.notify_all();
+}
+
+void SimGpu::ResetEngineLocked()
+{
+    reset_generation_++;
+    submit_pending_ = false;
+    elsp_count_ = 0;
+    WriteRegister(kRenderEngineMmioBase + registers::ExeclistStatus::kOffset, 0);
+    WriteRegister(kRenderEngineMmioBase + registers::ExeclistStatus::kOffset + 4, 0);
+    WriteRegister(kRenderEngineMmioBase + registers::ResetControl::kOffset, 0);
+}
+
+void SimGpu::RaiseInterruptLocked(uint32_t bit)
+{
+    interrupt_identity_ |= bit;
+    WriteRegister(registers::GtInterruptIdentity0::kOffset, interrupt_identity_);
+
+    if ((ReadRegister(kRenderEngineMmioBase + registers::HardwareStatusMask::kRenderOffset) &
+         bit) ||
+        (ReadRegister(registers::GtInterruptMask0::kOffset) & bit) ||
+        !(ReadRegister(registers::GtInterruptEnable0::kOffset) & bit))
+        return;
+
+    UpdateMasterInterruptLocked();
+}
+
+void SimGpu::UpdateMasterInterruptLocked()
+{
+    constexpr uint32_t kPendingBit =
+        registers::MasterInterruptControl::kRenderInterruptsPendingBitMask;
+
+    uint32_t val = ReadRegister(registers::MasterInterruptControl::kOffset) & ~kPendingBit;
+    if (interrupt_identity_)
+        val |= kPendingBit;
+    WriteRegister(registers::MasterInterruptControl::kOffset, val);
+
+    if (interrupt_identity_ && (val & registers::MasterInterruptControl::kEnableBitMask))
+        interrupt_line_.Signal();
+}
+
+void SimGpu::EngineLoop()
+{
+    while (true) {
+        uint64_t descriptors[2];
+        bool reset;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            engine_cv_.wait(lock, [this] { return stop_ || submit_pending_; });
+            if (stop_)
+                return;
+
+            descriptors[0] = pending_descriptors_[0];
+            descriptors[1] = pending_descriptors_[1];
+            submit_pending_ = false;
+            reset = engine_generation_ != reset_generation_;
+            engine_generation_ = reset_generation_;
+
+            uint32_t status_offset = kRenderEngineMmioBase + registers::ExeclistStatus::kOffset;
+            WriteRegister(status_offset,
+                          ReadRegister(status_offset) &
+                              ~(1 << registers::ExeclistStatus::kExeclistQueueFullShift));
+            WriteRegister(status_offset + 4, magma::upper_32_bits(descriptors[0]));
+        }
+
+        if (reset)
+            context_loaded_ = false;
+
+        for (uint32_t i = 0; i < 2; i++) {
+            uint64_t descriptor = descriptors[i];
+            if (!(descriptor & kDescriptorValid))
+                break;
+
+            if (i > 0) {
+                // A new submission replaces element 1.
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (stop_ || submit_pending_ || engine_generation_ != reset_generation_)
+                    break;
+                WriteRegister(kRenderEngineMmioBase + registers::ExeclistStatus::kOffset + 4,
+                              magma::upper_32_bits(descriptor));
+            }
+
+            // Resubmitting the loaded context only moves its tail.
+            bool lite_restore = context_loaded_ && context_id_ == (descriptor >> 32);
+            if (!LoadContext(descriptor, lite_restore)) {
+                Fault(descriptor & ~static_cast<uint64_t>(PAGE_SIZE - 1));
+                break;
+            }
+
+            if (!RunRing())
+                break;
+            SaveContext();
+        }
+    }
+}
+
+bool SimGpu::LoadContext(uint64_t descriptor, bool lite_restore)
+{
+    context_loaded_ = false;
+
+    // The register state follows the per process hardware status page.
+    uint64_t context_addr = descriptor & 0xFFFFF000;
+    uint32_t* state = Translate(context_addr + PAGE_SIZE, false);
+    if (!state)
+        return DRETF(false, "context 0x%lx not mapped", context_addr);
+
+    ring_tail_ = state[kStateRingTail];
+    if (!lite_restore) {
+        register_state_ = state;
+        ring_start_ = state[kStateRingStart];
+        ring_size_ = (state[kStateRingControl] & 0x1FF000) + PAGE_SIZE;
+        ring_head_ = state[kStateRingHead];
+        for (uint32_t i = 0; i < 4; i++) {
+            pdp_[i] = (static_cast<uint64_t>(state[kStatePdp0Upper - 4 * i]) << 32) |
+                      state[kStatePdp0Lower - 4 * i];
+        }
+    }
+
+    if (ring_head_ >= ring_size_ || ring_tail_ >= ring_size_)
+        return DRETF(false, "bad ring head 0x%x tail 0x%x", ring_head_, ring_tail_);
+
+    context_id_ = descriptor >> 32;
+    context_loaded_ = true;
+    return true;
+}
+
+void SimGpu::SaveContext() { register_state_[kStateRingHead] = ring_head_; }
+
+bool SimGpu::RunRing()
+{
+    std::vector<uint32_t> command;
+    while (ring_head_ != ring_tail_) {
+        if (Halted())
+            return false;
+
+        uint32_t* header = Translate(ring_start_ + ring_head_, false);
+        if (!header) {
+            Fault(ring_start_ + ring_head_);
+            return false;
+        }
+
+        // Commands may wrap around the end of the ring.
+        command.resize(CommandLength(*header));
+        for (uint32_t i = 0; i < command.size(); i++) {
+            uint32_t* dword = Translate(ring_start_ + ring_head_, false);
+            if (!dword) {
+                Fault(ring_start_ + ring_head_);
+                return false;
+            }
+            command[i] = *dword;
+            ring_head_ = (ring_head_ + sizeof(uint32_t)) % ring_size_;
+        }
+
+        WriteRegister(kRenderEngineMmioBase + registers::ActiveHeadPointer::kOffset,
+                      magma::lower_32_bits(ring_start_ + ring_head_));
+        WriteRegister(kRenderEngineMmioBase + registers::ActiveHeadPointer::kUpperOffset,
+                      magma::upper_32_bits(ring_start_ + ring_head_));
+        WriteRegister(kRenderEngineMmioBase + registers::RingbufferHead::kOffset, ring_head_);
+        WriteRegister(kRenderEngineMmioBase + registers::RingbufferStart::kOffset,
+                      magma::lower_32_bits(ring_start_));
+
+        if ((command[0] & kMiCommandMask) == MiBatchBufferStart::kCommandType) {
+            uint64_t batch_addr = (static_cast<uint64_t>(command[2]) << 32) | command[1];
+            if (!RunBatch(batch_addr, command[0] & MiBatchBufferStart::kAddressSpacePpgtt))
+                return false;
+        } else if (!ExecuteCommand(command, false)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SimGpu::RunBatch(uint64_t gpu_addr, bool ppgtt)
+{
+    std::vector<uint32_t> command;
+    for (uint32_t count = 0;; count++) {
+        if (count == kMaxBatchCommands || !ReadCommand(gpu_addr, ppgtt, &command)) {
+            Fault(gpu_addr);
+            return false;
+        }
+        gpu_addr += command.size() * sizeof(uint32_t);
+
+        uint32_t opcode = command[0] & kMiCommandMask;
+        if (opcode == MiBatchBufferEnd::kCommandType)
+            break;
+
+        if (opcode == MiBatchBufferStart::kCommandType) {
+            // Chained batch.
+            gpu_addr = (static_cast<uint64_t>(command[2]) << 32) | command[1];
+            ppgtt = command[0] & MiBatchBufferStart::kAddressSpacePpgtt;
+            continue;
+        }
+
+        if (!ExecuteCommand(command, ppgtt))
+            return false;
+    }
+
+    std::chrono::microseconds delay;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        delay = batch_delay_;
+    }
+    if (delay.count())
+        std::this_thread::sleep_for(delay);
+
+    batch_count_++;
+    return !Halted();
+}
+
+bool SimGpu::ExecuteCommand(const std::vector<uint32_t>& command, bool ppgtt)
+{
+    uint32_t header = command[0];
+
+    if ((header & kMiCommandMask) == MiUserInterrupt::kCommandType) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        RaiseInterruptLocked(registers::InterruptRegisterBase::kUserInterruptBit);
+        return true;
+    }
+
+    if ((header & kMiCommandMask) == MiLoadDataImmediate::kCommandType) {
+        for (uint32_t i = 1; i + 1 < command.size(); i += 2) {
+            if (command[i] < bar_size_ / 2)
+                WriteRegister(command[i], command[i + 1]);
+        }
+        return true;
+    }
+
+    if ((header & kMiCommandMask) == MiSemaphoreWait::kCommandType) {
+        uint64_t addr = (static_cast<uint64_t>(command[3]) << 32) | command[2];
+        uint32_t* dword = Translate(addr, !(header & MiSemaphoreWait::kMemoryTypeGlobalGttBit));
+        if (!dword) {
+            Fault(addr);
+            return false;
+        }
+        semaphore_wait_count_++;
+        while (*reinterpret_cast<volatile uint32_t*>(dword) < command[1]) {
+            if (Halted())
+                return false;
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        return true;
+    }
+
+    if ((header & 0xFFFF0000) == kPipeControlHeader) {
+        constexpr uint32_t kPostSyncOperationMask = 0x3 << 14;
+        if ((command[1] & kPostSyncOperationMask) != MiPipeControl::kPostSyncWriteImmediateBit)
+            return true;
+        uint64_t addr = (static_cast<uint64_t>(command[3]) << 32) | (command[2] & ~0x3u);
+        uint32_t* dword =
+            Translate(addr, !(command[1] & MiPipeControl::kAddressSpaceGlobalGttBit));
+        if (!dword) {
+            Fault(addr);
+            return false;
+        }
+        *reinterpret_cast<volatile uint32_t*>(dword) = command[4];
+        return true;
+    }
+
+    return true;
+}
+
+bool SimGpu::Halted()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stop_ || engine_generation_ != reset_generation_;
+}
+
+void SimGpu::Fault(uint64_t gpu_addr)
+{
+    magma::log(magma::LOG_WARNING, "SimGpu: fault at gpu address 0x%lx", gpu_addr);
+    context_loaded_ = false;
+    fault_count_++;
+    WriteRegister(registers::AllEngineFault::kOffset, registers::AllEngineFault::kValid);
+}
+
+uint32_t* SimGpu::TranslateBus(uint64_t bus_addr)
+{
+    auto page = reinterpret_cast<uint8_t*>(bus_mapper_(bus_addr & ~(PAGE_SIZE - 1)));
+    if (!page)
+        return nullptr;
+    return reinterpret_cast<uint32_t*>(page + (bus_addr & (PAGE_SIZE - 1)));
+}
+
+uint32_t* SimGpu::Translate(uint64_t gpu_addr, bool ppgtt)
+{
+    constexpr uint64_t kAddressMask = ~static_cast<uint64_t>(PAGE_SIZE - 1);
+    uint64_t page_offset = gpu_addr & (PAGE_SIZE - 1);
+
+    if (!ppgtt) {
+        uint64_t pte_offset = bar_size_ / 2 + (gpu_addr >> PAGE_SHIFT) * sizeof(uint64_t);
+        if (pte_offset >= bar_size_)
+            return nullptr;
+        uint64_t pte = *reinterpret_cast<volatile uint64_t*>(
+            reinterpret_cast<uint8_t*>(bar_) + pte_offset);
+        if (!(pte & PAGE_PRESENT))
+            return nullptr;
+        return TranslateBus((pte & kAddressMask) | page_offset);
+    }
+
+    // Legacy 32 bit ppgtt: four page directories of 512 page tables of 512 pages.
+    if (gpu_addr >> 32)
+        return nullptr;
+    uint32_t* pde = TranslateBus((pdp_[gpu_addr >> 30] & kAddressMask) +
+                                 ((gpu_addr >> 21) & 0x1FF) * sizeof(uint64_t));
+    if (!pde || !(*pde & PAGE_PRESENT))
+        return nullptr;
+    uint64_t pde_val = *reinterpret_cast<uint64_t*>(pde);
+    uint32_t* pte = TranslateBus((pde_val & kAddressMask) +
+                                 ((gpu_addr >> PAGE_SHIFT) & 0x1FF) * sizeof(uint64_t));
+    if (!pte || !(*pte & PAGE_PRESENT))
+        return nullptr;
+    uint64_t pte_val = *reinterpret_cast<uint64_t*>(pte);
+    return TranslateBus((pte_val & kAddressMask) | page_offset);
+}
+
+bool SimGpu::ReadCommand(uint64_t gpu_addr, bool ppgtt, std::vector<uint32_t>* command_out)
+{
+    uint32_t* header = Translate(gpu_addr, ppgtt);
+    if (!header)
+        return false;
+
+    command_out->resize(CommandLength(*header));
+    for (uint32_t i = 0; i < command_out->size(); i++) {
+        uint32_t* dword = Translate(gpu_addr + i * sizeof(uint32_t), ppgtt);
+        if (!dword)
+            return false;
+        (*command_out)[i] = *dword;
+    }
+    return true;
+}
+
+uint32_t SimGpu::CommandLength(uint32_t header)
+{
+    constexpr uint32_t kMiType = 0;
+    constexpr uint32_t kGfxPipeType = 3;
+    constexpr uint32_t kLengthMask = 0xFF;
+
+    switch (header >> 29) {
+        case kMiType:
+            // MI commands with opcodes below 0x10 are a single dword.
+            if (((header >> 23) & 0x3F) < 0x10)
+                return 1;
+            break;
+        case kGfxPipeType:
+            switch (header >> 16) {
+                case 0x6904: // PIPELINE_SELECT
+                case 0x780B: // 3DSTATE_VF_STATISTICS
+                    return 1;
+            }
+            break;
+    }
+    return (header & kLengthMask) + 2;
+}
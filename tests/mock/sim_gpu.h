@@ -0,0 +1,153 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIM_GPU_H
+#define SIM_GPU_H
+
+#include "platform_pci_device.h"
+#include "register_io.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A software model of the render engine, enough to run the driver without hardware.
+// Bar 0 holds the registers in its first half and the global gtt in its second half, as on
+// hardware. Since mmio is plain memory, the simulator sees register writes through a
+// RegisterIo hook; it acknowledges forcewake and reset handshakes, accepts execlist submissions
+// and raises user interrupts.
+// The engine thread executes a submitted context's ring: MI_BATCH_BUFFER_START (global gtt or
+// 32 bit ppgtt), PIPE_CONTROL immediate writes, MI_SEMAPHORE_WAIT, MI_LOAD_REGISTER_IMM and
+// MI_USER_INTERRUPT; other commands are skipped. Element 1 of an execlist runs once element 0
+// is idle. A new submission is loaded once the running context is idle; there's no preemption.
+class SimGpu {
+public:
+    // Resolves the bus address of a page, as found in gtt entries and page directories, to the
+    // cpu address of that page. Returns null if the page isn't known.
+    using BusMapper = std::function<void*(uint64_t bus_addr)>;
+
+    // The default gtt size, encoded in the gmch graphics control register.
+    static constexpr uint64_t kGttSize = 8 * 1024 * 1024;
+
+    // Dword indices in the context register state page, as EngineCommandStreamer lays it out.
+    static constexpr uint32_t kStateRingHead = 0x5;
+    static constexpr uint32_t kStateRingTail = 0x7;
+    static constexpr uint32_t kStateRingStart = 0x9;
+    static constexpr uint32_t kStateRingControl = 0xB;
+    // PDP n is at kStatePdp0Upper - 4 * n (upper dword) and kStatePdp0Lower - 4 * n.
+    static constexpr uint32_t kStatePdp0Upper = 0x31;
+    static constexpr uint32_t kStatePdp0Lower = 0x33;
+
+    // If |bus_mapper| is null, bus addresses are taken to be cpu addresses. To run the driver,
+    // pass SimBusMapper::bus_mapper().
+    static std::unique_ptr<SimGpu> Create(uint32_t device_id, BusMapper bus_mapper = nullptr);
+
+    ~SimGpu();
+
+    // Returns a pci device backed by this simulator, which must outlive it.
+    std::unique_ptr<magma::PlatformPciDevice> CreatePciDevice();
+
+    // Returns the hook through which the simulator sees register writes. It must be installed
+    // on the RegisterIo of the driver before its first register access.
+    std::unique_ptr<RegisterIo::Hook> CreateRegisterHook();
+
+    // Time spent executing each batch buffer.
+    void set_batch_delay(std::chrono::microseconds delay)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        batch_delay_ = delay;
+    }
+
+    uint64_t batch_count() { return batch_count_; }
+    uint64_t fault_count() { return fault_count_; }
+    uint64_t semaphore_wait_count() { return semaphore_wait_count_; }
+
+private:
+    class PciDevice;
+    class Mmio;
+    class Interrupt;
+    class Hook;
+
+    // Signalled by the simulator, waited on by the driver's interrupt thread.
+    class InterruptLine {
+    public:
+        void Signal();
+        void Wait();
+
+    private:
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        uint32_t count_ = 0;
+    };
+
+    SimGpu(uint32_t device_id, BusMapper bus_mapper, void* bar, uint64_t bar_size);
+
+    uint32_t ReadRegister(uint32_t offset);
+    void WriteRegister(uint32_t offset, uint32_t val);
+
+    // Called through the register hook.
+    void RegisterWritten(uint32_t offset, uint32_t val);
+
+    // The following require |mutex_|.
+    void SubmitLocked(uint64_t descriptor0, uint64_t descriptor1);
+    void ResetEngineLocked();
+    void RaiseInterruptLocked(uint32_t bit);
+    void UpdateMasterInterruptLocked();
+
+    void EngineLoop();
+
+    // Engine thread only.
+    bool LoadContext(uint64_t descriptor, bool lite_restore);
+    void SaveContext();
+    // Returns false if execution should stop, after a fault, reset or shutdown.
+    bool RunRing();
+    bool RunBatch(uint64_t gpu_addr, bool ppgtt);
+    bool ExecuteCommand(const std::vector<uint32_t>& command, bool ppgtt);
+    bool Halted();
+    void Fault(uint64_t gpu_addr);
+
+    uint32_t* Translate(uint64_t gpu_addr, bool ppgtt);
+    uint32_t* TranslateBus(uint64_t bus_addr);
+    bool ReadCommand(uint64_t gpu_addr, bool ppgtt, std::vector<uint32_t>* command_out);
+
+    static uint32_t CommandLength(uint32_t header);
+
+    uint32_t device_id_;
+    BusMapper bus_mapper_;
+    void* bar_;
+    uint64_t bar_size_;
+    InterruptLine interrupt_line_;
+
+    std::mutex mutex_;
+    std::condition_variable engine_cv_;
+    bool stop_ = false;
+    uint32_t elsp_dwords_[4]{};
+    uint32_t elsp_count_ = 0;
+    bool submit_pending_ = false;
+    uint64_t pending_descriptors_[2]{};
+    uint32_t reset_generation_ = 0;
+    uint32_t interrupt_identity_ = 0;
+    std::chrono::microseconds batch_delay_{0};
+
+    // Engine thread state.
+    uint32_t engine_generation_ = 0;
+    bool context_loaded_ = false;
+    uint64_t context_id_ = 0;
+    uint32_t* register_state_ = nullptr;
+    uint64_t ring_start_ = 0;
+    uint32_t ring_size_ = 0;
+    uint32_t ring_head_ = 0;
+    uint32_t ring_tail_ = 0;
+    uint64_t pdp_[4]{};
+
+    std::atomic<uint64_t> batch_count_{0};
+    std::atomic<uint64_t> fault_count_{0};
+    std::atomic<uint64_t> semaphore_wait_count_{0};
+    std::thread engine_thread_;
+};
+
+#endif // SIM_GPU_H
@@ -0,0 +1,124 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "batch_latency.h"
+#include "gtest/gtest.h"
+
+class TestBatchLatency {
+public:
+    void Bucket()
+    {
+        EXPECT_EQ(0u, LatencyHistogram::bucket(0));
+        EXPECT_EQ(0u, LatencyHistogram::bucket(999));
+        EXPECT_EQ(1u, LatencyHistogram::bucket(1000));
+        EXPECT_EQ(1u, LatencyHistogram::bucket(1999));
+        EXPECT_EQ(2u, LatencyHistogram::bucket(2000));
+        EXPECT_EQ(2u, LatencyHistogram::bucket(3999));
+        EXPECT_EQ(11u, LatencyHistogram::bucket(1024 * 1000));
+        EXPECT_EQ(LatencyHistogram::kBucketCount - 1, LatencyHistogram::bucket(UINT64_MAX));
+
+        LatencyHistogram histogram;
+        histogram.Record(500);
+        histogram.Record(1500);
+        histogram.Record(1700);
+        EXPECT_EQ(1u, histogram.count(0));
+        EXPECT_EQ(2u, histogram.count(1));
+        EXPECT_EQ(0u, histogram.count(2));
+    }
+
+    void Record()
+    {
+        constexpr uint64_t kPeriodPs = 80000;
+        BatchLatencyStats stats(1);
+
+        BatchTimes times;
+        times.enqueue_ns = 1000000;
+        times.pickup_ns = times.enqueue_ns + 1500;
+        times.submit_ns = times.pickup_ns + 3000;
+        times.submit_ticks = 100;
+        // 8us of waiting, then 160us of execution.
+        times.gpu_start_ticks = times.submit_ticks + 100;
+        times.gpu_end_ticks = times.gpu_start_ticks + 2000;
+        // Completion processed 20us after the gpu finished.
+        times.complete_ns = times.submit_ns + 168000 + 20000;
+        stats.Record(times, kPeriodPs);
+
+        EXPECT_EQ(1u, stats.count(kMsdIntelGenBatchLatencyQueue, LatencyHistogram::bucket(1500)));
+        EXPECT_EQ(1u,
+                  stats.count(kMsdIntelGenBatchLatencySchedule, LatencyHistogram::bucket(3000)));
+        EXPECT_EQ(1u,
+                  stats.count(kMsdIntelGenBatchLatencyGpuWait, LatencyHistogram::bucket(8000)));
+        EXPECT_EQ(1u, stats.count(kMsdIntelGenBatchLatencyGpuExecution,
+                                  LatencyHistogram::bucket(160000)));
+        EXPECT_EQ(1u,
+                  stats.count(kMsdIntelGenBatchLatencyRetire, LatencyHistogram::bucket(20000)));
+        EXPECT_EQ(1u, stats.count(kMsdIntelGenBatchLatencyTotal,
+                                  LatencyHistogram::bucket(times.complete_ns - times.enqueue_ns)));
+
+        // Untimed by the gpu; only the cpu stages are recorded.
+        times.submit_ticks = 0;
+        stats.Record(times, kPeriodPs);
+        EXPECT_EQ(2u, stats.count(kMsdIntelGenBatchLatencyQueue, LatencyHistogram::bucket(1500)));
+        EXPECT_EQ(1u,
+                  stats.count(kMsdIntelGenBatchLatencyGpuWait, LatencyHistogram::bucket(8000)));
+
+        // The end timestamp didn't land.
+        times.submit_ticks = 100;
+        times.gpu_end_ticks = 0;
+        stats.Record(times, kPeriodPs);
+        EXPECT_EQ(1u, stats.count(kMsdIntelGenBatchLatencyGpuExecution,
+                                  LatencyHistogram::bucket(160000)));
+        EXPECT_EQ(1u,
+                  stats.count(kMsdIntelGenBatchLatencyGpuWait, LatencyHistogram::bucket(8000)));
+
+        EXPECT_EQ(3u, stats.batch_count());
+        EXPECT_EQ(2u, stats.untimed_batch_count());
+        EXPECT_EQ(160000u, stats.gpu_runtime_ns());
+    }
+
+    void Runtime()
+    {
+        constexpr uint64_t kPeriodPs = 83333;
+        BatchLatencyStats stats(1);
+
+        // Two batches run back to back; the second starts when the first ends.
+        BatchTimes first;
+        first.submit_ticks = 1000;
+        first.gpu_start_ticks = 1010;
+        first.gpu_end_ticks = 13010;
+        BatchTimes second = first;
+        second.gpu_start_ticks = first.gpu_end_ticks;
+        second.gpu_end_ticks = second.gpu_start_ticks + 24000;
+
+        // 12000 ticks at 12MHz.
+        EXPECT_EQ(999996u, first.gpu_runtime_ns(kPeriodPs));
+        stats.Record(first, kPeriodPs);
+        stats.Record(second, kPeriodPs);
+        EXPECT_EQ(first.gpu_runtime_ns(kPeriodPs) + second.gpu_runtime_ns(kPeriodPs),
+                  stats.gpu_runtime_ns());
+        EXPECT_EQ(BatchTimes::ticks_to_ns(36000, kPeriodPs), stats.gpu_runtime_ns());
+
+        BatchTimes untimed;
+        EXPECT_FALSE(untimed.gpu_timed());
+        EXPECT_EQ(0u, untimed.gpu_runtime_ns(kPeriodPs));
+    }
+};
+
+TEST(BatchLatency, Bucket)
+{
+    TestBatchLatency test;
+    test.Bucket();
+}
+
+TEST(BatchLatency, Record)
+{
+    TestBatchLatency test;
+    test.Record();
+}
+
+TEST(BatchLatency, Runtime)
+{
+    TestBatchLatency test;
+    test.Runtime();
+}
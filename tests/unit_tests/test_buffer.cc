@@ -53,6 +53,51 @@ public:
         EXPECT_TRUE(address_space->is_clear(gpu_addr));
     }
 
+    static void SetCachingType()
+    {
+        std::shared_ptr<MockAddressSpace> address_space(
+            new MockAddressSpace(PAGE_SIZE, PAGE_SIZE * 10));
+
+        std::shared_ptr<MsdIntelBuffer> buffer(MsdIntelBuffer::Create(PAGE_SIZE, "test"));
+        ASSERT_NE(buffer, nullptr);
+        EXPECT_EQ(CACHING_LLC, buffer->caching_type());
+        EXPECT_EQ(LRU_AGE_FROM_UNCORE, buffer->lru_age());
+
+        EXPECT_TRUE(buffer->SetCachingType(CACHING_WRITE_COMBINING, LRU_AGE_FROM_UNCORE));
+        EXPECT_EQ(CACHING_WRITE_COMBINING, buffer->caching_type());
+
+        EXPECT_TRUE(buffer->SetCachingType(CACHING_LLC, LRU_AGE_ZERO));
+        EXPECT_EQ(CACHING_LLC, buffer->caching_type());
+        EXPECT_EQ(LRU_AGE_ZERO, buffer->lru_age());
+
+        // A mapping that fails to insert leaves the caching type unchanged and changeable.
+        class FailingAddressSpace : public MockAddressSpace {
+        public:
+            FailingAddressSpace() : MockAddressSpace(PAGE_SIZE, PAGE_SIZE * 10) {}
+
+            bool Insert(uint64_t addr, magma::PlatformBuffer* buffer, uint64_t offset,
+                        uint64_t length, CachingType caching_type, LruAge lru_age) override
+            {
+                return false;
+            }
+        };
+        EXPECT_EQ(nullptr,
+                  AddressSpace::MapBufferGpu(std::make_shared<FailingAddressSpace>(), buffer, 0));
+        EXPECT_TRUE(buffer->SetCachingType(CACHING_LLC, LRU_AGE_ZERO));
+
+        auto mapping = AddressSpace::MapBufferGpu(address_space, buffer, 0);
+        ASSERT_NE(mapping, nullptr);
+
+        // Can't change the policy of existing page table entries.
+        EXPECT_FALSE(buffer->SetCachingType(CACHING_NONE, LRU_AGE_FROM_UNCORE));
+        EXPECT_EQ(CACHING_LLC, buffer->caching_type());
+        EXPECT_EQ(LRU_AGE_ZERO, buffer->lru_age());
+
+        buffer = MsdIntelBuffer::Create(PAGE_SIZE, "test", CACHING_NONE, LRU_AGE_FROM_UNCORE);
+        ASSERT_NE(buffer, nullptr);
+        EXPECT_EQ(CACHING_NONE, buffer->caching_type());
+    }
+
     static void CachedMapping()
     {
 
@@ -258,7 +303,10 @@ public:
 
         std::thread wait_thread(
             [](MsdIntelBuffer* buffer, uint32_t* val) {
-                buffer->WaitRendering();
+                BufferWaiter waiter;
+                EXPECT_TRUE(MsdIntelBuffer::WaitRendering({buffer}, MsdIntelBuffer::WAIT_ALL,
+                                                          UINT64_MAX, &waiter)
+                                .ok());
                 EXPECT_EQ(2u, *val);
             },
             buffer.get(), &val);
@@ -275,6 +323,54 @@ public:
 
         wait_thread.join();
     }
+
+    static void WaitRenderingMultiple(MsdIntelBuffer::WaitMode mode)
+    {
+        std::vector<std::unique_ptr<MsdIntelBuffer>> buffers;
+        std::vector<MsdIntelBuffer*> buffer_ptrs;
+        for (uint32_t i = 0; i < 3; i++) {
+            buffers.push_back(MsdIntelBuffer::Create(PAGE_SIZE, "test"));
+            buffers.back()->IncrementInflightCounter();
+            buffer_ptrs.push_back(buffers.back().get());
+        }
+
+        BufferWaiter waiter;
+        EXPECT_EQ(MAGMA_STATUS_TIMED_OUT,
+                  MsdIntelBuffer::WaitRendering(buffer_ptrs, mode, 10, &waiter).get());
+        for (auto& buffer : buffers)
+            EXPECT_EQ(0u, buffer->waiter_count_);
+
+        std::atomic_uint32_t idle_count{};
+        std::thread wait_thread([&buffer_ptrs, &waiter, &idle_count, mode]() {
+            EXPECT_TRUE(MsdIntelBuffer::WaitRendering(buffer_ptrs, mode, UINT64_MAX, &waiter).ok());
+            if (mode == MsdIntelBuffer::WAIT_ANY) {
+                EXPECT_GE(idle_count.load(), 1u);
+            } else {
+                EXPECT_EQ(3u, idle_count.load());
+            }
+        });
+
+        for (auto& buffer : buffers) {
+            magma::msleep(100);
+            ++idle_count;
+            buffer->DecrementInflightCounter();
+        }
+
+        wait_thread.join();
+
+        for (auto& buffer : buffers)
+            EXPECT_EQ(0u, buffer->waiter_count_);
+
+        // Already idle buffers complete immediately.
+        buffers[0]->IncrementInflightCounter();
+        EXPECT_TRUE(MsdIntelBuffer::WaitRendering(buffer_ptrs, MsdIntelBuffer::WAIT_ANY, 0,
+                                                  &waiter)
+                        .ok());
+        EXPECT_EQ(MAGMA_STATUS_TIMED_OUT,
+                  MsdIntelBuffer::WaitRendering(buffer_ptrs, MsdIntelBuffer::WAIT_ALL, 0, &waiter)
+                      .get());
+        buffers[0]->DecrementInflightCounter();
+    }
 };
 
 TEST(MsdIntelBuffer, CreateAndDestroy) { TestMsdIntelBuffer::CreateAndDestroy(); }
@@ -309,6 +405,14 @@ TEST(MsdIntelBuffer, OverlappedMapping)
     TestMsdIntelBuffer::OverlappedMapping(8192);
 }
 
+TEST(MsdIntelBuffer, SetCachingType) { TestMsdIntelBuffer::SetCachingType(); }
+
 TEST(MsdIntelBuffer, CachedMapping) { TestMsdIntelBuffer::CachedMapping(); }
 
 TEST(MsdIntelBuffer, WaitRendering) { TestMsdIntelBuffer::WaitRendering(); }
+
+TEST(MsdIntelBuffer, WaitRenderingMultiple)
+{
+    TestMsdIntelBuffer::WaitRenderingMultiple(MsdIntelBuffer::WAIT_ANY);
+    TestMsdIntelBuffer::WaitRenderingMultiple(MsdIntelBuffer::WAIT_ALL);
+}
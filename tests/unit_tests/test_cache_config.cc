@@ -61,19 +61,36 @@ public:
             (MemoryObjectControlState::LLC_ELLC << MemoryObjectControlState::kCacheShift) |
             (MemoryObjectControlState::WRITEBACK << MemoryObjectControlState::kCacheabilityShift);
 
+        constexpr uint32_t kMocsWriteThrough =
+            (MemoryObjectControlState::LRU_3 << MemoryObjectControlState::kLruManagementShift) |
+            (MemoryObjectControlState::LLC_ELLC << MemoryObjectControlState::kCacheShift) |
+            (MemoryObjectControlState::WRITETHROUGH
+             << MemoryObjectControlState::kCacheabilityShift);
+
+        constexpr uint32_t kMocsCachedStreaming =
+            (MemoryObjectControlState::LRU_0 << MemoryObjectControlState::kLruManagementShift) |
+            (MemoryObjectControlState::LLC_ELLC << MemoryObjectControlState::kCacheShift) |
+            (MemoryObjectControlState::WRITEBACK << MemoryObjectControlState::kCacheabilityShift);
+
         for (uint32_t i = 0; i < CacheConfig::kMemoryObjectControlStateEntries; i++) {
             const uint32_t kOffset =
                 MemoryObjectControlState::kGraphicsOffset + i * sizeof(uint32_t);
             DLOG("0x%x: 0x%08x", ptr[0], ptr[1]);
             EXPECT_EQ(*ptr++, kOffset);
             switch (i) {
-                case 1:
+                case CacheConfig::kMocsPagetableIndex:
                     EXPECT_EQ(*ptr++, kMocsPageTable);
                     break;
-                case 2:
+                case CacheConfig::kMocsCachedIndex:
                     EXPECT_EQ(*ptr++, kMocsCached);
                     break;
-                case 0:
+                case CacheConfig::kMocsWriteThroughIndex:
+                    EXPECT_EQ(*ptr++, kMocsWriteThrough);
+                    break;
+                case CacheConfig::kMocsCachedStreamingIndex:
+                    EXPECT_EQ(*ptr++, kMocsCachedStreaming);
+                    break;
+                case CacheConfig::kMocsUncachedIndex:
                 default:
                     EXPECT_EQ(*ptr++, kMocsUncached);
             }
@@ -95,7 +112,13 @@ public:
                                         (LncfMemoryObjectControlState::UNCACHED
                                          << LncfMemoryObjectControlState::kCacheabilityShift);
 
-        constexpr uint32_t kIndexOne = (LncfMemoryObjectControlState::UNCACHED
+        constexpr uint32_t kIndexOne = (LncfMemoryObjectControlState::WRITETHROUGH
+                                        << LncfMemoryObjectControlState::kCacheabilityShift)
+                                           << 16 |
+                                       (LncfMemoryObjectControlState::WRITEBACK
+                                        << LncfMemoryObjectControlState::kCacheabilityShift);
+
+        constexpr uint32_t kIndexTwo = (LncfMemoryObjectControlState::UNCACHED
                                         << LncfMemoryObjectControlState::kCacheabilityShift)
                                            << 16 |
                                        (LncfMemoryObjectControlState::WRITEBACK
@@ -118,6 +141,9 @@ public:
                 case 1:
                     EXPECT_EQ(*ptr++, kIndexOne);
                     break;
+                case 2:
+                    EXPECT_EQ(*ptr++, kIndexTwo);
+                    break;
                 default:
                     EXPECT_EQ(*ptr++, kIndexOther);
             }
@@ -7,7 +7,9 @@
 #include "gpu_mapping_cache.h"
 #include "helper/command_buffer_helper.h"
 #include "helper/platform_device_helper.h"
+#include "instructions.h"
 #include "mock/mock_address_space.h"
+#include "mock/mock_mapped_batch.h"
 #include "msd_intel_context.h"
 #include "msd_intel_device.h"
 #include "gtest/gtest.h"
@@ -89,6 +91,24 @@ public:
         }
     }
 
+    void TestPipeControlFlags()
+    {
+        constexpr uint32_t kReleaseFlags =
+            MiPipeControl::kCommandStreamerStallEnableBit |
+            MiPipeControl::kGenericMediaStateClearBit |
+            MiPipeControl::kIndirectStatePointersDisableBit | MiPipeControl::kDcFlushEnableBit;
+
+        EXPECT_EQ(kReleaseFlags, cmd_buf_->GetPipeControlFlags(nullptr));
+
+        MockMappedBatch unrelated_batch;
+        EXPECT_EQ(kReleaseFlags, cmd_buf_->GetPipeControlFlags(&unrelated_batch));
+
+        // Followed by a batch using the same resources, only semaphores need the data cache flush.
+        auto signal_semaphores = cmd_buf_->TakeSignalSemaphores();
+        EXPECT_EQ(MiPipeControl::kCommandStreamerStallEnableBit,
+                  cmd_buf_->GetPipeControlFlags(cmd_buf_.get()));
+    }
+
     void TestPrepareForExecution()
     {
         auto engine =
@@ -201,6 +221,8 @@ TEST(CommandBuffer, MapUnmapResourcesGpu)
 
 TEST(CommandBuffer, PatchRelocations) { ::Test::Create()->TestPatchRelocations(); }
 
+TEST(CommandBuffer, PipeControlFlags) { ::Test::Create()->TestPipeControlFlags(); }
+
 TEST(CommandBuffer, PrepareForExecution) { ::Test::Create()->TestPrepareForExecution(); }
 
 TEST(CommandBuffer, Execute) { ::Test::Create()->TestExecute(); }
\ No newline at end of file
@@ -0,0 +1,124 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "completion_signaler.h"
+#include "gtest/gtest.h"
+
+class TestCompletionSignaler {
+public:
+    static void Signal()
+    {
+        CompletionSignaler signaler;
+
+        std::vector<std::shared_ptr<magma::PlatformSemaphore>> semaphores;
+        for (uint32_t i = 0; i < 4; i++) {
+            semaphores.push_back(magma::PlatformSemaphore::Create());
+        }
+
+        signaler.Add(10, {semaphores[0]});
+        signaler.Add(11, {});
+        signaler.Add(12, {semaphores[1], semaphores[2]});
+        signaler.Add(13, {semaphores[3]});
+        EXPECT_EQ(3u, signaler.pending_.size());
+
+        EXPECT_EQ(0u, signaler.Signal(9, 0));
+
+        // One completion range covers several sequences.
+        uint64_t observed_time_ns = CompletionSignaler::GetCurrentTimeNs();
+        EXPECT_EQ(3u, signaler.Signal(12, observed_time_ns));
+        EXPECT_TRUE(semaphores[0]->Wait(0));
+        EXPECT_TRUE(semaphores[1]->Wait(0));
+        EXPECT_TRUE(semaphores[2]->Wait(0));
+        EXPECT_FALSE(semaphores[3]->Wait(0));
+
+        // Already signalled sequences aren't signalled again.
+        EXPECT_EQ(0u, signaler.Signal(12, 0));
+
+        auto stats = signaler.stats();
+        EXPECT_EQ(3u, stats.signal_count);
+        EXPECT_EQ(1u, stats.batch_count);
+        EXPECT_EQ(1u, stats.latency_count);
+        EXPECT_EQ(stats.total_latency_ns, stats.max_latency_ns);
+
+        EXPECT_EQ(1u, signaler.SignalAll());
+        EXPECT_TRUE(semaphores[3]->Wait(0));
+        EXPECT_EQ(0u, signaler.pending_.size());
+
+        stats = signaler.stats();
+        EXPECT_EQ(4u, stats.signal_count);
+        EXPECT_EQ(2u, stats.batch_count);
+        EXPECT_EQ(1u, stats.latency_count);
+    }
+
+    static void Take()
+    {
+        CompletionSignaler signaler;
+
+        std::vector<std::shared_ptr<magma::PlatformSemaphore>> semaphores;
+        for (uint32_t i = 0; i < 3; i++) {
+            semaphores.push_back(magma::PlatformSemaphore::Create());
+        }
+
+        signaler.Add(10, {semaphores[0]});
+        signaler.Add(11, {semaphores[1], semaphores[2]});
+
+        EXPECT_EQ(0u, signaler.Take(9).size());
+
+        auto taken = signaler.Take(11);
+        ASSERT_EQ(2u, taken.size());
+        EXPECT_EQ(semaphores[1], taken[0]);
+        EXPECT_EQ(semaphores[2], taken[1]);
+        EXPECT_EQ(1u, signaler.pending_.size());
+
+        // Taken semaphores aren't signalled by their old sequence number.
+        EXPECT_EQ(1u, signaler.SignalAll());
+        EXPECT_TRUE(semaphores[0]->Wait(0));
+        EXPECT_FALSE(semaphores[1]->Wait(0));
+
+        // Resubmitted under a new sequence number.
+        signaler.Add(12, std::move(taken));
+        EXPECT_EQ(2u, signaler.Signal(12, 0));
+        EXPECT_TRUE(semaphores[1]->Wait(0));
+        EXPECT_TRUE(semaphores[2]->Wait(0));
+    }
+
+    static void WaitSequenceNumber()
+    {
+        CompletionSignaler signaler;
+
+        std::vector<std::shared_ptr<magma::PlatformSemaphore>> semaphores;
+        for (uint32_t i = 0; i < 3; i++) {
+            semaphores.push_back(magma::PlatformSemaphore::Create());
+        }
+
+        uint32_t sequence_number;
+        EXPECT_FALSE(signaler.GetWaitSequenceNumber({semaphores[0]}, &sequence_number));
+
+        // Sequence numbers wrap between the two sequences.
+        signaler.Add(UINT32_MAX, {semaphores[0], semaphores[1]});
+        signaler.Add(1, {semaphores[1]});
+
+        EXPECT_TRUE(signaler.GetWaitSequenceNumber({semaphores[0]}, &sequence_number));
+        EXPECT_EQ(UINT32_MAX, sequence_number);
+        EXPECT_TRUE(signaler.GetWaitSequenceNumber(semaphores, &sequence_number));
+        EXPECT_EQ(1u, sequence_number);
+        EXPECT_FALSE(signaler.GetWaitSequenceNumber({semaphores[2]}, &sequence_number));
+
+        EXPECT_EQ(0u, signaler.Signal(UINT32_MAX - 1, 0));
+        EXPECT_EQ(2u, signaler.Signal(UINT32_MAX, 0));
+        EXPECT_FALSE(signaler.GetWaitSequenceNumber({semaphores[0]}, &sequence_number));
+        EXPECT_TRUE(signaler.GetWaitSequenceNumber({semaphores[1]}, &sequence_number));
+        EXPECT_EQ(1u, sequence_number);
+
+        EXPECT_EQ(1u, signaler.Signal(1, 0));
+        EXPECT_FALSE(signaler.GetWaitSequenceNumber(semaphores, &sequence_number));
+        EXPECT_EQ(0u, signaler.pending_sequence_numbers_.size());
+    }
+};
+
+TEST(CompletionSignaler, Signal) { TestCompletionSignaler::Signal(); }
+
+TEST(CompletionSignaler, Take) { TestCompletionSignaler::Take(); }
+
+TEST(CompletionSignaler, WaitSequenceNumber) { TestCompletionSignaler::WaitSequenceNumber(); }
@@ -3,15 +3,59 @@
 // found in the LICENSE file.
 
 #include "global_context.h"
+#include "magma_util/sleep.h"
 #include "mock/mock_address_space.h"
 #include "msd_intel_connection.h"
 #include "msd_intel_context.h"
 #include "ringbuffer.h"
 #include "test_command_buffer.h"
 #include "gtest/gtest.h"
+#include <thread>
 
 class TestContext {
 public:
+    class ConnectionOwner : public MsdIntelConnection::Owner {
+    public:
+        ConnectionOwner(std::function<void(std::unique_ptr<CommandBuffer> command_buffer)> callback)
+            : callback_(callback)
+        {
+        }
+
+        magma::Status SubmitCommandBuffer(std::unique_ptr<CommandBuffer> command_buffer) override
+        {
+            DLOG("command buffer received 0x%" PRIx64,
+                 TestCommandBuffer::platform_buffer(command_buffer.get())->id());
+            callback_(std::move(command_buffer));
+            return MAGMA_STATUS_OK;
+        }
+
+        void DestroyContext(std::shared_ptr<ClientContext> client_context) override {}
+        void ReleaseBuffer(std::shared_ptr<AddressSpace> address_space,
+                           std::shared_ptr<MsdIntelBuffer> buffer) override
+        {
+        }
+        void PresentBuffer(std::shared_ptr<MsdIntelBuffer> buffer,
+                           magma_system_image_descriptor* image_desc,
+                           std::vector<std::shared_ptr<magma::PlatformSemaphore>> wait_semaphores,
+                           std::vector<std::shared_ptr<magma::PlatformSemaphore>> signal_semaphores,
+                           present_buffer_callback_t callback) override
+        {
+        }
+
+        WaitReactor* wait_reactor() override { return wait_reactor_.get(); }
+
+        BusMapper* bus_mapper() override { return BusMapper::Platform(); }
+        CompletionSignaler* completion_signaler() override { return &completion_signaler_; }
+
+        void BeginFrequencyBoost() override {}
+        void EndFrequencyBoost() override {}
+
+        std::function<void(std::unique_ptr<CommandBuffer>)> callback_;
+        std::unique_ptr<WaitReactor> wait_reactor_ = WaitReactor::Create();
+        CompletionSignaler completion_signaler_;
+        std::unique_ptr<magma::PlatformSemaphore> semaphore_;
+    };
+
     void Init()
     {
         std::weak_ptr<MsdIntelConnection> connection;
@@ -84,41 +128,6 @@ public:
         DLOG("SubmitCommandBuffer command_buffer_count %u semaphore_count %u", command_buffer_count,
              semaphore_count);
 
-        class ConnectionOwner : public MsdIntelConnection::Owner {
-        public:
-            ConnectionOwner(
-                std::function<void(std::unique_ptr<CommandBuffer> command_buffer)> callback)
-                : callback_(callback)
-            {
-            }
-
-            magma::Status
-            SubmitCommandBuffer(std::unique_ptr<CommandBuffer> command_buffer) override
-            {
-                DLOG("command buffer received 0x%" PRIx64,
-                     TestCommandBuffer::platform_buffer(command_buffer.get())->id());
-                callback_(std::move(command_buffer));
-                return MAGMA_STATUS_OK;
-            }
-
-            void DestroyContext(std::shared_ptr<ClientContext> client_context) override {}
-            void ReleaseBuffer(std::shared_ptr<AddressSpace> address_space,
-                               std::shared_ptr<MsdIntelBuffer> buffer) override
-            {
-            }
-            void
-            PresentBuffer(std::shared_ptr<MsdIntelBuffer> buffer,
-                          magma_system_image_descriptor* image_desc,
-                          std::vector<std::shared_ptr<magma::PlatformSemaphore>> wait_semaphores,
-                          std::vector<std::shared_ptr<magma::PlatformSemaphore>> signal_semaphores,
-                          present_buffer_callback_t callback) override
-            {
-            }
-
-            std::function<void(std::unique_ptr<CommandBuffer>)> callback_;
-            std::unique_ptr<magma::PlatformSemaphore> semaphore_;
-        };
-
         std::vector<std::unique_ptr<CommandBuffer>> submitted_command_buffers;
         auto finished_semaphore =
             std::shared_ptr<magma::PlatformSemaphore>(magma::PlatformSemaphore::Create());
@@ -193,6 +202,210 @@ public:
         context->Shutdown();
     }
 
+    static void ShutdownRemovesWaitSets(bool close_connection)
+    {
+        std::vector<std::unique_ptr<CommandBuffer>> submitted_command_buffers;
+        auto owner = std::make_unique<ConnectionOwner>(
+            [&submitted_command_buffers](std::unique_ptr<CommandBuffer> command_buffer) {
+                submitted_command_buffers.push_back(std::move(command_buffer));
+            });
+
+        auto connection = std::shared_ptr<MsdIntelConnection>(
+            MsdIntelConnection::Create(owner.get(), nullptr, 0u));
+        auto address_space = std::make_shared<MockAddressSpace>(0, PAGE_SIZE);
+        auto context = std::make_shared<ClientContext>(connection, address_space);
+
+        std::shared_ptr<MsdIntelBuffer> command_buffer_content =
+            MsdIntelBuffer::Create(PAGE_SIZE, "test");
+        magma_system_command_buffer* command_buffer_desc;
+        ASSERT_TRUE(command_buffer_content->platform_buffer()->MapCpu(
+            reinterpret_cast<void**>(&command_buffer_desc)));
+        command_buffer_desc->batch_buffer_resource_index = 0;
+        command_buffer_desc->batch_start_offset = 0;
+        command_buffer_desc->num_resources = 0;
+        command_buffer_desc->wait_semaphore_count = 1;
+        command_buffer_desc->signal_semaphore_count = 0;
+
+        auto semaphore =
+            std::shared_ptr<magma::PlatformSemaphore>(magma::PlatformSemaphore::Create());
+        std::weak_ptr<magma::PlatformSemaphore> weak_semaphore = semaphore;
+
+        auto command_buffer =
+            TestCommandBuffer::Create(command_buffer_content, context, {}, {semaphore}, {});
+        ASSERT_NE(command_buffer, nullptr);
+        semaphore.reset();
+
+        EXPECT_EQ(MAGMA_STATUS_OK, context->SubmitCommandBuffer(std::move(command_buffer)).get());
+        EXPECT_FALSE(weak_semaphore.expired());
+
+        if (close_connection)
+            connection.reset();
+
+        // The semaphore never signals; shutdown must release the reactor's wait on it.
+        context->Shutdown();
+        EXPECT_TRUE(weak_semaphore.expired());
+        EXPECT_EQ(0u, submitted_command_buffers.size());
+    }
+
+    static void SubmitCommandBufferGpuWait()
+    {
+        std::vector<std::unique_ptr<CommandBuffer>> submitted_command_buffers;
+        auto owner = std::make_unique<ConnectionOwner>(
+            [&submitted_command_buffers](std::unique_ptr<CommandBuffer> command_buffer) {
+                submitted_command_buffers.push_back(std::move(command_buffer));
+            });
+
+        auto connection = std::shared_ptr<MsdIntelConnection>(
+            MsdIntelConnection::Create(owner.get(), nullptr, 0u));
+        auto address_space = std::make_shared<MockAddressSpace>(0, PAGE_SIZE);
+        auto producer_context = std::make_shared<ClientContext>(connection, address_space);
+        auto consumer_context = std::make_shared<ClientContext>(connection, address_space);
+
+        auto create_command_buffer =
+            [](std::shared_ptr<ClientContext> context,
+               std::vector<std::shared_ptr<magma::PlatformSemaphore>> wait_semaphores,
+               std::vector<std::shared_ptr<magma::PlatformSemaphore>> signal_semaphores) {
+                std::shared_ptr<MsdIntelBuffer> command_buffer_content =
+                    MsdIntelBuffer::Create(PAGE_SIZE, "test");
+                magma_system_command_buffer* command_buffer_desc;
+                EXPECT_TRUE(command_buffer_content->platform_buffer()->MapCpu(
+                    reinterpret_cast<void**>(&command_buffer_desc)));
+                command_buffer_desc->batch_buffer_resource_index = 0;
+                command_buffer_desc->batch_start_offset = 0;
+                command_buffer_desc->num_resources = 0;
+                command_buffer_desc->wait_semaphore_count = wait_semaphores.size();
+                command_buffer_desc->signal_semaphore_count = signal_semaphores.size();
+                return TestCommandBuffer::Create(command_buffer_content, context, {},
+                                                 std::move(wait_semaphores),
+                                                 std::move(signal_semaphores));
+            };
+
+        std::shared_ptr<magma::PlatformSemaphore> device_semaphore =
+            magma::PlatformSemaphore::Create();
+        std::shared_ptr<magma::PlatformSemaphore> foreign_semaphore =
+            magma::PlatformSemaphore::Create();
+
+        EXPECT_EQ(MAGMA_STATUS_OK,
+                  producer_context
+                      ->SubmitCommandBuffer(create_command_buffer(producer_context, {},
+                                                                 {device_semaphore}))
+                      .get());
+        ASSERT_EQ(1u, submitted_command_buffers.size());
+
+        // Waiting only on a semaphore signalled by a submitted command buffer needs no cpu wait.
+        EXPECT_EQ(MAGMA_STATUS_OK,
+                  consumer_context
+                      ->SubmitCommandBuffer(
+                          create_command_buffer(consumer_context, {device_semaphore}, {}))
+                      .get());
+        ASSERT_EQ(2u, submitted_command_buffers.size());
+
+        auto gpu_wait_semaphores = submitted_command_buffers[1]->TakeGpuWaitSemaphores();
+        ASSERT_EQ(1u, gpu_wait_semaphores.size());
+        EXPECT_EQ(device_semaphore->id(), gpu_wait_semaphores[0]->id());
+
+        // A foreign semaphore still waits on the cpu.
+        EXPECT_EQ(MAGMA_STATUS_OK,
+                  consumer_context
+                      ->SubmitCommandBuffer(create_command_buffer(
+                          consumer_context, {device_semaphore, foreign_semaphore}, {}))
+                      .get());
+        EXPECT_EQ(2u, submitted_command_buffers.size());
+
+        foreign_semaphore->Signal();
+        for (uint32_t i = 0; i < 100 && submitted_command_buffers.size() < 3; i++) {
+            magma::msleep(10);
+        }
+        ASSERT_EQ(3u, submitted_command_buffers.size());
+        EXPECT_EQ(1u, submitted_command_buffers[2]->TakeGpuWaitSemaphores().size());
+
+        // Once the producer's semaphores are signalled they are no longer gpu waitable.
+        owner->completion_signaler_.Add(1, submitted_command_buffers[0]->TakeSignalSemaphores());
+        EXPECT_EQ(1u, owner->completion_signaler_.Signal(1, 0));
+        std::vector<std::shared_ptr<magma::PlatformSemaphore>> semaphores{device_semaphore};
+        EXPECT_TRUE(owner->completion_signaler_.TakeRegistered(&semaphores).empty());
+
+        producer_context->Shutdown();
+        consumer_context->Shutdown();
+    }
+
+    static void WaitRendering()
+    {
+        auto owner = std::make_unique<ConnectionOwner>(nullptr);
+        auto connection = std::shared_ptr<MsdIntelConnection>(
+            MsdIntelConnection::Create(owner.get(), nullptr, 0u));
+        MsdIntelAbiConnection abi_connection(connection);
+
+        std::vector<std::unique_ptr<MsdIntelAbiBuffer>> abi_buffers;
+        std::vector<msd_buffer_t*> buffers;
+        for (uint32_t i = 0; i < 2; i++) {
+            abi_buffers.push_back(
+                std::make_unique<MsdIntelAbiBuffer>(MsdIntelBuffer::Create(PAGE_SIZE, "test")));
+            abi_buffers.back()->ptr()->IncrementInflightCounter();
+            buffers.push_back(abi_buffers.back().get());
+        }
+
+        EXPECT_EQ(MAGMA_STATUS_TIMED_OUT,
+                  msd_intel_connection_wait_rendering(&abi_connection, buffers.data(),
+                                                      buffers.size(), false, 10));
+
+        abi_buffers[0]->ptr()->DecrementInflightCounter();
+        EXPECT_EQ(MAGMA_STATUS_OK, msd_intel_connection_wait_rendering(
+                                       &abi_connection, buffers.data(), buffers.size(), false, 0));
+        EXPECT_EQ(MAGMA_STATUS_TIMED_OUT,
+                  msd_intel_connection_wait_rendering(&abi_connection, buffers.data(),
+                                                      buffers.size(), true, 10));
+
+        std::thread wait_thread([&abi_connection, &buffers] {
+            EXPECT_EQ(MAGMA_STATUS_OK,
+                      msd_intel_connection_wait_rendering(&abi_connection, buffers.data(),
+                                                          buffers.size(), true, UINT64_MAX));
+        });
+        magma::msleep(10);
+        abi_buffers[1]->ptr()->DecrementInflightCounter();
+        wait_thread.join();
+
+        connection->set_context_killed();
+        EXPECT_EQ(MAGMA_STATUS_CONTEXT_KILLED,
+                  msd_connection_wait_rendering(&abi_connection, buffers[0]));
+    }
+
+    static void SetHangBudget()
+    {
+        auto owner = std::make_unique<ConnectionOwner>(nullptr);
+        auto connection = std::shared_ptr<MsdIntelConnection>(
+            MsdIntelConnection::Create(owner.get(), nullptr, 0u));
+        auto context = std::make_shared<ClientContext>(
+            connection, std::make_shared<MockAddressSpace>(0, PAGE_SIZE));
+        EXPECT_EQ(MsdIntelContext::kDefaultHangBudgetMs, context->hang_budget_ms());
+
+        MsdIntelAbiContext abi_context(context);
+        EXPECT_EQ(MAGMA_STATUS_OK, msd_intel_context_set_hang_budget(&abi_context, 5000));
+        EXPECT_EQ(5000u, context->hang_budget_ms());
+
+        EXPECT_EQ(MAGMA_STATUS_INVALID_ARGS, msd_intel_context_set_hang_budget(&abi_context, 0));
+        EXPECT_EQ(5000u, context->hang_budget_ms());
+    }
+
+    static void QueryGpuRuntime()
+    {
+        std::weak_ptr<MsdIntelConnection> connection;
+        auto address_space = std::make_shared<MockAddressSpace>(0, PAGE_SIZE);
+        auto first = std::make_shared<ClientContext>(connection, address_space);
+        auto second = std::make_shared<ClientContext>(connection, address_space);
+        first->AddGpuRuntime(1000);
+        second->AddGpuRuntime(2000);
+        second->AddGpuRuntime(500);
+
+        MsdIntelAbiContext abi_first(first);
+        MsdIntelAbiContext abi_second(second);
+        uint64_t runtime_ns;
+        EXPECT_EQ(MAGMA_STATUS_OK, msd_intel_context_query_gpu_runtime(&abi_first, &runtime_ns));
+        EXPECT_EQ(1000u, runtime_ns);
+        EXPECT_EQ(MAGMA_STATUS_OK, msd_intel_context_query_gpu_runtime(&abi_second, &runtime_ns));
+        EXPECT_EQ(2500u, runtime_ns);
+    }
+
 private:
     static MsdIntelBuffer* get_buffer(MsdIntelContext* context, EngineCommandStreamerId id)
     {
@@ -231,3 +444,17 @@ TEST(ClientContext, SubmitCommandBuffer)
     TestContext::SubmitCommandBuffer(3, 2);
     TestContext::SubmitCommandBuffer(2, 5);
 }
+
+TEST(ClientContext, SubmitCommandBufferGpuWait) { TestContext::SubmitCommandBufferGpuWait(); }
+
+TEST(ClientContext, ShutdownRemovesWaitSets)
+{
+    TestContext::ShutdownRemovesWaitSets(false);
+    TestContext::ShutdownRemovesWaitSets(true);
+}
+
+TEST(MsdIntelConnection, WaitRendering) { TestContext::WaitRendering(); }
+
+TEST(ClientContext, SetHangBudget) { TestContext::SetHangBudget(); }
+
+TEST(ClientContext, QueryGpuRuntime) { TestContext::QueryGpuRuntime(); }
@@ -2,6 +2,7 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include "cache_config.h"
 #include "device_id.h"
 #include "engine_command_streamer.h"
 #include "gtt.h"
@@ -47,6 +48,39 @@ class TestEngineCommandStreamer : public EngineCommandStreamer::Owner,
 public:
     static constexpr uint32_t kFirstSequenceNumber = 5;
 
+    // Acknowledges the engine reset handshake.
+    class ResetHook : public RegisterIo::Hook {
+    public:
+        ResetHook(RegisterIo* register_io) : register_io_(register_io) {}
+
+        void Write32(uint32_t offset, uint32_t val) override
+        {
+            switch (offset) {
+                case EngineCommandStreamer::kRenderEngineMmioBase +
+                    registers::ResetControl::kOffset:
+                    // set ready for reset bit
+                    if (val & 0x00010001) {
+                        val = register_io_->mmio()->Read32(offset) | 0x2;
+                        register_io_->mmio()->Write32(offset, val);
+                    }
+                    break;
+                case registers::GraphicsDeviceResetControl::kOffset:
+                    // clear the render reset bit
+                    if (val & 0x2) {
+                        val = register_io_->mmio()->Read32(offset) & ~0x2;
+                        register_io_->mmio()->Write32(offset, val);
+                    }
+                    break;
+            }
+        }
+
+        void Read32(uint32_t offset, uint32_t val) override {}
+        void Read64(uint32_t offset, uint64_t val) override {}
+
+    private:
+        RegisterIo* register_io_;
+    };
+
     TestEngineCommandStreamer(uint32_t device_id = 0x1916) : device_id_(device_id)
     {
         register_io_ =
@@ -55,7 +89,8 @@ public:
         std::weak_ptr<MsdIntelConnection> connection;
 
         context_ = std::shared_ptr<MsdIntelContext>(
-            new ClientContext(connection, std::make_shared<Gtt>(GpuMappingCache::Create())));
+            new ClientContext(connection, std::make_shared<Gtt>(GpuMappingCache::Create(),
+                                                                BusMapper::Platform())));
 
         mock_status_page_ = std::unique_ptr<MockStatusPageBuffer>(new MockStatusPageBuffer());
 
@@ -141,6 +176,66 @@ public:
         EXPECT_EQ(state[0x43], 0ul);
     }
 
+    void InitContextCacheConfig()
+    {
+        InitContext();
+
+        EXPECT_TRUE(context_->Map(address_space_, engine_cs_->id()));
+
+        auto ringbuffer = context_->get_ringbuffer(engine_cs_->id());
+        ASSERT_NE(ringbuffer, nullptr);
+        uint32_t tail_start = ringbuffer->tail();
+
+        EXPECT_TRUE(engine_cs_->InitContextCacheConfig(context_));
+
+        const std::vector<uint32_t>& golden = engine_cs_->golden_cache_config_;
+        ASSERT_EQ(CacheConfig::InstructionBytesRequired() -
+                      MiBatchBufferEnd::kDwordCount * sizeof(uint32_t),
+                  golden.size() * sizeof(uint32_t));
+        EXPECT_EQ(golden.size() * sizeof(uint32_t), ringbuffer->tail() - tail_start);
+
+        auto ringbuffer_content = TestRingbuffer::vaddr(ringbuffer);
+        for (uint32_t i = 0; i < golden.size(); i++) {
+            EXPECT_EQ(golden[i], ringbuffer_content[tail_start / 4 + i]);
+        }
+
+        EXPECT_TRUE(context_->Unmap(engine_cs_->id()));
+    }
+
+    void ContextPool()
+    {
+        auto pool_address_space = std::make_shared<MockAddressSpace>(0, PAGE_SIZE * 1000);
+        auto& context_pool = engine_cs_->context_pool_;
+
+        EXPECT_TRUE(engine_cs_->RefillContextPool(pool_address_space, 1));
+        EXPECT_EQ(1u, context_pool.size());
+        while (engine_cs_->RefillContextPool(pool_address_space, 1))
+            ;
+        EXPECT_EQ(context_pool.capacity(), context_pool.size());
+
+        // Taken from the pool, already mapped.
+        InitContext();
+        EXPECT_EQ(context_pool.capacity() - 1, context_pool.size());
+        gpu_addr_t gpu_addr;
+        EXPECT_TRUE(context_->GetGpuAddress(engine_cs_->id(), &gpu_addr));
+        EXPECT_TRUE(context_->Map(pool_address_space, engine_cs_->id()));
+
+        uint32_t sequence_number = sequencer_->peek_next_sequence_number();
+        engine_cs_->RecycleContext(context_.get());
+        EXPECT_FALSE(context_->IsInitializedForEngine(engine_cs_->id()));
+        EXPECT_TRUE(context_pool.full());
+
+        // Held back until a sequence submitted after recycling completes.
+        engine_cs_->ReleaseRecycledContexts(sequence_number - 1);
+        EXPECT_EQ(context_pool.capacity() - 1, context_pool.size());
+        engine_cs_->ReleaseRecycledContexts(sequence_number);
+        EXPECT_EQ(context_pool.capacity(), context_pool.size());
+
+        // Reused with the context image reset.
+        InitContext();
+        EXPECT_TRUE(context_->GetGpuAddress(engine_cs_->id(), &gpu_addr));
+    }
+
     void InitHardware()
     {
         register_io()->Write32(
@@ -187,7 +282,8 @@ public:
 
         register_io_->InstallHook(std::make_unique<RegisterTracer>());
 
-        EXPECT_TRUE(render_cs->RenderInit(context_, std::move(init_batch), address_space_));
+        EXPECT_TRUE(render_cs->InitRenderInitBatch(std::move(init_batch), address_space_));
+        EXPECT_TRUE(render_cs->RenderInit(context_));
 
         uint32_t expected_dwords = MiBatchBufferStart::kDwordCount + MiNoop::kDwordCount +
                                    MiPipeControl::kDwordCount + MiNoop::kDwordCount +
@@ -239,6 +335,13 @@ public:
                         ->platform_buffer()
                         ->UnmapCpu());
 
+        // The register state page stays mapped across submissions.
+        uint32_t* register_state = context_->GetRegisterState(engine_cs_->id());
+        ASSERT_NE(register_state, nullptr);
+        EXPECT_EQ(register_state, context_->GetRegisterState(engine_cs_->id()));
+        EXPECT_EQ(register_state[7], ringbuffer->tail());
+        EXPECT_EQ(register_state[9], gpu_addr);
+
         EXPECT_TRUE(context_->GetGpuAddress(engine_cs_->id(), &gpu_addr));
 
         uint32_t upper_32_bits = gpu_addr >> 12;
@@ -260,45 +363,278 @@ public:
         EXPECT_TRUE(context_->Unmap(engine_cs_->id()));
     }
 
-    void Reset()
+    void ProcessCompletedCommandBuffers()
     {
-        class Hook : public RegisterIo::Hook {
-        public:
-            Hook(RegisterIo* register_io) : register_io_(register_io) {}
-
-            void Write32(uint32_t offset, uint32_t val) override
-            {
-                switch (offset) {
-                    case EngineCommandStreamer::kRenderEngineMmioBase +
-                        registers::ResetControl::kOffset:
-                        // set ready for reset bit
-                        if (val & 0x00010001) {
-                            val = register_io_->mmio()->Read32(offset) | 0x2;
-                            register_io_->mmio()->Write32(offset, val);
-                        }
-                        break;
-                    case registers::GraphicsDeviceResetControl::kOffset:
-                        // clear the render reset bit
-                        if (val & 0x2) {
-                            val = register_io_->mmio()->Read32(offset) & ~0x2;
-                            register_io_->mmio()->Write32(offset, val);
-                        }
-                        break;
-                }
-            }
+        RenderInit();
 
-            void Read32(uint32_t offset, uint32_t val) override {}
-            void Read64(uint32_t offset, uint64_t val) override {}
+        auto render_cs = reinterpret_cast<RenderEngineCommandStreamer*>(engine_cs_.get());
+        auto ringbuffer = context_->get_ringbuffer(engine_cs_->id());
 
-        private:
-            RegisterIo* register_io_;
-        };
+        ASSERT_EQ(1u, render_cs->inflight_command_sequences_.size());
+        uint32_t ringbuffer_offset =
+            render_cs->inflight_command_sequences_.front().ringbuffer_offset();
+        auto batch_buffer = render_cs->inflight_command_sequences_.front()
+                                .mapped_batch()
+                                ->GetBatchMapping()
+                                ->buffer();
+        EXPECT_EQ(1u, batch_buffer->inflight_counter());
+
+        render_cs->ProcessCompletedCommandBuffers(kFirstSequenceNumber);
+
+        // Bookkeeping is done but the batch hasn't been released yet.
+        EXPECT_EQ(0u, render_cs->inflight_command_sequences_.size());
+        EXPECT_EQ(ringbuffer_offset, ringbuffer->head());
+        EXPECT_EQ(1u, render_cs->retire_queue_.size());
+        EXPECT_EQ(1u, batch_buffer->inflight_counter());
+
+        EXPECT_FALSE(render_cs->RetireCompletedBatches(1));
+        EXPECT_EQ(0u, render_cs->retire_queue_.size());
+    }
+
+    void LiteRestore()
+    {
+        auto render_cs = reinterpret_cast<RenderEngineCommandStreamer*>(engine_cs_.get());
+
+        InitContext();
+        EXPECT_TRUE(context_->Map(address_space_, engine_cs_->id()));
+        auto ringbuffer = context_->get_ringbuffer(engine_cs_->id());
 
-        register_io_->InstallHook(std::make_unique<Hook>(register_io_.get()));
+        EXPECT_TRUE(render_cs->InitRenderInitBatch(render_cs->CreateRenderInitBatch(device_id_),
+                                                   address_space_));
+
+        EXPECT_TRUE(render_cs->RenderInit(context_));
+        EXPECT_EQ(1u, engine_cs_->submit_stats().context_switch_count);
+        EXPECT_EQ(0u, engine_cs_->submit_stats().lite_restore_count);
+
+        // The context is still running so only its tail is updated.
+        EXPECT_TRUE(render_cs->RenderInit(context_));
+        EXPECT_EQ(1u, engine_cs_->submit_stats().context_switch_count);
+        EXPECT_EQ(1u, engine_cs_->submit_stats().lite_restore_count);
+        EXPECT_EQ(ringbuffer->tail(), context_->GetRegisterState(engine_cs_->id())[7]);
+
+        // Both submissions share the one relocated render init batch.
+        ASSERT_EQ(2u, render_cs->inflight_command_sequences_.size());
+        EXPECT_EQ(render_cs->inflight_command_sequences_.front().mapped_batch()->GetBatchMapping(),
+                  render_cs->inflight_command_sequences_.back().mapped_batch()->GetBatchMapping());
+
+        render_cs->ProcessCompletedCommandBuffers(kFirstSequenceNumber + 1);
+        EXPECT_EQ(0u, render_cs->inflight_command_sequences_.size());
+
+        EXPECT_TRUE(render_cs->RenderInit(context_));
+        EXPECT_EQ(2u, engine_cs_->submit_stats().context_switch_count);
+        EXPECT_EQ(1u, engine_cs_->submit_stats().lite_restore_count);
+    }
+
+    // Records the batch each batch's flushes were left to.
+    class FlushRecordingBatch : public SimpleMappedBatch {
+    public:
+        FlushRecordingBatch(std::shared_ptr<MsdIntelContext> context,
+                            std::shared_ptr<GpuMapping> mapping, MappedBatch** next_batch_out)
+            : SimpleMappedBatch(context, std::move(mapping)), next_batch_out_(next_batch_out)
+        {
+        }
+
+        uint32_t GetPipeControlFlags(MappedBatch* next_batch) override
+        {
+            *next_batch_out_ = next_batch;
+            return 0;
+        }
+
+    private:
+        MappedBatch** next_batch_out_;
+    };
+
+    void FlushesLeftOnlyToEmittedBatch()
+    {
+        auto render_cs = reinterpret_cast<RenderEngineCommandStreamer*>(engine_cs_.get());
+
+        std::shared_ptr<AddressSpace> address_space(new MockAddressSpace(0, PAGE_SIZE * 1000));
+
+        InitContext();
+        EXPECT_TRUE(context_->Map(address_space, engine_cs_->id()));
+
+        std::weak_ptr<MsdIntelConnection> connection;
+        auto other_context = std::shared_ptr<MsdIntelContext>(
+            new ClientContext(connection, std::make_shared<Gtt>(GpuMappingCache::Create(),
+                                                                BusMapper::Platform())));
+        EXPECT_TRUE(engine_cs_->InitContext(other_context.get()));
+        EXPECT_TRUE(other_context->Map(address_space, engine_cs_->id()));
+
+        EXPECT_TRUE(render_cs->InitRenderInitBatch(render_cs->CreateRenderInitBatch(device_id_),
+                                                   address_space));
+
+        // Queued as context, context, other context, context.
+        std::vector<std::shared_ptr<MsdIntelContext>> contexts{context_, context_, other_context,
+                                                               context_};
+        std::vector<MappedBatch*> batches;
+        std::vector<MappedBatch*> next_batches(contexts.size());
+        for (uint32_t i = 0; i < contexts.size(); i++) {
+            auto batch = std::make_unique<FlushRecordingBatch>(
+                contexts[i], render_cs->render_init_batch_mapping_, &next_batches[i]);
+            batches.push_back(batch.get());
+            contexts[i]->pending_batch_queue().emplace(std::move(batch));
+            render_cs->scheduler_->CommandBufferQueued(contexts[i]);
+        }
+
+        // The second batch goes in right behind the first, so it takes the first's flushes.
+        // The other context's batch is scheduled next, so the second keeps its own.
+        render_cs->ScheduleContext();
+        EXPECT_EQ(2u, render_cs->inflight_command_sequences_.size());
+        EXPECT_EQ(batches[1], next_batches[0]);
+        EXPECT_EQ(nullptr, next_batches[1]);
+
+        render_cs->ProcessCompletedCommandBuffers(kFirstSequenceNumber + 1);
+        EXPECT_EQ(1u, render_cs->inflight_command_sequences_.size());
+        EXPECT_EQ(nullptr, next_batches[2]);
+
+        render_cs->ProcessCompletedCommandBuffers(kFirstSequenceNumber + 2);
+        EXPECT_EQ(1u, render_cs->inflight_command_sequences_.size());
+        EXPECT_EQ(nullptr, next_batches[3]);
+
+        render_cs->ProcessCompletedCommandBuffers(kFirstSequenceNumber + 3);
+        EXPECT_EQ(0u, render_cs->inflight_command_sequences_.size());
+    }
+
+    // A batch timed like a user batch.
+    class TimedBatch : public SimpleMappedBatch {
+    public:
+        using SimpleMappedBatch::SimpleMappedBatch;
+
+        bool IsSimple() override { return false; }
+    };
+
+    void UserBatchesWaitForTimestampSlot()
+    {
+        auto render_cs = reinterpret_cast<RenderEngineCommandStreamer*>(engine_cs_.get());
+
+        InitContext();
+        EXPECT_TRUE(context_->Map(address_space_, engine_cs_->id()));
+        EXPECT_TRUE(render_cs->InitRenderInitBatch(render_cs->CreateRenderInitBatch(device_id_),
+                                                   address_space_));
+
+        constexpr uint32_t kSlotCount = HardwareStatusPage::kTimestampSlotCount;
+        for (uint32_t i = 0; i < kSlotCount + 1; i++) {
+            context_->pending_batch_queue().emplace(
+                std::make_unique<TimedBatch>(context_, render_cs->render_init_batch_mapping_));
+            render_cs->scheduler_->CommandBufferQueued(context_);
+        }
+
+        // Every batch in flight is timed; the last waits for a slot.
+        render_cs->ScheduleContext();
+        EXPECT_EQ(kSlotCount, render_cs->inflight_command_sequences_.size());
+        EXPECT_EQ(1u, context_->pending_batch_queue().size());
+        uint32_t first_slot = render_cs->inflight_command_sequences_.front().timestamp_slot();
+        EXPECT_LT(first_slot, kSlotCount);
+
+        // Retiring the first frees its slot for the last.
+        render_cs->ProcessCompletedCommandBuffers(kFirstSequenceNumber);
+        EXPECT_EQ(kSlotCount, render_cs->inflight_command_sequences_.size());
+        EXPECT_EQ(0u, context_->pending_batch_queue().size());
+        EXPECT_EQ(first_slot, render_cs->inflight_command_sequences_.back().timestamp_slot());
+
+        render_cs->ProcessCompletedCommandBuffers(kFirstSequenceNumber + kSlotCount);
+        EXPECT_EQ(0u, render_cs->inflight_command_sequences_.size());
+    }
+
+    void Reset()
+    {
+        register_io_->InstallHook(std::make_unique<ResetHook>(register_io_.get()));
 
         EXPECT_TRUE(engine_cs_->Reset());
     }
 
+    void ResetReplaysInnocentContexts()
+    {
+        auto render_cs = reinterpret_cast<RenderEngineCommandStreamer*>(engine_cs_.get());
+
+        // Room for two contexts.
+        std::shared_ptr<AddressSpace> address_space(new MockAddressSpace(0, PAGE_SIZE * 1000));
+
+        InitContext();
+        EXPECT_TRUE(context_->Map(address_space, engine_cs_->id()));
+        auto ringbuffer = context_->get_ringbuffer(engine_cs_->id());
+
+        std::weak_ptr<MsdIntelConnection> connection;
+        auto guilty_context = std::shared_ptr<MsdIntelContext>(
+            new ClientContext(connection, std::make_shared<Gtt>(GpuMappingCache::Create(),
+                                                                BusMapper::Platform())));
+        EXPECT_TRUE(engine_cs_->InitContext(guilty_context.get()));
+        EXPECT_TRUE(guilty_context->Map(address_space, engine_cs_->id()));
+        auto guilty_ringbuffer = guilty_context->get_ringbuffer(engine_cs_->id());
+
+        EXPECT_TRUE(render_cs->InitRenderInitBatch(render_cs->CreateRenderInitBatch(device_id_),
+                                                   address_space));
+
+        hw_status_page_->write_sequence_number(kFirstSequenceNumber - 1);
+
+        uint32_t head = ringbuffer->head();
+        EXPECT_TRUE(render_cs->RenderInit(context_));
+        EXPECT_TRUE(render_cs->RenderInit(guilty_context));
+        EXPECT_TRUE(render_cs->RenderInit(context_));
+        uint32_t tail = ringbuffer->tail();
+
+        // The engine hung in the guilty context's batch; the ring head is past its batch start.
+        gpu_addr_t guilty_ringbuffer_gpu_addr;
+        EXPECT_TRUE(guilty_ringbuffer->GetGpuAddress(&guilty_ringbuffer_gpu_addr));
+        register_io_->Write32(EngineCommandStreamer::kRenderEngineMmioBase +
+                                  registers::RingbufferStart::kOffset,
+                              magma::lower_32_bits(guilty_ringbuffer_gpu_addr));
+        uint32_t batch_start_size =
+            (MiBatchBufferStart::kDwordCount + MiNoop::kDwordCount) * sizeof(uint32_t);
+        register_io_->Write32(EngineCommandStreamer::kRenderEngineMmioBase +
+                                  registers::RingbufferHead::kOffset,
+                              guilty_ringbuffer->head() + batch_start_size);
+
+        // The active head is an address in the guilty context's ppgtt; make it alias the innocent
+        // context's ring commands in the global gtt.
+        gpu_addr_t ringbuffer_gpu_addr;
+        EXPECT_TRUE(ringbuffer->GetGpuAddress(&ringbuffer_gpu_addr));
+        uint64_t active_head = ringbuffer_gpu_addr + head;
+        register_io_->Write32(EngineCommandStreamer::kRenderEngineMmioBase +
+                                  registers::ActiveHeadPointer::kUpperOffset,
+                              magma::upper_32_bits(active_head));
+        register_io_->Write32(EngineCommandStreamer::kRenderEngineMmioBase +
+                                  registers::ActiveHeadPointer::kOffset,
+                              magma::lower_32_bits(active_head));
+
+        register_io_->InstallHook(std::make_unique<ResetHook>(register_io_.get()));
+
+        render_cs->ResetCurrentContext();
+
+        EXPECT_EQ(0u, render_cs->inflight_command_sequences_.size());
+        EXPECT_EQ(2u, render_cs->replay_batches_.size());
+
+        // The guilty context's commands are skipped.
+        EXPECT_EQ(guilty_ringbuffer->tail(), guilty_ringbuffer->head());
+
+        // The innocent context restarts from its first incomplete sequence.
+        EXPECT_EQ(head, ringbuffer->tail());
+        EXPECT_EQ(head, context_->GetRegisterState(engine_cs_->id())[5]);
+
+        // A batch queued before the replay runs after the replayed batches.
+        auto queued_batch =
+            std::make_unique<SimpleMappedBatch>(context_, render_cs->render_init_batch_mapping_);
+        MappedBatch* queued_batch_ptr = queued_batch.get();
+        context_->pending_batch_queue().emplace(std::move(queued_batch));
+        render_cs->scheduler_->CommandBufferQueued(context_);
+
+        render_cs->ReplayInflightBatches();
+
+        // The replayed batches go through the scheduler, so only the innocent context runs.
+        EXPECT_EQ(0u, render_cs->replay_batches_.size());
+        ASSERT_EQ(3u, render_cs->inflight_command_sequences_.size());
+        for (uint32_t i = 0; i < 3; i++) {
+            auto sequence = std::move(render_cs->inflight_command_sequences_.front());
+            render_cs->inflight_command_sequences_.pop();
+            EXPECT_EQ(context_, sequence.GetContext().lock());
+            EXPECT_TRUE(sequence.mapped_batch()->was_scheduled());
+            EXPECT_EQ(i == 2, sequence.mapped_batch() == queued_batch_ptr);
+            if (i == 1)
+                EXPECT_EQ(tail, sequence.ringbuffer_offset());
+            render_cs->inflight_command_sequences_.push(std::move(sequence));
+        }
+    }
+
 private:
     RegisterIo* register_io() override { return register_io_.get(); }
 
@@ -309,7 +645,9 @@ private:
         return hw_status_page_.get();
     }
 
-    void batch_submitted(uint32_t sequence_number) override {}
+    void batch_submitted(uint32_t sequence_number, uint32_t hang_budget_ms) override {}
+
+    void batch_completed(MappedBatch* mapped_batch) override {}
 
     void* hardware_status_page_cpu_addr(EngineCommandStreamerId id) override
     {
@@ -339,6 +677,18 @@ TEST(RenderEngineCommandStreamer, InitContext)
     test.InitContext();
 }
 
+TEST(RenderEngineCommandStreamer, InitContextCacheConfig)
+{
+    TestEngineCommandStreamer test;
+    test.InitContextCacheConfig();
+}
+
+TEST(RenderEngineCommandStreamer, ContextPool)
+{
+    TestEngineCommandStreamer test;
+    test.ContextPool();
+}
+
 TEST(RenderEngineCommandStreamer, InitHardware)
 {
     TestEngineCommandStreamer test;
@@ -357,8 +707,38 @@ TEST(RenderEngineCommandStreamer, RenderInitGen9)
     test.RenderInit();
 }
 
+TEST(RenderEngineCommandStreamer, ProcessCompletedCommandBuffers)
+{
+    TestEngineCommandStreamer test;
+    test.ProcessCompletedCommandBuffers();
+}
+
+TEST(RenderEngineCommandStreamer, LiteRestore)
+{
+    TestEngineCommandStreamer test;
+    test.LiteRestore();
+}
+
+TEST(RenderEngineCommandStreamer, FlushesLeftOnlyToEmittedBatch)
+{
+    TestEngineCommandStreamer test;
+    test.FlushesLeftOnlyToEmittedBatch();
+}
+
+TEST(RenderEngineCommandStreamer, UserBatchesWaitForTimestampSlot)
+{
+    TestEngineCommandStreamer test;
+    test.UserBatchesWaitForTimestampSlot();
+}
+
 TEST(RenderEngineCommandStreamer, Reset)
 {
     TestEngineCommandStreamer test;
     test.Reset();
 }
+
+TEST(RenderEngineCommandStreamer, ResetReplaysInnocentContexts)
+{
+    TestEngineCommandStreamer test;
+    test.ResetReplaysInnocentContexts();
+}
@@ -0,0 +1,268 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "error_state.h"
+#include "error_state_decoder.h"
+#include "gen_command_table.h"
+#include "gtest/gtest.h"
+#include "magma_util/macros.h"
+
+class TestErrorState {
+public:
+    void Writer()
+    {
+        ErrorStateWriter writer(PAGE_SIZE);
+        EXPECT_TRUE(writer.empty());
+
+        // Nothing is written outside a section.
+        writer.Begin(0x1916, ErrorState::kReasonHang, 0x1000, 0x1002);
+        EXPECT_FALSE(writer.Write32(1));
+        EXPECT_EQ(ErrorState::kHeaderDwords * sizeof(uint32_t), writer.size_bytes());
+
+        writer.BeginSection(ErrorState::kRegisters);
+        EXPECT_TRUE(writer.Write32(0x2034));
+        EXPECT_TRUE(writer.Write32(0x40));
+        writer.EndSection();
+
+        const uint32_t* dwords = writer.dwords();
+        EXPECT_EQ(ErrorState::kMagic, dwords[ErrorState::kHeaderMagic]);
+        EXPECT_EQ(ErrorState::kVersion, dwords[ErrorState::kHeaderVersion]);
+        EXPECT_EQ(0x1916u, dwords[ErrorState::kHeaderDeviceId]);
+        EXPECT_EQ(0u, dwords[ErrorState::kHeaderFlags]);
+        EXPECT_EQ(1u, dwords[ErrorState::kHeaderGeneration]);
+        EXPECT_EQ(static_cast<uint32_t>(ErrorState::kRegisters),
+                  dwords[ErrorState::kHeaderDwords]);
+        EXPECT_EQ(2u, dwords[ErrorState::kHeaderDwords + 1]);
+
+        // Nothing is added once complete.
+        EXPECT_FALSE(writer.complete());
+        writer.Complete();
+        EXPECT_TRUE(writer.complete());
+        uint32_t size_bytes = writer.size_bytes();
+        writer.BeginSection(ErrorState::kStatusPage);
+        EXPECT_FALSE(writer.Write32(0));
+        writer.EndSection();
+        EXPECT_EQ(size_bytes, writer.size_bytes());
+        EXPECT_EQ(static_cast<uint32_t>(ErrorState::kFlagComplete),
+                  writer.dwords()[ErrorState::kHeaderFlags]);
+
+        // Begin discards the previous error state and starts the next generation.
+        writer.Begin(0x1916, ErrorState::kReasonFault, 0, 0);
+        EXPECT_EQ(ErrorState::kHeaderDwords * sizeof(uint32_t), writer.size_bytes());
+        EXPECT_FALSE(writer.complete());
+        EXPECT_EQ(2u, writer.dwords()[ErrorState::kHeaderGeneration]);
+
+        writer.Clear();
+        EXPECT_TRUE(writer.empty());
+    }
+
+    void Truncated()
+    {
+        constexpr uint32_t kCapacityDwords = ErrorState::kHeaderDwords +
+                                             ErrorState::kSectionHeaderDwords +
+                                             ErrorState::kBatchFieldDwords + 4;
+        ErrorStateWriter writer(kCapacityDwords * sizeof(uint32_t));
+        writer.Begin(0x1916, ErrorState::kReasonHang, 0, 0);
+
+        std::vector<uint32_t> batch(16, 0);
+        WriteBatch(&writer, 0x1001, 0x10000, batch);
+        EXPECT_EQ(kCapacityDwords * sizeof(uint32_t), writer.size_bytes());
+
+        // Sections that don't fit at all are dropped.
+        writer.BeginSection(ErrorState::kStatusPage);
+        EXPECT_FALSE(writer.Write32(0));
+        writer.EndSection();
+        EXPECT_EQ(kCapacityDwords * sizeof(uint32_t), writer.size_bytes());
+
+        auto decoder = Parse(writer);
+        ASSERT_NE(nullptr, decoder);
+        EXPECT_TRUE(decoder->truncated());
+        ASSERT_EQ(1u, decoder->batches().size());
+        EXPECT_EQ(batch.size() * sizeof(uint32_t), decoder->batches()[0].length);
+        EXPECT_EQ(4u, decoder->batches()[0].contents.size());
+        EXPECT_TRUE(decoder->status_page().empty());
+    }
+
+    void Decode()
+    {
+        constexpr uint64_t kBatchGpuAddr = 0x10000;
+        constexpr uint64_t kRingbufferGpuAddr = 0x80000;
+        constexpr uint32_t kRingbufferSize = 0x100;
+
+        ErrorStateWriter writer(PAGE_SIZE * 4);
+        writer.Begin(0x1916, ErrorState::kReasonHang, 0x1000, 0x1001);
+
+        // The active head is on the batch's PIPE_CONTROL.
+        writer.BeginSection(ErrorState::kRegisters);
+        writer.Write32(0x2074);
+        writer.Write32(kBatchGpuAddr + 3 * sizeof(uint32_t));
+        writer.Write32(0x205C);
+        writer.Write32(0);
+        writer.EndSection();
+
+        // Wraps around the end of the ringbuffer.
+        std::vector<uint32_t> ring = {0x18800101, kBatchGpuAddr, 0, 0x01000000};
+        uint32_t ring_head = kRingbufferSize - 2 * sizeof(uint32_t);
+        writer.BeginSection(ErrorState::kRingbuffer);
+        writer.Write64(0xc0ffee);
+        writer.Write64(kRingbufferGpuAddr);
+        writer.Write32(kRingbufferSize);
+        writer.Write32(ring_head);
+        writer.Write32(2 * sizeof(uint32_t));
+        writer.WriteDwords(ring.data(), ring.size());
+        writer.EndSection();
+
+        std::vector<uint32_t> batch = {0x11000001, 0x2358, 0, 0x7a000004, 0x00100000, 0, 0,
+                                       0,          0,      0, 0x05000000};
+        WriteBatch(&writer, 0x1001, kBatchGpuAddr, batch);
+
+        writer.BeginSection(ErrorState::kMapping);
+        writer.Write32(0x1001);
+        writer.Write64(0xb0ff);
+        writer.Write64(kBatchGpuAddr);
+        writer.Write64(0);
+        writer.Write64(PAGE_SIZE);
+        writer.EndSection();
+
+        std::vector<uint32_t> status_page(PAGE_SIZE / sizeof(uint32_t));
+        status_page[0x20 / sizeof(uint32_t)] = 0x1000;
+        writer.BeginSection(ErrorState::kStatusPage);
+        writer.WriteDwords(status_page.data(), status_page.size());
+        writer.EndSection();
+
+        writer.Complete();
+
+        auto decoder = Parse(writer);
+        ASSERT_NE(nullptr, decoder);
+        EXPECT_FALSE(decoder->truncated());
+        EXPECT_TRUE(decoder->complete());
+        EXPECT_EQ(1u, decoder->generation());
+        EXPECT_EQ(0x1916u, decoder->device_id());
+        EXPECT_EQ(static_cast<uint32_t>(ErrorState::kReasonHang), decoder->reason());
+        EXPECT_EQ(0x1000u, decoder->last_completed_sequence());
+        EXPECT_EQ(0x1001u, decoder->last_submitted_sequence());
+        EXPECT_EQ(kBatchGpuAddr + 3 * sizeof(uint32_t), decoder->active_head());
+
+        ASSERT_EQ(1u, decoder->ringbuffers().size());
+        EXPECT_EQ(0xc0ffeeu, decoder->ringbuffers()[0].context_id);
+        EXPECT_EQ(ring_head, decoder->ringbuffers()[0].head);
+        EXPECT_EQ(ring, decoder->ringbuffers()[0].contents);
+
+        ASSERT_EQ(1u, decoder->batches().size());
+        EXPECT_EQ(0x1001u, decoder->batches()[0].sequence_number);
+        EXPECT_EQ(kBatchGpuAddr, decoder->batches()[0].gpu_addr);
+        EXPECT_EQ(batch, decoder->batches()[0].contents);
+
+        ASSERT_EQ(1u, decoder->mappings().size());
+        EXPECT_EQ(0xb0ffu, decoder->mappings()[0].buffer_id);
+        EXPECT_EQ(static_cast<uint64_t>(PAGE_SIZE), decoder->mappings()[0].length);
+
+        EXPECT_EQ(status_page, decoder->status_page());
+
+        std::string text;
+        decoder->Format(text);
+        EXPECT_NE(std::string::npos, text.find("ACTIVE HEAD WITHIN THIS BATCH"));
+        EXPECT_NE(std::string::npos, text.find("    0x00010000: MI_LOAD_REGISTER_IMM"));
+        EXPECT_NE(std::string::npos, text.find("==> 0x0001000c: PIPE_CONTROL"));
+        EXPECT_NE(std::string::npos, text.find("    0x00010028: MI_BATCH_BUFFER_END"));
+        // The ringbuffer addresses wrap.
+        EXPECT_NE(std::string::npos, text.find("    0x000800f8: MI_BATCH_BUFFER_START"));
+        EXPECT_NE(std::string::npos, text.find("    0x00080000: MI_NOOP x 1"));
+        EXPECT_NE(std::string::npos, text.find("0x020: 0x00001000"));
+    }
+
+    void ParseBytes()
+    {
+        ErrorStateWriter writer(PAGE_SIZE);
+        writer.Begin(0x1916, ErrorState::kReasonFault, 0x1000, 0x1001);
+        std::vector<uint32_t> batch(13, 0);
+        batch.back() = 0x05000000;
+        WriteBatch(&writer, 0x1001, 0x10000, batch);
+
+        // As read from the driver.
+        auto bytes = reinterpret_cast<const uint8_t*>(writer.dwords());
+        std::vector<uint8_t> data(bytes, bytes + writer.size_bytes());
+        auto decoder = ErrorStateDecoder::Parse(data);
+        ASSERT_NE(nullptr, decoder);
+        EXPECT_EQ(static_cast<uint32_t>(ErrorState::kReasonFault), decoder->reason());
+        ASSERT_EQ(1u, decoder->batches().size());
+        EXPECT_EQ(batch, decoder->batches()[0].contents);
+
+        data.pop_back();
+        EXPECT_EQ(nullptr, ErrorStateDecoder::Parse(data));
+    }
+
+    void CommandLengths()
+    {
+        const struct {
+            uint32_t header;
+            uint32_t dword_count;
+            const char* name;
+        } kCommands[] = {
+            {0x00000000, 1, "MI_NOOP"},
+            {0x01000000, 1, "MI_USER_INTERRUPT"},
+            {0x05000000, 1, "MI_BATCH_BUFFER_END"},
+            {0x11000003, 5, "MI_LOAD_REGISTER_IMM"},
+            {0x18800101, 3, "MI_BATCH_BUFFER_START"},
+            {0x0E000002, 4, "MI_SEMAPHORE_WAIT"},
+            {0x10400002, 4, "MI_STORE_DATA_IMM"},
+            {0x54C00008, 10, "XY_SRC_COPY_BLT"},
+            {0x61010011, 19, "STATE_BASE_ADDRESS"},
+            {0x69040302, 1, "PIPELINE_SELECT"},
+            {0x7000000A, 12, "MEDIA_VFE_STATE"},
+            {0x71000004, 6, "MEDIA_OBJECT"},
+            {0x7105000D, 15, "GPGPU_WALKER"},
+            {0x7105050D, 15, "GPGPU_WALKER"}, // predicated, indirect
+            {0x780B0001, 1, "3DSTATE_VF_STATISTICS"},
+            {0x7808000B, 13, "3DSTATE_VERTEX_BUFFERS"},
+            {0x79170100, 0x102, "3DSTATE_SO_DECL_LIST"},
+            {0x7A000004, 6, "PIPE_CONTROL"},
+            {0x7B000005, 7, "3DPRIMITIVE"},
+        };
+
+        for (auto& command : kCommands) {
+            uint32_t dword_count;
+            EXPECT_TRUE(GenCommandTable::GetLength(command.header, &dword_count))
+                << command.name;
+            EXPECT_EQ(command.dword_count, dword_count) << command.name;
+            EXPECT_STREQ(command.name, GenCommandTable::GetName(command.header));
+        }
+
+        uint32_t dword_count;
+        // Command type 1 is reserved.
+        EXPECT_FALSE(GenCommandTable::GetLength(0x20000000, &dword_count));
+        EXPECT_EQ(nullptr, GenCommandTable::GetName(0x7FFF0000));
+        EXPECT_TRUE(GenCommandTable::IsBatchBufferEnd(0x05000000));
+        EXPECT_FALSE(GenCommandTable::IsBatchBufferEnd(0x7A000004));
+    }
+
+private:
+    static void WriteBatch(ErrorStateWriter* writer, uint32_t sequence_number, uint64_t gpu_addr,
+                           const std::vector<uint32_t>& contents)
+    {
+        writer->BeginSection(ErrorState::kBatch);
+        writer->Write32(sequence_number);
+        writer->Write64(0xc0ffee);
+        writer->Write64(gpu_addr);
+        writer->Write32(contents.size() * sizeof(uint32_t));
+        writer->WriteDwords(contents.data(), contents.size());
+        writer->EndSection();
+    }
+
+    static std::unique_ptr<ErrorStateDecoder> Parse(ErrorStateWriter& writer)
+    {
+        return ErrorStateDecoder::Parse(std::vector<uint32_t>(
+            writer.dwords(), writer.dwords() + writer.size_bytes() / sizeof(uint32_t)));
+    }
+};
+
+TEST(ErrorState, Writer) { TestErrorState().Writer(); }
+
+TEST(ErrorState, Truncated) { TestErrorState().Truncated(); }
+
+TEST(ErrorState, Decode) { TestErrorState().Decode(); }
+
+TEST(ErrorState, ParseBytes) { TestErrorState().ParseBytes(); }
+
+TEST(ErrorState, CommandLengths) { TestErrorState().CommandLengths(); }
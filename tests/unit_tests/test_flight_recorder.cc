@@ -0,0 +1,110 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "flight_recorder.h"
+#include "gtest/gtest.h"
+#include <memory>
+#include <thread>
+
+class TestFlightRecorder {
+public:
+    void RecordAndGet()
+    {
+        auto recorder = std::make_unique<FlightRecorder>();
+        EXPECT_TRUE(recorder->GetEvents(16).empty());
+
+        recorder->Record(FlightRecorder::kEnqueue, 7, 0x1000);
+        recorder->Record(FlightRecorder::kExeclistSubmit, 0x20);
+        recorder->Record(FlightRecorder::kRetire, 0x20, 0x1000);
+
+        auto events = recorder->GetEvents(16);
+        ASSERT_EQ(3u, events.size());
+        EXPECT_EQ(FlightRecorder::kEnqueue, events[0].type);
+        EXPECT_EQ(7u, events[0].id);
+        EXPECT_EQ(0x1000u, events[0].data);
+        EXPECT_EQ(FlightRecorder::kExeclistSubmit, events[1].type);
+        EXPECT_EQ(0u, events[1].data);
+        EXPECT_EQ(FlightRecorder::kRetire, events[2].type);
+        for (uint32_t i = 0; i < events.size(); i++) {
+            EXPECT_EQ(i, events[i].index);
+            if (i > 0)
+                EXPECT_GE(events[i].timestamp_ns, events[i - 1].timestamp_ns);
+        }
+
+        // The most recent.
+        events = recorder->GetEvents(1);
+        ASSERT_EQ(1u, events.size());
+        EXPECT_EQ(FlightRecorder::kRetire, events[0].type);
+
+        EXPECT_STREQ("execlist submit", FlightRecorder::EventName(FlightRecorder::kExeclistSubmit));
+    }
+
+    void Wrap()
+    {
+        auto recorder = std::make_unique<FlightRecorder>();
+        constexpr uint32_t kCount = FlightRecorder::kCapacity + 10;
+        for (uint32_t i = 0; i < kCount; i++) {
+            recorder->Record(FlightRecorder::kInterrupt, i);
+        }
+
+        auto events = recorder->GetEvents(kCount);
+        ASSERT_EQ(static_cast<size_t>(FlightRecorder::kCapacity), events.size());
+        EXPECT_EQ(10u, events.front().id);
+        EXPECT_EQ(kCount - 1, events.back().id);
+    }
+
+    void Concurrent()
+    {
+        auto recorder = std::make_unique<FlightRecorder>();
+        constexpr uint32_t kThreadCount = 4;
+        constexpr uint32_t kEventsPerThread = 10000;
+
+        std::vector<std::thread> threads;
+        for (uint32_t thread = 0; thread < kThreadCount; thread++) {
+            threads.emplace_back([&recorder, thread] {
+                for (uint32_t i = 0; i < kEventsPerThread; i++) {
+                    // The data repeats the id so torn events would show.
+                    recorder->Record(FlightRecorder::kSchedule, thread << 16 | i,
+                                     thread << 16 | i);
+                }
+            });
+        }
+
+        // Reads while the writers run see only whole events.
+        for (uint32_t i = 0; i < 100; i++) {
+            for (auto& event : recorder->GetEvents(FlightRecorder::kCapacity)) {
+                EXPECT_EQ(FlightRecorder::kSchedule, event.type);
+                EXPECT_EQ(event.id, event.data);
+            }
+        }
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        auto events = recorder->GetEvents(FlightRecorder::kCapacity);
+        EXPECT_EQ(static_cast<size_t>(FlightRecorder::kCapacity), events.size());
+        for (auto& event : events) {
+            EXPECT_EQ(event.id, event.data);
+        }
+    }
+};
+
+TEST(FlightRecorder, RecordAndGet)
+{
+    TestFlightRecorder test;
+    test.RecordAndGet();
+}
+
+TEST(FlightRecorder, Wrap)
+{
+    TestFlightRecorder test;
+    test.Wrap();
+}
+
+TEST(FlightRecorder, Concurrent)
+{
+    TestFlightRecorder test;
+    test.Concurrent();
+}
@@ -17,6 +17,7 @@ public:
     {
         switch (domain) {
             case registers::ForceWake::GEN8:
+            case registers::ForceWake::GEN9_GT:
                 offset_ = registers::ForceWake::kOffset;
                 status_offset_ = registers::ForceWake::kStatusOffset;
                 break;
@@ -0,0 +1,184 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "forcewake_manager.h"
+#include "mock/mock_mmio.h"
+#include "registers.h"
+#include "gtest/gtest.h"
+
+constexpr uint32_t kReleaseDelayUs = 10000;
+// In the render domain.
+constexpr uint32_t kRenderRangeOffset = 0x2034;
+// In the GT domain; written by the frequency governor.
+constexpr uint32_t kGtRangeOffset = 0xA008;
+// Not in any forcewake domain.
+constexpr uint32_t kDisplayOffset = 0x44200;
+
+class TestForceWakeManager {
+public:
+    // Acknowledges forcewake requests the way the hardware would.
+    class AckHook : public RegisterIo::Hook {
+    public:
+        AckHook(magma::PlatformMmio* mmio) : mmio_(mmio) {}
+
+        void Write32(uint32_t offset, uint32_t val) override
+        {
+            uint32_t status_offset;
+            if (offset == registers::ForceWake::kRenderOffset) {
+                status_offset = registers::ForceWake::kRenderStatusOffset;
+            } else if (offset == registers::ForceWake::kOffset) {
+                status_offset = registers::ForceWake::kStatusOffset;
+            } else {
+                return;
+            }
+            uint32_t mask = val >> 16;
+            uint32_t status = mmio_->Read32(status_offset);
+            status = (status & ~mask) | (val & mask);
+            mmio_->Write32(status_offset, status);
+        }
+        void Read32(uint32_t offset, uint32_t val) override {}
+        void Read64(uint32_t offset, uint64_t val) override {}
+
+    private:
+        magma::PlatformMmio* mmio_;
+    };
+
+    TestForceWakeManager()
+    {
+        register_io_ =
+            std::unique_ptr<RegisterIo>(new RegisterIo(MockMmio::Create(2 * 1024 * 1024)));
+        register_io_->InstallHook(std::make_unique<AckHook>(register_io_->mmio()));
+
+        auto forcewake = ForceWakeManager::Create(
+            register_io_.get(), {registers::ForceWake::GEN9_RENDER, registers::ForceWake::GEN9_GT},
+            kReleaseDelayUs);
+        forcewake_ = forcewake.get();
+        register_io_->InstallForceWakeHook(std::move(forcewake));
+    }
+
+    bool awake()
+    {
+        return register_io_->mmio()->Read32(registers::ForceWake::kRenderStatusOffset) & 1;
+    }
+
+    bool gt_awake()
+    {
+        return register_io_->mmio()->Read32(registers::ForceWake::kStatusOffset) & 1;
+    }
+
+    void DeferredRelease()
+    {
+        register_io_->Read32(kDisplayOffset);
+        EXPECT_FALSE(awake());
+        EXPECT_EQ(0u, forcewake_->stats().acquire_count);
+
+        register_io_->Write32(kRenderRangeOffset, 0);
+        EXPECT_TRUE(awake());
+        EXPECT_TRUE(forcewake_->release_pending());
+        register_io_->Read32(kRenderRangeOffset);
+        EXPECT_EQ(1u, forcewake_->stats().acquire_count);
+
+        auto start = std::chrono::steady_clock::now();
+        forcewake_->ReleaseIdle(start);
+        EXPECT_TRUE(awake());
+
+        forcewake_->ReleaseIdle(start + std::chrono::microseconds(2 * kReleaseDelayUs));
+        EXPECT_FALSE(awake());
+        EXPECT_FALSE(forcewake_->release_pending());
+
+        ForceWakeManager::Stats stats = forcewake_->stats();
+        EXPECT_EQ(1u, stats.acquire_count);
+        EXPECT_EQ(1u, stats.release_count);
+        EXPECT_GE(stats.max_release_latency_us, kReleaseDelayUs);
+        EXPECT_EQ(stats.max_release_latency_us, stats.total_release_latency_us);
+        EXPECT_GE(stats.awake_us, kReleaseDelayUs);
+
+        register_io_->Read32(kRenderRangeOffset);
+        EXPECT_TRUE(awake());
+        EXPECT_EQ(2u, forcewake_->stats().acquire_count);
+    }
+
+    void ReferenceCount()
+    {
+        uint32_t domains = forcewake_->Acquire(kRenderRangeOffset);
+        EXPECT_NE(0u, domains);
+        EXPECT_EQ(domains, forcewake_->Acquire(kRenderRangeOffset));
+        EXPECT_TRUE(awake());
+        EXPECT_EQ(1u, forcewake_->stats().acquire_count);
+
+        // Register accesses while held don't wake again.
+        register_io_->Read32(kRenderRangeOffset);
+        forcewake_->Release(domains);
+        EXPECT_FALSE(forcewake_->release_pending());
+
+        // Still referenced, so not released however long it's been.
+        forcewake_->ReleaseIdle(std::chrono::steady_clock::now() + std::chrono::seconds(1));
+        EXPECT_TRUE(awake());
+
+        forcewake_->Release(domains);
+        EXPECT_TRUE(forcewake_->release_pending());
+        forcewake_->ReleaseIdle(std::chrono::steady_clock::now() + std::chrono::seconds(1));
+        EXPECT_FALSE(awake());
+        EXPECT_EQ(1u, forcewake_->stats().acquire_count);
+        EXPECT_EQ(1u, forcewake_->stats().release_count);
+    }
+
+    void NoReleaseDelay()
+    {
+        forcewake_->set_release_delay_us(0);
+
+        register_io_->Read32(kRenderRangeOffset);
+        EXPECT_FALSE(awake());
+        EXPECT_FALSE(forcewake_->release_pending());
+
+        register_io_->Read32(kRenderRangeOffset);
+        ForceWakeManager::Stats stats = forcewake_->stats();
+        EXPECT_EQ(2u, stats.acquire_count);
+        EXPECT_EQ(2u, stats.release_count);
+    }
+
+    void GtDomain()
+    {
+        register_io_->Write32(kGtRangeOffset, 0);
+        EXPECT_TRUE(gt_awake());
+        EXPECT_FALSE(awake());
+
+        register_io_->Read32(kRenderRangeOffset);
+        EXPECT_TRUE(awake());
+        EXPECT_EQ(2u, forcewake_->stats().acquire_count);
+
+        forcewake_->ReleaseIdle(std::chrono::steady_clock::now() + std::chrono::seconds(1));
+        EXPECT_FALSE(gt_awake());
+        EXPECT_FALSE(awake());
+        EXPECT_EQ(2u, forcewake_->stats().release_count);
+    }
+
+private:
+    std::unique_ptr<RegisterIo> register_io_;
+    ForceWakeManager* forcewake_;
+};
+
+TEST(ForceWakeManager, DeferredRelease)
+{
+    TestForceWakeManager test;
+    test.DeferredRelease();
+}
+
+TEST(ForceWakeManager, ReferenceCount)
+{
+    TestForceWakeManager test;
+    test.ReferenceCount();
+}
+
+TEST(ForceWakeManager, NoReleaseDelay)
+{
+    TestForceWakeManager test;
+    test.NoReleaseDelay();
+}
+
+TEST(ForceWakeManager, GtDomain)
+{
+    TestForceWakeManager test;
+    test.GtDomain();
+}
@@ -0,0 +1,153 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "frequency_governor.h"
+#include "mock/mock_mmio.h"
+#include "register_tracer.h"
+#include "registers.h"
+#include "gtest/gtest.h"
+
+constexpr uint32_t kRpnMhz = 300;
+constexpr uint32_t kRp1Mhz = 700;
+constexpr uint32_t kRp0Mhz = 1100;
+
+class TestFrequencyGovernor {
+public:
+    using time_point = FrequencyGovernor::time_point;
+
+    TestFrequencyGovernor()
+    {
+        register_io_ =
+            std::unique_ptr<RegisterIo>(new RegisterIo(MockMmio::Create(2 * 1024 * 1024)));
+        register_io_->mmio()->Write32(registers::RenderPerformanceStateCapability::kOffset,
+                                      (kRpnMhz / 50) << 16 | (kRp1Mhz / 50) << 8 | kRp0Mhz / 50);
+        register_io_->InstallHook(std::make_unique<RegisterTracer>());
+
+        governor_ = FrequencyGovernor::Create(register_io_.get());
+        EXPECT_EQ(kRpnMhz, governor_->min_mhz());
+        EXPECT_EQ(kRp0Mhz, governor_->max_mhz());
+
+        start_ = std::chrono::steady_clock::now();
+        governor_->Sample(false, false, start_);
+        EXPECT_EQ(kRpnMhz, governor_->requested_mhz());
+    }
+
+    // Samples every 10ms for |ms|; the engine is |busy| throughout.
+    void Run(uint32_t ms, bool busy)
+    {
+        governor_->Sample(busy, false, start_ + std::chrono::milliseconds(elapsed_ms_));
+        for (uint32_t i = 0; i < ms; i += 10) {
+            elapsed_ms_ += 10;
+            governor_->Sample(busy, false, start_ + std::chrono::milliseconds(elapsed_ms_));
+        }
+    }
+
+    uint32_t request_writes()
+    {
+        uint32_t count = 0;
+        for (auto& op : static_cast<RegisterTracer*>(register_io_->hook())->trace()) {
+            if (op.type == RegisterTracer::Operation::WRITE32 &&
+                op.offset == registers::RenderPerformanceNormalFrequencyRequest::kOffset)
+                count++;
+        }
+        return count;
+    }
+
+    uint32_t request_register_mhz()
+    {
+        return (register_io_->mmio()->Read32(
+                    registers::RenderPerformanceNormalFrequencyRequest::kOffset) >>
+                23) *
+               50 / 3;
+    }
+
+    void StepUpAndDown()
+    {
+        constexpr uint32_t kPeriodMs = FrequencyGovernor::kEvaluationPeriodMs;
+
+        EXPECT_EQ(1u, request_writes());
+        EXPECT_TRUE(governor_->idle());
+
+        // Fully busy steps up one level per evaluation period.
+        Run(kPeriodMs, true);
+        EXPECT_EQ(kRp1Mhz, governor_->requested_mhz());
+        EXPECT_FALSE(governor_->idle());
+        Run(kPeriodMs, true);
+        EXPECT_EQ(kRp0Mhz, governor_->requested_mhz());
+        EXPECT_EQ(3u, request_writes());
+
+        // Unchanged requests aren't rewritten.
+        Run(5 * kPeriodMs, true);
+        EXPECT_EQ(kRp0Mhz, governor_->requested_mhz());
+        EXPECT_EQ(3u, request_writes());
+        EXPECT_EQ(kRp0Mhz / 50, request_register_mhz() / 50);
+
+        // Moderate load holds the current level.
+        for (uint32_t i = 0; i < 5; i++) {
+            Run(kPeriodMs * 6 / 10, true);
+            Run(kPeriodMs * 4 / 10, false);
+        }
+        EXPECT_EQ(kRp0Mhz, governor_->requested_mhz());
+        EXPECT_EQ(3u, request_writes());
+
+        // Idle steps down one level per evaluation period.
+        Run(kPeriodMs, false);
+        EXPECT_EQ(kRp1Mhz, governor_->requested_mhz());
+        Run(kPeriodMs, false);
+        EXPECT_EQ(kRpnMhz, governor_->requested_mhz());
+        EXPECT_TRUE(governor_->idle());
+        Run(kPeriodMs, false);
+        EXPECT_EQ(kRpnMhz, governor_->requested_mhz());
+        EXPECT_EQ(5u, request_writes());
+    }
+
+    void Boost()
+    {
+        governor_->BeginBoost();
+        governor_->BeginBoost();
+        EXPECT_FALSE(governor_->idle());
+        Run(10, false);
+        EXPECT_EQ(kRp0Mhz, governor_->requested_mhz());
+
+        // Boost holds RP0 regardless of load.
+        Run(5 * FrequencyGovernor::kEvaluationPeriodMs, false);
+        EXPECT_EQ(kRp0Mhz, governor_->requested_mhz());
+        EXPECT_EQ(2u, request_writes());
+
+        governor_->EndBoost();
+        Run(10, false);
+        EXPECT_EQ(kRp0Mhz, governor_->requested_mhz());
+
+        governor_->EndBoost();
+        Run(10, false);
+        EXPECT_EQ(kRpnMhz, governor_->requested_mhz());
+        EXPECT_TRUE(governor_->idle());
+
+        // Boosting for a single sample.
+        elapsed_ms_ += 10;
+        governor_->Sample(false, true, start_ + std::chrono::milliseconds(elapsed_ms_));
+        EXPECT_EQ(kRp0Mhz, governor_->requested_mhz());
+        Run(10, false);
+        EXPECT_EQ(kRpnMhz, governor_->requested_mhz());
+        EXPECT_EQ(5u, request_writes());
+    }
+
+private:
+    std::unique_ptr<RegisterIo> register_io_;
+    std::unique_ptr<FrequencyGovernor> governor_;
+    time_point start_;
+    uint32_t elapsed_ms_ = 0;
+};
+
+TEST(FrequencyGovernor, StepUpAndDown)
+{
+    TestFrequencyGovernor test;
+    test.StepUpAndDown();
+}
+
+TEST(FrequencyGovernor, Boost)
+{
+    TestFrequencyGovernor test;
+    test.Boost();
+}
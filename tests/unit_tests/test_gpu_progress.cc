@@ -0,0 +1,109 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "gpu_progress.h"
+#include "gtest/gtest.h"
+
+class TestGpuProgress {
+public:
+    using time_point = GpuProgress::time_point;
+
+    static void Idle()
+    {
+        GpuProgress progress;
+        time_point start = std::chrono::steady_clock::now();
+
+        EXPECT_FALSE(progress.work_outstanding());
+        EXPECT_FALSE(progress.CheckForHang(0, 0, start + std::chrono::seconds(10)));
+    }
+
+    static void SequenceProgress()
+    {
+        GpuProgress progress;
+        time_point start = std::chrono::steady_clock::now();
+
+        progress.Submitted(1, 20, start);
+        progress.Submitted(2, 20, start);
+        EXPECT_TRUE(progress.work_outstanding());
+
+        EXPECT_FALSE(progress.CheckForHang(0, 0x1000, start + std::chrono::milliseconds(10)));
+
+        // Sequence 1 completes, resetting the budget for sequence 2.
+        EXPECT_FALSE(progress.CheckForHang(1, 0x1000, start + std::chrono::milliseconds(25)));
+        EXPECT_FALSE(progress.CheckForHang(1, 0x1000, start + std::chrono::milliseconds(40)));
+        EXPECT_TRUE(progress.CheckForHang(1, 0x1000, start + std::chrono::milliseconds(50)));
+
+        progress.Completed(2, start + std::chrono::milliseconds(60));
+        EXPECT_FALSE(progress.work_outstanding());
+        EXPECT_FALSE(progress.CheckForHang(2, 0x1000, start + std::chrono::milliseconds(100)));
+    }
+
+    static void ActiveHeadProgress()
+    {
+        GpuProgress progress;
+        time_point start = std::chrono::steady_clock::now();
+
+        progress.Submitted(1, 20, start);
+
+        // The active head moving counts as progress even if no sequence completes.
+        for (uint32_t i = 1; i <= 10; i++) {
+            EXPECT_FALSE(progress.CheckForHang(0, 0x1000 + i * 0x10,
+                                               start + std::chrono::milliseconds(i * 15)));
+        }
+
+        EXPECT_FALSE(progress.CheckForHang(0, 0x1000 + 10 * 0x10,
+                                           start + std::chrono::milliseconds(160)));
+        EXPECT_TRUE(progress.CheckForHang(0, 0x1000 + 10 * 0x10,
+                                          start + std::chrono::milliseconds(175)));
+    }
+
+    static void Budget()
+    {
+        GpuProgress progress;
+        time_point start = std::chrono::steady_clock::now();
+
+        // A long compute job with a large budget isn't declared hung.
+        progress.Submitted(1, 5000, start);
+        progress.Submitted(2, 20, start);
+
+        EXPECT_FALSE(progress.CheckForHang(0, 0x1000, start));
+        EXPECT_FALSE(progress.CheckForHang(0, 0x1000, start + std::chrono::seconds(4)));
+        EXPECT_TRUE(progress.CheckForHang(0, 0x1000, start + std::chrono::seconds(6)));
+
+        // Once it completes, the next sequence's budget applies.
+        EXPECT_FALSE(progress.CheckForHang(1, 0x1000, start + std::chrono::seconds(7)));
+        EXPECT_TRUE(progress.CheckForHang(
+            1, 0x1000, start + std::chrono::seconds(7) + std::chrono::milliseconds(30)));
+    }
+
+    static void Reset()
+    {
+        GpuProgress progress;
+        time_point start = std::chrono::steady_clock::now();
+
+        progress.Submitted(1, 20, start);
+        progress.Submitted(2, 20, start);
+        EXPECT_FALSE(progress.CheckForHang(0, 0x1000, start));
+        EXPECT_TRUE(progress.CheckForHang(0, 0x1000, start + std::chrono::milliseconds(30)));
+
+        // Sequence 1 completed before the reset; sequence 2 is resubmitted later, and its budget
+        // starts then.
+        progress.Reset(1);
+        EXPECT_FALSE(progress.work_outstanding());
+        progress.Submitted(2, 20, start + std::chrono::milliseconds(100));
+        EXPECT_FALSE(progress.CheckForHang(1, 0x1000, start + std::chrono::milliseconds(100)));
+        EXPECT_FALSE(progress.CheckForHang(1, 0x1000, start + std::chrono::milliseconds(115)));
+        EXPECT_TRUE(progress.CheckForHang(1, 0x1000, start + std::chrono::milliseconds(125)));
+    }
+};
+
+TEST(GpuProgress, Idle) { TestGpuProgress::Idle(); }
+
+TEST(GpuProgress, SequenceProgress) { TestGpuProgress::SequenceProgress(); }
+
+TEST(GpuProgress, ActiveHeadProgress) { TestGpuProgress::ActiveHeadProgress(); }
+
+TEST(GpuProgress, Budget) { TestGpuProgress::Budget(); }
+
+TEST(GpuProgress, Reset) { TestGpuProgress::Reset(); }
@@ -101,7 +101,7 @@ public:
         platform_device =
             std::unique_ptr<MockPlatformPciDevice>(new MockPlatformPciDevice(reg_size + gtt_size));
         reg_io = std::unique_ptr<RegisterIo>(new RegisterIo(MockMmio::Create(reg_size)));
-        gtt = std::unique_ptr<Gtt>(new Gtt(GpuMappingCache::Create()));
+        gtt = std::unique_ptr<Gtt>(new Gtt(GpuMappingCache::Create(), BusMapper::Platform()));
 
         bool ret = gtt->Init(gtt_size, platform_device.get());
         EXPECT_TRUE(ret);
@@ -127,7 +127,7 @@ public:
         platform_device =
             std::shared_ptr<MockPlatformPciDevice>(new MockPlatformPciDevice(bar0_size));
         reg_io = std::unique_ptr<RegisterIo>(new RegisterIo(MockMmio::Create(bar0_size)));
-        gtt = std::unique_ptr<Gtt>(new Gtt(GpuMappingCache::Create()));
+        gtt = std::unique_ptr<Gtt>(new Gtt(GpuMappingCache::Create(), BusMapper::Platform()));
 
         bool ret = gtt->Init(gtt_size, platform_device.get());
         EXPECT_EQ(ret, true);
@@ -149,7 +149,8 @@ public:
         EXPECT_EQ(ret, true);
 
         // Try to insert without pinning
-        ret = gtt->Insert(addr[0], buffer[0].get(), 0, buffer[0]->size(), CACHING_NONE);
+        ret = gtt->Insert(addr[0], buffer[0].get(), 0, buffer[0]->size(), CACHING_NONE,
+                          LRU_AGE_FROM_UNCORE);
         EXPECT_EQ(ret, false);
 
         ret = buffer[0]->PinPages(0, buffer[0]->size() / PAGE_SIZE);
@@ -158,22 +159,26 @@ public:
         EXPECT_EQ(ret, true);
 
         // Mismatch addr and buffer
-        ret = gtt->Insert(addr[1], buffer[0].get(), 0, buffer[0]->size(), CACHING_NONE);
+        ret = gtt->Insert(addr[1], buffer[0].get(), 0, buffer[0]->size(), CACHING_NONE,
+                          LRU_AGE_FROM_UNCORE);
         EXPECT_EQ(ret, false);
 
         // Totally bogus addr
-        ret = gtt->Insert(0xdead1000, buffer[0].get(), 0, buffer[0]->size(), CACHING_NONE);
+        ret = gtt->Insert(0xdead1000, buffer[0].get(), 0, buffer[0]->size(), CACHING_NONE,
+                          LRU_AGE_FROM_UNCORE);
         EXPECT_EQ(ret, false);
 
         // Correct
-        ret = gtt->Insert(addr[0], buffer[0].get(), 0, buffer[0]->size(), CACHING_NONE);
+        ret = gtt->Insert(addr[0], buffer[0].get(), 0, buffer[0]->size(), CACHING_NONE,
+                          LRU_AGE_FROM_UNCORE);
         EXPECT_EQ(ret, true);
 
         check_pte_entries(platform_device->mmio(), buffer[0].get(), addr[0], scratch_bus_addr,
                           CACHING_NONE);
 
         // Also correct
-        ret = gtt->Insert(addr[1], buffer[1].get(), 0, buffer[1]->size(), CACHING_NONE);
+        ret = gtt->Insert(addr[1], buffer[1].get(), 0, buffer[1]->size(), CACHING_NONE,
+                          LRU_AGE_FROM_UNCORE);
         EXPECT_EQ(ret, true);
 
         check_pte_entries(platform_device->mmio(), buffer[1].get(), addr[1], scratch_bus_addr,
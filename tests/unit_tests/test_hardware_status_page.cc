@@ -4,6 +4,7 @@
 
 #include "hardware_status_page.h"
 #include "gtest/gtest.h"
+#include <string.h>
 
 using unique_ptr_void_free = std::unique_ptr<void, decltype(&free)>;
 
@@ -25,6 +26,36 @@ public:
         EXPECT_EQ(status_page->read_sequence_number(), val + 1);
     }
 
+    void Timestamps()
+    {
+        auto status_page = std::unique_ptr<HardwareStatusPage>(new HardwareStatusPage(this, id_));
+
+        // Slots are qword aligned, clear of the sequence number and within the page.
+        EXPECT_EQ(0u, HardwareStatusPage::timestamp_offset(0, false) % sizeof(uint64_t));
+        EXPECT_GE(HardwareStatusPage::timestamp_offset(0, false),
+                  HardwareStatusPage::kSequenceNumberOffset + sizeof(uint32_t));
+        EXPECT_LT(
+            HardwareStatusPage::timestamp_offset(HardwareStatusPage::kTimestampSlotCount - 1, true),
+            0x400u);
+
+        // As the gpu writes them.
+        uint32_t slot = 3;
+        uint64_t start = 0x123456789a;
+        uint64_t end = 0x123456abcd;
+        auto cpu_addr = reinterpret_cast<uint8_t*>(cpu_addr_.get());
+        memcpy(cpu_addr + HardwareStatusPage::timestamp_offset(slot, false), &start, sizeof(start));
+        memcpy(cpu_addr + HardwareStatusPage::timestamp_offset(slot, true), &end, sizeof(end));
+
+        EXPECT_EQ(start, status_page->read_timestamp(slot, false));
+        EXPECT_EQ(end, status_page->read_timestamp(slot, true));
+
+        status_page->write_sequence_number(0xabcd1234);
+        status_page->clear_timestamps(slot);
+        EXPECT_EQ(0u, status_page->read_timestamp(slot, false));
+        EXPECT_EQ(0u, status_page->read_timestamp(slot, true));
+        EXPECT_EQ(0xabcd1234u, status_page->read_sequence_number());
+    }
+
 private:
     void* hardware_status_page_cpu_addr(EngineCommandStreamerId id) override
     {
@@ -48,3 +79,9 @@ TEST(HardwareStatusPage, ReadWrite)
     TestHardwareStatusPage test;
     test.ReadWrite();
 }
+
+TEST(HardwareStatusPage, Timestamps)
+{
+    TestHardwareStatusPage test;
+    test.Timestamps();
+}
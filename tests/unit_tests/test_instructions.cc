@@ -92,6 +92,45 @@ public:
         EXPECT_EQ(0u, *vaddr++);
     }
 
+    void PipeControlTimestamp()
+    {
+        uint32_t tail_start = ringbuffer_->tail();
+
+        uint32_t* vaddr = TestRingbuffer::vaddr(ringbuffer_.get()) + tail_start / 4;
+
+        gpu_addr_t gpu_addr = 0xabcd1234cafebee8;
+
+        MiPipeControl::write_timestamp(ringbuffer_.get(), gpu_addr,
+                                       MiPipeControl::kCommandStreamerStallEnableBit);
+
+        EXPECT_EQ(ringbuffer_->tail() - tail_start, MiPipeControl::kDwordCount * sizeof(uint32_t));
+        EXPECT_EQ(0x7A000000u | (MiPipeControl::kDwordCount - 2), *vaddr++);
+        EXPECT_EQ(0x0110C000u, *vaddr++);
+        EXPECT_EQ(magma::lower_32_bits(gpu_addr), *vaddr++);
+        EXPECT_EQ(magma::upper_32_bits(gpu_addr), *vaddr++);
+        EXPECT_EQ(0u, *vaddr++);
+        EXPECT_EQ(0u, *vaddr++);
+    }
+
+    void SemaphoreWait()
+    {
+        uint32_t tail_start = ringbuffer_->tail();
+
+        uint32_t* vaddr = TestRingbuffer::vaddr(ringbuffer_.get()) + tail_start / 4;
+
+        gpu_addr_t gpu_addr = 0xabcd1234cafebeef;
+        uint32_t sequence_number = 0xdeadbeef;
+
+        MiSemaphoreWait::write(ringbuffer_.get(), sequence_number, gpu_addr);
+
+        EXPECT_EQ(ringbuffer_->tail() - tail_start,
+                  MiSemaphoreWait::kDwordCount * sizeof(uint32_t));
+        EXPECT_EQ(0x0E409002u, *vaddr++);
+        EXPECT_EQ(sequence_number, *vaddr++);
+        EXPECT_EQ(magma::lower_32_bits(gpu_addr), *vaddr++);
+        EXPECT_EQ(magma::upper_32_bits(gpu_addr), *vaddr++);
+    }
+
 private:
     // order of destruction important so gpu mappings can access the address space
     std::shared_ptr<AddressSpace> address_space_;
@@ -115,3 +154,15 @@ TEST(Instructions, PipeControl)
     TestInstructions test;
     test.PipeControl();
 }
+
+TEST(Instructions, PipeControlTimestamp)
+{
+    TestInstructions test;
+    test.PipeControlTimestamp();
+}
+
+TEST(Instructions, SemaphoreWait)
+{
+    TestInstructions test;
+    test.SemaphoreWait();
+}
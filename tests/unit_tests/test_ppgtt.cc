@@ -10,16 +10,31 @@
 
 class TestPerProcessGtt {
 public:
-    static uint32_t cache_bits(CachingType caching_type)
+    // PWT, PCD and PAT select the private PAT index.
+    static constexpr uint64_t kPatIndexMask = (1 << 3) | (1 << 4) | (1 << 7);
+
+    static uint64_t pat_bits(CachingType caching_type, LruAge lru_age)
     {
         switch (caching_type) {
             case CACHING_NONE:
                 return (1 << 3) | (1 << 4); // 3
             case CACHING_WRITE_THROUGH:
-                return (1 << 4); // 3
+                return (1 << 4); // 2
+            case CACHING_WRITE_COMBINING:
+                return (1 << 3); // 1
             case CACHING_LLC:
-                return 1 << 7; // 4
+                switch (lru_age) {
+                    case LRU_AGE_FROM_UNCORE:
+                        return 1 << 7; // 4
+                    case LRU_AGE_ZERO:
+                        return (1 << 7) | (1 << 3); // 5
+                    case LRU_AGE_NO_CHANGE:
+                        return (1 << 7) | (1 << 4); // 6
+                    case LRU_AGE_THREE:
+                        return (1 << 7) | (1 << 4) | (1 << 3); // 7
+                }
         }
+        return 0;
     }
 
     static gen_pte_t get_pte(PerProcessGtt* ppgtt, gpu_addr_t gpu_addr)
@@ -50,13 +65,13 @@ public:
             EXPECT_EQ(pte & ~(PAGE_SIZE - 1), bus_addr);
             EXPECT_TRUE(pte & (1 << 0));  // present
             EXPECT_FALSE(pte & (1 << 1)); // not writeable
-            EXPECT_EQ(pte & cache_bits(CACHING_NONE), cache_bits(CACHING_NONE));
+            EXPECT_EQ(pte & kPatIndexMask, pat_bits(CACHING_NONE, LRU_AGE_FROM_UNCORE));
         }
     }
 
     static void check_pte_entries(PerProcessGtt* ppgtt, magma::PlatformBuffer* buffer,
                                   uint64_t gpu_addr, uint64_t scratch_bus_addr,
-                                  CachingType caching_type)
+                                  CachingType caching_type, LruAge lru_age)
     {
         ASSERT_NE(ppgtt, nullptr);
 
@@ -78,7 +93,11 @@ public:
 
             EXPECT_TRUE(pte & (1 << 0));
             EXPECT_EQ(static_cast<bool>(pte & (1 << 1)), i < page_count); // writeable
-            EXPECT_EQ(pte & cache_bits(caching_type), cache_bits(caching_type));
+            if (i < page_count) {
+                EXPECT_EQ(pte & kPatIndexMask, pat_bits(caching_type, lru_age));
+            } else {
+                EXPECT_EQ(pte & kPatIndexMask, pat_bits(CACHING_NONE, LRU_AGE_FROM_UNCORE));
+            }
         }
         EXPECT_TRUE(buffer->UnmapPageRangeBus(0, page_count));
     }
@@ -98,7 +117,8 @@ public:
     {
         auto scratch_buffer = get_scratch_buffer();
 
-        auto ppgtt = PerProcessGtt::Create(scratch_buffer, GpuMappingCache::Create());
+        auto ppgtt = PerProcessGtt::Create(scratch_buffer, GpuMappingCache::Create(),
+                                           BusMapper::Platform());
 
         EXPECT_TRUE(ppgtt->Init());
 
@@ -114,7 +134,8 @@ public:
     {
         auto scratch_buffer = get_scratch_buffer();
 
-        auto ppgtt = PerProcessGtt::Create(scratch_buffer, GpuMappingCache::Create());
+        auto ppgtt = PerProcessGtt::Create(scratch_buffer, GpuMappingCache::Create(),
+                                           BusMapper::Platform());
         EXPECT_TRUE(ppgtt->Init());
 
         uint64_t scratch_bus_addr;
@@ -131,27 +152,33 @@ public:
         EXPECT_TRUE(ppgtt->Alloc(buffer[1]->size(), 0, &addr[1]));
 
         // Try to insert without pinning
-        EXPECT_FALSE(ppgtt->Insert(addr[0], buffer[0].get(), 0, buffer[0]->size(), CACHING_NONE));
+        EXPECT_FALSE(ppgtt->Insert(addr[0], buffer[0].get(), 0, buffer[0]->size(), CACHING_NONE,
+                                   LRU_AGE_FROM_UNCORE));
 
         EXPECT_TRUE(buffer[0]->PinPages(0, buffer[0]->size() / PAGE_SIZE));
         EXPECT_TRUE(buffer[1]->PinPages(0, buffer[1]->size() / PAGE_SIZE));
 
         // Mismatch addr and buffer
-        EXPECT_FALSE(ppgtt->Insert(addr[1], buffer[0].get(), 0, buffer[0]->size(), CACHING_NONE));
+        EXPECT_FALSE(ppgtt->Insert(addr[1], buffer[0].get(), 0, buffer[0]->size(), CACHING_NONE,
+                                   LRU_AGE_FROM_UNCORE));
 
         // Totally bogus addr
-        EXPECT_FALSE(
-            ppgtt->Insert(0xdead1000, buffer[0].get(), 0, buffer[0]->size(), CACHING_NONE));
+        EXPECT_FALSE(ppgtt->Insert(0xdead1000, buffer[0].get(), 0, buffer[0]->size(),
+                                   CACHING_NONE, LRU_AGE_FROM_UNCORE));
 
         // Correct
-        EXPECT_TRUE(ppgtt->Insert(addr[0], buffer[0].get(), 0, buffer[0]->size(), CACHING_NONE));
+        EXPECT_TRUE(ppgtt->Insert(addr[0], buffer[0].get(), 0, buffer[0]->size(), CACHING_NONE,
+                                  LRU_AGE_FROM_UNCORE));
 
-        check_pte_entries(ppgtt.get(), buffer[0].get(), addr[0], scratch_bus_addr, CACHING_NONE);
+        check_pte_entries(ppgtt.get(), buffer[0].get(), addr[0], scratch_bus_addr, CACHING_NONE,
+                          LRU_AGE_FROM_UNCORE);
 
         // Also correct
-        EXPECT_TRUE(ppgtt->Insert(addr[1], buffer[1].get(), 0, buffer[1]->size(), CACHING_NONE));
+        EXPECT_TRUE(ppgtt->Insert(addr[1], buffer[1].get(), 0, buffer[1]->size(), CACHING_NONE,
+                                  LRU_AGE_FROM_UNCORE));
 
-        check_pte_entries(ppgtt.get(), buffer[1].get(), addr[1], scratch_bus_addr, CACHING_NONE);
+        check_pte_entries(ppgtt.get(), buffer[1].get(), addr[1], scratch_bus_addr, CACHING_NONE,
+                          LRU_AGE_FROM_UNCORE);
 
         // Bogus addr
         EXPECT_FALSE(ppgtt->Clear(0xdead1000));
@@ -175,6 +202,44 @@ public:
         EXPECT_TRUE(scratch_buffer->UnmapPageRangeBus(0, 1));
     }
 
+    static void InsertPatIndex()
+    {
+        auto scratch_buffer = get_scratch_buffer();
+
+        auto ppgtt = PerProcessGtt::Create(scratch_buffer, GpuMappingCache::Create(),
+                                           BusMapper::Platform());
+        EXPECT_TRUE(ppgtt->Init());
+
+        uint64_t scratch_bus_addr;
+        EXPECT_TRUE(scratch_buffer->MapPageRangeBus(0, 1, &scratch_bus_addr));
+
+        auto buffer = magma::PlatformBuffer::Create(PAGE_SIZE * 2, "test");
+        EXPECT_TRUE(buffer->PinPages(0, buffer->size() / PAGE_SIZE));
+
+        uint64_t addr;
+        EXPECT_TRUE(ppgtt->Alloc(buffer->size(), 0, &addr));
+
+        const std::vector<std::pair<CachingType, LruAge>> policies = {
+            {CACHING_NONE, LRU_AGE_FROM_UNCORE},
+            {CACHING_WRITE_THROUGH, LRU_AGE_FROM_UNCORE},
+            {CACHING_WRITE_COMBINING, LRU_AGE_FROM_UNCORE},
+            {CACHING_LLC, LRU_AGE_FROM_UNCORE},
+            {CACHING_LLC, LRU_AGE_ZERO},
+            {CACHING_LLC, LRU_AGE_NO_CHANGE},
+            {CACHING_LLC, LRU_AGE_THREE}};
+
+        for (auto& policy : policies) {
+            EXPECT_TRUE(
+                ppgtt->Insert(addr, buffer.get(), 0, buffer->size(), policy.first, policy.second));
+            check_pte_entries(ppgtt.get(), buffer.get(), addr, scratch_bus_addr, policy.first,
+                              policy.second);
+            EXPECT_TRUE(ppgtt->Clear(addr));
+        }
+
+        EXPECT_TRUE(ppgtt->Free(addr));
+        EXPECT_TRUE(scratch_buffer->UnmapPageRangeBus(0, 1));
+    }
+
     static void PrivatePat()
     {
         auto reg_io =
@@ -191,4 +256,6 @@ TEST(PerProcessGtt, Init) { TestPerProcessGtt::Init(); }
 
 TEST(PerProcessGtt, Insert) { TestPerProcessGtt::Insert(); }
 
+TEST(PerProcessGtt, InsertPatIndex) { TestPerProcessGtt::InsertPatIndex(); }
+
 TEST(PerProcessGtt, PrivatePat) { TestPerProcessGtt::PrivatePat(); }
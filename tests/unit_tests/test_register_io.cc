@@ -0,0 +1,119 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "mock/mock_mmio.h"
+#include "register_io.h"
+#include "register_profiler.h"
+#include "register_tracer.h"
+#include "gtest/gtest.h"
+
+constexpr uint32_t kShadowedOffset = 0x70180;
+constexpr uint32_t kOffset = 0x70184;
+
+class TestRegisterIo {
+public:
+    TestRegisterIo()
+    {
+        register_io_ = std::unique_ptr<RegisterIo>(new RegisterIo(MockMmio::Create(1024 * 1024)));
+        register_io_->ShadowRegister(kShadowedOffset);
+        auto tracer = std::make_unique<RegisterTracer>();
+        tracer_ = tracer.get();
+        register_io_->InstallHook(std::move(tracer));
+    }
+
+    void ShadowedWrite()
+    {
+        register_io_->Write32(kShadowedOffset, 1);
+        register_io_->Write32(kShadowedOffset, 1);
+        register_io_->Write32(kShadowedOffset, 2);
+        register_io_->Write32(kShadowedOffset, 2);
+        EXPECT_EQ(2u, register_io_->Read32(kShadowedOffset));
+        EXPECT_EQ(2u, register_io_->mmio()->Read32(kShadowedOffset));
+
+        // Only the writes that changed the value reached the hardware, and the read was served
+        // from the shadow.
+        ASSERT_EQ(2u, tracer_->trace().size());
+        EXPECT_EQ(RegisterTracer::Operation::WRITE32, tracer_->trace()[0].type);
+        EXPECT_EQ(1u, tracer_->trace()[0].val);
+        EXPECT_EQ(RegisterTracer::Operation::WRITE32, tracer_->trace()[1].type);
+        EXPECT_EQ(2u, tracer_->trace()[1].val);
+    }
+
+    void ShadowedRead()
+    {
+        register_io_->mmio()->Write32(kShadowedOffset, 0xabcd);
+
+        // The first read fills the shadow.
+        EXPECT_EQ(0xabcdu, register_io_->Read32(kShadowedOffset));
+        EXPECT_EQ(0xabcdu, register_io_->Read32(kShadowedOffset));
+        register_io_->Write32(kShadowedOffset, 0xabcd);
+
+        ASSERT_EQ(1u, tracer_->trace().size());
+        EXPECT_EQ(RegisterTracer::Operation::READ32, tracer_->trace()[0].type);
+        EXPECT_EQ(kShadowedOffset, tracer_->trace()[0].offset);
+    }
+
+    void NotShadowed()
+    {
+        register_io_->Write32(kOffset, 1);
+        register_io_->Write32(kOffset, 1);
+        EXPECT_EQ(1u, register_io_->Read32(kOffset));
+        EXPECT_EQ(1u, register_io_->Read32(kOffset));
+
+        EXPECT_EQ(4u, tracer_->trace().size());
+    }
+
+    void ChainedHooks()
+    {
+        auto tracer = std::make_unique<RegisterTracer>();
+        RegisterTracer* second_tracer = tracer.get();
+        register_io_->InstallHook(std::move(tracer));
+        auto profiler = std::make_unique<RegisterProfiler>();
+        RegisterProfiler* profiler_ptr = profiler.get();
+        register_io_->InstallHook(std::move(profiler));
+
+        for (uint32_t i = 0; i < RegisterProfiler::kSampleInterval; i++) {
+            register_io_->Write32(kOffset, i);
+        }
+        EXPECT_EQ(RegisterProfiler::kSampleInterval - 1, register_io_->Read32(kOffset));
+
+        // Every hook saw every access.
+        EXPECT_EQ(RegisterProfiler::kSampleInterval + 1, tracer_->trace().size());
+        EXPECT_EQ(RegisterProfiler::kSampleInterval + 1, second_tracer->trace().size());
+        EXPECT_EQ(RegisterTracer::Operation::READ32, second_tracer->trace().back().type);
+        auto registers = profiler_ptr->TopRegisters(1);
+        ASSERT_EQ(1u, registers.size());
+        EXPECT_EQ(kOffset, registers[0].offset);
+        EXPECT_EQ(RegisterProfiler::kSampleInterval, registers[0].write_count);
+        EXPECT_EQ(1u, registers[0].read_count);
+    }
+
+private:
+    std::unique_ptr<RegisterIo> register_io_;
+    RegisterTracer* tracer_;
+};
+
+TEST(RegisterIo, ShadowedWrite)
+{
+    TestRegisterIo test;
+    test.ShadowedWrite();
+}
+
+TEST(RegisterIo, ShadowedRead)
+{
+    TestRegisterIo test;
+    test.ShadowedRead();
+}
+
+TEST(RegisterIo, NotShadowed)
+{
+    TestRegisterIo test;
+    test.NotShadowed();
+}
+
+TEST(RegisterIo, ChainedHooks)
+{
+    TestRegisterIo test;
+    test.ChainedHooks();
+}
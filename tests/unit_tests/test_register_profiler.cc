@@ -0,0 +1,80 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "mock/mock_mmio.h"
+#include "register_profiler.h"
+#include "gtest/gtest.h"
+
+class TestRegisterProfiler {
+public:
+    TestRegisterProfiler()
+    {
+        register_io_ = std::unique_ptr<RegisterIo>(new RegisterIo(MockMmio::Create(1024 * 1024)));
+        auto profiler = std::make_unique<RegisterProfiler>();
+        profiler_ = profiler.get();
+        register_io_->InstallHook(std::move(profiler));
+    }
+
+    void Counts()
+    {
+        for (uint32_t i = 0; i < 10; i++) {
+            register_io_->Read32(0x2034);
+        }
+        for (uint32_t i = 0; i < 5; i++) {
+            register_io_->Write32(0x2030, i);
+            register_io_->Read32(0x2030);
+        }
+        register_io_->Read64(0x4400);
+
+        auto registers = profiler_->TopRegisters(2);
+        ASSERT_EQ(2u, registers.size());
+        EXPECT_EQ(0x2034u, registers[0].offset);
+        EXPECT_EQ(10u, registers[0].read_count);
+        EXPECT_EQ(0u, registers[0].write_count);
+        EXPECT_EQ(0x2030u, registers[1].offset);
+        EXPECT_EQ(5u, registers[1].read_count);
+        EXPECT_EQ(5u, registers[1].write_count);
+
+        registers = profiler_->TopRegisters(10);
+        ASSERT_EQ(3u, registers.size());
+        EXPECT_EQ(0x4400u, registers[2].offset);
+        EXPECT_EQ(1u, registers[2].read_count);
+        EXPECT_EQ(0u, profiler_->untracked_count());
+
+        // One in every kSampleInterval accesses is timed.
+        uint64_t timed_count = 0;
+        for (auto& entry : profiler_->table_) {
+            timed_count += entry.timed_count;
+        }
+        EXPECT_EQ((21u + RegisterProfiler::kSampleInterval - 1) / RegisterProfiler::kSampleInterval,
+                  timed_count);
+    }
+
+    void TableFull()
+    {
+        // Offsets that all hash to the same entry.
+        constexpr uint32_t kStride = RegisterProfiler::kTableSize * 4;
+        for (uint32_t i = 0; i <= RegisterProfiler::kMaxProbes; i++) {
+            register_io_->Read32(i * kStride);
+        }
+        EXPECT_EQ(RegisterProfiler::kMaxProbes, profiler_->TopRegisters(100).size());
+        EXPECT_EQ(1u, profiler_->untracked_count());
+    }
+
+private:
+    std::unique_ptr<RegisterIo> register_io_;
+    RegisterProfiler* profiler_;
+};
+
+TEST(RegisterProfiler, Counts)
+{
+    TestRegisterProfiler test;
+    test.Counts();
+}
+
+TEST(RegisterProfiler, TableFull)
+{
+    TestRegisterProfiler test;
+    test.TableFull();
+}
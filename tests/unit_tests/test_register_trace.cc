@@ -0,0 +1,225 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "mock/mock_mmio.h"
+#include "mock/register_trace_replayer.h"
+#include "register_trace.h"
+#include "registers.h"
+#include "gtest/gtest.h"
+
+constexpr uint32_t kDeviceId = 0x1916;
+// 8MB gtt
+constexpr uint16_t kGmchGraphicsControl = 3 << registers::GmchGraphicsControl::kGttSizeShift;
+
+class TestRegisterTrace {
+public:
+    // Records a few accesses, with reads returning |read_value|.
+    static std::vector<uint8_t> Record(uint32_t read_value, uint32_t capacity_bytes = 4096)
+    {
+        RegisterIo register_io(MockMmio::Create(1024 * 1024));
+        register_io.mmio()->Write32(0x2034, read_value);
+        register_io.mmio()->Write64(0x4400, 0x1122334455667788);
+
+        auto recorder = std::make_unique<RegisterTraceRecorder>(kDeviceId, kGmchGraphicsControl,
+                                                                capacity_bytes);
+        RegisterTraceRecorder* recorder_ptr = recorder.get();
+        register_io.InstallHook(std::move(recorder));
+
+        register_io.Write32(0x2030, 0xabcd);
+        register_io.Read32(0x2034);
+        register_io.Read64(0x4400);
+        register_io.Write32(0x2030, 0x1234);
+
+        return recorder_ptr->Serialize();
+    }
+
+    void RecordAndParse()
+    {
+        std::vector<uint8_t> data = Record(0x5678);
+        // Header, three 3 dword records and a 4 dword record.
+        EXPECT_EQ((4u + 3 * 3 + 4) * sizeof(uint32_t), data.size());
+
+        auto trace = RegisterTrace::Parse(data);
+        ASSERT_NE(nullptr, trace);
+        EXPECT_EQ(kDeviceId, trace->device_id());
+        EXPECT_EQ(kGmchGraphicsControl, trace->gmch_graphics_control());
+
+        auto& operations = trace->operations();
+        ASSERT_EQ(4u, operations.size());
+        EXPECT_EQ(RegisterTrace::Operation::WRITE32, operations[0].type);
+        EXPECT_EQ(0x2030u, operations[0].offset);
+        EXPECT_EQ(0xabcdu, operations[0].val);
+        EXPECT_EQ(0u, operations[0].timestamp_ns);
+        EXPECT_EQ(RegisterTrace::Operation::READ32, operations[1].type);
+        EXPECT_EQ(0x2034u, operations[1].offset);
+        EXPECT_EQ(0x5678u, operations[1].val);
+        EXPECT_EQ(RegisterTrace::Operation::READ64, operations[2].type);
+        EXPECT_EQ(0x4400u, operations[2].offset);
+        EXPECT_EQ(0x1122334455667788u, operations[2].val);
+        EXPECT_EQ(RegisterTrace::Operation::WRITE32, operations[3].type);
+        EXPECT_EQ(0x1234u, operations[3].val);
+        for (uint32_t i = 1; i < operations.size(); i++) {
+            EXPECT_GE(operations[i].timestamp_ns, operations[i - 1].timestamp_ns);
+        }
+
+        // Truncated, and not a trace.
+        data.pop_back();
+        EXPECT_EQ(nullptr, RegisterTrace::Parse(data));
+        data.resize(data.size() - 3);
+        EXPECT_EQ(nullptr, RegisterTrace::Parse(data));
+        data[0] = 0;
+        EXPECT_EQ(nullptr, RegisterTrace::Parse(data));
+    }
+
+    void Capacity()
+    {
+        RegisterIo register_io(MockMmio::Create(1024 * 1024));
+        // Room for the header and two 32 bit records.
+        auto recorder = std::make_unique<RegisterTraceRecorder>(
+            kDeviceId, kGmchGraphicsControl, (4 + 2 * 3) * sizeof(uint32_t));
+        RegisterTraceRecorder* recorder_ptr = recorder.get();
+        register_io.InstallHook(std::move(recorder));
+
+        for (uint32_t i = 0; i < 5; i++) {
+            register_io.Write32(0x2030, i);
+        }
+        EXPECT_EQ(2u, recorder_ptr->record_count());
+        EXPECT_EQ(3u, recorder_ptr->dropped_count());
+
+        auto trace = RegisterTrace::Parse(recorder_ptr->Serialize());
+        ASSERT_NE(nullptr, trace);
+        EXPECT_EQ(2u, trace->operations().size());
+    }
+
+    void Snapshot()
+    {
+        RegisterIo register_io(MockMmio::Create(1024 * 1024));
+        auto recorder = std::make_unique<RegisterTraceRecorder>(kDeviceId, kGmchGraphicsControl,
+                                                                4096);
+        RegisterTraceRecorder* recorder_ptr = recorder.get();
+        register_io.InstallHook(std::move(recorder));
+        register_io.Write32(0x2030, 0xabcd);
+
+        std::vector<uint8_t> snapshot = recorder_ptr->Serialize();
+        std::vector<uint8_t> copy = snapshot;
+
+        // Recording goes on without touching the snapshot.
+        register_io.Read64(0x4400);
+        EXPECT_EQ(copy, snapshot);
+
+        auto trace = RegisterTrace::Parse(snapshot);
+        ASSERT_NE(nullptr, trace);
+        EXPECT_EQ(1u, trace->operations().size());
+
+        trace = RegisterTrace::Parse(recorder_ptr->Serialize());
+        ASSERT_NE(nullptr, trace);
+        EXPECT_EQ(2u, trace->operations().size());
+    }
+
+    void Replay()
+    {
+        auto replayer = RegisterTraceReplayer::Create(RegisterTrace::Parse(Record(0x5678)));
+        ASSERT_NE(nullptr, replayer);
+
+        auto platform_device = replayer->CreatePciDevice();
+        uint16_t value;
+        EXPECT_TRUE(platform_device->ReadPciConfig16(2, &value));
+        EXPECT_EQ(kDeviceId, value);
+        EXPECT_TRUE(
+            platform_device->ReadPciConfig16(registers::GmchGraphicsControl::kOffset, &value));
+        EXPECT_EQ(kGmchGraphicsControl, value);
+
+        RegisterIo register_io(platform_device->CpuMapPciMmio(
+            0, magma::PlatformMmio::CACHE_POLICY_UNCACHED_DEVICE));
+        register_io.InstallHook(replayer->CreateRegisterHook());
+
+        // Reads return the recorded values.
+        register_io.Write32(0x2030, 0xabcd);
+        EXPECT_EQ(0x5678u, register_io.Read32(0x2034));
+        EXPECT_EQ(0x1122334455667788u, register_io.Read64(0x4400));
+        EXPECT_FALSE(replayer->done());
+        register_io.Write32(0x2030, 0x1234);
+        EXPECT_TRUE(replayer->done());
+        EXPECT_EQ(0u, replayer->mismatch_count());
+
+        // Past the end.
+        register_io.Read32(0x2034);
+        EXPECT_EQ(1u, replayer->mismatch_count());
+        EXPECT_EQ(4u, replayer->first_mismatch());
+    }
+
+    void ReplayMismatch()
+    {
+        auto replayer = RegisterTraceReplayer::Create(RegisterTrace::Parse(Record(0x5678)));
+        ASSERT_NE(nullptr, replayer);
+
+        auto platform_device = replayer->CreatePciDevice();
+        RegisterIo register_io(platform_device->CpuMapPciMmio(
+            0, magma::PlatformMmio::CACHE_POLICY_UNCACHED_DEVICE));
+        register_io.InstallHook(replayer->CreateRegisterHook());
+
+        // A different value written, then the rest in step.
+        register_io.Write32(0x2030, 0xdcba);
+        EXPECT_EQ(0x5678u, register_io.Read32(0x2034));
+        EXPECT_EQ(1u, replayer->mismatch_count());
+        EXPECT_EQ(0u, replayer->first_mismatch());
+    }
+
+    void FirstDifference()
+    {
+        auto a = RegisterTrace::Parse(Record(0x5678));
+        auto b = RegisterTrace::Parse(Record(0x8765));
+        ASSERT_NE(nullptr, a);
+        ASSERT_NE(nullptr, b);
+
+        // Read values don't count.
+        EXPECT_EQ(4u, RegisterTrace::FirstDifference(a->operations(), b->operations()));
+
+        std::vector<RegisterTrace::Operation> operations = b->operations();
+        operations.pop_back();
+        EXPECT_EQ(3u, RegisterTrace::FirstDifference(a->operations(), operations));
+
+        operations[2].offset = 0x4408;
+        EXPECT_EQ(2u, RegisterTrace::FirstDifference(a->operations(), operations));
+
+        operations[0].val = 0;
+        EXPECT_EQ(0u, RegisterTrace::FirstDifference(a->operations(), operations));
+    }
+};
+
+TEST(RegisterTrace, RecordAndParse)
+{
+    TestRegisterTrace test;
+    test.RecordAndParse();
+}
+
+TEST(RegisterTrace, Capacity)
+{
+    TestRegisterTrace test;
+    test.Capacity();
+}
+
+TEST(RegisterTrace, Snapshot)
+{
+    TestRegisterTrace test;
+    test.Snapshot();
+}
+
+TEST(RegisterTrace, Replay)
+{
+    TestRegisterTrace test;
+    test.Replay();
+}
+
+TEST(RegisterTrace, ReplayMismatch)
+{
+    TestRegisterTrace test;
+    test.ReplayMismatch();
+}
+
+TEST(RegisterTrace, FirstDifference)
+{
+    TestRegisterTrace test;
+    test.FirstDifference();
+}
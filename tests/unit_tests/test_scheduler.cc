@@ -31,6 +31,7 @@ public:
         context_[0]->pending_batch_queue().push(std::make_unique<MockMappedBatch>());
         scheduler->CommandBufferQueued(context_[0]);
 
+        EXPECT_EQ(context_[0], scheduler->PeekContext());
         context = scheduler->ScheduleContext();
         EXPECT_EQ(context, context_[0]);
 
@@ -38,6 +39,7 @@ public:
         scheduler->CommandBufferQueued(context_[1]);
 
         // 0 is still current
+        EXPECT_EQ(nullptr, scheduler->PeekContext());
         context = scheduler->ScheduleContext();
         EXPECT_EQ(nullptr, context);
 
@@ -64,6 +66,42 @@ public:
         EXPECT_EQ(nullptr, context);
     }
 
+    void GpuWait()
+    {
+        class GpuWaitBatch : public MockMappedBatch {
+        public:
+            bool HasGpuWaitSemaphores() override { return true; }
+        };
+
+        auto scheduler = Scheduler::CreateFifoScheduler();
+
+        context_[0]->pending_batch_queue().push(std::make_unique<MockMappedBatch>());
+        scheduler->CommandBufferQueued(context_[0]);
+        EXPECT_EQ(context_[0], scheduler->ScheduleContext());
+
+        context_[1]->pending_batch_queue().push(std::make_unique<GpuWaitBatch>());
+        scheduler->CommandBufferQueued(context_[1]);
+        context_[2]->pending_batch_queue().push(std::make_unique<GpuWaitBatch>());
+        scheduler->CommandBufferQueued(context_[2]);
+
+        // 1 waits on the gpu, so it runs behind 0.
+        EXPECT_EQ(context_[1], scheduler->PeekContext());
+        EXPECT_EQ(context_[1], scheduler->ScheduleContext());
+
+        // At most two contexts execute.
+        EXPECT_EQ(nullptr, scheduler->PeekContext());
+        EXPECT_EQ(nullptr, scheduler->ScheduleContext());
+
+        scheduler->CommandBufferCompleted(context_[0]);
+
+        EXPECT_EQ(context_[2], scheduler->ScheduleContext());
+
+        scheduler->CommandBufferCompleted(context_[1]);
+        scheduler->CommandBufferCompleted(context_[2]);
+
+        EXPECT_EQ(nullptr, scheduler->ScheduleContext());
+    }
+
 private:
     std::weak_ptr<MsdIntelConnection> connection_;
     std::shared_ptr<MsdIntelContext> context_[kNumContext];
@@ -74,3 +112,9 @@ TEST(Scheduler, Fifo)
     TestScheduler test;
     test.Fifo();
 }
+
+TEST(Scheduler, GpuWait)
+{
+    TestScheduler test;
+    test.GpuWait();
+}
@@ -0,0 +1,480 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "forcewake.h"
+#include "hardware_status_page.h"
+#include "instructions.h"
+#include "magma_common_defs.h"
+#include "mock/sim_bus_mapper.h"
+#include "mock/sim_gpu.h"
+#include "msd_intel_connection.h"
+#include "msd_intel_context.h"
+#include "msd_intel_device.h"
+#include "pagetable.h"
+#include "platform_semaphore.h"
+#include "registers.h"
+#include "test_command_buffer.h"
+#include "gtest/gtest.h"
+#include <thread>
+
+constexpr uint32_t kDeviceId = 0x1916;
+constexpr uint32_t kRenderEngineMmioBase = 0x2000;
+
+// Fake bus addresses of the test's pages.
+constexpr uint64_t kBusBase = 0x80000000;
+constexpr uint32_t kPageCount = 8;
+
+// Global gtt pages, mapped at gpu address page * PAGE_SIZE.
+constexpr uint32_t kStatusPage = 0;
+constexpr uint32_t kContextPage = 1; // register state in the next page
+constexpr uint32_t kRingPage = 3;
+constexpr uint32_t kBatchPage = 4;
+constexpr uint32_t kGttPageCount = 5;
+
+// Ppgtt pages.
+constexpr uint32_t kPageDirectoryPage = 5;
+constexpr uint32_t kPageTablePage = 6;
+constexpr uint32_t kPpgttBatchPage = 7;
+constexpr uint64_t kPpgttBatchAddr = 0x10000;
+
+constexpr uint32_t kLoadRegisterOffset = 0x7004;
+
+class TestSimGpu {
+public:
+    class PageWriter : public InstructionWriter {
+    public:
+        PageWriter(uint32_t* page) : page_(page) {}
+
+        void write_dword(uint32_t dword) override { page_[offset_++] = dword; }
+
+        uint32_t tail() { return offset_ * sizeof(uint32_t); }
+
+    private:
+        uint32_t* page_;
+        uint32_t offset_ = 0;
+    };
+
+    TestSimGpu() : pages_(kPageCount, std::vector<uint32_t>(PAGE_SIZE / sizeof(uint32_t)))
+    {
+        sim_ = SimGpu::Create(kDeviceId, [this](uint64_t bus_addr) -> void* {
+            if (bus_addr < kBusBase || bus_addr >= bus(kPageCount))
+                return nullptr;
+            return page((bus_addr - kBusBase) / PAGE_SIZE);
+        });
+        pci_device_ = sim_->CreatePciDevice();
+        register_io_ = std::unique_ptr<RegisterIo>(new RegisterIo(pci_device_->CpuMapPciMmio(
+            0, magma::PlatformMmio::CACHE_POLICY_UNCACHED_DEVICE)));
+        register_io_->InstallHook(sim_->CreateRegisterHook());
+        interrupt_ = pci_device_->RegisterInterrupt();
+
+        magma::PlatformMmio* mmio = register_io_->mmio();
+        for (uint32_t i = 0; i < kGttPageCount; i++) {
+            mmio->Write64(mmio->size() / 2 + i * sizeof(uint64_t),
+                          bus(i) | PAGE_PRESENT | PAGE_RW);
+        }
+
+        uint32_t* state = page(kContextPage + 1);
+        state[SimGpu::kStateRingStart] = kRingPage * PAGE_SIZE;
+        // One page, valid.
+        state[SimGpu::kStateRingControl] = 1;
+        state[SimGpu::kStatePdp0Lower] = bus(kPageDirectoryPage);
+
+        reinterpret_cast<uint64_t*>(page(kPageDirectoryPage))[0] =
+            bus(kPageTablePage) | PAGE_PRESENT | PAGE_RW;
+        reinterpret_cast<uint64_t*>(page(kPageTablePage))[kPpgttBatchAddr >> PAGE_SHIFT] =
+            bus(kPpgttBatchPage) | PAGE_PRESENT | PAGE_RW;
+
+        registers::HardwareStatusMask::write(
+            register_io_.get(), kRenderEngineMmioBase,
+            registers::InterruptRegisterBase::RENDER_ENGINE,
+            registers::InterruptRegisterBase::USER, registers::InterruptRegisterBase::UNMASK);
+        registers::GtInterruptEnable0::write(register_io_.get(),
+                                             registers::InterruptRegisterBase::RENDER_ENGINE,
+                                             registers::InterruptRegisterBase::USER, true);
+        registers::MasterInterruptControl::write(register_io_.get(), true);
+    }
+
+    static uint64_t bus(uint32_t page) { return kBusBase + page * PAGE_SIZE; }
+
+    uint32_t* page(uint32_t index) { return pages_[index].data(); }
+
+    uint32_t sequence_number()
+    {
+        return reinterpret_cast<volatile uint32_t*>(
+            page(kStatusPage))[HardwareStatusPage::kSequenceNumberOffset >> 2];
+    }
+
+    void WriteSequenceNumber(PageWriter* ring, uint32_t sequence_number)
+    {
+        MiPipeControl::write(ring, sequence_number,
+                             kStatusPage * PAGE_SIZE + HardwareStatusPage::kSequenceNumberOffset,
+                             0);
+        MiUserInterrupt::write(ring);
+    }
+
+    void Submit(uint32_t tail)
+    {
+        page(kContextPage + 1)[SimGpu::kStateRingTail] = tail;
+        registers::ExeclistSubmitPort::write(
+            register_io_.get(), kRenderEngineMmioBase, 0,
+            registers::ExeclistSubmitPort::context_descriptor(kContextPage * PAGE_SIZE, 1, true));
+    }
+
+    template <typename Condition> static bool WaitFor(Condition condition)
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        while (!condition()) {
+            if (std::chrono::steady_clock::now() > deadline)
+                return false;
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        return true;
+    }
+
+    void ExecBatch()
+    {
+        PageWriter batch(page(kBatchPage));
+        MiNoop::write(&batch);
+        MiBatchBufferEnd::write(&batch);
+
+        PageWriter ring(page(kRingPage));
+        MiBatchBufferStart::write(&ring, kBatchPage * PAGE_SIZE, ADDRESS_SPACE_GGTT);
+        WriteSequenceNumber(&ring, 1);
+        Submit(ring.tail());
+
+        EXPECT_TRUE(WaitFor([this] { return sequence_number() == 1; }));
+        interrupt_->Wait();
+        EXPECT_EQ(1u, sim_->batch_count());
+        EXPECT_TRUE(registers::MasterInterruptControl::read(register_io_.get()) &
+                    registers::MasterInterruptControl::kRenderInterruptsPendingBitMask);
+        EXPECT_TRUE(registers::GtInterruptIdentity0::read(
+                        register_io_.get(), registers::InterruptRegisterBase::RENDER_ENGINE) &
+                    registers::InterruptRegisterBase::kUserInterruptBit);
+
+        registers::GtInterruptIdentity0::write(
+            register_io_.get(), registers::InterruptRegisterBase::RENDER_ENGINE,
+            registers::InterruptRegisterBase::USER, registers::InterruptRegisterBase::MASK);
+        EXPECT_EQ(0u, registers::GtInterruptIdentity0::read(
+                          register_io_.get(), registers::InterruptRegisterBase::RENDER_ENGINE));
+        EXPECT_FALSE(registers::MasterInterruptControl::read(register_io_.get()) &
+                     registers::MasterInterruptControl::kRenderInterruptsPendingBitMask);
+
+        // The context's ring head is saved once the ring is idle.
+        EXPECT_TRUE(WaitFor([this, &ring] {
+            return page(kContextPage + 1)[SimGpu::kStateRingHead] == ring.tail();
+        }));
+        EXPECT_EQ(0u, sim_->fault_count());
+    }
+
+    void PpgttBatch()
+    {
+        uint32_t value = 0xabcd;
+        PageWriter batch(page(kPpgttBatchPage));
+        MiLoadDataImmediate::write(&batch, kLoadRegisterOffset, 1, &value);
+        WriteSequenceNumber(&batch, 2);
+        MiBatchBufferEnd::write(&batch);
+
+        PageWriter ring(page(kRingPage));
+        MiBatchBufferStart::write(&ring, kPpgttBatchAddr, ADDRESS_SPACE_PPGTT);
+        Submit(ring.tail());
+
+        EXPECT_TRUE(WaitFor([this] { return sequence_number() == 2; }));
+        EXPECT_EQ(value, register_io_->mmio()->Read32(kLoadRegisterOffset));
+        EXPECT_EQ(0u, sim_->fault_count());
+    }
+
+    void BatchDelay()
+    {
+        constexpr auto kDelay = std::chrono::milliseconds(20);
+        sim_->set_batch_delay(kDelay);
+
+        PageWriter batch(page(kBatchPage));
+        MiBatchBufferEnd::write(&batch);
+
+        auto start = std::chrono::steady_clock::now();
+
+        PageWriter ring(page(kRingPage));
+        MiBatchBufferStart::write(&ring, kBatchPage * PAGE_SIZE, ADDRESS_SPACE_GGTT);
+        WriteSequenceNumber(&ring, 1);
+        Submit(ring.tail());
+
+        // Resubmitting the running context extends its ring.
+        MiBatchBufferStart::write(&ring, kBatchPage * PAGE_SIZE, ADDRESS_SPACE_GGTT);
+        WriteSequenceNumber(&ring, 2);
+        Submit(ring.tail());
+
+        EXPECT_TRUE(WaitFor([this] { return sequence_number() == 2; }));
+        EXPECT_GE(std::chrono::steady_clock::now() - start, 2 * kDelay);
+        EXPECT_EQ(2u, sim_->batch_count());
+    }
+
+    void Fault()
+    {
+        PageWriter ring(page(kRingPage));
+        MiBatchBufferStart::write(&ring, kGttPageCount * PAGE_SIZE, ADDRESS_SPACE_GGTT);
+        WriteSequenceNumber(&ring, 1);
+        Submit(ring.tail());
+
+        EXPECT_TRUE(WaitFor([this] { return sim_->fault_count() == 1; }));
+        EXPECT_TRUE(registers::AllEngineFault::valid(
+            registers::AllEngineFault::read(register_io_.get())));
+        EXPECT_NE(1u, sequence_number());
+    }
+
+    void Handshakes()
+    {
+        ForceWake::request(register_io_.get(), registers::ForceWake::GEN9_RENDER);
+        EXPECT_EQ(1u, registers::ForceWake::read_status(register_io_.get(),
+                                                        registers::ForceWake::GEN9_RENDER));
+        ForceWake::release(register_io_.get(), registers::ForceWake::GEN9_RENDER);
+        EXPECT_EQ(0u, registers::ForceWake::read_status(register_io_.get(),
+                                                        registers::ForceWake::GEN9_RENDER));
+
+        EXPECT_FALSE(
+            registers::ResetControl::ready_for_reset(register_io_.get(), kRenderEngineMmioBase));
+        registers::ResetControl::request(register_io_.get(), kRenderEngineMmioBase);
+        EXPECT_TRUE(
+            registers::ResetControl::ready_for_reset(register_io_.get(), kRenderEngineMmioBase));
+        registers::GraphicsDeviceResetControl::initiate_reset(
+            register_io_.get(), registers::GraphicsDeviceResetControl::RENDER_ENGINE);
+        EXPECT_TRUE(registers::GraphicsDeviceResetControl::is_reset_complete(
+            register_io_.get(), registers::GraphicsDeviceResetControl::RENDER_ENGINE));
+
+        uint16_t value;
+        EXPECT_TRUE(pci_device_->ReadPciConfig16(2, &value));
+        EXPECT_EQ(kDeviceId, value);
+        EXPECT_TRUE(
+            pci_device_->ReadPciConfig16(registers::GmchGraphicsControl::kOffset, &value));
+        EXPECT_EQ(SimGpu::kGttSize, registers::GmchGraphicsControl::gtt_size(value));
+    }
+
+private:
+    std::vector<std::vector<uint32_t>> pages_;
+    std::unique_ptr<SimGpu> sim_;
+    std::unique_ptr<magma::PlatformPciDevice> pci_device_;
+    std::unique_ptr<RegisterIo> register_io_;
+    std::unique_ptr<magma::PlatformInterrupt> interrupt_;
+};
+
+// Runs MsdIntelDevice on the simulator, over the driver's own buffers.
+class TestSimDevice {
+public:
+    static std::unique_ptr<CommandBuffer> CreateCommandBuffer(
+        std::weak_ptr<ClientContext> context, std::shared_ptr<MsdIntelBuffer> batch_buffer,
+        std::vector<std::shared_ptr<magma::PlatformSemaphore>> wait_semaphores = {},
+        std::vector<std::shared_ptr<magma::PlatformSemaphore>> signal_semaphores = {})
+    {
+        uint32_t semaphore_count = wait_semaphores.size() + signal_semaphores.size();
+        std::shared_ptr<MsdIntelBuffer> descriptor =
+            MsdIntelBuffer::Create(sizeof(magma_system_command_buffer) +
+                                       semaphore_count * sizeof(uint64_t) +
+                                       sizeof(magma_system_exec_resource),
+                                   "descriptor");
+        if (!descriptor)
+            return DRETP(nullptr, "couldn't create descriptor");
+
+        void* addr;
+        if (!descriptor->platform_buffer()->MapCpu(&addr))
+            return DRETP(nullptr, "couldn't map descriptor");
+
+        auto command_buffer = reinterpret_cast<magma_system_command_buffer*>(addr);
+        command_buffer->batch_buffer_resource_index = 0;
+        command_buffer->batch_start_offset = 0;
+        command_buffer->num_resources = 1;
+        command_buffer->wait_semaphore_count = wait_semaphores.size();
+        command_buffer->signal_semaphore_count = signal_semaphores.size();
+
+        // Semaphore ids precede the resources.
+        auto semaphore_ids = reinterpret_cast<uint64_t*>(command_buffer + 1);
+        for (auto& semaphore : wait_semaphores)
+            *semaphore_ids++ = semaphore->id();
+        for (auto& semaphore : signal_semaphores)
+            *semaphore_ids++ = semaphore->id();
+
+        auto resource = reinterpret_cast<magma_system_exec_resource*>(semaphore_ids);
+        resource->buffer_id = batch_buffer->platform_buffer()->id();
+        resource->num_relocations = 0;
+        resource->offset = 0;
+        resource->length = batch_buffer->platform_buffer()->size();
+
+        descriptor->platform_buffer()->UnmapCpu();
+
+        return TestCommandBuffer::Create(descriptor, context, {std::move(batch_buffer)},
+                                         std::move(wait_semaphores),
+                                         std::move(signal_semaphores));
+    }
+
+    static std::shared_ptr<MsdIntelBuffer> CreateBatchBuffer()
+    {
+        std::shared_ptr<MsdIntelBuffer> batch_buffer = MsdIntelBuffer::Create(PAGE_SIZE, "batch");
+        if (!batch_buffer)
+            return DRETP(nullptr, "couldn't create batch buffer");
+
+        void* batch_cpu_addr;
+        if (!batch_buffer->platform_buffer()->MapCpu(&batch_cpu_addr))
+            return DRETP(nullptr, "couldn't map batch buffer");
+        TestSimGpu::PageWriter batch(reinterpret_cast<uint32_t*>(batch_cpu_addr));
+        MiNoop::write(&batch);
+        MiBatchBufferEnd::write(&batch);
+        batch_buffer->platform_buffer()->UnmapCpu();
+
+        return batch_buffer;
+    }
+
+    // Pages resolve only while the driver holds their bus mapping.
+    void ResolveMappedPages()
+    {
+        SimBusMapper sim_bus_mapper;
+        std::unique_ptr<BusMapper> bus_mapper = sim_bus_mapper.CreateBusMapper();
+
+        std::unique_ptr<magma::PlatformBuffer> buffer =
+            magma::PlatformBuffer::Create(2 * PAGE_SIZE, "test");
+        ASSERT_NE(nullptr, buffer);
+        ASSERT_TRUE(buffer->PinPages(0, 2));
+
+        std::unique_ptr<BusMapping> mapping = bus_mapper->MapPageRange(buffer.get(), 1, 1);
+        ASSERT_NE(nullptr, mapping);
+        ASSERT_EQ(1u, mapping->page_count());
+        uint64_t bus_addr = mapping->bus_addr()[0];
+
+        void* cpu_addr;
+        ASSERT_TRUE(buffer->MapCpu(&cpu_addr));
+        EXPECT_EQ(reinterpret_cast<uint8_t*>(cpu_addr) + PAGE_SIZE,
+                  sim_bus_mapper.Resolve(bus_addr));
+        EXPECT_EQ(1u, sim_bus_mapper.mapped_page_count());
+        EXPECT_TRUE(buffer->UnmapCpu());
+
+        mapping.reset();
+        EXPECT_EQ(nullptr, sim_bus_mapper.Resolve(bus_addr));
+        EXPECT_EQ(0u, sim_bus_mapper.mapped_page_count());
+
+        EXPECT_TRUE(buffer->UnpinPages(0, 2));
+    }
+
+    void SubmitAndRetire()
+    {
+        SimBusMapper bus_mapper;
+        auto sim = SimGpu::Create(kDeviceId, bus_mapper.bus_mapper());
+        ASSERT_NE(nullptr, sim);
+
+        auto device = MsdIntelDevice::Create(sim->CreatePciDevice(), sim->CreateRegisterHook(),
+                                             bus_mapper.CreateBusMapper(), true);
+        ASSERT_NE(nullptr, device);
+
+        std::shared_ptr<MsdIntelConnection> connection = device->Open(0);
+        ASSERT_NE(nullptr, connection);
+        auto context = std::make_shared<ClientContext>(connection, connection->per_process_gtt());
+
+        std::shared_ptr<MsdIntelBuffer> batch_buffer = CreateBatchBuffer();
+        ASSERT_NE(nullptr, batch_buffer);
+
+        auto command_buffer = CreateCommandBuffer(context, batch_buffer);
+        ASSERT_NE(nullptr, command_buffer);
+        EXPECT_TRUE(context->SubmitCommandBuffer(std::move(command_buffer)).ok());
+
+        // The batch buffer is idle once the command buffer has been retired.
+        EXPECT_TRUE(
+            connection->WaitRendering({batch_buffer.get()}, MsdIntelBuffer::WAIT_ALL, 1000).ok());
+        EXPECT_EQ(0u, batch_buffer->inflight_counter());
+
+        // The render init batch and the command buffer's, from the ppgtt.
+        EXPECT_GE(sim->batch_count(), 2u);
+        EXPECT_EQ(0u, sim->fault_count());
+
+        connection->DestroyContext(std::move(context));
+    }
+
+    // A context waiting on a semaphore of a running context's batch is dispatched behind it, and
+    // the gpu resolves the dependency.
+    void GpuSemaphoreWait()
+    {
+        SimBusMapper bus_mapper;
+        auto sim = SimGpu::Create(kDeviceId, bus_mapper.bus_mapper());
+        ASSERT_NE(nullptr, sim);
+
+        auto device = MsdIntelDevice::Create(sim->CreatePciDevice(), sim->CreateRegisterHook(),
+                                             bus_mapper.CreateBusMapper(), true);
+        ASSERT_NE(nullptr, device);
+
+        std::shared_ptr<MsdIntelConnection> connection = device->Open(0);
+        ASSERT_NE(nullptr, connection);
+        auto producer =
+            std::make_shared<ClientContext>(connection, connection->per_process_gtt());
+        auto consumer =
+            std::make_shared<ClientContext>(connection, connection->per_process_gtt());
+
+        std::shared_ptr<MsdIntelBuffer> batch_buffer = CreateBatchBuffer();
+        ASSERT_NE(nullptr, batch_buffer);
+
+        std::shared_ptr<magma::PlatformSemaphore> produced = magma::PlatformSemaphore::Create();
+        std::shared_ptr<magma::PlatformSemaphore> consumed = magma::PlatformSemaphore::Create();
+
+        // Keeps the producer's batch running while the consumer's is submitted.
+        sim->set_batch_delay(std::chrono::milliseconds(20));
+
+        auto command_buffer = CreateCommandBuffer(producer, batch_buffer, {}, {produced});
+        ASSERT_NE(nullptr, command_buffer);
+        EXPECT_TRUE(producer->SubmitCommandBuffer(std::move(command_buffer)).ok());
+
+        command_buffer = CreateCommandBuffer(consumer, batch_buffer, {produced}, {consumed});
+        ASSERT_NE(nullptr, command_buffer);
+        EXPECT_TRUE(consumer->SubmitCommandBuffer(std::move(command_buffer)).ok());
+
+        EXPECT_TRUE(consumed->Wait(1000));
+        EXPECT_TRUE(produced->Wait(0));
+        EXPECT_EQ(1u, sim->semaphore_wait_count());
+        EXPECT_EQ(0u, sim->fault_count());
+
+        connection->DestroyContext(std::move(consumer));
+        connection->DestroyContext(std::move(producer));
+    }
+};
+
+TEST(SimGpu, ExecBatch)
+{
+    TestSimGpu test;
+    test.ExecBatch();
+}
+
+TEST(SimGpu, PpgttBatch)
+{
+    TestSimGpu test;
+    test.PpgttBatch();
+}
+
+TEST(SimGpu, BatchDelay)
+{
+    TestSimGpu test;
+    test.BatchDelay();
+}
+
+TEST(SimGpu, Fault)
+{
+    TestSimGpu test;
+    test.Fault();
+}
+
+TEST(SimGpu, Handshakes)
+{
+    TestSimGpu test;
+    test.Handshakes();
+}
+
+TEST(SimGpu, ResolveMappedPages)
+{
+    TestSimDevice test;
+    test.ResolveMappedPages();
+}
+
+TEST(SimGpu, DeviceSubmitAndRetire)
+{
+    TestSimDevice test;
+    test.SubmitAndRetire();
+}
+
+TEST(SimGpu, DeviceGpuSemaphoreWait)
+{
+    TestSimDevice test;
+    test.GpuSemaphoreWait();
+}
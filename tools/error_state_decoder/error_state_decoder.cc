@@ -0,0 +1,339 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "error_state_decoder.h"
+#include "gen_command_table.h"
+#include "magma_util/macros.h"
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+struct RegisterName {
+    uint32_t offset;
+    const char* name;
+};
+
+// The registers the driver captures; render engine registers are at mmio base 0x2000.
+const RegisterName kRegisterNames[] = {
+    {0x2030, "RCS_RING_BUFFER_TAIL"},
+    {0x2034, "RCS_RING_BUFFER_HEAD"},
+    {0x2038, "RCS_RING_BUFFER_START"},
+    {0x203C, "RCS_RING_BUFFER_CTL"},
+    {0x205C, "RCS_ACTHD_UDW"},
+    {0x2064, "RCS_IPEIR"},
+    {0x2068, "RCS_IPEHR"},
+    {0x206C, "RCS_INSTDONE"},
+    {0x2074, "RCS_ACTHD"},
+    {0x2080, "RCS_HWS_PGA"},
+    {0x209C, "RCS_MI_MODE"},
+    {0x2110, "RCS_BB_STATE"},
+    {0x2140, "RCS_BB_ADDR"},
+    {0x2168, "RCS_BB_ADDR_UDW"},
+    {0x2180, "RCS_CCID"},
+    {0x2234, "RCS_EXECLIST_STATUS"},
+    {0x2238, "RCS_EXECLIST_STATUS_UDW"},
+    {0x229C, "RCS_GFX_MODE"},
+    {0x2358, "RCS_TIMESTAMP"},
+    {0x235C, "RCS_TIMESTAMP_UDW"},
+    {0x4094, "ALL_ENGINE_FAULT"},
+    {0x40A0, "ERROR"},
+    {0x4B10, "FAULT_TLB_READ_DATA0"},
+    {0x4B14, "FAULT_TLB_READ_DATA1"},
+    {0xA01C, "RP_STATUS"},
+    {0x44200, "MASTER_INTERRUPT_CONTROL"},
+    {0x44304, "GT_IMR0"},
+    {0x44308, "GT_IIR0"},
+    {0x4430C, "GT_IER0"},
+};
+
+constexpr uint32_t kActiveHeadOffset = 0x2074;
+constexpr uint32_t kActiveHeadUpperOffset = 0x205C;
+constexpr uint32_t kAllEngineFaultOffset = 0x4094;
+constexpr uint32_t kFaultTlbReadData0Offset = 0x4B10;
+constexpr uint32_t kFaultTlbReadData1Offset = 0x4B14;
+
+constexpr uint32_t kDwordsPerLine = 8;
+
+const char* register_name(uint32_t offset)
+{
+    for (auto& reg : kRegisterNames) {
+        if (reg.offset == offset)
+            return reg.name;
+    }
+    return "";
+}
+
+const char* reason_name(uint32_t reason)
+{
+    switch (reason) {
+        case ErrorState::kReasonHang:
+            return "hang";
+        case ErrorState::kReasonFault:
+            return "fault";
+    }
+    return "unknown";
+}
+
+void Append(std::string& out, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+void Append(std::string& out, const char* fmt, ...)
+{
+    char buf[256];
+    va_list args;
+    va_start(args, fmt);
+    int size = std::vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (size < 0)
+        return;
+    if (static_cast<size_t>(size) < sizeof(buf)) {
+        out.append(buf, size);
+        return;
+    }
+    std::vector<char> long_buf(size + 1);
+    va_start(args, fmt);
+    std::vsnprintf(long_buf.data(), long_buf.size(), fmt, args);
+    va_end(args);
+    out.append(long_buf.data(), size);
+}
+
+uint64_t read64(const uint32_t* dwords)
+{
+    return static_cast<uint64_t>(dwords[1]) << 32 | dwords[0];
+}
+
+} // namespace
+
+std::unique_ptr<ErrorStateDecoder> ErrorStateDecoder::Parse(const std::vector<uint8_t>& data)
+{
+    if (data.size() % sizeof(uint32_t))
+        return DRETP(nullptr, "error state size %zu isn't a multiple of 4", data.size());
+    std::vector<uint32_t> dwords(data.size() / sizeof(uint32_t));
+    memcpy(dwords.data(), data.data(), data.size());
+    return Parse(dwords);
+}
+
+std::unique_ptr<ErrorStateDecoder> ErrorStateDecoder::Parse(const std::vector<uint32_t>& dwords)
+{
+    if (dwords.size() < ErrorState::kHeaderDwords || dwords[0] != ErrorState::kMagic)
+        return DRETP(nullptr, "not an error state");
+    if (dwords[1] != ErrorState::kVersion)
+        return DRETP(nullptr, "unsupported error state version %u", dwords[1]);
+
+    std::unique_ptr<ErrorStateDecoder> decoder(new ErrorStateDecoder());
+    std::copy(dwords.begin(), dwords.begin() + ErrorState::kHeaderDwords, decoder->header_);
+
+    for (size_t i = ErrorState::kHeaderDwords; i < dwords.size();) {
+        if (dwords.size() - i < ErrorState::kSectionHeaderDwords)
+            return DRETP(nullptr, "truncated section header at dword %zu", i);
+        uint32_t type = dwords[i];
+        uint32_t count = dwords[i + 1];
+        i += ErrorState::kSectionHeaderDwords;
+        if (dwords.size() - i < count)
+            return DRETP(nullptr, "section at dword %zu overruns the error state", i);
+        const uint32_t* payload = &dwords[i];
+        i += count;
+
+        switch (type) {
+            case ErrorState::kRegisters:
+                for (uint32_t j = 0; j + 1 < count; j += 2) {
+                    decoder->registers_.push_back({payload[j], payload[j + 1]});
+                }
+                break;
+
+            case ErrorState::kRingbuffer: {
+                if (count < ErrorState::kRingbufferFieldDwords)
+                    break;
+                Ringbuffer ringbuffer;
+                ringbuffer.context_id = read64(&payload[0]);
+                ringbuffer.gpu_addr = read64(&payload[2]);
+                ringbuffer.size = payload[4];
+                ringbuffer.head = payload[5];
+                ringbuffer.tail = payload[6];
+                ringbuffer.contents.assign(payload + ErrorState::kRingbufferFieldDwords,
+                                           payload + count);
+                decoder->ringbuffers_.push_back(std::move(ringbuffer));
+                break;
+            }
+
+            case ErrorState::kBatch: {
+                if (count < ErrorState::kBatchFieldDwords)
+                    break;
+                Batch batch;
+                batch.sequence_number = payload[0];
+                batch.context_id = read64(&payload[1]);
+                batch.gpu_addr = read64(&payload[3]);
+                batch.length = payload[5];
+                batch.contents.assign(payload + ErrorState::kBatchFieldDwords, payload + count);
+                decoder->batches_.push_back(std::move(batch));
+                break;
+            }
+
+            case ErrorState::kMapping:
+                if (count < ErrorState::kMappingDwords)
+                    break;
+                decoder->mappings_.push_back({payload[0], read64(&payload[1]), read64(&payload[3]),
+                                              read64(&payload[5]), read64(&payload[7])});
+                break;
+
+            case ErrorState::kStatusPage:
+                decoder->status_page_.assign(payload, payload + count);
+                break;
+
+            default:
+                // Skipped, so newer drivers can add sections.
+                break;
+        }
+    }
+
+    return decoder;
+}
+
+bool ErrorStateDecoder::GetRegister(uint32_t offset, uint32_t* value_out)
+{
+    for (auto& reg : registers_) {
+        if (reg.first == offset) {
+            *value_out = reg.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t ErrorStateDecoder::active_head()
+{
+    uint32_t lower, upper;
+    if (!GetRegister(kActiveHeadOffset, &lower) || !GetRegister(kActiveHeadUpperOffset, &upper))
+        return 0;
+    return static_cast<uint64_t>(upper) << 32 | lower;
+}
+
+void ErrorStateDecoder::FormatCommands(const std::vector<uint32_t>& dwords, uint64_t gpu_addr,
+                                       uint64_t active_head, bool stop_at_batch_end,
+                                       std::string& out)
+{
+    for (size_t i = 0; i < dwords.size();) {
+        uint64_t addr = gpu_addr + i * sizeof(uint32_t);
+        uint32_t header = dwords[i];
+
+        uint32_t dword_count;
+        if (!GenCommandTable::GetLength(header, &dword_count)) {
+            const char* marker = active_head == addr ? "==>" : "   ";
+            Append(out, "%s 0x%08lx: unknown command 0x%08x\n", marker, addr, header);
+            i++;
+            continue;
+        }
+
+        if (header == 0) {
+            // Runs of padding collapse to one line.
+            size_t run = 1;
+            while (i + run < dwords.size() && dwords[i + run] == 0)
+                run++;
+            uint64_t end = addr + run * sizeof(uint32_t);
+            const char* marker = active_head >= addr && active_head < end ? "==>" : "   ";
+            Append(out, "%s 0x%08lx: MI_NOOP x %zu\n", marker, addr, run);
+            i += run;
+            continue;
+        }
+
+        size_t available = std::min(static_cast<size_t>(dword_count), dwords.size() - i);
+        uint64_t end = addr + available * sizeof(uint32_t);
+        const char* marker = active_head >= addr && active_head < end ? "==>" : "   ";
+        const char* name = GenCommandTable::GetName(header);
+        if (name) {
+            Append(out, "%s 0x%08lx: %s", marker, addr, name);
+        } else {
+            Append(out, "%s 0x%08lx: unknown 0x%04x", marker, addr, header >> 16);
+        }
+        if (available < dword_count)
+            Append(out, " (cut short, %u dwords)", dword_count);
+
+        for (size_t j = 0; j < available; j++) {
+            if (j % kDwordsPerLine == 0)
+                out.append("\n                ");
+            Append(out, " %08x", dwords[i + j]);
+        }
+        out.append("\n");
+
+        i += available;
+        if (stop_at_batch_end && GenCommandTable::IsBatchBufferEnd(header))
+            break;
+    }
+}
+
+void ErrorStateDecoder::Format(std::string& out)
+{
+    out.append("---- error state begin ----\n");
+    Append(out, "device id 0x%x, reason %s, generation %u%s%s\n", device_id(),
+           reason_name(reason()), generation(), truncated() ? ", TRUNCATED" : "",
+           complete() ? "" : ", INCOMPLETE");
+    Append(out, "last completed sequence number 0x%x, last submitted 0x%x\n",
+           last_completed_sequence(), last_submitted_sequence());
+
+    out.append("registers:\n");
+    for (auto& reg : registers_) {
+        Append(out, "  0x%05x %-26s 0x%08x\n", reg.first, register_name(reg.first), reg.second);
+    }
+
+    uint32_t fault;
+    if (GetRegister(kAllEngineFaultOffset, &fault) && (fault & 1)) {
+        uint32_t tlb_data0 = 0, tlb_data1 = 0;
+        GetRegister(kFaultTlbReadData0Offset, &tlb_data0);
+        GetRegister(kFaultTlbReadData1Offset, &tlb_data1);
+        uint64_t tlb_data = static_cast<uint64_t>(tlb_data1) << 32 | tlb_data0;
+        uint64_t fault_gpu_address = (tlb_data & 0xFFFFFFFFFull) << 12;
+        Append(out, "ENGINE FAULT: engine 0x%x src 0x%x type 0x%x gpu_address 0x%lx global %d\n",
+               (fault >> 12) & 0x3, (fault >> 3) & 0xFF, (fault >> 1) & 0x3, fault_gpu_address,
+               (tlb_data & (1ull << 36)) ? 1 : 0);
+    }
+
+    uint64_t head = active_head();
+    Append(out, "active head 0x%lx\n", head);
+
+    if (!status_page_.empty()) {
+        out.append("hardware status page, nonzero dwords:\n");
+        for (uint32_t i = 0; i < status_page_.size(); i++) {
+            if (status_page_[i])
+                Append(out, "  0x%03zx: 0x%08x\n", i * sizeof(uint32_t), status_page_[i]);
+        }
+    }
+
+    for (auto& ringbuffer : ringbuffers_) {
+        Append(out, "\nringbuffer of context 0x%lx at 0x%lx, size 0x%x, head 0x%x tail 0x%x\n",
+               ringbuffer.context_id, ringbuffer.gpu_addr, ringbuffer.size, ringbuffer.head,
+               ringbuffer.tail);
+        // The contents wrap at the end of the ringbuffer.
+        uint32_t head_offset = std::min(ringbuffer.head, ringbuffer.size);
+        size_t before_wrap = std::min(ringbuffer.contents.size(),
+                                      static_cast<size_t>(ringbuffer.size - head_offset) /
+                                          sizeof(uint32_t));
+        FormatCommands(std::vector<uint32_t>(ringbuffer.contents.begin(),
+                                             ringbuffer.contents.begin() + before_wrap),
+                       ringbuffer.gpu_addr + head_offset, head, false, out);
+        FormatCommands(std::vector<uint32_t>(ringbuffer.contents.begin() + before_wrap,
+                                             ringbuffer.contents.end()),
+                       ringbuffer.gpu_addr, head, false, out);
+    }
+
+    for (auto& batch : batches_) {
+        Append(out, "\nbatch sequence number 0x%x, context 0x%lx, gpu address 0x%lx, length 0x%x\n",
+               batch.sequence_number, batch.context_id, batch.gpu_addr, batch.length);
+        if (head >= batch.gpu_addr && head < batch.gpu_addr + batch.length)
+            out.append("ACTIVE HEAD WITHIN THIS BATCH\n");
+        for (auto& mapping : mappings_) {
+            if (mapping.sequence_number != batch.sequence_number)
+                continue;
+            Append(out, "  mapping buffer 0x%lx gpu address [0x%lx, 0x%lx) offset 0x%lx\n",
+                   mapping.buffer_id, mapping.gpu_addr, mapping.gpu_addr + mapping.length,
+                   mapping.offset);
+        }
+        if (batch.contents.size() * sizeof(uint32_t) < batch.length)
+            Append(out, "only 0x%zx bytes captured\n", batch.contents.size() * sizeof(uint32_t));
+        FormatCommands(batch.contents, batch.gpu_addr, head, true, out);
+    }
+
+    out.append("---- error state end ----\n");
+}
@@ -0,0 +1,86 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef ERROR_STATE_DECODER_H
+#define ERROR_STATE_DECODER_H
+
+#include "error_state.h"
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Parses an error state captured by the driver and formats it as text.
+class ErrorStateDecoder {
+public:
+    struct Ringbuffer {
+        uint64_t context_id;
+        uint64_t gpu_addr;
+        uint32_t size;
+        uint32_t head;
+        uint32_t tail;
+        // From head up to tail.
+        std::vector<uint32_t> contents;
+    };
+
+    struct Batch {
+        uint32_t sequence_number;
+        uint64_t context_id;
+        uint64_t gpu_addr;
+        uint32_t length;
+        // Shorter than the length if the error state was truncated.
+        std::vector<uint32_t> contents;
+    };
+
+    struct Mapping {
+        uint32_t sequence_number;
+        uint64_t buffer_id;
+        uint64_t gpu_addr;
+        uint64_t offset;
+        uint64_t length;
+    };
+
+    // Accepts the binary error state, as exported with msd_intel_device_export_error_state.
+    static std::unique_ptr<ErrorStateDecoder> Parse(const std::vector<uint8_t>& data);
+    static std::unique_ptr<ErrorStateDecoder> Parse(const std::vector<uint32_t>& dwords);
+
+    void Format(std::string& out);
+
+    uint32_t device_id() { return header_[ErrorState::kHeaderDeviceId]; }
+    uint32_t reason() { return header_[ErrorState::kHeaderReason]; }
+    bool truncated() { return header_[ErrorState::kHeaderFlags] & ErrorState::kFlagTruncated; }
+    bool complete() { return header_[ErrorState::kHeaderFlags] & ErrorState::kFlagComplete; }
+    uint32_t generation() { return header_[ErrorState::kHeaderGeneration]; }
+    uint32_t last_completed_sequence() { return header_[ErrorState::kHeaderLastCompletedSequence]; }
+    uint32_t last_submitted_sequence() { return header_[ErrorState::kHeaderLastSubmittedSequence]; }
+
+    const std::vector<std::pair<uint32_t, uint32_t>>& registers() { return registers_; }
+    const std::vector<Ringbuffer>& ringbuffers() { return ringbuffers_; }
+    const std::vector<Batch>& batches() { return batches_; }
+    const std::vector<Mapping>& mappings() { return mappings_; }
+    const std::vector<uint32_t>& status_page() { return status_page_; }
+
+    // Returns false if the register wasn't captured.
+    bool GetRegister(uint32_t offset, uint32_t* value_out);
+
+    // The render engine's active head pointer, or 0 if it wasn't captured.
+    uint64_t active_head();
+
+    // Appends the commands in |dwords|, found at |gpu_addr|, one per line. The command holding
+    // |active_head| is marked. If |stop_at_batch_end|, stops after MI_BATCH_BUFFER_END.
+    static void FormatCommands(const std::vector<uint32_t>& dwords, uint64_t gpu_addr,
+                               uint64_t active_head, bool stop_at_batch_end, std::string& out);
+
+private:
+    ErrorStateDecoder() {}
+
+    uint32_t header_[ErrorState::kHeaderDwords];
+    std::vector<std::pair<uint32_t, uint32_t>> registers_;
+    std::vector<Ringbuffer> ringbuffers_;
+    std::vector<Batch> batches_;
+    std::vector<Mapping> mappings_;
+    std::vector<uint32_t> status_page_;
+};
+
+#endif // ERROR_STATE_DECODER_H
@@ -0,0 +1,280 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "gen_command_table.h"
+#include <stddef.h>
+
+// from intel-gfx-prm-osrc-skl-vol02a-commandreference-instructions.pdf
+namespace {
+
+enum CommandType { kMi = 0, kBlt = 2, kRender = 3 };
+
+uint32_t command_type(uint32_t header) { return header >> 29; }
+
+// Bits 28:23.
+uint32_t mi_opcode(uint32_t header) { return (header >> 23) & 0x3F; }
+
+// Bits 28:22.
+uint32_t blt_opcode(uint32_t header) { return (header >> 22) & 0x7F; }
+
+// Pipeline type in bits 28:27, opcode in 26:24 and sub-opcode in 23:16.
+uint32_t render_pipeline(uint32_t header) { return (header >> 27) & 0x3; }
+uint32_t render_opcode(uint32_t header) { return (header >> 24) & 0x7; }
+uint32_t render_id(uint32_t header) { return header >> 16; }
+
+struct Command {
+    uint32_t id;
+    const char* name;
+};
+
+const Command kMiCommands[] = {
+    {0x00, "MI_NOOP"},
+    {0x02, "MI_USER_INTERRUPT"},
+    {0x03, "MI_WAIT_FOR_EVENT"},
+    {0x05, "MI_ARB_CHECK"},
+    {0x06, "MI_RS_CONTROL"},
+    {0x07, "MI_REPORT_HEAD"},
+    {0x08, "MI_ARB_ON_OFF"},
+    {0x09, "MI_URB_ATOMIC_ALLOC"},
+    {0x0A, "MI_BATCH_BUFFER_END"},
+    {0x0B, "MI_SUSPEND_FLUSH"},
+    {0x0C, "MI_PREDICATE"},
+    {0x0D, "MI_TOPOLOGY_FILTER"},
+    {0x0E, "MI_SET_APPID"},
+    {0x0F, "MI_RS_CONTEXT"},
+    {0x12, "MI_LOAD_SCAN_LINES_INCL"},
+    {0x13, "MI_LOAD_SCAN_LINES_EXCL"},
+    {0x14, "MI_DISPLAY_FLIP"},
+    {0x18, "MI_SET_CONTEXT"},
+    {0x1A, "MI_MATH"},
+    {0x1B, "MI_SEMAPHORE_SIGNAL"},
+    {0x1C, "MI_SEMAPHORE_WAIT"},
+    {0x1D, "MI_FORCE_WAKEUP"},
+    {0x20, "MI_STORE_DATA_IMM"},
+    {0x21, "MI_STORE_DATA_INDEX"},
+    {0x22, "MI_LOAD_REGISTER_IMM"},
+    {0x23, "MI_UPDATE_GTT"},
+    {0x24, "MI_STORE_REGISTER_MEM"},
+    {0x26, "MI_FLUSH_DW"},
+    {0x27, "MI_CLFLUSH"},
+    {0x28, "MI_REPORT_PERF_COUNT"},
+    {0x29, "MI_LOAD_REGISTER_MEM"},
+    {0x2A, "MI_LOAD_REGISTER_REG"},
+    {0x2B, "MI_RS_STORE_DATA_IMM"},
+    {0x2C, "MI_LOAD_URB_MEM"},
+    {0x2D, "MI_STORE_URB_MEM"},
+    {0x2E, "MI_COPY_MEM_MEM"},
+    {0x2F, "MI_ATOMIC"},
+    {0x31, "MI_BATCH_BUFFER_START"},
+    {0x36, "MI_CONDITIONAL_BATCH_BUFFER_END"},
+};
+
+const Command kBltCommands[] = {
+    {0x01, "XY_SETUP_BLT"},
+    {0x11, "XY_SETUP_MONO_PATTERN_SL_BLT"},
+    {0x40, "COLOR_BLT"},
+    {0x42, "XY_FAST_COPY_BLT"},
+    {0x43, "SRC_COPY_BLT"},
+    {0x50, "XY_COLOR_BLT"},
+    {0x53, "XY_SRC_COPY_BLT"},
+};
+
+const Command kRenderCommands[] = {
+    {0x6101, "STATE_BASE_ADDRESS"},
+    {0x6102, "STATE_SIP"},
+    {0x6904, "PIPELINE_SELECT"},
+    {0x7000, "MEDIA_VFE_STATE"},
+    {0x7001, "MEDIA_CURBE_LOAD"},
+    {0x7002, "MEDIA_INTERFACE_DESCRIPTOR_LOAD"},
+    {0x7004, "MEDIA_STATE_FLUSH"},
+    {0x7100, "MEDIA_OBJECT"},
+    {0x7101, "MEDIA_OBJECT_PRT"},
+    {0x7103, "MEDIA_OBJECT_WALKER"},
+    {0x7105, "GPGPU_WALKER"},
+    {0x7804, "3DSTATE_CLEAR_PARAMS"},
+    {0x7805, "3DSTATE_DEPTH_BUFFER"},
+    {0x7806, "3DSTATE_STENCIL_BUFFER"},
+    {0x7807, "3DSTATE_HIER_DEPTH_BUFFER"},
+    {0x7808, "3DSTATE_VERTEX_BUFFERS"},
+    {0x7809, "3DSTATE_VERTEX_ELEMENTS"},
+    {0x780a, "3DSTATE_INDEX_BUFFER"},
+    {0x780b, "3DSTATE_VF_STATISTICS"},
+    {0x780c, "3DSTATE_VF"},
+    {0x780d, "3DSTATE_MULTISAMPLE"},
+    {0x780e, "3DSTATE_CC_STATE_POINTERS"},
+    {0x780f, "3DSTATE_SCISSOR_STATE_POINTERS"},
+    {0x7810, "3DSTATE_VS"},
+    {0x7811, "3DSTATE_GS"},
+    {0x7812, "3DSTATE_CLIP"},
+    {0x7813, "3DSTATE_SF"},
+    {0x7814, "3DSTATE_WM"},
+    {0x7815, "3DSTATE_CONSTANT_VS"},
+    {0x7816, "3DSTATE_CONSTANT_GS"},
+    {0x7817, "3DSTATE_CONSTANT_PS"},
+    {0x7818, "3DSTATE_SAMPLE_MASK"},
+    {0x7819, "3DSTATE_CONSTANT_HS"},
+    {0x781a, "3DSTATE_CONSTANT_DS"},
+    {0x781b, "3DSTATE_HS"},
+    {0x781c, "3DSTATE_TE"},
+    {0x781d, "3DSTATE_DS"},
+    {0x781e, "3DSTATE_STREAMOUT"},
+    {0x781f, "3DSTATE_SBE"},
+    {0x7820, "3DSTATE_PS"},
+    {0x7821, "3DSTATE_VIEWPORT_STATE_POINTERS_SF_CLIP"},
+    {0x7823, "3DSTATE_VIEWPORT_STATE_POINTERS_CC"},
+    {0x7824, "3DSTATE_BLEND_STATE_POINTERS"},
+    {0x7826, "3DSTATE_BINDING_TABLE_POINTERS_VS"},
+    {0x7827, "3DSTATE_BINDING_TABLE_POINTERS_HS"},
+    {0x7828, "3DSTATE_BINDING_TABLE_POINTERS_DS"},
+    {0x7829, "3DSTATE_BINDING_TABLE_POINTERS_GS"},
+    {0x782a, "3DSTATE_BINDING_TABLE_POINTERS_PS"},
+    {0x782b, "3DSTATE_SAMPLER_STATE_POINTERS_VS"},
+    {0x782c, "3DSTATE_SAMPLER_STATE_POINTERS_HS"},
+    {0x782d, "3DSTATE_SAMPLER_STATE_POINTERS_DS"},
+    {0x782e, "3DSTATE_SAMPLER_STATE_POINTERS_GS"},
+    {0x782f, "3DSTATE_SAMPLER_STATE_POINTERS_PS"},
+    {0x7830, "3DSTATE_URB_VS"},
+    {0x7831, "3DSTATE_URB_HS"},
+    {0x7832, "3DSTATE_URB_DS"},
+    {0x7833, "3DSTATE_URB_GS"},
+    {0x7834, "3DSTATE_GATHER_CONSTANT_VS"},
+    {0x7835, "3DSTATE_GATHER_CONSTANT_GS"},
+    {0x7836, "3DSTATE_GATHER_CONSTANT_HS"},
+    {0x7837, "3DSTATE_GATHER_CONSTANT_DS"},
+    {0x7838, "3DSTATE_GATHER_CONSTANT_PS"},
+    {0x7839, "3DSTATE_DX9_CONSTANTF_VS"},
+    {0x783a, "3DSTATE_DX9_CONSTANTF_PS"},
+    {0x783b, "3DSTATE_DX9_CONSTANTI_VS"},
+    {0x783c, "3DSTATE_DX9_CONSTANTI_PS"},
+    {0x783d, "3DSTATE_DX9_CONSTANTB_VS"},
+    {0x783e, "3DSTATE_DX9_CONSTANTB_PS"},
+    {0x783f, "3DSTATE_DX9_LOCAL_VALID_VS"},
+    {0x7840, "3DSTATE_DX9_LOCAL_VALID_PS"},
+    {0x7841, "3DSTATE_DX9_GENERATE_ACTIVE_VS"},
+    {0x7842, "3DSTATE_DX9_GENERATE_ACTIVE_PS"},
+    {0x7843, "3DSTATE_BINDING_TABLE_EDIT_VS"},
+    {0x7844, "3DSTATE_BINDING_TABLE_EDIT_GS"},
+    {0x7845, "3DSTATE_BINDING_TABLE_EDIT_HS"},
+    {0x7846, "3DSTATE_BINDING_TABLE_EDIT_DS"},
+    {0x7847, "3DSTATE_BINDING_TABLE_EDIT_PS"},
+    {0x7849, "3DSTATE_VF_INSTANCING"},
+    {0x784a, "3DSTATE_VF_SGVS"},
+    {0x784b, "3DSTATE_VF_TOPOLOGY"},
+    {0x784c, "3DSTATE_WM_CHROMAKEY"},
+    {0x784d, "3DSTATE_PS_BLEND"},
+    {0x784e, "3DSTATE_WM_DEPTH_STENCIL"},
+    {0x784f, "3DSTATE_PS_EXTRA"},
+    {0x7850, "3DSTATE_RASTER"},
+    {0x7851, "3DSTATE_SBE_SWIZ"},
+    {0x7852, "3DSTATE_WM_HZ_OP"},
+    {0x7900, "3DSTATE_DRAWING_RECTANGLE"},
+    {0x7902, "3DSTATE_SAMPLER_PALETTE_LOAD0"},
+    {0x7904, "3DSTATE_CHROMA_KEY"},
+    {0x7906, "3DSTATE_POLY_STIPPLE_OFFSET"},
+    {0x7907, "3DSTATE_POLY_STIPPLE_PATTERN"},
+    {0x7908, "3DSTATE_LINE_STIPPLE"},
+    {0x790a, "3DSTATE_AA_LINE_PARAMETERS"},
+    {0x790c, "3DSTATE_SAMPLER_PALETTE_LOAD1"},
+    {0x7912, "3DSTATE_PUSH_CONSTANT_ALLOC_VS"},
+    {0x7913, "3DSTATE_PUSH_CONSTANT_ALLOC_HS"},
+    {0x7914, "3DSTATE_PUSH_CONSTANT_ALLOC_DS"},
+    {0x7915, "3DSTATE_PUSH_CONSTANT_ALLOC_GS"},
+    {0x7916, "3DSTATE_PUSH_CONSTANT_ALLOC_PS"},
+    {0x7917, "3DSTATE_SO_DECL_LIST"},
+    {0x7918, "3DSTATE_SO_BUFFER"},
+    {0x7919, "3DSTATE_BINDING_TABLE_POOL_ALLOC"},
+    {0x791a, "3DSTATE_GATHER_POOL_ALLOC"},
+    {0x791b, "3DSTATE_DX9_CONSTANT_BUFFER_POOL_ALLOC"},
+    {0x791c, "3DSTATE_SAMPLE_PATTERN"},
+    {0x791d, "3DSTATE_URB_CLEAR"},
+    {0x791e, "3DSTATE_3D_MODE"},
+    {0x7a00, "PIPE_CONTROL"},
+    {0x7b00, "3DPRIMITIVE"},
+};
+
+// Render commands whose length isn't in the field their pipeline uses; a mask of 0 marks a
+// single dword command.
+const struct {
+    uint32_t id;
+    uint32_t length_mask;
+} kRenderLengthFields[] = {
+    // Bits 8 and 10 are the predicate and indirect parameter enables.
+    {0x7105, 0xFF},  // GPGPU_WALKER
+    {0x780b, 0},     // 3DSTATE_VF_STATISTICS
+    {0x7917, 0x1FF}, // 3DSTATE_SO_DECL_LIST
+};
+
+template <size_t N> const char* find(const Command (&commands)[N], uint32_t id)
+{
+    for (auto& command : commands) {
+        if (command.id == id)
+            return command.name;
+    }
+    return nullptr;
+}
+
+// Returns false for reserved opcodes.
+bool render_length_mask(uint32_t header, uint32_t* length_mask_out)
+{
+    for (auto& field : kRenderLengthFields) {
+        if (field.id == render_id(header)) {
+            *length_mask_out = field.length_mask;
+            return true;
+        }
+    }
+
+    switch (render_pipeline(header)) {
+        case 0: // common
+            *length_mask_out = 0xFF;
+            return render_opcode(header) < 2;
+        case 1: // single dword, such as PIPELINE_SELECT
+            *length_mask_out = 0;
+            return render_opcode(header) < 2;
+        case 2: // media
+            *length_mask_out = 0xFFFF;
+            return render_opcode(header) < 3;
+        case 3: // 3D
+            *length_mask_out = 0xFF;
+            return render_opcode(header) < 4;
+    }
+    return false;
+}
+
+} // namespace
+
+bool GenCommandTable::GetLength(uint32_t header, uint32_t* dword_count_out)
+{
+    switch (command_type(header)) {
+        case kMi:
+            // Commands below 0x10 are a single dword; the rest have a length field.
+            *dword_count_out = mi_opcode(header) < 0x10 ? 1 : (header & 0xFF) + 2;
+            return true;
+
+        case kBlt:
+            *dword_count_out = (header & 0xFF) + 2;
+            return true;
+
+        case kRender: {
+            uint32_t length_mask;
+            if (!render_length_mask(header, &length_mask))
+                return false;
+            *dword_count_out = length_mask ? (header & length_mask) + 2 : 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* GenCommandTable::GetName(uint32_t header)
+{
+    switch (command_type(header)) {
+        case kMi:
+            return find(kMiCommands, mi_opcode(header));
+        case kBlt:
+            return find(kBltCommands, blt_opcode(header));
+        case kRender:
+            return find(kRenderCommands, render_id(header));
+    }
+    return nullptr;
+}
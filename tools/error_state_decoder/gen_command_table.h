@@ -0,0 +1,27 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef GEN_COMMAND_TABLE_H
+#define GEN_COMMAND_TABLE_H
+
+#include <stdint.h>
+
+// Lengths and names of the gen8 and gen9 command streamer commands, found from the command
+// header: MI, 2D, and the 3D, media and GPGPU pipeline commands.
+class GenCommandTable {
+public:
+    // Returns false if |header| isn't a known command type, in which case its length can't be
+    // known.
+    static bool GetLength(uint32_t header, uint32_t* dword_count_out);
+
+    // Returns null if the command isn't in the table.
+    static const char* GetName(uint32_t header);
+
+    static bool IsBatchBufferEnd(uint32_t header) { return header >> 23 == kMiBatchBufferEnd; }
+
+private:
+    static constexpr uint32_t kMiBatchBufferEnd = 0x0A;
+};
+
+#endif // GEN_COMMAND_TABLE_H
@@ -0,0 +1,43 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "error_state_decoder.h"
+#include <stdio.h>
+
+// Usage: error_state_decoder <file>
+// The file is a binary error state, as exported from the driver with
+// msd_intel_device_export_error_state after a gpu hang or fault. The decoded error state goes
+// to stdout.
+int main(int argc, char** argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <error state file>\n", argv[0]);
+        return 1;
+    }
+
+    FILE* file = fopen(argv[1], "rb");
+    if (!file) {
+        fprintf(stderr, "couldn't open %s\n", argv[1]);
+        return 1;
+    }
+
+    std::vector<uint8_t> data;
+    uint8_t buf[4096];
+    size_t size;
+    while ((size = fread(buf, 1, sizeof(buf), file)) > 0) {
+        data.insert(data.end(), buf, buf + size);
+    }
+    fclose(file);
+
+    auto decoder = ErrorStateDecoder::Parse(data);
+    if (!decoder) {
+        fprintf(stderr, "no valid error state found in %s\n", argv[1]);
+        return 1;
+    }
+
+    std::string text;
+    decoder->Format(text);
+    fwrite(text.data(), 1, text.size(), stdout);
+    return 0;
+}